@@ -4,6 +4,7 @@
 
 #include "basebox_api.h"
 #include "basebox_grpc_statistics.h"
+#include "basebox_grpc_telemetry.h"
 #include "sai.h"
 
 #include <glog/logging.h>
@@ -18,9 +19,12 @@ namespace basebox {
 
 ApiServer::ApiServer(std::shared_ptr<switch_interface> swi,
                      std::shared_ptr<tap_manager> tap_man)
-    : stats(new NetworkStats(swi, tap_man)) {}
+    : stats(new NetworkStats(swi, tap_man)), telemetry(new Telemetry()) {}
 
-ApiServer::~ApiServer() { delete stats; }
+ApiServer::~ApiServer() {
+  delete stats;
+  delete telemetry;
+}
 
 void ApiServer::runGRPCServer() {
   std::string server_address("0.0.0.0:5000");
@@ -28,6 +32,7 @@ void ApiServer::runGRPCServer() {
 
   builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
   builder.RegisterService(stats);
+  builder.RegisterService(telemetry);
   std::unique_ptr<::grpc::Server> server = builder.BuildAndStart();
   LOG(INFO) << "gRPC server listening on " << server_address;
   server->Wait();
@@ -10,6 +10,7 @@ namespace basebox {
 
 // forward declarations
 class NetworkStats;
+class Telemetry;
 class switch_interface;
 class tap_manager;
 
@@ -22,6 +23,7 @@ public:
 
 private:
   NetworkStats *stats;
+  Telemetry *telemetry;
 };
 
 } // namespace basebox
@@ -0,0 +1,72 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <glog/logging.h>
+
+#include "basebox_grpc_telemetry.h"
+#include "utils/latency_histogram.h"
+#include "utils/metrics.h"
+
+namespace basebox {
+
+using ::telemetry::Latencies;
+using ::telemetry::LatencyHistogram;
+using ::telemetry::Metric;
+using ::telemetry::Metrics;
+
+::grpc::Status Telemetry::GetLatencies(
+    __attribute__((unused))::grpc::ServerContext *context,
+    __attribute__((unused)) const Empty *request, Latencies *response) {
+  VLOG(2) << __FUNCTION__ << ": received grpc call";
+
+  for (int e = 0; e < LATENCY_MAX_EVENT; e++) {
+    for (int c = 0; c < LATENCY_MAX_CHECKPOINT; c++) {
+      auto event = static_cast<enum latency_event_t>(e);
+      auto cp = static_cast<enum latency_checkpoint_t>(c);
+      latency_histogram::snapshot s = event_latency(event, cp).get_snapshot();
+
+      LatencyHistogram *h = response->add_histograms();
+      h->set_event(latency_event_name(event));
+      h->set_checkpoint(latency_checkpoint_name(cp));
+      h->set_count(s.count);
+      h->set_sum_us(s.sum);
+      h->set_max_us(s.max);
+      h->set_p50_us(s.percentile(50));
+      h->set_p90_us(s.percentile(90));
+      h->set_p99_us(s.percentile(99));
+      h->set_p999_us(s.percentile(99.9));
+
+      for (size_t i = 0; i < s.buckets.size(); i++) {
+        if (s.buckets[i] == 0)
+          continue;
+
+        LatencyHistogram::Bucket *b = h->add_buckets();
+        b->set_le_us(latency_histogram::bucket_upper_bound(i));
+        b->set_count(s.buckets[i]);
+      }
+    }
+  }
+
+  return ::grpc::Status::OK;
+}
+
+::grpc::Status Telemetry::GetMetrics(
+    __attribute__((unused))::grpc::ServerContext *context,
+    __attribute__((unused)) const Empty *request, Metrics *response) {
+  VLOG(2) << __FUNCTION__ << ": received grpc call";
+
+  for (const auto &sample : metrics_registry::get().collect()) {
+    Metric *m = response->add_metrics();
+    m->set_name(sample.name);
+    m->set_type(sample.is_counter ? Metric::COUNTER : Metric::GAUGE);
+    m->set_value(sample.value);
+
+    for (const auto &label : sample.labels)
+      (*m->mutable_labels())[label.first] = label.second;
+  }
+
+  return ::grpc::Status::OK;
+}
+
+} // namespace basebox
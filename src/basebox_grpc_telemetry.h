@@ -0,0 +1,30 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <grpcpp/grpcpp.h>
+
+#include "telemetry/telemetry-service.grpc.pb.h"
+
+namespace basebox {
+
+class Telemetry final : public ::telemetry::Telemetry::Service {
+public:
+  typedef ::empty::Empty Empty;
+
+  Telemetry() = default;
+
+  virtual ~Telemetry(){};
+
+  ::grpc::Status GetLatencies(::grpc::ServerContext *context,
+                              const Empty *request,
+                              ::telemetry::Latencies *response) override;
+
+  ::grpc::Status GetMetrics(::grpc::ServerContext *context,
+                            const Empty *request,
+                            ::telemetry::Metrics *response) override;
+};
+
+} // namespace basebox
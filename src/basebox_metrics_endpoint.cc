@@ -0,0 +1,134 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "basebox_metrics_endpoint.h"
+#include "utils/metrics.h"
+
+namespace basebox {
+
+MetricsEndpoint::~MetricsEndpoint() {
+  stopped = true;
+
+  if (fd != -1) {
+    // wakes up the blocking accept
+    shutdown(fd, SHUT_RDWR);
+  }
+
+  if (worker.joinable())
+    worker.join();
+
+  if (fd != -1)
+    close(fd);
+}
+
+int MetricsEndpoint::start() {
+  struct addrinfo hints;
+  struct addrinfo *ai = nullptr;
+  std::string service = std::to_string(port);
+  int one = 1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV | AI_PASSIVE;
+
+  int rv = getaddrinfo(address.c_str(), service.c_str(), &hints, &ai);
+  if (rv != 0) {
+    LOG(ERROR) << __FUNCTION__ << ": invalid address " << address << ": "
+               << gai_strerror(rv);
+    return -EINVAL;
+  }
+
+  fd = socket(ai->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    int err = errno;
+    LOG(ERROR) << __FUNCTION__ << ": socket failed: " << strerror(err);
+    freeaddrinfo(ai);
+    return -err;
+  }
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  if (bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 || listen(fd, 8) < 0) {
+    int err = errno;
+    LOG(ERROR) << __FUNCTION__ << ": failed to listen on " << address
+               << " port " << port << ": " << strerror(err);
+    freeaddrinfo(ai);
+    close(fd);
+    fd = -1;
+    return -err;
+  }
+  freeaddrinfo(ai);
+
+  worker = std::thread(&MetricsEndpoint::serve, this);
+  LOG(INFO) << "metrics endpoint listening on " << address << " port "
+            << port;
+
+  return 0;
+}
+
+void MetricsEndpoint::serve() {
+  while (!stopped) {
+    int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (!stopped)
+        LOG(ERROR) << __FUNCTION__ << ": accept failed: " << strerror(errno);
+      return;
+    }
+
+    handle_client(client);
+    close(client);
+  }
+}
+
+void MetricsEndpoint::handle_client(int client) {
+  struct timeval tv = {1, 0};
+  std::string request;
+  char buf[1024];
+
+  // a slow client must not stall the scrapes of others for long
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  // the request is not interpreted, but read up to the end of its header
+  while (request.find("\r\n\r\n") == std::string::npos &&
+         request.size() < 8192) {
+    ssize_t rv = read(client, buf, sizeof(buf));
+    if (rv <= 0)
+      return;
+    request.append(buf, rv);
+  }
+
+  std::string body = metrics_registry::get().expose();
+  std::string response = "HTTP/1.0 200 OK\r\n"
+                         "Content-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: " +
+                         std::to_string(body.size()) + "\r\n\r\n" + body;
+
+  for (size_t sent = 0; sent < response.size();) {
+    ssize_t rv = send(client, response.data() + sent, response.size() - sent,
+                      MSG_NOSIGNAL);
+    if (rv <= 0) {
+      VLOG(1) << __FUNCTION__ << ": send failed: " << strerror(errno);
+      return;
+    }
+    sent += rv;
+  }
+}
+
+} // namespace basebox
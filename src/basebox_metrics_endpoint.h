@@ -0,0 +1,45 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace basebox {
+
+/**
+ * Minimal HTTP server answering every request with the text exposition of
+ * the metrics registry, to be scraped by prometheus.
+ *
+ * The endpoint has no authentication, it is meant to be bound to a loopback
+ * or management address only.
+ */
+class MetricsEndpoint final {
+public:
+  MetricsEndpoint(const std::string &address, uint16_t port)
+      : address(address), port(port), fd(-1), stopped(false) {}
+  ~MetricsEndpoint();
+
+  // returns 0 on success, -EINVAL if address is not a numeric IPv4 or IPv6
+  // address, other negative errno otherwise
+  int start();
+
+private:
+  MetricsEndpoint(const MetricsEndpoint &) = delete;
+  MetricsEndpoint &operator=(const MetricsEndpoint &) = delete;
+
+  std::string address;
+  uint16_t port;
+  int fd;
+  std::atomic<bool> stopped;
+  std::thread worker;
+
+  void serve();
+  void handle_client(int client);
+};
+
+} // namespace basebox
@@ -6,6 +6,7 @@
 #include <glog/logging.h>
 
 #include "basebox_api.h"
+#include "basebox_metrics_endpoint.h"
 #include "netlink/cnetlink.h"
 #include "netlink/nbi_impl.h"
 #include "netlink/tap_manager.h"
@@ -15,6 +16,11 @@
 DECLARE_string(tryfromenv); // from gflags
 DEFINE_int32(port, 6653, "Listening port");
 DEFINE_int32(ofdpa_grpc_port, 50051, "Listening port of ofdpa gRPC server");
+DEFINE_int32(metrics_port, 0,
+             "Listening port of the HTTP metrics endpoint, 0 to disable");
+DEFINE_string(metrics_address, "127.0.0.1",
+              "Listening address of the HTTP metrics endpoint, the endpoint "
+              "is unauthenticated");
 
 static bool validate_port(const char *flagname, gflags::int32 value) {
   VLOG(3) << __FUNCTION__ << ": flagname=" << flagname << ", value=" << value;
@@ -23,9 +29,14 @@ static bool validate_port(const char *flagname, gflags::int32 value) {
   return false;
 }
 
+static bool validate_optional_port(const char *flagname, gflags::int32 value) {
+  return value == 0 || validate_port(flagname, value);
+}
+
 int main(int argc, char **argv) {
   using basebox::cnetlink;
   using basebox::controller;
+  using basebox::MetricsEndpoint;
   using basebox::nbi_impl;
   using basebox::tap_manager;
 
@@ -39,8 +50,16 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
+  if (!gflags::RegisterFlagValidator(&FLAGS_metrics_port,
+                                     &validate_optional_port)) {
+    std::cerr << "Failed to register port validator 3" << std::endl;
+    exit(1);
+  }
+
   // all variables can be set from env
-  FLAGS_tryfromenv = std::string("port,ofdpa_grpc_port");
+  FLAGS_tryfromenv = std::string("port,ofdpa_grpc_port,metrics_port,"
+                                 "metrics_address,fib_aggregation,"
+                                 "state_snapshot");
   gflags::SetUsageMessage("");
   gflags::SetVersionString(PROJECT_VERSION);
 
@@ -62,6 +81,14 @@ int main(int argc, char **argv) {
   rofl::csockaddr baddr(AF_INET, std::string("0.0.0.0"), FLAGS_port);
   box->dpt_sock_listen(baddr);
 
+  std::unique_ptr<MetricsEndpoint> metrics;
+  if (FLAGS_metrics_port) {
+    metrics.reset(
+        new MetricsEndpoint(FLAGS_metrics_address, FLAGS_metrics_port));
+    if (metrics->start() < 0)
+      metrics.reset();
+  }
+
   basebox::ApiServer grpcConnector(box, tap_man);
   grpcConnector.runGRPCServer();
 
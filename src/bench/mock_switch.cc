@@ -0,0 +1,348 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cstdlib>
+
+#include "mock_switch.h"
+#include "utils/latency_histogram.h"
+
+namespace basebox {
+
+static int sent() noexcept {
+  latency_trace::message_sent();
+  return 0;
+}
+
+int mock_switch::lag_create(uint32_t *lag_id) noexcept {
+  *lag_id = nbi::combine_port_type(next_lag_id++, nbi::port_type_lag);
+  return sent();
+}
+
+int mock_switch::lag_remove(uint32_t lag_id) noexcept {
+  return sent();
+}
+
+int mock_switch::lag_add_member(uint32_t lag_id, uint32_t port_id) noexcept {
+  return sent();
+}
+
+int mock_switch::lag_remove_member(uint32_t lag_id, uint32_t port_id) noexcept {
+  return sent();
+}
+
+int mock_switch::overlay_tunnel_add(uint32_t tunnel_id) noexcept {
+  return sent();
+}
+
+int mock_switch::overlay_tunnel_remove(uint32_t tunnel_id) noexcept {
+  return sent();
+}
+
+int mock_switch::l2_addr_remove_all_in_vlan(uint32_t port,
+                                            uint16_t vid) noexcept {
+  return sent();
+}
+
+int mock_switch::l2_addr_flush(uint32_t port, uint16_t vid) noexcept {
+  return sent();
+}
+
+int mock_switch::l2_addr_add(uint32_t port, uint16_t vid,
+                             const rofl::caddress_ll &mac, bool filtered,
+                             bool permanent) noexcept {
+  return sent();
+}
+
+int mock_switch::l2_addr_remove(uint32_t port, uint16_t vid,
+                                const rofl::caddress_ll &mac) noexcept {
+  return sent();
+}
+
+int mock_switch::l2_overlay_addr_add(uint32_t lport, uint32_t tunnel_id,
+                                     const rofl::cmacaddr &mac,
+                                     bool permanent) noexcept {
+  return sent();
+}
+
+int mock_switch::l2_overlay_addr_remove(uint32_t tunnel_id, uint32_t lport_id,
+                                        const rofl::cmacaddr &mac) noexcept {
+  return sent();
+}
+
+int mock_switch::l3_termination_add(uint32_t sport, uint16_t vid,
+                                    const rofl::caddress_ll &dmac) noexcept {
+  return sent();
+}
+
+int mock_switch::l3_termination_add_v6(uint32_t sport, uint16_t vid,
+                                       const rofl::caddress_ll &dmac) noexcept {
+  return sent();
+}
+
+int mock_switch::l3_termination_remove(uint32_t sport, uint16_t vid,
+                                       const rofl::caddress_ll &dmac) noexcept {
+  return sent();
+}
+
+int
+mock_switch::l3_termination_remove_v6(uint32_t sport, uint16_t vid,
+                                      const rofl::caddress_ll &dmac) noexcept {
+  return sent();
+}
+
+int mock_switch::l3_egress_create(uint32_t port, uint16_t vid,
+                                  const rofl::caddress_ll &src_mac,
+                                  const rofl::caddress_ll &dst_mac,
+                                  uint32_t *l3_interface) noexcept {
+  *l3_interface = next_l3_interface++;
+  return sent();
+}
+
+int mock_switch::l3_egress_update(uint32_t port, uint16_t vid,
+                                  const rofl::caddress_ll &src_mac,
+                                  const rofl::caddress_ll &dst_mac,
+                                  uint32_t *l3_interface_id) noexcept {
+  return sent();
+}
+
+int mock_switch::l3_egress_remove(uint32_t l3_interface) noexcept {
+  return sent();
+}
+
+int mock_switch::l3_unicast_host_add(const rofl::caddress_in4 &ipv4_dst,
+                                     uint32_t l3_interface, bool is_ecmp,
+                                     bool update_route) noexcept {
+  return sent();
+}
+
+int mock_switch::l3_unicast_host_remove(
+    const rofl::caddress_in4 &ipv4_dst) noexcept {
+  return sent();
+}
+
+int mock_switch::l3_unicast_host_add(const rofl::caddress_in6 &ipv6_dst,
+                                     uint32_t l3_interface, bool is_ecmp,
+                                     bool update_route) noexcept {
+  return sent();
+}
+
+int mock_switch::l3_unicast_host_remove(
+    const rofl::caddress_in6 &ipv6_dst) noexcept {
+  return sent();
+}
+
+int mock_switch::l3_unicast_route_add(const rofl::caddress_in4 &ipv4_dst,
+                                      const rofl::caddress_in4 &mask,
+                                      uint32_t l3_interface, bool is_ecmp,
+                                      bool update_route) noexcept {
+  return sent();
+}
+
+int
+mock_switch::l3_unicast_route_remove(const rofl::caddress_in4 &ipv4_dst,
+                                     const rofl::caddress_in4 &mask) noexcept {
+  return sent();
+}
+
+int mock_switch::l3_unicast_route_add(const rofl::caddress_in6 &ipv6_dst,
+                                      const rofl::caddress_in6 &mask,
+                                      uint32_t l3_interface, bool is_ecmp,
+                                      bool update_route) noexcept {
+  return sent();
+}
+
+int
+mock_switch::l3_unicast_route_remove(const rofl::caddress_in6 &ipv6_dst,
+                                     const rofl::caddress_in6 &mask) noexcept {
+  return sent();
+}
+
+int mock_switch::l3_ecmp_add(uint32_t l3_ecmp_id,
+                             const std::set<uint32_t> &l3_interfaces) noexcept {
+  return sent();
+}
+
+int mock_switch::l3_ecmp_remove(uint32_t l3_ecmp_id) noexcept {
+  return sent();
+}
+
+int mock_switch::ingress_port_vlan_accept_all(uint32_t port) noexcept {
+  return sent();
+}
+
+int mock_switch::ingress_port_vlan_drop_accept_all(uint32_t port) noexcept {
+  return sent();
+}
+
+int mock_switch::ingress_port_vlan_add(uint32_t port, uint16_t vid,
+                                       bool pvid) noexcept {
+  return sent();
+}
+
+int mock_switch::ingress_port_vlan_remove(uint32_t port, uint16_t vid,
+                                          bool pvid) noexcept {
+  return sent();
+}
+
+int mock_switch::egress_port_vlan_accept_all(uint32_t port) noexcept {
+  return sent();
+}
+
+int mock_switch::egress_port_vlan_drop_accept_all(uint32_t port) noexcept {
+  return sent();
+}
+
+int mock_switch::egress_port_vlan_add(uint32_t port, uint16_t vid,
+                                      bool untagged) noexcept {
+  return sent();
+}
+
+int mock_switch::egress_port_vlan_remove(uint32_t port, uint16_t vid) noexcept {
+  return sent();
+}
+
+int mock_switch::add_l2_overlay_flood(uint32_t tunnel_id,
+                                      uint32_t lport_id) noexcept {
+  return sent();
+}
+
+int mock_switch::del_l2_overlay_flood(uint32_t tunnel_id,
+                                      uint32_t lport_id) noexcept {
+  return sent();
+}
+
+int mock_switch::egress_bridge_port_vlan_add(uint32_t port, uint16_t vid,
+                                             bool untagged) noexcept {
+  return sent();
+}
+
+int mock_switch::egress_bridge_port_vlan_remove(uint32_t port,
+                                                uint16_t vid) noexcept {
+  return sent();
+}
+
+int mock_switch::ingress_port_vlan_range_add(uint32_t port, uint16_t vid_start,
+                                             uint16_t vid_end,
+                                             uint16_t pvid) noexcept {
+  return sent();
+}
+
+int mock_switch::ingress_port_vlan_range_remove(uint32_t port,
+                                                uint16_t vid_start,
+                                                uint16_t vid_end,
+                                                uint16_t pvid) noexcept {
+  return sent();
+}
+
+int mock_switch::egress_bridge_port_vlan_range_add(uint32_t port,
+                                                   uint16_t vid_start,
+                                                   uint16_t vid_end,
+                                                   bool untagged) noexcept {
+  return sent();
+}
+
+int
+mock_switch::egress_bridge_port_vlan_range_remove(uint32_t port,
+                                                  uint16_t vid_start,
+                                                  uint16_t vid_end) noexcept {
+  return sent();
+}
+
+int mock_switch::enqueue(uint32_t port_id, basebox::packet *pkt) noexcept {
+  std::free(pkt);
+  return 0;
+}
+
+int mock_switch::subscribe_to(enum swi_flags flags) noexcept {
+  return 0;
+}
+
+bool mock_switch::is_connected() noexcept {
+  return true;
+}
+
+int mock_switch::get_statistics(uint64_t port_no, uint32_t number_of_counters,
+                                const sai_port_stat_t *counter_ids,
+                                uint64_t *counters) noexcept {
+  for (uint32_t i = 0; i < number_of_counters; i++)
+    counters[i] = 0;
+  return 0;
+}
+
+int mock_switch::tunnel_tenant_create(uint32_t tunnel_id,
+                                      uint32_t vni) noexcept {
+  return sent();
+}
+
+int mock_switch::tunnel_tenant_delete(uint32_t tunnel_id) noexcept {
+  return sent();
+}
+
+int mock_switch::tunnel_next_hop_create(uint32_t next_hop_id, uint64_t src_mac,
+                                        uint64_t dst_mac,
+                                        uint32_t physical_port,
+                                        uint16_t vlan_id) noexcept {
+  return sent();
+}
+
+int mock_switch::tunnel_next_hop_modify(uint32_t next_hop_id, uint64_t src_mac,
+                                        uint64_t dst_mac,
+                                        uint32_t physical_port,
+                                        uint16_t vlan_id) noexcept {
+  return sent();
+}
+
+int mock_switch::tunnel_next_hop_delete(uint32_t next_hop_id) noexcept {
+  return sent();
+}
+
+int mock_switch::tunnel_next_hop_group_create(uint32_t group_id) noexcept {
+  return sent();
+}
+
+int mock_switch::tunnel_next_hop_group_delete(uint32_t group_id) noexcept {
+  return sent();
+}
+
+int mock_switch::tunnel_next_hop_group_member_add(
+    uint32_t group_id, uint32_t next_hop_id) noexcept {
+  return sent();
+}
+
+int mock_switch::tunnel_next_hop_group_member_remove(
+    uint32_t group_id, uint32_t next_hop_id) noexcept {
+  return sent();
+}
+
+int mock_switch::tunnel_access_port_create(uint32_t port_id,
+                                           const std::string &port_name,
+                                           uint32_t physical_port,
+                                           uint16_t vlan_id,
+                                           bool untagged) noexcept {
+  return sent();
+}
+
+int mock_switch::tunnel_enpoint_create(
+    uint32_t port_id, const std::string &port_name, uint32_t remote_ipv4,
+    uint32_t local_ipv4, uint32_t ttl, uint32_t next_hop_id, bool ecmp,
+    uint32_t terminator_udp_dst_port, uint32_t initiator_udp_dst_port,
+    uint32_t udp_src_port_if_no_entropy, bool use_entropy) noexcept {
+  return sent();
+}
+
+int mock_switch::tunnel_port_delete(uint32_t port_id) noexcept {
+  return sent();
+}
+
+int mock_switch::tunnel_port_tenant_add(uint32_t port_id,
+                                        uint32_t tunnel_id) noexcept {
+  return sent();
+}
+
+int mock_switch::tunnel_port_tenant_remove(uint32_t port_id,
+                                           uint32_t tunnel_id) noexcept {
+  return sent();
+}
+
+} // namespace basebox
@@ -0,0 +1,330 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/*
+ * Benchmark of the netlink subsystems against a mock switch.
+ *
+ * The benchmark moves into a network namespace of its own, creates the tap
+ * ports like baseboxd does for a connected switch and feeds synthetic
+ * workloads into the kernel. Every phase runs until cnetlink has been idle
+ * for a while, the applied events and switch calls are taken from the
+ * latency histograms and the metrics registry.
+ *
+ * With --replay a capture of baseboxd's netlink messages, see
+ * --nl_record_file, is sent to cnetlink instead of the workloads.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include <net/if.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "bench/mock_switch.h"
+#include "bench/nl_replay.h"
+#include "bench/nl_workload.h"
+#include "netlink/cnetlink.h"
+#include "netlink/nbi_impl.h"
+#include "netlink/tap_manager.h"
+#include "utils/latency_histogram.h"
+#include "utils/metrics.h"
+
+DEFINE_string(workloads, "routes,macs,vlans",
+              "Comma separated workloads to run: routes, macs, vlans and "
+              "neighs");
+DEFINE_int32(ports, 4, "Number of switch ports");
+DEFINE_int32(routes, 100000, "Number of routes of the routes workload");
+DEFINE_int32(macs, 10000, "Number of fdb entries of the macs workload");
+DEFINE_int32(vlans, 100, "Number of vlans per port of the vlans workload");
+DEFINE_int32(neighs, 1000,
+             "Number of neighbours of the neighs workload, more than the "
+             "neighbour table's gc_thresh3 are rejected by the kernel");
+DEFINE_int32(idle_ms, 500,
+             "Time without applied events after which a phase is complete");
+DEFINE_string(replay, "", "Capture of netlink messages to replay");
+DEFINE_double(replay_speed, 0,
+              "Replay speed relative to the capture, 0 is as fast as "
+              "possible");
+
+namespace basebox {
+
+struct bench_totals {
+  uint64_t events;
+  uint64_t calls;
+  std::map<std::string, uint64_t> calls_by_name;
+  latency_histogram::snapshot applied;
+};
+
+static bench_totals read_totals() {
+  bench_totals t{0, 0, {}, {0, 0, 0, {}}};
+
+  for (int e = 0; e < LATENCY_MAX_EVENT; e++) {
+    auto s = event_latency(static_cast<enum latency_event_t>(e),
+                           LATENCY_APPLIED)
+                 .get_snapshot();
+
+    if (t.applied.buckets.empty())
+      t.applied.buckets.resize(s.buckets.size());
+    for (size_t i = 0; i < s.buckets.size(); i++)
+      t.applied.buckets[i] += s.buckets[i];
+    t.applied.count += s.count;
+    t.applied.sum += s.sum;
+    t.applied.max = std::max(t.applied.max, s.max);
+  }
+  t.events = t.applied.count;
+
+  for (const auto &m : metrics_registry::get().collect()) {
+    if (m.name != "baseboxd_switch_calls_total")
+      continue;
+
+    for (const auto &l : m.labels) {
+      if (l.first == "call")
+        t.calls_by_name[l.second] += m.value;
+    }
+    t.calls += m.value;
+  }
+
+  return t;
+}
+
+// events waiting in the netlink event lanes
+static int64_t queued_events() {
+  int64_t queued = 0;
+
+  for (const auto &m : metrics_registry::get().collect()) {
+    if (m.name != "baseboxd_queue_depth")
+      continue;
+
+    for (const auto &l : m.labels) {
+      if (l.first == "queue" && l.second.compare(0, 7, "nl_objs") == 0)
+        queued += m.value;
+    }
+  }
+
+  return queued;
+}
+
+// waits until cnetlink was idle for idle_ms, returns the last activity
+static std::chrono::steady_clock::time_point wait_idle() {
+  auto idle = std::chrono::milliseconds(FLAGS_idle_ms);
+  auto last_change = std::chrono::steady_clock::now();
+  uint64_t last = read_totals().events;
+
+  for (;;) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    auto now = std::chrono::steady_clock::now();
+    uint64_t events = read_totals().events;
+
+    if (events != last || queued_events() > 0) {
+      last = events;
+      last_change = now;
+    } else if (now - last_change >= idle) {
+      return last_change;
+    }
+  }
+}
+
+static void report(const std::string &phase, int requests,
+                   const bench_totals &before, const bench_totals &after,
+                   std::chrono::steady_clock::duration elapsed) {
+  uint64_t events = after.events - before.events;
+  uint64_t calls = after.calls - before.calls;
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  latency_histogram::snapshot applied = after.applied;
+
+  // the histograms are cumulative, the max is the one of all phases so far
+  applied.count -= before.applied.count;
+  applied.sum -= before.applied.sum;
+  for (size_t i = 0; i < applied.buckets.size(); i++)
+    applied.buckets[i] -= before.applied.buckets[i];
+
+  printf("%-12s %9d %9lu %9.3f %11.0f %9lu %8.2f %9lu %9lu\n",
+         phase.c_str(), requests, (unsigned long)events, seconds,
+         seconds > 0 ? events / seconds : 0.0, (unsigned long)calls,
+         events ? (double)calls / events : 0.0,
+         (unsigned long)applied.percentile(50),
+         (unsigned long)applied.percentile(99));
+
+  for (const auto &c : after.calls_by_name) {
+    auto it = before.calls_by_name.find(c.first);
+    uint64_t n = c.second - (it != before.calls_by_name.end() ? it->second : 0);
+
+    if (n)
+      printf("  %-40s %9lu\n", c.first.c_str(), (unsigned long)n);
+  }
+}
+
+// the taps vanish with the network namespace, the netlink thread is not
+// stopped as it might still call into the switch while that is torn down
+[[noreturn]] static void finish(int rv) {
+  fflush(stdout);
+  _exit(rv < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static int measure(const nl_workload::phase &phase) {
+  bench_totals before = read_totals();
+  auto start = std::chrono::steady_clock::now();
+  int requests = phase.run();
+
+  if (requests < 0) {
+    LOG(ERROR) << __FUNCTION__ << ": phase " << phase.name
+               << " failed: " << strerror(-requests);
+    return requests;
+  }
+
+  auto end = wait_idle();
+  report(phase.name, requests, before, read_totals(), end - start);
+
+  return 0;
+}
+
+[[noreturn]] static void run(const std::vector<std::string> &workloads,
+                             nl_replay *replay) {
+  mock_switch swi;
+  std::shared_ptr<cnetlink> nl(new cnetlink());
+  std::shared_ptr<tap_manager> tap_man(new tap_manager(nl));
+  std::unique_ptr<nbi_impl> nbi(new nbi_impl(nl, tap_man));
+  std::deque<nbi::port_notification_data> ntfys;
+  std::vector<nl_workload::phase> phases;
+  std::vector<int> ports;
+  nl_workload feed;
+  int rv;
+
+  auto has = [&workloads](const char *w) {
+    return std::find(workloads.begin(), workloads.end(), w) != workloads.end();
+  };
+  auto add = [&phases](std::vector<nl_workload::phase> &&p) {
+    phases.insert(phases.end(), p.begin(), p.end());
+  };
+
+  rv = feed.init();
+  if (rv < 0)
+    finish(rv);
+
+  if (replay) {
+    uint32_t i = 1;
+    for (const auto &name : replay->get_ports())
+      ntfys.emplace_back(
+          nbi::port_notification_data{nbi::PORT_EVENT_ADD, i++, name});
+  } else {
+    for (int i = 1; i <= FLAGS_ports; i++)
+      ntfys.emplace_back(nbi::port_notification_data{
+          nbi::PORT_EVENT_ADD, (uint32_t)i, "port" + std::to_string(i)});
+  }
+
+  printf("%-12s %9s %9s %9s %11s %9s %8s %9s %9s\n", "phase", "requests",
+         "events", "seconds", "events/s", "calls", "calls/ev", "p50 us",
+         "p99 us");
+
+  nbi->register_switch(&swi);
+  nbi->switch_state_notification(nbi::SWITCH_STATE_UP);
+  wait_idle();
+
+  rv = measure({"ports", [&]() {
+                  nbi->port_notification(ntfys);
+                  return (int)ntfys.size();
+                }});
+  if (rv < 0)
+    finish(rv);
+
+  for (auto &n : ntfys) {
+    int ifindex = if_nametoindex(n.name.c_str());
+    if (ifindex == 0) {
+      LOG(ERROR) << __FUNCTION__ << ": tap " << n.name << " does not exist";
+      finish(-ENODEV);
+    }
+    ports.push_back(ifindex);
+  }
+
+  if (replay)
+    add(replay->replay(nl->get_monitor_port(), FLAGS_replay_speed));
+  else
+    add(feed.ports_up(ports));
+  if (has("macs") || has("vlans"))
+    add(feed.bridge(ports));
+  for (auto &w : workloads) {
+    if (w == "routes")
+      add(feed.routes(ports, FLAGS_routes));
+    else if (w == "macs")
+      add(feed.macs(ports, FLAGS_macs));
+    else if (w == "vlans")
+      add(feed.vlans(ports, FLAGS_vlans));
+    else if (w == "neighs")
+      add(feed.neighs(ports, FLAGS_neighs));
+  }
+
+  for (auto &phase : phases) {
+    rv = measure(phase);
+    if (rv < 0)
+      finish(rv);
+  }
+
+  unsigned errors = feed.get_errors();
+  if (errors)
+    LOG(WARNING) << __FUNCTION__ << ": " << errors
+                 << " requests were rejected by the kernel";
+
+  finish(0);
+}
+
+} // namespace basebox
+
+int main(int argc, char **argv) {
+  std::vector<std::string> workloads;
+  std::unique_ptr<basebox::nl_replay> replay;
+  std::string w;
+
+  gflags::SetUsageMessage("netlink benchmark, needs CAP_SYS_ADMIN and "
+                          "CAP_NET_ADMIN, e.g. run it with unshare -r");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  if (!FLAGS_replay.empty()) {
+    if (FLAGS_replay_speed < 0) {
+      std::cerr << "invalid replay speed" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    replay.reset(new basebox::nl_replay());
+    if (replay->open(FLAGS_replay) < 0)
+      return EXIT_FAILURE;
+  }
+
+  std::istringstream ws(replay ? "" : FLAGS_workloads);
+  while (std::getline(ws, w, ',')) {
+    if (w != "routes" && w != "macs" && w != "vlans" && w != "neighs") {
+      std::cerr << "unknown workload " << w << std::endl;
+      return EXIT_FAILURE;
+    }
+    workloads.push_back(w);
+  }
+
+  if (FLAGS_ports < 1 || FLAGS_ports > 255 || FLAGS_routes < 0 ||
+      FLAGS_routes > (1 << 22) || FLAGS_macs < 0 || FLAGS_vlans < 0 ||
+      FLAGS_vlans > 4000 || FLAGS_neighs < 0 ||
+      FLAGS_neighs > (1 << 15) - 3) {
+    std::cerr << "invalid workload size" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // never touch the interfaces of the host
+  if (unshare(CLONE_NEWNET) < 0) {
+    std::cerr << "failed to create a network namespace: " << strerror(errno)
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  basebox::run(workloads, replay.get());
+}
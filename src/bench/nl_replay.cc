@@ -0,0 +1,266 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <linux/if_link.h>
+#include <linux/neighbour.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+
+#include <glog/logging.h>
+#include <netlink/msg.h>
+#include <netlink/netlink.h>
+#include <netlink/socket.h>
+
+#include "nl_replay.h"
+
+namespace basebox {
+
+// interfaces of the capture that are not taps, out of the kernel's range
+static const int foreign_ifindex_offset = 100000;
+
+static bool is_replayed(int type) {
+  switch (type) {
+  case RTM_NEWLINK:
+  case RTM_DELLINK:
+  case RTM_NEWADDR:
+  case RTM_DELADDR:
+  case RTM_NEWNEIGH:
+  case RTM_DELNEIGH:
+  case RTM_NEWROUTE:
+  case RTM_DELROUTE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static int family_header_len(int type) {
+  switch (type) {
+  case RTM_NEWLINK:
+  case RTM_DELLINK:
+    return sizeof(struct ifinfomsg);
+  case RTM_NEWADDR:
+  case RTM_DELADDR:
+    return sizeof(struct ifaddrmsg);
+  case RTM_NEWNEIGH:
+  case RTM_DELNEIGH:
+    return sizeof(struct ndmsg);
+  case RTM_NEWROUTE:
+  case RTM_DELROUTE:
+    return sizeof(struct rtmsg);
+  default:
+    return -1;
+  }
+}
+
+static bool is_ifindex_attr(int type, int attr) {
+  switch (type) {
+  case RTM_NEWLINK:
+  case RTM_DELLINK:
+    return attr == IFLA_MASTER || attr == IFLA_LINK;
+  case RTM_NEWNEIGH:
+  case RTM_DELNEIGH:
+    return attr == NDA_IFINDEX || attr == NDA_MASTER;
+  case RTM_NEWROUTE:
+  case RTM_DELROUTE:
+    return attr == RTA_OIF || attr == RTA_IIF;
+  default:
+    return false;
+  }
+}
+
+// returns the name of a tun link, or an empty string
+static std::string tun_name(const struct nlmsghdr *hdr) {
+  auto msg = const_cast<struct nlmsghdr *>(hdr);
+  struct nlattr *tb[IFLA_MAX + 1];
+  struct nlattr *info[IFLA_INFO_MAX + 1];
+  char name[IFNAMSIZ];
+
+  if (hdr->nlmsg_type != RTM_NEWLINK ||
+      !nlmsg_valid_hdr(msg, sizeof(struct ifinfomsg)) ||
+      nlmsg_parse(msg, sizeof(struct ifinfomsg), tb, IFLA_MAX, nullptr) < 0 ||
+      !tb[IFLA_IFNAME] || !tb[IFLA_LINKINFO] ||
+      nla_parse_nested(info, IFLA_INFO_MAX, tb[IFLA_LINKINFO], nullptr) < 0 ||
+      !info[IFLA_INFO_KIND] || nla_strcmp(info[IFLA_INFO_KIND], "tun") != 0)
+    return "";
+
+  nla_strlcpy(name, tb[IFLA_IFNAME], sizeof(name));
+  return name;
+}
+
+nl_replay::~nl_replay() {
+  if (sock)
+    nl_socket_free(sock);
+}
+
+int nl_replay::open(const std::string &path) {
+  const struct nlmsghdr *hdr;
+  uint64_t timestamp;
+
+  int rv = capture.open(path);
+  if (rv < 0)
+    return rv;
+
+  while (capture.next(&timestamp, &hdr)) {
+    std::string name = tun_name(hdr);
+    if (name.empty())
+      continue;
+
+    auto ifi = static_cast<struct ifinfomsg *>(
+        nlmsg_data(const_cast<struct nlmsghdr *>(hdr)));
+    port_ifindexes[ifi->ifi_index] = name;
+    if (std::find(ports.begin(), ports.end(), name) == ports.end())
+      ports.push_back(name);
+  }
+  capture.rewind();
+
+  LOG(INFO) << __FUNCTION__ << ": " << path << " holds "
+            << capture.get_records() << " messages and " << ports.size()
+            << " taps, " << capture.get_dropped()
+            << " messages were overwritten";
+
+  return 0;
+}
+
+std::vector<nl_workload::phase> nl_replay::replay(uint32_t nl_port,
+                                                  double speed) {
+  return {{"replay", [this, nl_port, speed]() { return run(nl_port, speed); }}};
+}
+
+int nl_replay::map_ifindex(int ifindex) const noexcept {
+  if (ifindex <= 0)
+    return ifindex;
+
+  auto it = ifindexes.find(ifindex);
+  if (it != ifindexes.end())
+    return it->second;
+
+  return ifindex + foreign_ifindex_offset;
+}
+
+void nl_replay::rewrite(struct nlmsghdr *hdr) const noexcept {
+  int type = hdr->nlmsg_type;
+  int hdrlen = family_header_len(type);
+  struct nlattr *a;
+  int rem;
+
+  if (hdrlen < 0 || !nlmsg_valid_hdr(hdr, hdrlen))
+    return;
+
+  switch (type) {
+  case RTM_NEWLINK:
+  case RTM_DELLINK: {
+    auto ifi = static_cast<struct ifinfomsg *>(nlmsg_data(hdr));
+    ifi->ifi_index = map_ifindex(ifi->ifi_index);
+    break;
+  }
+  case RTM_NEWADDR:
+  case RTM_DELADDR: {
+    auto ifa = static_cast<struct ifaddrmsg *>(nlmsg_data(hdr));
+    ifa->ifa_index = map_ifindex(ifa->ifa_index);
+    break;
+  }
+  case RTM_NEWNEIGH:
+  case RTM_DELNEIGH: {
+    auto ndm = static_cast<struct ndmsg *>(nlmsg_data(hdr));
+    ndm->ndm_ifindex = map_ifindex(ndm->ndm_ifindex);
+    break;
+  }
+  default:
+    break;
+  }
+
+  nlmsg_for_each_attr(a, hdr, hdrlen, rem) {
+    int attr = nla_type(a);
+
+    if (is_ifindex_attr(type, attr) && nla_len(a) >= (int)sizeof(uint32_t)) {
+      auto ifindex = static_cast<uint32_t *>(nla_data(a));
+      *ifindex = map_ifindex(*ifindex);
+    } else if ((type == RTM_NEWROUTE || type == RTM_DELROUTE) &&
+               attr == RTA_MULTIPATH) {
+      auto nh = static_cast<struct rtnexthop *>(nla_data(a));
+      int len = nla_len(a);
+
+      while (len >= (int)sizeof(*nh) && nh->rtnh_len >= sizeof(*nh) &&
+             nh->rtnh_len <= len) {
+        nh->rtnh_ifindex = map_ifindex(nh->rtnh_ifindex);
+        len -= RTNH_ALIGN(nh->rtnh_len);
+        nh = RTNH_NEXT(nh);
+      }
+    }
+  }
+}
+
+int nl_replay::run(uint32_t nl_port, double speed) {
+  const struct nlmsghdr *hdr;
+  std::vector<uint8_t> buf;
+  uint64_t timestamp, first = 0;
+  int sent = 0;
+  int rv;
+
+  if (sock == nullptr) {
+    sock = nl_socket_alloc();
+    if (sock == nullptr)
+      return -ENOMEM;
+
+    rv = nl_connect(sock, NETLINK_ROUTE);
+    if (rv < 0) {
+      LOG(ERROR) << __FUNCTION__ << ": failed to connect: " << nl_geterror(rv);
+      nl_socket_free(sock);
+      sock = nullptr;
+      return -EINVAL;
+    }
+    // unicast into the monitor socket, blocks while its buffer is full
+    nl_socket_set_peer_port(sock, nl_port);
+  }
+
+  ifindexes.clear();
+  for (const auto &p : port_ifindexes) {
+    int ifindex = if_nametoindex(p.second.c_str());
+    if (ifindex == 0) {
+      LOG(ERROR) << __FUNCTION__ << ": tap " << p.second << " does not exist";
+      return -ENODEV;
+    }
+    ifindexes[p.first] = ifindex;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  while (capture.next(&timestamp, &hdr)) {
+    if (!is_replayed(hdr->nlmsg_type))
+      continue;
+
+    if (sent == 0)
+      first = timestamp;
+    if (speed > 0)
+      std::this_thread::sleep_until(
+          start + std::chrono::nanoseconds(
+                      (uint64_t)((timestamp - first) / speed)));
+
+    auto data = reinterpret_cast<const uint8_t *>(hdr);
+    buf.assign(data, data + hdr->nlmsg_len);
+
+    auto msg = reinterpret_cast<struct nlmsghdr *>(buf.data());
+    // the dumps of the capture end without their NLMSG_DONE
+    msg->nlmsg_flags &= ~NLM_F_MULTI;
+    rewrite(msg);
+
+    rv = nl_sendto(sock, buf.data(), buf.size());
+    if (rv < 0) {
+      LOG(ERROR) << __FUNCTION__ << ": failed to send: " << nl_geterror(rv);
+      capture.rewind();
+      return -EIO;
+    }
+    sent++;
+  }
+  capture.rewind();
+
+  return sent;
+}
+
+} // namespace basebox
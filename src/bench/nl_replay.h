@@ -0,0 +1,59 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bench/nl_workload.h"
+#include "netlink/nl_recorder.h"
+
+extern "C" {
+struct nl_sock;
+struct nlmsghdr;
+}
+
+namespace basebox {
+
+/**
+ * Replays a capture of cnetlink's monitor socket.
+ *
+ * The recorded link, address, neighbour and route notifications are sent
+ * straight to the monitor socket, the kernel of the benchmark only holds the
+ * taps. The taps of the capture are recreated with their names, the
+ * ifindexes of the capture are mapped to the new taps and every other
+ * interface is moved out of the range of the benchmark's namespace.
+ */
+class nl_replay final {
+public:
+  nl_replay() : sock(nullptr) {}
+  ~nl_replay();
+
+  int open(const std::string &path);
+
+  // names of the taps of the capture, in the order they were created
+  const std::vector<std::string> &get_ports() const noexcept { return ports; }
+
+  // speed 1 keeps the recorded timing, 0 sends as fast as possible
+  std::vector<nl_workload::phase> replay(uint32_t nl_port, double speed);
+
+private:
+  nl_replay(const nl_replay &) = delete;
+  nl_replay &operator=(const nl_replay &) = delete;
+
+  nl_capture_reader capture;
+  struct nl_sock *sock;
+  std::vector<std::string> ports;
+  std::map<int, std::string> port_ifindexes; // of the capture
+  std::map<int, int> ifindexes;              // capture to benchmark
+
+  int run(uint32_t nl_port, double speed);
+  int map_ifindex(int ifindex) const noexcept;
+  void rewrite(struct nlmsghdr *hdr) const noexcept;
+};
+
+} // namespace basebox
@@ -0,0 +1,404 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <linux/if_bridge.h>
+#include <linux/if_link.h>
+#include <linux/neighbour.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+
+#include <glog/logging.h>
+#include <netlink/msg.h>
+#include <netlink/netlink.h>
+#include <netlink/socket.h>
+
+#include "nl_workload.h"
+
+namespace basebox {
+
+static const char *bridge_name = "swbridge";
+
+// kernel error replies are read before they can fill the socket buffer
+static const unsigned drain_interval = 1024;
+
+static int error_cb(struct sockaddr_nl *nla, struct nlmsgerr *err,
+                    void *arg) {
+  if (err->error) {
+    VLOG(2) << __FUNCTION__ << ": request failed: " << strerror(-err->error);
+    ++*static_cast<unsigned *>(arg);
+  }
+  return NL_SKIP;
+}
+
+static struct nl_msg *request(int type, int flags, const void *hdr,
+                              size_t len) {
+  struct nl_msg *msg = nlmsg_alloc_simple(type, flags);
+
+  if (!msg)
+    LOG(FATAL) << __FUNCTION__ << ": out of memory";
+  if (nlmsg_append(msg, const_cast<void *>(hdr), len, NLMSG_ALIGNTO) < 0)
+    LOG(FATAL) << __FUNCTION__ << ": out of memory";
+
+  return msg;
+}
+
+static struct nl_msg *link_request(int type, int flags, int family,
+                                   int ifindex, unsigned ifi_flags = 0,
+                                   unsigned ifi_change = 0) {
+  struct ifinfomsg ifi;
+
+  memset(&ifi, 0, sizeof(ifi));
+  ifi.ifi_family = family;
+  ifi.ifi_index = ifindex;
+  ifi.ifi_flags = ifi_flags;
+  ifi.ifi_change = ifi_change;
+
+  return request(type, flags, &ifi, sizeof(ifi));
+}
+
+static struct nl_msg *addr_request(int type, int flags, int ifindex,
+                                   uint32_t addr, int prefixlen) {
+  struct ifaddrmsg ifa;
+  uint32_t be_addr = htonl(addr);
+
+  memset(&ifa, 0, sizeof(ifa));
+  ifa.ifa_family = AF_INET;
+  ifa.ifa_prefixlen = prefixlen;
+  ifa.ifa_scope = RT_SCOPE_UNIVERSE;
+  ifa.ifa_index = ifindex;
+
+  struct nl_msg *msg = request(type, flags, &ifa, sizeof(ifa));
+  if (nla_put_u32(msg, IFA_LOCAL, be_addr) < 0 ||
+      nla_put_u32(msg, IFA_ADDRESS, be_addr) < 0)
+    LOG(FATAL) << __FUNCTION__ << ": out of memory";
+
+  return msg;
+}
+
+static struct nl_msg *neigh_request(int type, int flags, int family,
+                                    int ifindex, uint16_t state,
+                                    uint8_t ntf_flags, const uint8_t *lladdr) {
+  struct ndmsg ndm;
+
+  memset(&ndm, 0, sizeof(ndm));
+  ndm.ndm_family = family;
+  ndm.ndm_ifindex = ifindex;
+  ndm.ndm_state = state;
+  ndm.ndm_flags = ntf_flags;
+  ndm.ndm_type = RTN_UNICAST;
+
+  struct nl_msg *msg = request(type, flags, &ndm, sizeof(ndm));
+  if (nla_put(msg, NDA_LLADDR, 6, lladdr) < 0)
+    LOG(FATAL) << __FUNCTION__ << ": out of memory";
+
+  return msg;
+}
+
+static struct nl_msg *route_request(int type, int flags, uint32_t dst,
+                                    int dst_len) {
+  struct rtmsg rtm;
+
+  memset(&rtm, 0, sizeof(rtm));
+  rtm.rtm_family = AF_INET;
+  rtm.rtm_dst_len = dst_len;
+  rtm.rtm_table = RT_TABLE_MAIN;
+  rtm.rtm_protocol = RTPROT_BGP;
+  rtm.rtm_scope = RT_SCOPE_UNIVERSE;
+  rtm.rtm_type = RTN_UNICAST;
+
+  struct nl_msg *msg = request(type, flags, &rtm, sizeof(rtm));
+  if (nla_put_u32(msg, RTA_DST, htonl(dst)) < 0)
+    LOG(FATAL) << __FUNCTION__ << ": out of memory";
+
+  return msg;
+}
+
+static struct nl_msg *vlan_request(int type, int ifindex, uint16_t vid) {
+  struct bridge_vlan_info vinfo;
+  struct nl_msg *msg = link_request(type, 0, AF_BRIDGE, ifindex);
+
+  memset(&vinfo, 0, sizeof(vinfo));
+  vinfo.vid = vid;
+
+  struct nlattr *af_spec = nla_nest_start(msg, IFLA_AF_SPEC);
+  if (!af_spec ||
+      nla_put(msg, IFLA_BRIDGE_VLAN_INFO, sizeof(vinfo), &vinfo) < 0)
+    LOG(FATAL) << __FUNCTION__ << ": out of memory";
+  nla_nest_end(msg, af_spec);
+
+  return msg;
+}
+
+// 10.<port>.0.1/24 on the port, the neighbour 10.<port>.0.2 is the gateway
+static uint32_t port_net(size_t port) { return 0x0a000000 | (port << 16); }
+
+static void port_gateway_mac(size_t port, uint8_t *mac) {
+  memset(mac, 0, 6);
+  mac[0] = 0x02;
+  mac[5] = port;
+}
+
+// 10.<port>.128.1/17 on the port, the neighbours follow it
+static uint32_t port_neigh_net(size_t port) { return port_net(port) | 0x8000; }
+
+static void storm_mac(unsigned i, uint8_t *mac) {
+  mac[0] = 0x02;
+  mac[1] = 0xbb;
+  for (int b = 0; b < 4; b++)
+    mac[5 - b] = i >> (8 * b);
+}
+
+nl_workload::~nl_workload() {
+  if (sock)
+    nl_socket_free(sock);
+}
+
+int nl_workload::init() {
+  int rv;
+
+  sock = nl_socket_alloc();
+  if (sock == nullptr)
+    return -ENOMEM;
+
+  rv = nl_connect(sock, NETLINK_ROUTE);
+  if (rv < 0) {
+    LOG(ERROR) << __FUNCTION__ << ": failed to connect: " << nl_geterror(rv);
+    return -EINVAL;
+  }
+
+  // only errors are replied, they are read from time to time
+  nl_socket_disable_auto_ack(sock);
+  nl_socket_disable_seq_check(sock);
+  nl_socket_set_nonblocking(sock);
+  nl_socket_modify_err_cb(sock, NL_CB_CUSTOM, error_cb, &errors);
+
+  return 0;
+}
+
+int nl_workload::send(struct nl_msg *msg) {
+  int rv = nl_send_auto(sock, msg);
+
+  nlmsg_free(msg);
+  if (rv < 0) {
+    errors++;
+    return rv;
+  }
+
+  if (++unread == drain_interval)
+    drain();
+
+  return 0;
+}
+
+void nl_workload::drain() {
+  while (nl_recvmsgs_default(sock) >= 0)
+    ;
+  unread = 0;
+}
+
+unsigned nl_workload::get_errors() {
+  drain();
+  return errors;
+}
+
+std::vector<nl_workload::phase>
+nl_workload::ports_up(const std::vector<int> &ports) {
+  auto up = [this, ports]() {
+    for (int ifindex : ports)
+      send(link_request(RTM_NEWLINK, 0, AF_UNSPEC, ifindex, IFF_UP, IFF_UP));
+    drain();
+    return (int)ports.size();
+  };
+
+  return {{"ports up", up}};
+}
+
+std::vector<nl_workload::phase>
+nl_workload::bridge(const std::vector<int> &ports) {
+  auto create = [this, ports]() {
+    struct nl_msg *msg = link_request(RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL,
+                                      AF_UNSPEC, 0);
+    struct nlattr *info, *data;
+
+    if (nla_put_string(msg, IFLA_IFNAME, bridge_name) < 0 ||
+        !(info = nla_nest_start(msg, IFLA_LINKINFO)) ||
+        nla_put_string(msg, IFLA_INFO_KIND, "bridge") < 0 ||
+        !(data = nla_nest_start(msg, IFLA_INFO_DATA)) ||
+        nla_put_u8(msg, IFLA_BR_VLAN_FILTERING, 1) < 0)
+      LOG(FATAL) << __FUNCTION__ << ": out of memory";
+    nla_nest_end(msg, data);
+    nla_nest_end(msg, info);
+    send(msg);
+
+    bridge_ifindex = if_nametoindex(bridge_name);
+    if (bridge_ifindex == 0) {
+      LOG(ERROR) << __FUNCTION__ << ": failed to create " << bridge_name;
+      return -ENODEV;
+    }
+
+    for (int ifindex : ports) {
+      msg = link_request(RTM_NEWLINK, 0, AF_UNSPEC, ifindex);
+      if (nla_put_u32(msg, IFLA_MASTER, bridge_ifindex) < 0)
+        LOG(FATAL) << __FUNCTION__ << ": out of memory";
+      send(msg);
+    }
+
+    send(link_request(RTM_NEWLINK, 0, AF_UNSPEC, bridge_ifindex, IFF_UP,
+                      IFF_UP));
+    drain();
+    return (int)ports.size() + 2;
+  };
+
+  return {{"bridge", create}};
+}
+
+std::vector<nl_workload::phase>
+nl_workload::routes(const std::vector<int> &ports, unsigned n) {
+  auto addresses = [this, ports]() {
+    for (size_t p = 0; p < ports.size(); p++)
+      send(addr_request(RTM_NEWADDR, NLM_F_CREATE | NLM_F_EXCL, ports[p],
+                        port_net(p) | 1, 24));
+    drain();
+    return (int)ports.size();
+  };
+
+  auto gateways = [this, ports]() {
+    uint8_t mac[6];
+
+    for (size_t p = 0; p < ports.size(); p++) {
+      port_gateway_mac(p, mac);
+      struct nl_msg *msg =
+          neigh_request(RTM_NEWNEIGH, NLM_F_CREATE | NLM_F_REPLACE, AF_INET,
+                        ports[p], NUD_PERMANENT, 0, mac);
+      if (nla_put_u32(msg, NDA_DST, htonl(port_net(p) | 2)) < 0)
+        LOG(FATAL) << __FUNCTION__ << ": out of memory";
+      send(msg);
+    }
+    drain();
+    return (int)ports.size();
+  };
+
+  // consecutive /24 prefixes from 64.0.0.0, the gateways are taken in turns
+  auto add = [this, ports, n]() {
+    for (unsigned i = 0; i < n; i++) {
+      size_t p = i % ports.size();
+      struct nl_msg *msg = route_request(
+          RTM_NEWROUTE, NLM_F_CREATE | NLM_F_EXCL, 0x40000000 + (i << 8), 24);
+      if (nla_put_u32(msg, RTA_GATEWAY, htonl(port_net(p) | 2)) < 0 ||
+          nla_put_u32(msg, RTA_OIF, ports[p]) < 0)
+        LOG(FATAL) << __FUNCTION__ << ": out of memory";
+      send(msg);
+    }
+    drain();
+    return (int)n;
+  };
+
+  auto del = [this, n]() {
+    for (unsigned i = 0; i < n; i++)
+      send(route_request(RTM_DELROUTE, 0, 0x40000000 + (i << 8), 24));
+    drain();
+    return (int)n;
+  };
+
+  return {{"addresses", addresses},
+          {"gateways", gateways},
+          {"route add", add},
+          {"route del", del}};
+}
+
+std::vector<nl_workload::phase>
+nl_workload::macs(const std::vector<int> &ports, unsigned n) {
+  auto fdb = [this, ports, n](int type, int flags) {
+    uint8_t mac[6];
+
+    for (unsigned i = 0; i < n; i++) {
+      storm_mac(i, mac);
+      struct nl_msg *msg =
+          neigh_request(type, flags, AF_BRIDGE, ports[i % ports.size()],
+                        NUD_REACHABLE, NTF_MASTER, mac);
+      if (nla_put_u16(msg, NDA_VLAN, 1) < 0)
+        LOG(FATAL) << __FUNCTION__ << ": out of memory";
+      send(msg);
+    }
+    drain();
+    return (int)n;
+  };
+
+  auto add = [fdb]() { return fdb(RTM_NEWNEIGH, NLM_F_CREATE | NLM_F_EXCL); };
+  auto del = [fdb]() { return fdb(RTM_DELNEIGH, 0); };
+
+  return {{"fdb add", add}, {"fdb del", del}};
+}
+
+std::vector<nl_workload::phase>
+nl_workload::vlans(const std::vector<int> &ports, unsigned n) {
+  auto trunk = [this, ports, n](int type) {
+    for (unsigned vid = 2; vid < n + 2; vid++) {
+      for (int ifindex : ports)
+        send(vlan_request(type, ifindex, vid));
+    }
+    drain();
+    return (int)(n * ports.size());
+  };
+
+  auto add = [trunk]() { return trunk(RTM_SETLINK); };
+  auto del = [trunk]() { return trunk(RTM_DELLINK); };
+
+  return {{"vlan add", add}, {"vlan del", del}};
+}
+
+std::vector<nl_workload::phase>
+nl_workload::neighs(const std::vector<int> &ports, unsigned n) {
+  auto addresses = [this, ports]() {
+    for (size_t p = 0; p < ports.size(); p++)
+      send(addr_request(RTM_NEWADDR, NLM_F_CREATE | NLM_F_EXCL, ports[p],
+                        port_neigh_net(p) | 1, 17));
+    drain();
+    return (int)ports.size();
+  };
+
+  // the link layer address stays the same, only the state changes
+  auto neigh = [this, ports, n](int type, int flags, uint16_t state) {
+    uint8_t mac[6];
+
+    for (unsigned i = 0; i < n; i++) {
+      size_t p = i % ports.size();
+      storm_mac(i, mac);
+      struct nl_msg *msg =
+          neigh_request(type, flags, AF_INET, ports[p], state, 0, mac);
+      if (nla_put_u32(msg, NDA_DST,
+                      htonl(port_neigh_net(p) + 2 + i / ports.size())) < 0)
+        LOG(FATAL) << __FUNCTION__ << ": out of memory";
+      send(msg);
+    }
+    drain();
+    return (int)n;
+  };
+
+  auto add = [neigh]() {
+    return neigh(RTM_NEWNEIGH, NLM_F_CREATE | NLM_F_EXCL, NUD_REACHABLE);
+  };
+  auto stale = [neigh]() {
+    return neigh(RTM_NEWNEIGH, NLM_F_REPLACE, NUD_STALE);
+  };
+  auto delay = [neigh]() {
+    return neigh(RTM_NEWNEIGH, NLM_F_REPLACE, NUD_DELAY);
+  };
+  auto reachable = [neigh]() {
+    return neigh(RTM_NEWNEIGH, NLM_F_REPLACE, NUD_REACHABLE);
+  };
+  auto del = [neigh]() { return neigh(RTM_DELNEIGH, 0, 0); };
+
+  return {{"addresses", addresses},
+          {"neigh add", add},
+          {"neigh stale", stale},
+          {"neigh delay", delay},
+          {"neigh reach", reachable},
+          {"neigh del", del}};
+}
+
+} // namespace basebox
@@ -0,0 +1,67 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+extern "C" {
+struct nl_msg;
+struct nl_sock;
+}
+
+namespace basebox {
+
+/**
+ * Synthetic netlink feeds for the benchmark.
+ *
+ * Requests are sent to the kernel of the benchmark's network namespace
+ * without waiting for acks, so the kernel notifies cnetlink as fast as it
+ * accepts them. Failed requests are counted, not retried.
+ */
+class nl_workload final {
+public:
+  struct phase {
+    std::string name;
+    std::function<int()> run; // number of requests sent or -errno
+  };
+
+  nl_workload() : sock(nullptr), errors(0), unread(0), bridge_ifindex(0) {}
+  ~nl_workload();
+
+  int init();
+
+  std::vector<phase> ports_up(const std::vector<int> &ports);
+  std::vector<phase> bridge(const std::vector<int> &ports);
+
+  // ipv4 /24 routes via a neighbour on every port, added and removed
+  std::vector<phase> routes(const std::vector<int> &ports, unsigned n);
+  // dynamic fdb entries spread over the bridge ports, added and removed
+  std::vector<phase> macs(const std::vector<int> &ports, unsigned n);
+  // vlans 2..n+1 on every bridge port, added and removed
+  std::vector<phase> vlans(const std::vector<int> &ports, unsigned n);
+  // ipv4 neighbours spread over the ports, taken through the NUD states a
+  // resolved neighbour cycles through, added and removed
+  std::vector<phase> neighs(const std::vector<int> &ports, unsigned n);
+
+  // requests rejected by the kernel so far
+  unsigned get_errors();
+
+private:
+  nl_workload(const nl_workload &) = delete;
+  nl_workload &operator=(const nl_workload &) = delete;
+
+  struct nl_sock *sock;
+  unsigned errors;
+  unsigned unread; // requests sent since the last drain
+  int bridge_ifindex;
+
+  int send(struct nl_msg *msg);
+  void drain();
+};
+
+} // namespace basebox
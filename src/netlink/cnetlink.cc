@@ -2,12 +2,15 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <exception>
 #include <fstream>
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <iterator>
+#include <map>
 #include <string_view>
 
 #include <sys/socket.h>
@@ -25,20 +28,53 @@
 #include "netlink-utils.h"
 #include "nl_output.h"
 #include "tap_manager.h"
+#include "utils/latency_histogram.h"
+#include "utils/metrics.h"
 
 #include "nl_bond.h"
+#include "nl_fast_path.h"
+#include "nl_ingest_filter.h"
 #include "nl_interface.h"
 #include "nl_l3.h"
+#include "nl_neigh_proxy.h"
+#include "nl_recorder.h"
 #include "nl_vlan.h"
 #include "nl_vxlan.h"
 
+DEFINE_int32(nl_rx_buffer_max, 64 * 1024 * 1024,
+             "Maximum size in bytes the netlink receive buffer is grown to "
+             "on repeated overruns");
+DEFINE_bool(nl_fast_path, false,
+            "Drop neighbour refreshes and unchanged routes before they are "
+            "parsed by libnl");
+DEFINE_bool(nl_neigh_suppress, false,
+            "Answer ARP requests and neighbour solicitations of bridged hosts "
+            "from the neighbour cache instead of flooding them");
+DEFINE_string(nl_record_file, "",
+              "Record the received netlink messages to this ring file");
+DEFINE_int32(nl_record_size_mb, 64,
+             "Size in MiB of the ring of recorded netlink messages");
+DEFINE_string(state_snapshot, "",
+              "File the switch state is persisted to for warm restarts, the "
+              "ids allocated by the netlink subsystems go to <file>.netlink "
+              "(empty: disabled)");
+DEFINE_int32(state_snapshot_interval, 10,
+             "Interval in seconds the switch state snapshot is written");
+DEFINE_int32(warm_restart_holdoff, 10,
+             "Time in seconds after the ports are initialized until the "
+             "switch state is reconciled on a warm restart");
+
 namespace basebox {
 
 cnetlink::cnetlink()
     : swi(nullptr), thread(1), caches(NL_MAX_CACHE, nullptr), nl_proc_max(10),
-      state(NL_STATE_STOPPED), bridge(nullptr), iface(new nl_interface(this)),
+      state(NL_STATE_STOPPED), resync_pending(NL_MAX_CACHE, false),
+      resync_scheduled(false), ids_reserved(false), overruns(0),
+      window_overruns(0),
+      window_start(std::chrono::steady_clock::now()), bridge(nullptr),
+      iface(new nl_interface(this)),
       bond(new nl_bond(this)), vlan(new nl_vlan(this)),
-      l3(new nl_l3(vlan, this)), vxlan(new nl_vxlan(l3, this)) {
+      l3(new nl_l3(vlan, this)), vxlan(new nl_vxlan(vlan, l3, this)) {
 
   sock_tx = nl_socket_alloc();
   if (sock_tx == nullptr) {
@@ -48,9 +84,26 @@ cnetlink::cnetlink()
   nl_connect(sock_tx, NETLINK_ROUTE);
   set_nl_socket_buffer_sizes(sock_tx);
 
+  if (FLAGS_nl_neigh_suppress)
+    neigh_proxy.reset(new nl_neigh_proxy(this));
+
+  if (!FLAGS_state_snapshot.empty()) {
+    int rv = id_pools.load(FLAGS_state_snapshot + ".netlink");
+    if (rv == 0)
+      ids_reserved = true;
+    else if (rv != -ENOENT)
+      LOG(WARNING) << __FUNCTION__ << ": ignoring " << FLAGS_state_snapshot
+                   << ".netlink: " << strerror(-rv);
+  }
+
   try {
+    init_metrics();
     thread.start("netlink");
     init_caches();
+    if (!FLAGS_state_snapshot.empty())
+      thread.add_timer(
+          this, NL_TIMER_STATE_SNAPSHOT,
+          rofl::ctimespec().expire_in(FLAGS_state_snapshot_interval));
   } catch (...) {
     LOG(FATAL) << __FUNCTION__ << ": caught unknown exception";
   }
@@ -80,11 +133,6 @@ int cnetlink::load_from_file(const std::string &path) {
   return out;
 }
 
-static int nl_overrun_handler_verbose(struct nl_msg *msg, void *arg) {
-  LOG(ERROR) << __FUNCTION__ << ": got called with msg=" << msg;
-  return NL_STOP;
-}
-
 static int nl_invalid_handler_verbose(struct nl_msg *msg, void *arg) {
   LOG(ERROR) << __FUNCTION__ << ": got called with msg=" << msg;
   return NL_STOP;
@@ -97,11 +145,24 @@ void cnetlink::init_caches() {
     LOG(FATAL) << __FUNCTION__ << ": failed to create netlink socket";
   }
 
-  nl_socket_modify_cb(sock_mon, NL_CB_OVERRUN, NL_CB_CUSTOM,
-                      nl_overrun_handler_verbose, nullptr);
+  nl_socket_modify_cb(sock_mon, NL_CB_OVERRUN, NL_CB_CUSTOM, nl_overrun_cb,
+                      this);
   nl_socket_modify_cb(sock_mon, NL_CB_INVALID, NL_CB_CUSTOM,
                       nl_invalid_handler_verbose, nullptr);
 
+  // installed before the initial dumps, so they are part of the recording
+  if (!FLAGS_nl_record_file.empty()) {
+    recorder.reset(new nl_recorder());
+    if (recorder->open(FLAGS_nl_record_file,
+                       (size_t)FLAGS_nl_record_size_mb << 20) < 0) {
+      LOG(ERROR) << __FUNCTION__ << ": netlink messages are not recorded";
+      recorder.reset();
+    } else {
+      nl_socket_modify_cb(sock_mon, NL_CB_MSG_IN, NL_CB_CUSTOM, nl_msg_in_cb,
+                          this);
+    }
+  }
+
   int rc = nl_cache_mngr_alloc(sock_mon, NETLINK_ROUTE, NL_AUTO_PROVIDE, &mngr);
 
   if (rc < 0) {
@@ -160,6 +221,25 @@ void cnetlink::init_caches() {
     LOG(FATAL) << __FUNCTION__ << ": add route/neigh to cache mngr";
   }
 
+  // the initial dumps are not filtered, drop what is not selected
+  ingest_filter.reset(new nl_ingest_filter());
+  if (ingest_filter->enabled()) {
+    prune_cache(NL_ROUTE_CACHE);
+    prune_cache(NL_NEIGH_CACHE);
+
+    rc = ingest_filter->attach(nl_socket_get_fd(sock_mon));
+    if (rc < 0)
+      LOG(WARNING) << __FUNCTION__ << ": filtering in user space only";
+  }
+
+  // installed after the initial dumps, the caches have to be complete
+  if (FLAGS_nl_fast_path)
+    fast_path.reset(new nl_fast_path());
+
+  if (fast_path || ingest_filter->enabled() || recorder)
+    nl_socket_modify_cb(sock_mon, NL_CB_MSG_IN, NL_CB_CUSTOM, nl_msg_in_cb,
+                        this);
+
   try {
     thread.add_read_fd(this, nl_cache_mngr_get_fd(mngr), true, false);
   } catch (std::exception &e) {
@@ -167,6 +247,32 @@ void cnetlink::init_caches() {
   }
 }
 
+void cnetlink::init_metrics() {
+  static const char *class_names[nl_event_queue::NL_MAX_EVENT_CLASS] = {
+      "nl_objs_link", "nl_objs_l2", "nl_objs_l3"};
+  static const char *cache_names[NL_MAX_CACHE] = {
+      "route/addr", "route/link", "route/neigh", "route/route"};
+  const char *depth_help = "Number of events waiting in a queue";
+  auto &registry = metrics_registry::get();
+
+  for (int i = 0; i < nl_event_queue::NL_MAX_EVENT_CLASS; i++)
+    class_depth[i] = &registry.gauge("baseboxd_queue_depth", depth_help,
+                                     {{"queue", class_names[i]}});
+
+  for (int i = 0; i < NL_MAX_CACHE; i++)
+    cache_objects[i] =
+        &registry.gauge("baseboxd_netlink_cache_objects",
+                        "Number of objects in a netlink cache",
+                        {{"cache", cache_names[i]}});
+
+  packet_in_depth = &registry.gauge("baseboxd_queue_depth", depth_help,
+                                    {{"queue", "packet_in"}});
+  fdb_evts_depth = &registry.gauge("baseboxd_queue_depth", depth_help,
+                                   {{"queue", "fdb_evts"}});
+  port_status_depth = &registry.gauge("baseboxd_queue_depth", depth_help,
+                                      {{"queue", "port_status_changes"}});
+}
+
 void cnetlink::init_subsystems() noexcept {
   assert(swi);
   l3->init();
@@ -176,6 +282,7 @@ void cnetlink::init_subsystems() noexcept {
 void cnetlink::shutdown_subsystems() noexcept {
   tap_man->clear();
   bond->clear();
+  link_descs.clear();
 }
 
 int cnetlink::set_nl_socket_buffer_sizes(nl_sock *sk) {
@@ -201,6 +308,56 @@ int cnetlink::set_nl_socket_buffer_sizes(nl_sock *sk) {
   return err;
 }
 
+bool cnetlink::accept_object(enum nl_cache_t id, nl_object *obj) const
+    noexcept {
+  switch (id) {
+  case NL_ROUTE_CACHE: {
+    auto route = ROUTE_CAST(obj);
+    return ingest_filter->accept_route(rtnl_route_get_family(route),
+                                       rtnl_route_get_table(route),
+                                       rtnl_route_get_protocol(route));
+  }
+  case NL_NEIGH_CACHE: {
+    auto neigh = NEIGH_CAST(obj);
+    int family = rtnl_neigh_get_family(neigh);
+
+    if (!ingest_filter->accept_neigh(family))
+      return false;
+
+    if (ingest_filter->neighbours_on_ports() &&
+        (family == AF_INET || family == AF_INET6))
+      return is_switch_interface(rtnl_neigh_get_ifindex(neigh));
+
+    return true;
+  }
+  default:
+    return true;
+  }
+}
+
+void cnetlink::prune_cache(enum nl_cache_t id) noexcept {
+  std::deque<nl_object *> rejected;
+
+  for (nl_object *obj = nl_cache_get_first(caches[id]); obj;
+       obj = nl_cache_get_next(obj)) {
+    if (!accept_object(id, obj)) {
+      nl_object_get(obj);
+      rejected.push_back(obj);
+    }
+  }
+
+  for (auto obj : rejected) {
+    nl_cache_remove(obj);
+    nl_object_put(obj);
+  }
+
+  if (id == NL_LINK_CACHE)
+    link_descs.clear();
+
+  VLOG(1) << __FUNCTION__ << ": dropped " << rejected.size()
+          << " objects from cache " << id;
+}
+
 void cnetlink::destroy_caches() { nl_cache_mngr_free(mngr); }
 
 // XXX TODO should return std::unique_ptr<struct rtnl_link,
@@ -210,7 +367,7 @@ struct rtnl_link *cnetlink::get_link_by_ifindex(int ifindex) const {
 
   // check the garbage
   if (link == nullptr) {
-    for (auto &obj : nl_objs) {
+    for (auto &obj : nl_objs.links()) {
       if (obj.get_action() != NL_ACT_DEL)
         continue;
 
@@ -245,7 +402,7 @@ struct rtnl_link *cnetlink::get_link(int ifindex, int family) const {
 
   if (_link == nullptr) {
     // check the garbage
-    for (auto &obj : nl_objs) {
+    for (auto &obj : nl_objs.links()) {
       if (obj.get_action() != NL_ACT_DEL)
         continue;
 
@@ -285,7 +442,7 @@ void cnetlink::get_bridge_ports(int br_ifindex,
                           link_list);
 
   // check the garbage
-  for (auto &obj : nl_objs) {
+  for (auto &obj : nl_objs.links()) {
     if (obj.get_action() != NL_ACT_DEL)
       continue;
 
@@ -363,10 +520,83 @@ int cnetlink::get_port_id(int ifindex) const {
   if (ifindex == 0)
     return 0;
 
+  nl_link_desc desc;
+  if (get_link_desc(ifindex, &desc) < 0)
+    return 0;
+
+  return desc.port_id;
+}
+
+int cnetlink::get_link_desc(int ifindex, nl_link_desc *desc) const noexcept {
+  const nl_link_desc *hit = link_descs.get(ifindex);
+  if (hit) {
+    *desc = *hit;
+    return 0;
+  }
+
+  // deleted links are looked up in the garbage, but not cached
+  bool cached = true;
+  rtnl_link *l = rtnl_link_get(caches[NL_LINK_CACHE], ifindex);
+  if (l == nullptr) {
+    l = get_link_by_ifindex(ifindex);
+    cached = false;
+  }
+
+  std::unique_ptr<rtnl_link, decltype(&rtnl_link_put)> link(l, rtnl_link_put);
+  if (link == nullptr)
+    return -ENODEV;
+
+  nl_link_desc d = {};
+  d.ifindex = ifindex;
+  d.master = rtnl_link_get_master(l);
+  d.link = rtnl_link_get_link(l);
+  d.port_id = get_port_id(l);
+  d.mtu = rtnl_link_get_mtu(l);
+  d.type = get_link_type(l);
+  d.tagged = rtnl_link_is_vlan(l);
+
+  switch (d.type) {
+  case LT_BRIDGE:
+  case LT_TUN:
+  case LT_BOND:
+  case LT_VLAN:
+    d.vid = vlan->get_vid(l);
+    break;
+  default:
+    // get_vid has no vid for other links
+    break;
+  }
+
+  nl_addr *addr = rtnl_link_get_addr(l);
+  if (addr && nl_addr_get_len(addr) == ETH_ALEN) {
+    memcpy(d.mac, nl_addr_get_binary_addr(addr), ETH_ALEN);
+    d.has_mac = true;
+  }
+
+  if (cached)
+    link_descs.set(d);
+
+  *desc = d;
+  return 0;
+}
+
+bool cnetlink::is_switch_interface(int ifindex) const noexcept {
+  if (ifindex == 0 || tap_man == nullptr)
+    return false;
+
+  if (bridge && bridge->get_ifindex() == ifindex)
+    return true;
+
   std::unique_ptr<rtnl_link, decltype(&rtnl_link_put)> link(
       get_link_by_ifindex(ifindex), rtnl_link_put);
 
-  return get_port_id(link.get());
+  if (link == nullptr)
+    return false;
+
+  if (rtnl_link_is_vlan(link.get()))
+    return is_switch_interface(rtnl_link_get_link(link.get()));
+
+  return get_port_id(link.get()) != 0;
 }
 
 void cnetlink::handle_wakeup(rofl::cthread &thread) {
@@ -379,6 +609,10 @@ void cnetlink::handle_wakeup(rofl::cthread &thread) {
   case NL_STATE_INIT:
     init_subsystems();
     state = NL_STATE_RUNNING;
+    // ids of the previous instance not claimed until then are dropped
+    if (ids_reserved)
+      thread.add_timer(this, NL_TIMER_WARM_RESTART,
+                       rofl::ctimespec().expire_in(FLAGS_warm_restart_holdoff));
     break;
   case NL_STATE_RUNNING:
     break;
@@ -390,30 +624,38 @@ void cnetlink::handle_wakeup(rofl::cthread &thread) {
     return;
   }
 
-  // loop through nl_objs
+  // loop through nl_objs, the classes of events are served in turns
   for (int cnt = 0;
-       cnt < nl_proc_max && nl_objs.size() && state == NL_STATE_RUNNING;
+       cnt < nl_proc_max && !nl_objs.empty() && state == NL_STATE_RUNNING;
        cnt++) {
     auto obj = nl_objs.front();
-    nl_objs.pop_front();
+    nl_objs.pop();
 
     switch (obj.get_msg_type()) {
     case RTM_NEWLINK:
-    case RTM_DELLINK:
+    case RTM_DELLINK: {
+      latency_trace trace(LATENCY_LINK, obj.get_received());
       route_link_apply(obj);
       break;
+    }
     case RTM_NEWNEIGH:
-    case RTM_DELNEIGH:
+    case RTM_DELNEIGH: {
+      latency_trace trace(LATENCY_NEIGH, obj.get_received());
       route_neigh_apply(obj);
       break;
+    }
     case RTM_NEWROUTE:
-    case RTM_DELROUTE:
+    case RTM_DELROUTE: {
+      latency_trace trace(LATENCY_ROUTE, obj.get_received());
       route_route_apply(obj);
       break;
+    }
     case RTM_NEWADDR:
-    case RTM_DELADDR:
+    case RTM_DELADDR: {
+      latency_trace trace(LATENCY_ADDR, obj.get_received());
       route_addr_apply(obj);
       break;
+    }
     default:
       LOG(ERROR) << __FUNCTION__ << ": unexpected netlink type "
                  << obj.get_msg_type();
@@ -433,9 +675,19 @@ void cnetlink::handle_wakeup(rofl::cthread &thread) {
     do_wakeup = true;
   }
 
-  if (do_wakeup || nl_objs.size()) {
-    VLOG(3) << __FUNCTION__
-            << ": calling wakeup nl_objs.size()=" << nl_objs.size();
+  for (int i = 0; i < nl_event_queue::NL_MAX_EVENT_CLASS; i++)
+    class_depth[i]->set(
+        nl_objs.size(static_cast<nl_event_queue::nl_event_class>(i)));
+
+  for (int i = 0; i < NL_MAX_CACHE; i++)
+    cache_objects[i]->set(nl_cache_nitems(caches[i]));
+
+  if (do_wakeup || !nl_objs.empty()) {
+    VLOG(3) << __FUNCTION__ << ": calling wakeup nl_objs.size()="
+            << nl_objs.size() << " (link="
+            << nl_objs.size(nl_event_queue::NL_EVENT_LINK)
+            << ", l2=" << nl_objs.size(nl_event_queue::NL_EVENT_L2)
+            << ", l3=" << nl_objs.size(nl_event_queue::NL_EVENT_L3) << ")";
     this->thread.wakeup(this);
   }
 }
@@ -446,6 +698,9 @@ void cnetlink::handle_read_event(rofl::cthread &thread, int fd) {
   if (fd == nl_cache_mngr_get_fd(mngr)) {
     int rv = nl_cache_mngr_data_ready(mngr);
     VLOG(3) << __FUNCTION__ << ": #processed=" << rv;
+    // ENOBUFS is reported as NLE_NOMEM, events were dropped by the kernel
+    if (rv == -NLE_NOMEM)
+      handle_overrun();
     // notify update
     if (state != NL_STATE_STOPPED) {
       this->thread.wakeup(this);
@@ -480,6 +735,43 @@ void cnetlink::handle_timeout(rofl::cthread &thread, uint32_t timer_id) {
     // was stopped before
     start();
     break;
+  case NL_TIMER_RESYNC:
+    resync_scheduled = false;
+    // one cache per run, links first as all other objects refer to them
+    for (auto id :
+         {NL_LINK_CACHE, NL_ADDR_CACHE, NL_NEIGH_CACHE, NL_ROUTE_CACHE}) {
+      if (!resync_pending[id])
+        continue;
+
+      resync_pending[id] = false;
+      if (resync_cache(id) < 0)
+        resync_pending[id] = true;
+      break;
+    }
+
+    if (std::find(resync_pending.begin(), resync_pending.end(), true) !=
+        resync_pending.end())
+      schedule_resync();
+    break;
+  case NL_TIMER_STATE_SNAPSHOT:
+    thread.add_timer(
+        this, NL_TIMER_STATE_SNAPSHOT,
+        rofl::ctimespec().expire_in(FLAGS_state_snapshot_interval));
+    id_pools.save(FLAGS_state_snapshot + ".netlink");
+    break;
+  case NL_TIMER_WARM_RESTART: {
+    // armed again once the switch is back
+    if (state != NL_STATE_RUNNING)
+      break;
+
+    ids_reserved = false;
+    // the remaining ids are l3 ecmp groups, the controller reconciliation
+    // removes them
+    size_t deleted = vxlan->delete_unclaimed();
+    LOG(INFO) << __FUNCTION__ << ": warm restart finished, " << deleted
+              << " tunnel objects of the previous state deleted, "
+              << id_pools.drop_reserved() << " other ids unclaimed";
+  } break;
   default:
     break;
   }
@@ -496,9 +788,231 @@ void cnetlink::nl_cb_v2(struct nl_cache *cache, struct nl_object *old_obj,
   assert(data);
   auto nl = static_cast<cnetlink *>(data);
 
+  // the link cache changed already, the descriptors have to follow
+  if (cache == nl->caches[NL_LINK_CACHE])
+    nl->invalidate_link_descs(action, old_obj, new_obj);
+
   // only enqueue nl msgs if not in stopped state
   if (nl->state != NL_STATE_STOPPED)
-    nl->nl_objs.emplace_back(action, old_obj, new_obj);
+    nl->nl_objs.emplace(action, old_obj, new_obj);
+}
+
+int cnetlink::nl_overrun_cb(struct nl_msg *msg, void *arg) {
+  LOG(ERROR) << __FUNCTION__ << ": got called with msg=" << msg;
+
+  assert(arg);
+  static_cast<cnetlink *>(arg)->handle_overrun();
+  return NL_STOP;
+}
+
+int cnetlink::nl_msg_in_cb(struct nl_msg *msg, void *arg) {
+  assert(arg);
+  auto nl = static_cast<cnetlink *>(arg);
+  auto hdr = nlmsg_hdr(msg);
+  auto filter = nl->ingest_filter.get();
+
+  if (nl->recorder)
+    nl->recorder->record(hdr);
+
+  // messages not caught by the socket filter, there is no filter yet while
+  // the initial dumps are recorded
+  switch (filter && filter->enabled() ? hdr->nlmsg_type : NLMSG_NOOP) {
+  case RTM_NEWROUTE:
+  case RTM_DELROUTE: {
+    nl_route_msg route;
+    if (nl_parse_route(hdr, &route) == 0 &&
+        !filter->accept_route(route.family, route.table, route.protocol))
+      return NL_SKIP;
+    break;
+  }
+  case RTM_NEWNEIGH:
+  case RTM_DELNEIGH: {
+    nl_neigh_msg neigh;
+    if (nl_parse_neigh(hdr, &neigh) < 0)
+      break;
+    if (!filter->accept_neigh(neigh.family))
+      return NL_SKIP;
+    // deletions pass, the neighbour may be cached from before
+    if (hdr->nlmsg_type == RTM_NEWNEIGH && filter->neighbours_on_ports() &&
+        (neigh.family == AF_INET || neigh.family == AF_INET6) &&
+        !nl->is_switch_interface(neigh.ifindex))
+      return NL_SKIP;
+    break;
+  }
+  default:
+    break;
+  }
+
+  if (nl->fast_path && nl->fast_path->is_redundant(hdr)) {
+    VLOG(3) << __FUNCTION__ << ": dropped, suppressed="
+            << nl->fast_path->get_suppressed();
+    return NL_SKIP;
+  }
+
+  return NL_OK;
+}
+
+void cnetlink::handle_overrun() noexcept {
+  auto now = std::chrono::steady_clock::now();
+
+  overruns++;
+  if (now - window_start > std::chrono::seconds(overrun_window)) {
+    window_start = now;
+    window_overruns = 0;
+  }
+  window_overruns++;
+
+  LOG(WARNING) << __FUNCTION__ << ": netlink events lost, overruns=" << overruns
+               << " (" << window_overruns << " in the last " << overrun_window
+               << "s)";
+
+  if (window_overruns >= overrun_grow_threshold)
+    grow_rx_buffer();
+
+  // a single socket serves all caches, any of them may have missed events
+  std::fill(resync_pending.begin(), resync_pending.end(), true);
+  schedule_resync();
+}
+
+void cnetlink::schedule_resync() noexcept {
+  if (resync_scheduled)
+    return;
+
+  try {
+    // let the burst settle, further overruns are handled by the same resync
+    thread.add_timer(this, NL_TIMER_RESYNC,
+                     rofl::ctimespec().expire_in(0, resync_delay * 1000000));
+    resync_scheduled = true;
+  } catch (std::exception &e) {
+    LOG(ERROR) << __FUNCTION__ << ": caught " << e.what();
+  }
+}
+
+int cnetlink::resync_cache(enum nl_cache_t id) noexcept {
+  static const char *cache_names[NL_MAX_CACHE] = {
+      "route/addr", "route/link", "route/neigh", "route/route"};
+  std::deque<nl_object *> dumped;
+  std::deque<nl_object *> gone;
+  nl_cache *fresh = nullptr;
+  nl_cache *cache = caches[id];
+  unsigned added = 0, changed = 0;
+
+  int rv = nl_cache_alloc_name(cache_names[id], &fresh);
+  if (rv < 0) {
+    LOG(ERROR) << __FUNCTION__ << ": failed to allocate " << cache_names[id]
+               << ": " << nl_geterror(rv);
+    return rv;
+  }
+
+  if (id == NL_LINK_CACHE || id == NL_NEIGH_CACHE)
+    nl_cache_set_flags(fresh, NL_CACHE_AF_ITER);
+
+  rv = nl_cache_refill(sock_tx, fresh);
+  if (rv < 0) {
+    LOG(ERROR) << __FUNCTION__ << ": failed to dump " << cache_names[id]
+               << ": " << nl_geterror(rv);
+    nl_cache_free(fresh);
+    return rv;
+  }
+
+  // keep the dumped objects, so they can be moved into the monitored cache
+  for (nl_object *obj = nl_cache_get_first(fresh); obj;
+       obj = nl_cache_get_next(obj)) {
+    nl_object_get(obj);
+    dumped.push_back(obj);
+  }
+  nl_cache_free(fresh);
+
+  // the fast path compares against state the caches may not have anymore
+  if (fast_path)
+    fast_path->clear();
+  if (id == NL_LINK_CACHE)
+    link_descs.clear();
+
+  nl_cache_mark_all(cache);
+  for (auto obj : dumped) {
+    if (ingest_filter->enabled() && !accept_object(id, obj)) {
+      nl_object_put(obj);
+      continue;
+    }
+
+    nl_object *old_obj = nl_cache_search(cache, obj);
+
+    if (old_obj == nullptr) {
+      nl_cache_add(cache, obj);
+      if (state != NL_STATE_STOPPED)
+        nl_objs.emplace(NL_ACT_NEW, nullptr, obj);
+      added++;
+    } else {
+      nl_object_unmark(old_obj);
+      if (nl_object_diff(old_obj, obj)) {
+        nl_cache_remove(old_obj);
+        nl_cache_add(cache, obj);
+        if (state != NL_STATE_STOPPED)
+          nl_objs.emplace(NL_ACT_CHANGE, old_obj, obj);
+        changed++;
+      }
+      nl_object_put(old_obj);
+    }
+
+    nl_object_put(obj);
+  }
+
+  // still marked objects are not present in the kernel anymore
+  for (nl_object *obj = nl_cache_get_first(cache); obj;
+       obj = nl_cache_get_next(obj)) {
+    if (nl_object_is_marked(obj)) {
+      nl_object_get(obj);
+      gone.push_back(obj);
+    }
+  }
+
+  for (auto obj : gone) {
+    nl_object_unmark(obj);
+    nl_cache_remove(obj);
+    if (state != NL_STATE_STOPPED)
+      nl_objs.emplace(NL_ACT_DEL, obj, nullptr);
+    nl_object_put(obj);
+  }
+
+  LOG(INFO) << __FUNCTION__ << ": " << cache_names[id] << " resynced, "
+            << added << " added, " << changed << " changed, " << gone.size()
+            << " deleted";
+
+  if (added + changed + gone.size() && state != NL_STATE_STOPPED)
+    thread.wakeup(this);
+
+  return 0;
+}
+
+void cnetlink::grow_rx_buffer() noexcept {
+  int fd = nl_socket_get_fd(sock_mon);
+  int size = 0;
+  socklen_t len = sizeof(size);
+
+  if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &len) < 0) {
+    LOG(ERROR) << __FUNCTION__ << ": getsockopt failed: " << strerror(errno);
+    return;
+  }
+
+  // the kernel reports twice the size that was set
+  size /= 2;
+  if (size >= FLAGS_nl_rx_buffer_max)
+    return;
+
+  int new_size =
+      (int)std::min<int64_t>((int64_t)size * 2, FLAGS_nl_rx_buffer_max);
+
+  // not limited by rmem_max, requires CAP_NET_ADMIN
+  int rv = setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &new_size,
+                      sizeof(new_size));
+  if (rv < 0) {
+    LOG(ERROR) << __FUNCTION__ << ": setsockopt failed: " << strerror(errno);
+    return;
+  }
+
+  LOG(INFO) << __FUNCTION__ << ": netlink rx buffer grown from " << size
+            << " to " << new_size << " bytes";
 }
 
 void cnetlink::set_tapmanager(std::shared_ptr<tap_manager> tm) {
@@ -508,11 +1022,52 @@ void cnetlink::set_tapmanager(std::shared_ptr<tap_manager> tm) {
 
 int cnetlink::send_nl_msg(nl_msg *msg) { return nl_send_sync(sock_tx, msg); }
 
+int cnetlink::send_nl_msgs(const std::vector<nl_msg *> &msgs) {
+  std::vector<uint8_t> buf;
+  int failed = 0;
+  int rv = 0;
+
+  for (size_t i = 0; i < msgs.size() && rv >= 0;) {
+    unsigned batch = 0;
+
+    buf.clear();
+    for (; i < msgs.size() && batch < nl_batch_max; i++, batch++) {
+      nl_complete_msg(sock_tx, msgs[i]);
+      auto hdr = nlmsg_hdr(msgs[i]);
+      auto data = reinterpret_cast<uint8_t *>(hdr);
+      buf.insert(buf.end(), data, data + NLMSG_ALIGN(hdr->nlmsg_len));
+    }
+
+    // the kernel handles every request of a write and acks them in order
+    rv = nl_sendto(sock_tx, buf.data(), buf.size());
+    if (rv < 0) {
+      LOG(ERROR) << __FUNCTION__ << ": failed to send " << batch
+                 << " requests: " << nl_geterror(rv);
+      break;
+    }
+
+    for (; batch > 0; batch--) {
+      if (nl_wait_for_ack(sock_tx) < 0)
+        failed++;
+    }
+  }
+
+  for (auto msg : msgs)
+    nlmsg_free(msg);
+
+  return rv < 0 ? -EIO : failed;
+}
+
+uint32_t cnetlink::get_monitor_port() const noexcept {
+  return nl_socket_get_local_port(sock_mon);
+}
+
 void cnetlink::learn_l2(uint32_t port_id, int fd, basebox::packet *pkt) {
   {
     std::lock_guard<std::mutex> scoped_lock(pi_mutex);
     packet_in.emplace_back(port_id, fd, pkt);
   }
+  packet_in_depth->add(1);
 
   VLOG(2) << __FUNCTION__ << ": got pkt " << pkt << " for fd=" << fd;
   thread.wakeup(this);
@@ -532,6 +1087,7 @@ int cnetlink::handle_source_mac_learn() {
        cnt++) {
     auto p = _packet_in.front();
     int ifindex = tap_man->get_ifindex(p.port_id);
+    bool answered = false;
 
     if (ifindex && bridge) {
       rtnl_link *br_link = get_link(ifindex, AF_BRIDGE);
@@ -541,14 +1097,21 @@ int cnetlink::handle_source_mac_learn() {
       if (br_link) {
         // learn the source mac
         bridge->learn_source_mac(br_link, p.pkt);
+
+        // resolved neighbours are answered instead of flooded by the bridge
+        if (neigh_proxy)
+          answered = neigh_proxy->answer(br_link, p.port_id, p.pkt);
       }
     }
 
-    VLOG(2) << __FUNCTION__ << ": send pkt " << p.pkt
-            << " to tap on fd=" << p.fd;
-    // pass process packets to tap_man
-    tap_man->enqueue(p.fd, p.pkt);
+    if (!answered) {
+      VLOG(2) << __FUNCTION__ << ": send pkt " << p.pkt
+              << " to tap on fd=" << p.fd;
+      // pass process packets to tap_man
+      tap_man->enqueue(p.fd, p.pkt);
+    }
     _packet_in.pop_front();
+    packet_in_depth->add(-1);
   }
 
   int size = _packet_in.size();
@@ -569,6 +1132,7 @@ void cnetlink::fdb_timeout(uint32_t port_id, uint16_t vid,
     std::lock_guard<std::mutex> scoped_lock(fdb_ev_mutex);
     fdb_evts.emplace_back(port_id, vid, mac);
   }
+  fdb_evts_depth->add(1);
 
   VLOG(2) << __FUNCTION__ << ": got port_id=" << port_id << ", vid=" << vid
           << ", mac=" << mac;
@@ -578,25 +1142,32 @@ void cnetlink::fdb_timeout(uint32_t port_id, uint16_t vid,
 
 int cnetlink::handle_fdb_timeout() {
   std::deque<fdb_ev> _fdb_evts;
+  std::map<uint32_t, std::vector<std::pair<uint16_t, rofl::caddress_ll>>>
+      aged; // by port_id
 
   {
     std::lock_guard<std::mutex> scoped_lock(fdb_ev_mutex);
     _fdb_evts.swap(fdb_evts);
   }
 
-  for (int cnt = 0; cnt < nl_proc_max && _fdb_evts.size() && bridge &&
-                    state == NL_STATE_RUNNING;
+  // coalesce the expirations per port, they often age out together
+  for (unsigned cnt = 0; cnt < fdb_batch_max && _fdb_evts.size() && bridge &&
+                         state == NL_STATE_RUNNING;
        cnt++) {
+    auto &fdbev = _fdb_evts.front();
+    aged[fdbev.port_id].emplace_back(fdbev.vid, fdbev.mac);
+    _fdb_evts.pop_front();
+  }
 
-    auto fdbev = _fdb_evts.front();
-    int ifindex = tap_man->get_ifindex(fdbev.port_id);
+  for (auto &port : aged) {
+    int ifindex = tap_man->get_ifindex(port.first);
     rtnl_link *br_link = get_link(ifindex, AF_BRIDGE);
 
-    if (br_link && bridge) {
-      bridge->fdb_timeout(br_link, fdbev.vid, fdbev.mac);
+    if (br_link) {
+      bridge->fdb_timeout(br_link, port.second);
     }
 
-    _fdb_evts.pop_front();
+    fdb_evts_depth->add(-static_cast<int64_t>(port.second.size()));
   }
 
   int size = _fdb_evts.size();
@@ -676,6 +1247,21 @@ void cnetlink::route_addr_apply(const nl_obj &obj) {
   }
 }
 
+void cnetlink::invalidate_link_descs(int action, nl_object *old_obj,
+                                     nl_object *new_obj) noexcept {
+  // a new or deleted link changes the ports of the links on top of it, a
+  // changed link those of its slaves and upper links
+  if (action != NL_ACT_CHANGE || !old_obj || !new_obj) {
+    link_descs.clear();
+    return;
+  }
+
+  link_descs.invalidate(rtnl_link_get_ifindex(LINK_CAST(old_obj)));
+  // a bond takes its port from its slaves, the slave may have moved
+  link_descs.invalidate(rtnl_link_get_master(LINK_CAST(old_obj)));
+  link_descs.invalidate(rtnl_link_get_master(LINK_CAST(new_obj)));
+}
+
 void cnetlink::route_link_apply(const nl_obj &obj) {
   try {
     switch (obj.get_action()) {
@@ -685,6 +1271,14 @@ void cnetlink::route_link_apply(const nl_obj &obj) {
       VLOG(2) << __FUNCTION__ << ": new link " << obj.get_new_obj();
 
       link_created(LINK_CAST(obj.get_new_obj()));
+
+      // pick up the neighbours previously dropped on this interface
+      if (ingest_filter->neighbours_on_ports() &&
+          is_switch_interface(
+              rtnl_link_get_ifindex(LINK_CAST(obj.get_new_obj())))) {
+        resync_pending[NL_NEIGH_CACHE] = true;
+        schedule_resync();
+      }
       break;
 
     case NL_ACT_CHANGE:
@@ -711,6 +1305,9 @@ void cnetlink::route_link_apply(const nl_obj &obj) {
       break;
     }
 
+    // taps and lags were registered or removed
+    invalidate_link_descs(obj.get_action(), obj.get_old_obj(),
+                          obj.get_new_obj());
   } catch (std::exception &e) { // XXX likely can be dropped now
     LOG(FATAL) << __FUNCTION__ << ": oops unknown exception " << e.what();
   }
@@ -972,10 +1569,28 @@ void cnetlink::link_updated(rtnl_link *old_link, rtnl_link *new_link) noexcept {
                 << rtnl_link_get_name(new_link);
       rtnl_link *_bond = get_link(rtnl_link_get_master(new_link), AF_UNSPEC);
       bond->add_lag_member(_bond, new_link);
+      link_descs.invalidate(rtnl_link_get_master(new_link));
       break;
     }
     iface->changed(old_link, new_link);
     break;
+  case LT_BOND_SLAVE: {
+    rtnl_link *_bond = get_link(rtnl_link_get_master(old_link), AF_UNSPEC);
+    if (_bond == nullptr) {
+      LOG(WARNING) << __FUNCTION__ << ": no bond of slave "
+                   << OBJ_CAST(old_link);
+      break;
+    }
+
+    if (lt_new == LT_BOND_SLAVE &&
+        rtnl_link_get_master(old_link) == rtnl_link_get_master(new_link))
+      break;
+
+    LOG(INFO) << __FUNCTION__ << ": link released "
+              << rtnl_link_get_name(new_link);
+    bond->remove_lag_member(_bond, old_link);
+    link_descs.invalidate(rtnl_link_get_ifindex(_bond));
+  } break;
   case LT_VLAN:
   case LT_BOND:
   case LT_BRIDGE:
@@ -1157,6 +1772,8 @@ void cnetlink::register_switch(switch_interface *swi) noexcept {
   vlan->register_switch_interface(swi);
   bond->register_switch_interface(swi);
   vxlan->register_switch_interface(swi);
+  if (neigh_proxy)
+    neigh_proxy->register_switch_interface(swi);
 
   swi->subscribe_to(switch_interface::SWIF_ARP);
 }
@@ -1190,6 +1807,7 @@ void cnetlink::port_status_changed(uint32_t port_no,
     auto pps = std::make_tuple(port_no, ps, 0);
     std::lock_guard<std::mutex> scoped_lock(pc_mutex);
     port_status_changes.push_back(pps);
+    port_status_depth->add(1);
   } catch (std::exception &e) {
     LOG(ERROR) << __FUNCTION__ << ": unknown exception " << e.what();
     return;
@@ -1205,6 +1823,7 @@ int cnetlink::handle_port_status_events() {
     std::lock_guard<std::mutex> scoped_lock(pc_mutex);
     _pc_changes.swap(port_status_changes);
   }
+  port_status_depth->add(-(int64_t)_pc_changes.size());
 
   for (auto change : _pc_changes) {
     int ifindex;
@@ -1232,11 +1851,28 @@ int cnetlink::handle_port_status_events() {
       }
       continue;
     }
+
+    rtnl_link *link = get_link(ifindex, AF_UNSPEC);
+    if (link == nullptr) {
+      VLOG(1) << __FUNCTION__ << ": no link of ifindex=" << ifindex;
+      continue;
+    }
+
+    // stop forwarding to a failed bridge port, the kernel does not age
+    // out the entries baseboxd learned on it
+    if ((std::get<1>(change) & nbi::PORT_STATUS_LOWER_DOWN) && bridge &&
+        get_link(ifindex, AF_BRIDGE))
+      bridge->flush_fdb(ifindex, 0);
+
+    // the kernel follows the switch port, bonds update their slaves
+    tap_man->set_carrier(
+        link, !(std::get<1>(change) & nbi::PORT_STATUS_LOWER_DOWN));
   }
 
   int size = _pc_retry.size();
   if (size) {
     VLOG(3) << __FUNCTION__ << ": " << size << " changes not processed";
+    port_status_depth->add(size);
     std::lock_guard<std::mutex> scoped_lock(pc_mutex);
     std::copy(make_move_iterator(_pc_retry.begin()),
               make_move_iterator(_pc_retry.end()),
@@ -4,24 +4,34 @@
 
 #pragma once
 
+#include <chrono>
 #include <deque>
 #include <memory>
 #include <mutex>
 #include <tuple>
+#include <vector>
 
 #include <netlink/cache.h>
 #include <rofl/common/cthread.hpp>
 
 #include "nl_bridge.h"
+#include "nl_event_queue.h"
+#include "nl_id_pool.h"
+#include "nl_link_desc.h"
 #include "nl_obj.h"
 #include "sai.h"
 
 namespace basebox {
 
 // forward declaration
+class metric_gauge;
 class nl_bond;
+class nl_fast_path;
+class nl_ingest_filter;
 class nl_interface;
 class nl_l3;
+class nl_neigh_proxy;
+class nl_recorder;
 class nl_vlan;
 class nl_vxlan;
 class tap_manager;
@@ -59,8 +69,26 @@ public:
   int get_port_id(rtnl_link *l) const;
   int get_port_id(int ifindex) const;
 
+  /**
+   * copies the cached attributes of a link to desc
+   *
+   * @returns 0 on success, -ENODEV if the link does not exist
+   */
+  int get_link_desc(int ifindex, nl_link_desc *desc) const noexcept;
+
+  /**
+   * @returns true if the interface is a switch port, a bond of switch ports,
+   * the bridge or a vlan on top of one of them
+   */
+  bool is_switch_interface(int ifindex) const noexcept;
+
   nl_cache *get_cache(enum nl_cache_t id) { return caches[id]; }
 
+  // ids of switch objects, persisted for warm restarts
+  nl_id_pool &get_id_pool(enum nl_id_pools::nl_id_pool_t id) noexcept {
+    return id_pools.get(id);
+  }
+
   void resend_state() noexcept;
 
   void register_switch(switch_interface *) noexcept;
@@ -74,9 +102,23 @@ public:
                        struct nl_object *new_obj, uint64_t diff, int action,
                        void *data);
 
+  static int nl_overrun_cb(struct nl_msg *msg, void *arg);
+  static int nl_msg_in_cb(struct nl_msg *msg, void *arg);
+
   void set_tapmanager(std::shared_ptr<tap_manager> tm);
 
   int send_nl_msg(nl_msg *msg);
+
+  /**
+   * send all requests in as few writes as possible and wait for their acks,
+   * the messages are freed
+   *
+   * @returns the number of failed requests or a negative error
+   */
+  int send_nl_msgs(const std::vector<nl_msg *> &msgs);
+
+  // netlink port id of the monitor socket, replays are sent to it
+  uint32_t get_monitor_port() const noexcept;
   void learn_l2(uint32_t port_id, int fd, packet *pkt);
 
   void fdb_timeout(uint32_t port_id, uint16_t vid,
@@ -90,6 +132,8 @@ private:
   enum timer {
     NL_TIMER_RESEND_STATE,
     NL_TIMER_RESYNC,
+    NL_TIMER_STATE_SNAPSHOT,
+    NL_TIMER_WARM_RESTART,
   };
 
   enum nl_state {
@@ -112,7 +156,28 @@ private:
 
   int nl_proc_max;
   enum nl_state state;
-  std::deque<nl_obj> nl_objs;
+  nl_event_queue nl_objs;
+  std::unique_ptr<nl_fast_path> fast_path; // nullptr if disabled
+  std::unique_ptr<nl_ingest_filter> ingest_filter;
+  std::unique_ptr<nl_recorder> recorder;        // nullptr if disabled
+  std::unique_ptr<nl_neigh_proxy> neigh_proxy; // nullptr if disabled
+
+  // derived from the link cache, only used by the netlink thread
+  mutable nl_link_desc_cache link_descs;
+
+  // monitor socket overruns
+  std::vector<bool> resync_pending;
+  bool resync_scheduled;
+  nl_id_pools id_pools;
+  bool ids_reserved; // ids of a previous instance not yet dropped
+  unsigned overruns;
+  unsigned window_overruns; // overruns in the current measurement window
+  std::chrono::steady_clock::time_point window_start;
+  const int overrun_window = 10;             // time in seconds
+  const unsigned overrun_grow_threshold = 2; // overruns per window
+  const long resync_delay = 100;             // time in milliseconds
+  const unsigned fdb_batch_max = 1024;       // aged entries per iteration
+  const unsigned nl_batch_max = 64;          // requests per write
 
   std::shared_ptr<tap_manager> tap_man;
   nl_bridge *bridge;
@@ -144,6 +209,13 @@ private:
   std::mutex fdb_ev_mutex;
   std::deque<fdb_ev> fdb_evts;
 
+  // exported queue depths and cache sizes
+  metric_gauge *class_depth[nl_event_queue::NL_MAX_EVENT_CLASS];
+  metric_gauge *cache_objects[NL_MAX_CACHE];
+  metric_gauge *packet_in_depth;
+  metric_gauge *fdb_evts_depth;
+  metric_gauge *port_status_depth;
+
   int handle_port_status_events();
   int handle_source_mac_learn();
   int handle_fdb_timeout();
@@ -161,10 +233,20 @@ private:
   int load_from_file(const std::string &path);
 
   void init_caches();
+  void init_metrics();
+  void invalidate_link_descs(int action, nl_object *old_obj,
+                             nl_object *new_obj) noexcept;
   void init_subsystems() noexcept;
   void shutdown_subsystems() noexcept;
 
   int set_nl_socket_buffer_sizes(nl_sock *sk);
+  bool accept_object(enum nl_cache_t id, nl_object *obj) const noexcept;
+  void prune_cache(enum nl_cache_t id) noexcept;
+
+  void handle_overrun() noexcept;
+  void schedule_resync() noexcept;
+  int resync_cache(enum nl_cache_t id) noexcept;
+  void grow_rx_buffer() noexcept;
 
   void destroy_caches();
 
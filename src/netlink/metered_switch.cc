@@ -0,0 +1,461 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <string>
+
+#include <glog/logging.h>
+
+#include "metered_switch.h"
+#include "utils/metrics.h"
+
+namespace basebox {
+
+// counters of a single operation, created on its first call
+class call_metrics final {
+public:
+  explicit call_metrics(const char *call)
+      : call(call), calls(metrics_registry::get().counter(
+                        "baseboxd_switch_calls_total",
+                        "Calls of switch operations", {{"call", call}})) {}
+
+  int done(int rv) noexcept {
+    calls.add();
+    if (rv < 0)
+      failed(rv);
+    return rv;
+  }
+
+private:
+  const char *call;
+  metric_counter &calls;
+
+  void failed(int rv) noexcept {
+    try {
+      // errors are rare, look up the counter of the error code on demand
+      metrics_registry::get()
+          .counter("baseboxd_switch_call_errors_total",
+                   "Failed calls of switch operations by errno",
+                   {{"call", call}, {"errno", std::to_string(-rv)}})
+          .add();
+    } catch (std::exception &e) {
+      LOG(ERROR) << __FUNCTION__ << ": caught " << e.what();
+    }
+  }
+};
+
+int metered_switch::lag_create(uint32_t *lag_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->lag_create(lag_id));
+}
+
+int metered_switch::lag_remove(uint32_t lag_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->lag_remove(lag_id));
+}
+
+int metered_switch::lag_add_member(uint32_t lag_id, uint32_t port_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->lag_add_member(lag_id, port_id));
+}
+
+int metered_switch::lag_remove_member(uint32_t lag_id,
+                                      uint32_t port_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->lag_remove_member(lag_id, port_id));
+}
+
+int metered_switch::overlay_tunnel_add(uint32_t tunnel_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->overlay_tunnel_add(tunnel_id));
+}
+
+int metered_switch::overlay_tunnel_remove(uint32_t tunnel_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->overlay_tunnel_remove(tunnel_id));
+}
+
+int metered_switch::l2_addr_remove_all_in_vlan(uint32_t port,
+                                               uint16_t vid) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l2_addr_remove_all_in_vlan(port, vid));
+}
+
+int metered_switch::l2_addr_flush(uint32_t port, uint16_t vid) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l2_addr_flush(port, vid));
+}
+
+int metered_switch::l2_addr_add(uint32_t port, uint16_t vid,
+                                const rofl::caddress_ll &mac, bool filtered,
+                                bool permanent) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l2_addr_add(port, vid, mac, filtered, permanent));
+}
+
+int metered_switch::l2_addr_remove(uint32_t port, uint16_t vid,
+                                   const rofl::caddress_ll &mac) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l2_addr_remove(port, vid, mac));
+}
+
+int metered_switch::l2_overlay_addr_add(uint32_t lport, uint32_t tunnel_id,
+                                        const rofl::cmacaddr &mac,
+                                        bool permanent) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l2_overlay_addr_add(lport, tunnel_id, mac, permanent));
+}
+
+int metered_switch::l2_overlay_addr_remove(uint32_t tunnel_id,
+                                           uint32_t lport_id,
+                                           const rofl::cmacaddr &mac) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l2_overlay_addr_remove(tunnel_id, lport_id, mac));
+}
+
+int metered_switch::l3_termination_add(uint32_t sport, uint16_t vid,
+                                       const rofl::caddress_ll &dmac) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_termination_add(sport, vid, dmac));
+}
+
+int
+metered_switch::l3_termination_add_v6(uint32_t sport, uint16_t vid,
+                                      const rofl::caddress_ll &dmac) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_termination_add_v6(sport, vid, dmac));
+}
+
+int
+metered_switch::l3_termination_remove(uint32_t sport, uint16_t vid,
+                                      const rofl::caddress_ll &dmac) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_termination_remove(sport, vid, dmac));
+}
+
+int metered_switch::l3_termination_remove_v6(
+    uint32_t sport, uint16_t vid, const rofl::caddress_ll &dmac) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_termination_remove_v6(sport, vid, dmac));
+}
+
+int metered_switch::l3_egress_create(uint32_t port, uint16_t vid,
+                                     const rofl::caddress_ll &src_mac,
+                                     const rofl::caddress_ll &dst_mac,
+                                     uint32_t *l3_interface) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_egress_create(port, vid, src_mac, dst_mac,
+                                      l3_interface));
+}
+
+int metered_switch::l3_egress_update(uint32_t port, uint16_t vid,
+                                     const rofl::caddress_ll &src_mac,
+                                     const rofl::caddress_ll &dst_mac,
+                                     uint32_t *l3_interface_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_egress_update(port, vid, src_mac, dst_mac,
+                                      l3_interface_id));
+}
+
+int metered_switch::l3_egress_remove(uint32_t l3_interface) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_egress_remove(l3_interface));
+}
+
+int metered_switch::l3_unicast_host_add(const rofl::caddress_in4 &ipv4_dst,
+                                        uint32_t l3_interface, bool is_ecmp,
+                                        bool update_route) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_unicast_host_add(ipv4_dst, l3_interface, is_ecmp,
+                                         update_route));
+}
+
+int metered_switch::l3_unicast_host_remove(
+    const rofl::caddress_in4 &ipv4_dst) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_unicast_host_remove(ipv4_dst));
+}
+
+int metered_switch::l3_unicast_host_add(const rofl::caddress_in6 &ipv6_dst,
+                                        uint32_t l3_interface, bool is_ecmp,
+                                        bool update_route) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_unicast_host_add(ipv6_dst, l3_interface, is_ecmp,
+                                         update_route));
+}
+
+int metered_switch::l3_unicast_host_remove(
+    const rofl::caddress_in6 &ipv6_dst) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_unicast_host_remove(ipv6_dst));
+}
+
+int metered_switch::l3_unicast_route_add(const rofl::caddress_in4 &ipv4_dst,
+                                         const rofl::caddress_in4 &mask,
+                                         uint32_t l3_interface, bool is_ecmp,
+                                         bool update_route) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_unicast_route_add(ipv4_dst, mask, l3_interface, is_ecmp,
+                                          update_route));
+}
+
+int metered_switch::l3_unicast_route_remove(
+    const rofl::caddress_in4 &ipv4_dst,
+    const rofl::caddress_in4 &mask) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_unicast_route_remove(ipv4_dst, mask));
+}
+
+int metered_switch::l3_unicast_route_add(const rofl::caddress_in6 &ipv6_dst,
+                                         const rofl::caddress_in6 &mask,
+                                         uint32_t l3_interface, bool is_ecmp,
+                                         bool update_route) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_unicast_route_add(ipv6_dst, mask, l3_interface, is_ecmp,
+                                          update_route));
+}
+
+int metered_switch::l3_unicast_route_remove(
+    const rofl::caddress_in6 &ipv6_dst,
+    const rofl::caddress_in6 &mask) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_unicast_route_remove(ipv6_dst, mask));
+}
+
+int
+metered_switch::l3_ecmp_add(uint32_t l3_ecmp_id,
+                            const std::set<uint32_t> &l3_interfaces) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_ecmp_add(l3_ecmp_id, l3_interfaces));
+}
+
+int metered_switch::l3_ecmp_remove(uint32_t l3_ecmp_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->l3_ecmp_remove(l3_ecmp_id));
+}
+
+int metered_switch::ingress_port_vlan_accept_all(uint32_t port) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->ingress_port_vlan_accept_all(port));
+}
+
+int metered_switch::ingress_port_vlan_drop_accept_all(uint32_t port) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->ingress_port_vlan_drop_accept_all(port));
+}
+
+int metered_switch::ingress_port_vlan_add(uint32_t port, uint16_t vid,
+                                          bool pvid) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->ingress_port_vlan_add(port, vid, pvid));
+}
+
+int metered_switch::ingress_port_vlan_remove(uint32_t port, uint16_t vid,
+                                             bool pvid) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->ingress_port_vlan_remove(port, vid, pvid));
+}
+
+int metered_switch::egress_port_vlan_accept_all(uint32_t port) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->egress_port_vlan_accept_all(port));
+}
+
+int metered_switch::egress_port_vlan_drop_accept_all(uint32_t port) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->egress_port_vlan_drop_accept_all(port));
+}
+
+int metered_switch::egress_port_vlan_add(uint32_t port, uint16_t vid,
+                                         bool untagged) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->egress_port_vlan_add(port, vid, untagged));
+}
+
+int metered_switch::egress_port_vlan_remove(uint32_t port,
+                                            uint16_t vid) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->egress_port_vlan_remove(port, vid));
+}
+
+int metered_switch::add_l2_overlay_flood(uint32_t tunnel_id,
+                                         uint32_t lport_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->add_l2_overlay_flood(tunnel_id, lport_id));
+}
+
+int metered_switch::del_l2_overlay_flood(uint32_t tunnel_id,
+                                         uint32_t lport_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->del_l2_overlay_flood(tunnel_id, lport_id));
+}
+
+int metered_switch::egress_bridge_port_vlan_add(uint32_t port, uint16_t vid,
+                                                bool untagged) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->egress_bridge_port_vlan_add(port, vid, untagged));
+}
+
+int metered_switch::egress_bridge_port_vlan_remove(uint32_t port,
+                                                   uint16_t vid) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->egress_bridge_port_vlan_remove(port, vid));
+}
+
+int metered_switch::ingress_port_vlan_range_add(uint32_t port,
+                                                uint16_t vid_start,
+                                                uint16_t vid_end,
+                                                uint16_t pvid) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->ingress_port_vlan_range_add(port, vid_start, vid_end,
+                                                 pvid));
+}
+
+int metered_switch::ingress_port_vlan_range_remove(uint32_t port,
+                                                   uint16_t vid_start,
+                                                   uint16_t vid_end,
+                                                   uint16_t pvid) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->ingress_port_vlan_range_remove(port, vid_start, vid_end,
+                                                    pvid));
+}
+
+int metered_switch::egress_bridge_port_vlan_range_add(uint32_t port,
+                                                      uint16_t vid_start,
+                                                      uint16_t vid_end,
+                                                      bool untagged) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->egress_bridge_port_vlan_range_add(port, vid_start, vid_end,
+                                                       untagged));
+}
+
+int metered_switch::egress_bridge_port_vlan_range_remove(
+    uint32_t port, uint16_t vid_start, uint16_t vid_end) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->egress_bridge_port_vlan_range_remove(port, vid_start,
+                                                          vid_end));
+}
+
+int metered_switch::enqueue(uint32_t port_id, basebox::packet *pkt) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->enqueue(port_id, pkt));
+}
+
+int metered_switch::subscribe_to(enum swi_flags flags) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->subscribe_to(flags));
+}
+
+bool metered_switch::is_connected() noexcept {
+  return swi->is_connected();
+}
+
+int metered_switch::get_statistics(uint64_t port_no,
+                                   uint32_t number_of_counters,
+                                   const sai_port_stat_t *counter_ids,
+                                   uint64_t *counters) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->get_statistics(port_no, number_of_counters, counter_ids,
+                                    counters));
+}
+
+int metered_switch::tunnel_tenant_create(uint32_t tunnel_id,
+                                         uint32_t vni) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->tunnel_tenant_create(tunnel_id, vni));
+}
+
+int metered_switch::tunnel_tenant_delete(uint32_t tunnel_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->tunnel_tenant_delete(tunnel_id));
+}
+
+int metered_switch::tunnel_next_hop_create(uint32_t next_hop_id,
+                                           uint64_t src_mac, uint64_t dst_mac,
+                                           uint32_t physical_port,
+                                           uint16_t vlan_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->tunnel_next_hop_create(next_hop_id, src_mac, dst_mac,
+                                            physical_port, vlan_id));
+}
+
+int metered_switch::tunnel_next_hop_modify(uint32_t next_hop_id,
+                                           uint64_t src_mac, uint64_t dst_mac,
+                                           uint32_t physical_port,
+                                           uint16_t vlan_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->tunnel_next_hop_modify(next_hop_id, src_mac, dst_mac,
+                                            physical_port, vlan_id));
+}
+
+int metered_switch::tunnel_next_hop_delete(uint32_t next_hop_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->tunnel_next_hop_delete(next_hop_id));
+}
+
+int metered_switch::tunnel_next_hop_group_create(uint32_t group_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->tunnel_next_hop_group_create(group_id));
+}
+
+int metered_switch::tunnel_next_hop_group_delete(uint32_t group_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->tunnel_next_hop_group_delete(group_id));
+}
+
+int metered_switch::tunnel_next_hop_group_member_add(
+    uint32_t group_id, uint32_t next_hop_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->tunnel_next_hop_group_member_add(group_id, next_hop_id));
+}
+
+int metered_switch::tunnel_next_hop_group_member_remove(
+    uint32_t group_id, uint32_t next_hop_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(
+      swi->tunnel_next_hop_group_member_remove(group_id, next_hop_id));
+}
+
+int metered_switch::tunnel_access_port_create(uint32_t port_id,
+                                              const std::string &port_name,
+                                              uint32_t physical_port,
+                                              uint16_t vlan_id,
+                                              bool untagged) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->tunnel_access_port_create(port_id, port_name,
+                                               physical_port, vlan_id,
+                                               untagged));
+}
+
+int metered_switch::tunnel_enpoint_create(
+    uint32_t port_id, const std::string &port_name, uint32_t remote_ipv4,
+    uint32_t local_ipv4, uint32_t ttl, uint32_t next_hop_id, bool ecmp,
+    uint32_t terminator_udp_dst_port, uint32_t initiator_udp_dst_port,
+    uint32_t udp_src_port_if_no_entropy, bool use_entropy) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->tunnel_enpoint_create(port_id, port_name, remote_ipv4,
+                                           local_ipv4, ttl, next_hop_id, ecmp,
+                                           terminator_udp_dst_port,
+                                           initiator_udp_dst_port,
+                                           udp_src_port_if_no_entropy,
+                                           use_entropy));
+}
+
+int metered_switch::tunnel_port_delete(uint32_t port_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->tunnel_port_delete(port_id));
+}
+
+int metered_switch::tunnel_port_tenant_add(uint32_t port_id,
+                                           uint32_t tunnel_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->tunnel_port_tenant_add(port_id, tunnel_id));
+}
+
+int metered_switch::tunnel_port_tenant_remove(uint32_t port_id,
+                                              uint32_t tunnel_id) noexcept {
+  static call_metrics m(__FUNCTION__);
+  return m.done(swi->tunnel_port_tenant_remove(port_id, tunnel_id));
+}
+
+} // namespace basebox
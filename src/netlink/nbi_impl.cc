@@ -5,6 +5,7 @@
 #include <glog/logging.h>
 
 #include "cnetlink.h"
+#include "metered_switch.h"
 #include "nbi_impl.h"
 #include "tap_manager.h"
 
@@ -24,8 +25,10 @@ nbi_impl::~nbi_impl() { nl->stop(); }
 void nbi_impl::resend_state() noexcept { nl->resend_state(); }
 
 void nbi_impl::register_switch(switch_interface *swi) noexcept {
-  this->swi = swi;
-  nl->register_switch(swi);
+  // count the operations of the netlink subsystems
+  metered.reset(new metered_switch(swi));
+  this->swi = metered.get();
+  nl->register_switch(this->swi);
 }
 
 void nbi_impl::switch_state_notification(enum switch_state state) noexcept {
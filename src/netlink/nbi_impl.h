@@ -12,10 +12,12 @@
 namespace basebox {
 
 class cnetlink;
+class metered_switch;
 class tap_manager;
 
 class nbi_impl : public nbi, public switch_callback {
   switch_interface *swi;
+  std::unique_ptr<metered_switch> metered;
   std::shared_ptr<cnetlink> nl;
   std::shared_ptr<tap_manager> tap_man;
 
@@ -156,7 +156,7 @@ int nl_bond::remove_lag_member(rtnl_link *bond, rtnl_link *link) {
   }
 
   auto lm_rv = lag_members.find(it->second);
-  if (lm_rv == lag_members.end()) {
+  if (lm_rv == lag_members.end() || lm_rv->second != port_id) {
     VLOG(1) << __FUNCTION__ << ": ignore invalid attached port "
             << OBJ_CAST(link);
     return -EINVAL;
@@ -2,11 +2,13 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <map>
 #include <utility>
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <netlink/route/link.h>
 #include <netlink/route/link/vxlan.h>
@@ -20,15 +22,48 @@
 #include "nl_vxlan.h"
 #include "sai.h"
 #include "tap_manager.h"
+#include "utils/metrics.h"
+
+DEFINE_int32(mac_learn_limit_port, 0,
+             "Maximum number of macs learned on a bridge port, 0 for no "
+             "limit");
+DEFINE_int32(mac_learn_limit_vlan, 0,
+             "Maximum number of macs learned in a vlan, 0 for no limit");
+DEFINE_int32(mac_learn_rate, 0,
+             "Maximum number of macs learned per second, 0 for no limit");
+DEFINE_int32(mac_learn_burst, 100,
+             "Number of macs learned at once above mac_learn_rate");
 
 namespace basebox {
 
+static uint64_t mac_key(const uint8_t *mac) {
+  uint64_t key = 0;
+
+  for (int i = 0; i < ETH_ALEN; i++)
+    key = key << 8 | mac[i];
+
+  return key;
+}
+
+static metric_counter &rejected_counter(const char *reason) {
+  return metrics_registry::get().counter(
+      "baseboxd_mac_learn_rejected_total",
+      "Source macs not learned because of a learning limit",
+      {{"reason", reason}});
+}
+
 nl_bridge::nl_bridge(switch_interface *sw, std::shared_ptr<tap_manager> tap_man,
                      cnetlink *nl, std::shared_ptr<nl_vxlan> vxlan)
     : bridge(nullptr), sw(sw), tap_man(std::move(tap_man)), nl(nl),
       vxlan(std::move(vxlan)),
       l2_cache(nl_cache_alloc(nl_cache_ops_lookup("route/neigh")),
-               nl_cache_free) {
+               nl_cache_free),
+      stations_aged(std::chrono::steady_clock::now()),
+      learn_tokens(FLAGS_mac_learn_burst),
+      learn_refill(std::chrono::steady_clock::now()),
+      rejected_port_limit(rejected_counter("port_limit")),
+      rejected_vlan_limit(rejected_counter("vlan_limit")),
+      rejected_rate(rejected_counter("rate")) {
   memset(&empty_br_vlan, 0, sizeof(rtnl_link_bridge_vlan));
   memset(&vxlan_dom_bitmap, 0, sizeof(vxlan_dom_bitmap));
 }
@@ -222,6 +257,52 @@ void nl_bridge::update_vlans(rtnl_link *old_link, rtnl_link *new_link) {
     }
   }
 
+  // runs of contiguous vids on a normal bridge port are programmed at once
+  int run_start = -1;
+  int run_end = -1;
+  bool run_add = false;
+  bool run_untagged = false;
+
+  auto flush_run = [&]() {
+    if (run_start < 0)
+      return;
+
+    VLOG(3) << __FUNCTION__ << ": " << (run_add ? "add" : "remove")
+            << " vids=" << run_start << "-" << run_end
+            << " on pport_no=" << pport_no << " link: " << OBJ_CAST(_link);
+
+    if (run_add) {
+      sw->egress_bridge_port_vlan_range_add(pport_no, run_start, run_end,
+                                            run_untagged);
+      sw->ingress_port_vlan_range_add(pport_no, run_start, run_end,
+                                      new_br_vlan->pvid);
+    } else {
+      sw->ingress_port_vlan_range_remove(pport_no, run_start, run_end,
+                                         old_br_vlan->pvid);
+
+      // delete all FM pointing to these groups first
+      for (int vid = run_start; vid <= run_end; vid++)
+        flush_fdb(rtnl_link_get_ifindex(_link), vid);
+
+      sw->egress_bridge_port_vlan_range_remove(pport_no, run_start, run_end);
+    }
+
+    run_start = -1;
+  };
+
+  auto extend_run = [&](int vid, bool add, bool untagged) {
+    if (run_start >= 0 &&
+        (run_add != add || run_untagged != untagged || run_end + 1 != vid))
+      flush_run();
+
+    if (run_start < 0) {
+      run_start = vid;
+      run_add = add;
+      run_untagged = untagged;
+    }
+    run_end = vid;
+  };
+
   for (int k = 0; k < RTNL_LINK_BRIDGE_VLAN_BITMAP_LEN; k++) {
     int base_bit;
     uint32_t a = old_br_vlan->vlan_bitmap[k];
@@ -288,12 +369,7 @@ void nl_bridge::update_vlans(rtnl_link *old_link, rtnl_link *new_link) {
               }
             } else {
               // normal vlan port
-              VLOG(3) << __FUNCTION__ << ": add vid=" << vid
-                      << " on pport_no=" << pport_no
-                      << " link: " << OBJ_CAST(_link);
-              sw->egress_bridge_port_vlan_add(pport_no, vid, egress_untagged);
-              sw->ingress_port_vlan_add(pport_no, vid,
-                                        new_br_vlan->pvid == vid);
+              extend_run(vid, true, egress_untagged);
             }
           }
         } else {
@@ -306,33 +382,7 @@ void nl_bridge::update_vlans(rtnl_link *old_link, rtnl_link *new_link) {
             update_access_ports(_link, new_link ? new_link : old_link, vid,
                                 tunnel_id, bridge_ports, false);
           } else {
-            VLOG(3) << __FUNCTION__ << ": remove vid=" << vid
-                    << " on pport_no=" << pport_no
-                    << " link: " << OBJ_CAST(_link);
-            sw->ingress_port_vlan_remove(pport_no, vid,
-                                         old_br_vlan->pvid == vid);
-
-            // delete all FM pointing to this group first
-            sw->l2_addr_remove_all_in_vlan(pport_no, vid);
-
-            std::unique_ptr<rtnl_neigh, decltype(&rtnl_neigh_put)> filter(
-                rtnl_neigh_alloc(), rtnl_neigh_put);
-
-            rtnl_neigh_set_ifindex(filter.get(), rtnl_link_get_ifindex(bridge));
-            rtnl_neigh_set_master(filter.get(), rtnl_link_get_master(bridge));
-            rtnl_neigh_set_family(filter.get(), AF_BRIDGE);
-            rtnl_neigh_set_vlan(filter.get(), vid);
-            rtnl_neigh_set_flags(filter.get(), NTF_MASTER | NTF_EXT_LEARNED);
-            rtnl_neigh_set_state(filter.get(), NUD_REACHABLE);
-
-            nl_cache_foreach_filter(l2_cache.get(), OBJ_CAST(filter.get()),
-                                    [](struct nl_object *o, void *arg) {
-                                      VLOG(3) << "l2_cache remove object " << o;
-                                      nl_cache_remove(o);
-                                    },
-                                    nullptr);
-
-            sw->egress_bridge_port_vlan_remove(pport_no, vid);
+            extend_run(vid, false, false);
           }
         }
 
@@ -369,6 +419,8 @@ void nl_bridge::update_vlans(rtnl_link *old_link, rtnl_link *new_link) {
 		}
 #endif
   }
+
+  flush_run();
 }
 
 std::deque<rtnl_neigh *> nl_bridge::get_fdb_entries_of_port(rtnl_link *br_port,
@@ -564,9 +616,22 @@ void nl_bridge::remove_neigh_from_fdb(rtnl_neigh *neigh) {
       rtnl_neigh_put);
 
   if (n_lookup) {
+    index_learned(n_lookup.get(), false);
     nl_cache_remove(OBJ_CAST(n_lookup.get()));
   }
 
+  // forget the station unless it is held or has moved on
+  if (nl_addr_get_len(addr) == ETH_ALEN) {
+    auto it = stations.find(std::make_pair(
+        rtnl_neigh_get_vlan(neigh),
+        mac_key(static_cast<uint8_t *>(nl_addr_get_binary_addr(addr)))));
+
+    if (it != stations.end() &&
+        it->second.ifindex == rtnl_neigh_get_ifindex(neigh) &&
+        it->second.held_until <= std::chrono::steady_clock::now())
+      stations.erase(it);
+  }
+
   const uint32_t port = nl->get_port_id(rtnl_neigh_get_ifindex(neigh));
   rofl::caddress_ll mac((uint8_t *)nl_addr_get_binary_addr(addr),
                         nl_addr_get_len(addr));
@@ -654,14 +719,46 @@ int nl_bridge::learn_source_mac(rtnl_link *br_link, packet *p) {
     return 0;
   }
 
+  // held macs must not use up the learning budget
+  if (is_station_held(vid, hdr->eth.h_source))
+    return -EAGAIN;
+
+  int rv = check_learn_limits(
+      rtnl_link_get_ifindex(br_link), vid,
+      is_station_move(rtnl_link_get_ifindex(br_link), vid, hdr->eth.h_source));
+  if (rv < 0)
+    return rv;
+
+  int old_ifindex = 0;
+  rv = track_station(rtnl_link_get_ifindex(br_link), vid, hdr->eth.h_source,
+                     &old_ifindex);
+  if (rv < 0)
+    return rv;
+
+  if (old_ifindex) {
+    // the kernel moves the entry, only the stale cache entry is dropped
+    rtnl_neigh_set_ifindex(n.get(), old_ifindex);
+    std::unique_ptr<rtnl_neigh, decltype(&rtnl_neigh_put)> n_lookup(
+        NEIGH_CAST(nl_cache_search(l2_cache.get(), OBJ_CAST(n.get()))),
+        rtnl_neigh_put);
+    if (n_lookup) {
+      index_learned(n_lookup.get(), false);
+      nl_cache_remove(OBJ_CAST(n_lookup.get()));
+    }
+    rtnl_neigh_set_ifindex(n.get(), rtnl_link_get_ifindex(br_link));
+  }
+
   nl_msg *msg = nullptr;
-  rtnl_neigh_build_add_request(n.get(),
-                               NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL, &msg);
+  rtnl_neigh_build_add_request(
+      n.get(),
+      NLM_F_REQUEST | NLM_F_CREATE | (old_ifindex ? NLM_F_REPLACE : NLM_F_EXCL),
+      &msg);
   assert(msg);
 
   // send the message and create new fdb entry
   if (nl->send_nl_msg(msg) < 0) {
     LOG(ERROR) << __FUNCTION__ << ": failed to send netlink message";
+    untrack_station(vid, hdr->eth.h_source, old_ifindex);
     return -EINVAL;
   }
 
@@ -669,54 +766,364 @@ int nl_bridge::learn_source_mac(rtnl_link *br_link, packet *p) {
   if (nl_cache_add(l2_cache.get(), OBJ_CAST(n.get())) < 0) {
     LOG(ERROR) << __FUNCTION__ << ": failed to add entry to l2_cache "
                << OBJ_CAST(n.get());
+    untrack_station(vid, hdr->eth.h_source, old_ifindex);
     return -EINVAL;
   }
+  index_learned(n.get(), true);
 
   VLOG(2) << __FUNCTION__ << ": learned new source mac " << OBJ_CAST(n.get());
 
   return 0;
 }
 
-int nl_bridge::fdb_timeout(rtnl_link *br_link, uint16_t vid,
-                           const rofl::caddress_ll &mac) {
-  int rv = 0;
+bool nl_bridge::is_station_held(uint16_t vid, const uint8_t *mac) const {
+  auto it = stations.find(std::make_pair(vid, mac_key(mac)));
+
+  return it != stations.end() &&
+         std::chrono::steady_clock::now() < it->second.held_until;
+}
+
+// true if the mac is learned on another port of the same vlan
+bool nl_bridge::is_station_move(int ifindex, uint16_t vid,
+                                const uint8_t *mac) const {
+  auto it = stations.find(std::make_pair(vid, mac_key(mac)));
+  if (it == stations.end() || it->second.ifindex == ifindex)
+    return false;
+
+  auto l = learned.find(std::make_pair(it->second.ifindex, vid));
+  return l != learned.end() && l->second.count(mac_key(mac));
+}
+
+int nl_bridge::track_station(int ifindex, uint16_t vid, const uint8_t *mac,
+                             int *old_ifindex) {
+  auto now = std::chrono::steady_clock::now();
+  auto key = std::make_pair(vid, mac_key(mac));
+  auto it = stations.find(key);
+
+  if (it == stations.end()) {
+    if (now - stations_aged > mac_move_window)
+      age_stations(now);
+    stations.emplace(key, station{ifindex, 0, now, now});
+    return 0;
+  }
+
+  station &st = it->second;
+  if (st.ifindex == ifindex)
+    return 0;
+
+  if (now < st.held_until)
+    return -EAGAIN;
+
+  if (now - st.last_move > mac_move_window)
+    st.moves = 0;
+
+  st.moves++;
+  st.last_move = now;
+
+  if (st.moves > mac_move_threshold) {
+    // back off exponentially while the mac keeps moving
+    unsigned excess = std::min(st.moves - mac_move_threshold - 1, 8u);
+    auto hold = std::min(mac_hold_min * (1 << excess), mac_hold_max);
+
+    st.held_until = now + hold;
+    // moves right after the hold count as the same flap
+    st.last_move = st.held_until;
+
+    LOG(WARNING) << __FUNCTION__ << ": mac " << rofl::caddress_ll(mac, ETH_ALEN)
+                 << " in vid " << vid << " moved " << st.moves
+                 << " times, holding it on ifindex " << st.ifindex << " for "
+                 << hold.count() << "s";
+    return -EAGAIN;
+  }
+
+  VLOG(1) << __FUNCTION__ << ": mac " << rofl::caddress_ll(mac, ETH_ALEN)
+          << " in vid " << vid << " moved from ifindex " << st.ifindex
+          << " to " << ifindex;
+
+  *old_ifindex = st.ifindex;
+  st.ifindex = ifindex;
+
+  return 0;
+}
+
+// reverts track_station if the mac could not be learned
+void nl_bridge::untrack_station(uint16_t vid, const uint8_t *mac,
+                                int old_ifindex) {
+  auto it = stations.find(std::make_pair(vid, mac_key(mac)));
+  if (it == stations.end())
+    return;
+
+  if (old_ifindex)
+    it->second.ifindex = old_ifindex;
+  else if (it->second.held_until <= std::chrono::steady_clock::now())
+    stations.erase(it);
+}
+
+// drops the stations that are neither held nor learned anymore, e.g. those
+// whose entry was removed while they were held
+void nl_bridge::age_stations(std::chrono::steady_clock::time_point now) {
+  stations_aged = now;
+
+  for (auto it = stations.begin(); it != stations.end();) {
+    auto l = learned.find(std::make_pair(it->second.ifindex, it->first.first));
+
+    if (it->second.held_until <= now &&
+        (l == learned.end() || l->second.count(it->first.second) == 0))
+      it = stations.erase(it);
+    else
+      ++it;
+  }
+}
+
+// a move takes an entry from the old port, it does not add one to the vlan
+int nl_bridge::check_learn_limits(int ifindex, uint16_t vid, bool move) {
+  auto port = learned_per_port.find(ifindex);
+  auto vlan = learned_per_vlan.find(vid);
+
+  if (FLAGS_mac_learn_limit_port > 0 && port != learned_per_port.end() &&
+      port->second >= (unsigned)FLAGS_mac_learn_limit_port) {
+    VLOG(1) << __FUNCTION__ << ": learning limit of ifindex " << ifindex
+            << " reached";
+    rejected_port_limit.add();
+    return -ENOSPC;
+  }
+
+  if (move)
+    return 0;
+
+  if (FLAGS_mac_learn_limit_vlan > 0 && vlan != learned_per_vlan.end() &&
+      vlan->second >= (unsigned)FLAGS_mac_learn_limit_vlan) {
+    VLOG(1) << __FUNCTION__ << ": learning limit of vid " << vid
+            << " reached";
+    rejected_vlan_limit.add();
+    return -ENOSPC;
+  }
+
+  if (FLAGS_mac_learn_rate <= 0)
+    return 0;
+
+  // token bucket, refilled at mac_learn_rate up to mac_learn_burst
+  auto now = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed = now - learn_refill;
+
+  learn_refill = now;
+  learn_tokens =
+      std::min<double>(learn_tokens + elapsed.count() * FLAGS_mac_learn_rate,
+                       std::max(FLAGS_mac_learn_burst, 1));
+
+  if (learn_tokens < 1) {
+    VLOG(1) << __FUNCTION__ << ": learning rate exceeded";
+    rejected_rate.add();
+    return -EBUSY;
+  }
+
+  learn_tokens -= 1;
+  return 0;
+}
+
+void nl_bridge::index_learned(rtnl_neigh *n, bool add) {
+  int ifindex = rtnl_neigh_get_ifindex(n);
+  uint16_t vid = rtnl_neigh_get_vlan(n);
+  nl_addr *addr = rtnl_neigh_get_lladdr(n);
+
+  if (addr == nullptr || nl_addr_get_len(addr) != ETH_ALEN)
+    return;
+
+  uint64_t mac = mac_key(static_cast<uint8_t *>(nl_addr_get_binary_addr(addr)));
+  auto key = std::make_pair(ifindex, vid);
+
+  if (add) {
+    if (!learned[key].insert(mac).second)
+      return;
+
+    learned_per_port[ifindex]++;
+    learned_per_vlan[vid]++;
+    return;
+  }
+
+  auto it = learned.find(key);
+  if (it == learned.end() || it->second.erase(mac) == 0)
+    return;
+
+  if (it->second.empty())
+    learned.erase(it);
+  if (--learned_per_port[ifindex] == 0)
+    learned_per_port.erase(ifindex);
+  if (--learned_per_vlan[vid] == 0)
+    learned_per_vlan.erase(vid);
+}
+
+int nl_bridge::flush_fdb(int ifindex, uint16_t vid) {
+  uint32_t port = 0;
+
+  if (ifindex) {
+    port = nl->get_port_id(ifindex);
+    if (port == 0) {
+      VLOG(1) << __FUNCTION__ << ": no port of ifindex " << ifindex;
+      return -EINVAL;
+    }
+  }
+
+  int rv = sw->l2_addr_flush(port, vid);
+  if (rv < 0)
+    LOG(ERROR) << __FUNCTION__ << ": failed to flush port_id=" << port
+               << ", vid=" << vid;
+
+  // only the flushed entries are visited
+  std::vector<std::pair<std::pair<int, uint16_t>, std::set<uint64_t>>> flushed;
+  auto it = ifindex ? learned.lower_bound(std::make_pair(ifindex, 0))
+                    : learned.begin();
+  for (; it != learned.end() && (!ifindex || it->first.first == ifindex);
+       ++it) {
+    if (!vid || it->first.second == vid)
+      flushed.emplace_back(*it);
+  }
 
   std::unique_ptr<rtnl_neigh, decltype(&rtnl_neigh_put)> n(rtnl_neigh_alloc(),
                                                            rtnl_neigh_put);
+  rtnl_neigh_set_master(n.get(), rtnl_link_get_ifindex(bridge));
+  rtnl_neigh_set_family(n.get(), AF_BRIDGE);
+  rtnl_neigh_set_flags(n.get(), NTF_MASTER | NTF_EXT_LEARNED);
 
-  std::unique_ptr<nl_addr, decltype(&nl_addr_put)> h_src(
-      nl_addr_build(AF_LLC, mac.somem(), mac.memlen()), nl_addr_put);
+  // the kernel keeps externally learned entries, they are deleted as well
+  std::vector<nl_msg *> msgs;
+  for (auto &f : flushed) {
+    rtnl_neigh_set_ifindex(n.get(), f.first.first);
+    rtnl_neigh_set_vlan(n.get(), f.first.second);
+
+    for (auto mac : f.second) {
+      uint8_t lladdr[ETH_ALEN];
+      for (int i = ETH_ALEN - 1; i >= 0; i--, mac >>= 8)
+        lladdr[i] = mac & 0xff;
+
+      std::unique_ptr<nl_addr, decltype(&nl_addr_put)> h_src(
+          nl_addr_build(AF_LLC, lladdr, sizeof(lladdr)), nl_addr_put);
+      rtnl_neigh_set_lladdr(n.get(), h_src.get());
+
+      std::unique_ptr<rtnl_neigh, decltype(&rtnl_neigh_put)> n_lookup(
+          NEIGH_CAST(nl_cache_search(l2_cache.get(), OBJ_CAST(n.get()))),
+          rtnl_neigh_put);
+      if (n_lookup)
+        nl_cache_remove(OBJ_CAST(n_lookup.get()));
+
+      nl_msg *msg = nullptr;
+      rtnl_neigh_build_delete_request(n.get(), NLM_F_REQUEST, &msg);
+      assert(msg);
+      msgs.push_back(msg);
+
+      index_learned(n.get(), false);
+    }
+  }
+
+  VLOG(1) << __FUNCTION__ << ": flushed " << msgs.size()
+          << " learned entries of ifindex=" << ifindex << ", vid=" << vid;
+
+  if (!msgs.empty()) {
+    int failed = nl->send_nl_msgs(msgs);
+    if (failed != 0)
+      LOG(ERROR) << __FUNCTION__ << ": failed to delete fdb entries rv="
+                 << failed;
+  }
+
+  // the switch flushed the static entries of the port as well
+  if (ifindex && !vid)
+    restore_static_fdb(ifindex);
+
+  return rv;
+}
+
+void nl_bridge::restore_static_fdb(int ifindex) {
+  std::unique_ptr<rtnl_neigh, decltype(&rtnl_neigh_put)> filter(
+      rtnl_neigh_alloc(), rtnl_neigh_put);
+
+  rtnl_neigh_set_ifindex(filter.get(), ifindex);
+  rtnl_neigh_set_master(filter.get(), rtnl_link_get_ifindex(bridge));
+  rtnl_neigh_set_family(filter.get(), AF_BRIDGE);
+
+  std::deque<rtnl_neigh *> neighs;
+  nl_cache_foreach_filter(nl->get_cache(cnetlink::NL_NEIGH_CACHE),
+                          OBJ_CAST(filter.get()),
+                          [](struct nl_object *o, void *arg) {
+                            auto *neighs = (std::deque<rtnl_neigh *> *)arg;
+                            neighs->push_back(NEIGH_CAST(o));
+                          },
+                          &neighs);
+
+  for (auto neigh : neighs) {
+    if ((rtnl_neigh_get_flags(neigh) & NTF_EXT_LEARNED) ||
+        !(rtnl_neigh_get_state(neigh) & (NUD_PERMANENT | NUD_NOARP)))
+      continue;
+
+    // ignore ll addr of bridge on slave
+    if (nl_addr_cmp(rtnl_link_get_addr(bridge), rtnl_neigh_get_lladdr(neigh)) ==
+        0)
+      continue;
+
+    add_neigh_to_fdb(neigh);
+  }
+}
+
+int nl_bridge::fdb_timeout(
+    rtnl_link *br_link,
+    const std::vector<std::pair<uint16_t, rofl::caddress_ll>> &entries) {
+  std::vector<nl_msg *> msgs;
+
+  std::unique_ptr<rtnl_neigh, decltype(&rtnl_neigh_put)> n(rtnl_neigh_alloc(),
+                                                           rtnl_neigh_put);
 
   rtnl_neigh_set_ifindex(n.get(), rtnl_link_get_ifindex(br_link));
   rtnl_neigh_set_master(n.get(), rtnl_link_get_master(br_link));
   rtnl_neigh_set_family(n.get(), AF_BRIDGE);
-  rtnl_neigh_set_vlan(n.get(), vid);
-  rtnl_neigh_set_lladdr(n.get(), h_src.get());
   rtnl_neigh_set_flags(n.get(), NTF_MASTER | NTF_EXT_LEARNED);
   rtnl_neigh_set_state(n.get(), NUD_REACHABLE);
 
-  // find entry in local l2_cache
-  std::unique_ptr<rtnl_neigh, decltype(&rtnl_neigh_put)> n_lookup(
-      NEIGH_CAST(nl_cache_search(l2_cache.get(), OBJ_CAST(n.get()))),
-      rtnl_neigh_put);
+  msgs.reserve(entries.size());
+  for (auto &e : entries) {
+    std::unique_ptr<nl_addr, decltype(&nl_addr_put)> h_src(
+        nl_addr_build(AF_LLC, e.second.somem(), e.second.memlen()),
+        nl_addr_put);
+
+    rtnl_neigh_set_vlan(n.get(), e.first);
+    rtnl_neigh_set_lladdr(n.get(), h_src.get());
+
+    // find entry in local l2_cache, duplicates of the batch are gone already
+    std::unique_ptr<rtnl_neigh, decltype(&rtnl_neigh_put)> n_lookup(
+        NEIGH_CAST(nl_cache_search(l2_cache.get(), OBJ_CAST(n.get()))),
+        rtnl_neigh_put);
+
+    if (!n_lookup)
+      continue;
 
-  if (n_lookup) {
     // * remove l2 entry from kernel
     nl_msg *msg = nullptr;
     rtnl_neigh_build_delete_request(n.get(), NLM_F_REQUEST, &msg);
     assert(msg);
-
-    // send the message and create new fdb entry
-    if (nl->send_nl_msg(msg) < 0) {
-      LOG(ERROR) << __FUNCTION__ << ": failed to send netlink message";
-      return -EINVAL;
-    }
+    msgs.push_back(msg);
 
     // XXX TODO maybe delete after NL event and not yet here
+    index_learned(n_lookup.get(), false);
     nl_cache_remove(OBJ_CAST(n_lookup.get()));
   }
 
-  return rv;
+  if (msgs.empty())
+    return 0;
+
+  VLOG(2) << __FUNCTION__ << ": removing " << msgs.size()
+          << " aged entries of " << OBJ_CAST(br_link);
+
+  int rv = nl->send_nl_msgs(msgs);
+  if (rv < 0) {
+    LOG(ERROR) << __FUNCTION__ << ": failed to send netlink messages";
+    return rv;
+  }
+
+  if (rv > 0) {
+    LOG(ERROR) << __FUNCTION__ << ": failed to delete " << rv
+               << " fdb entries";
+    return -EINVAL;
+  }
+
+  return 0;
 }
 
 bool nl_bridge::is_port_flooding(rtnl_link *br_link) const {
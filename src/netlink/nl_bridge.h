@@ -4,12 +4,16 @@
 
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <deque>
 #include <list>
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <netlink/route/link/bridge.h>
 
@@ -29,6 +33,7 @@ class caddress_ll;
 namespace basebox {
 
 class cnetlink;
+class metric_counter;
 class nl_vxlan;
 class switch_interface;
 class tap_manager;
@@ -53,8 +58,15 @@ public:
 
   bool is_mac_in_l2_cache(rtnl_neigh *n);
   int learn_source_mac(rtnl_link *br_link, packet *p);
-  int fdb_timeout(rtnl_link *br_link, uint16_t vid,
-                  const rofl::caddress_ll &mac);
+  int fdb_timeout(
+      rtnl_link *br_link,
+      const std::vector<std::pair<uint16_t, rofl::caddress_ll>> &entries);
+
+  /**
+   * remove the learned entries of a bridge port, of a vlan or of a port in a
+   * vlan from the switch, the l2 cache and the kernel, 0 matches all
+   */
+  int flush_fdb(int ifindex, uint16_t vid);
   int get_ifindex() { return rtnl_link_get_ifindex(bridge); }
 
   void get_bridge_ports(
@@ -87,6 +99,42 @@ private:
   rtnl_link_bridge_vlan empty_br_vlan;
   uint32_t vxlan_dom_bitmap[RTNL_LINK_BRIDGE_VLAN_BITMAP_LEN];
   std::map<uint16_t, uint32_t> vxlan_domain;
+
+  // learned source macs, a mac moving too often is held on its old port
+  struct station {
+    int ifindex;
+    unsigned moves; // in a row, less than mac_move_window apart
+    std::chrono::steady_clock::time_point last_move;
+    std::chrono::steady_clock::time_point held_until;
+  };
+  std::map<std::pair<uint16_t, uint64_t>, station> stations; // by vid, mac
+  std::chrono::steady_clock::time_point stations_aged;
+
+  const unsigned mac_move_threshold = 3; // moves before a mac is held
+  const std::chrono::seconds mac_move_window = std::chrono::seconds(10);
+  const std::chrono::seconds mac_hold_min = std::chrono::seconds(1);
+  const std::chrono::seconds mac_hold_max = std::chrono::seconds(180);
+
+  bool is_station_held(uint16_t vid, const uint8_t *mac) const;
+  bool is_station_move(int ifindex, uint16_t vid, const uint8_t *mac) const;
+  int track_station(int ifindex, uint16_t vid, const uint8_t *mac,
+                    int *old_ifindex);
+  void untrack_station(uint16_t vid, const uint8_t *mac, int old_ifindex);
+  void age_stations(std::chrono::steady_clock::time_point now);
+
+  // entries of the l2 cache, bounded by the learning limits
+  std::map<std::pair<int, uint16_t>, std::set<uint64_t>> learned;
+  std::map<int, unsigned> learned_per_port; // by ifindex
+  std::map<uint16_t, unsigned> learned_per_vlan;
+  double learn_tokens;
+  std::chrono::steady_clock::time_point learn_refill;
+  metric_counter &rejected_port_limit;
+  metric_counter &rejected_vlan_limit;
+  metric_counter &rejected_rate;
+
+  int check_learn_limits(int ifindex, uint16_t vid, bool move);
+  void index_learned(rtnl_neigh *n, bool add);
+  void restore_static_fdb(int ifindex);
 };
 
 } /* namespace basebox */
@@ -0,0 +1,101 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cassert>
+
+#include <linux/rtnetlink.h>
+#include <netlink/route/neighbour.h>
+
+#include "netlink-utils.h"
+#include "nl_event_queue.h"
+
+namespace basebox {
+
+void nl_event_queue::emplace(int action, struct nl_object *old_obj,
+                             struct nl_object *new_obj) {
+  nl_obj obj(action, old_obj, new_obj);
+  unsigned c = class_of(obj);
+
+  queues[c].push_back(obj);
+  seqs[c].push_back(seq++);
+}
+
+const nl_obj &nl_event_queue::front() noexcept {
+  assert(!empty());
+
+  // the oldest event is always ready, so one of the queues is
+  for (unsigned i = 0; i < NL_MAX_EVENT_CLASS; i++) {
+    unsigned c = (next_class + i) % NL_MAX_EVENT_CLASS;
+
+    if (ready(c)) {
+      selected = static_cast<enum nl_event_class>(c);
+      break;
+    }
+  }
+
+  return queues[selected].front();
+}
+
+void nl_event_queue::pop() noexcept {
+  assert(selected != NL_MAX_EVENT_CLASS);
+
+  queues[selected].pop_front();
+  seqs[selected].pop_front();
+  next_class = (selected + 1) % NL_MAX_EVENT_CLASS;
+  selected = NL_MAX_EVENT_CLASS;
+}
+
+size_t nl_event_queue::size() const noexcept {
+  size_t n = 0;
+
+  for (const auto &q : queues)
+    n += q.size();
+
+  return n;
+}
+
+enum nl_event_queue::nl_event_class
+nl_event_queue::class_of(const nl_obj &obj) noexcept {
+  switch (obj.get_msg_type()) {
+  case RTM_NEWLINK:
+  case RTM_DELLINK:
+    return NL_EVENT_LINK;
+  case RTM_NEWNEIGH:
+  case RTM_DELNEIGH: {
+    auto neigh = NEIGH_CAST(obj.get_action() == NL_ACT_DEL
+                                ? obj.get_old_obj()
+                                : obj.get_new_obj());
+
+    // remote VTEP entries are resolved through the underlay
+    if (rtnl_neigh_get_family(neigh) == AF_BRIDGE &&
+        rtnl_neigh_get_dst(neigh) == nullptr)
+      return NL_EVENT_L2;
+
+    return NL_EVENT_L3;
+  }
+  default:
+    return NL_EVENT_L3;
+  }
+}
+
+bool nl_event_queue::ready(unsigned c) const noexcept {
+  if (seqs[c].empty())
+    return false;
+
+  uint64_t s = seqs[c].front();
+
+  // links wait for everything before them
+  if (c == NL_EVENT_LINK) {
+    for (unsigned i = 0; i < NL_MAX_EVENT_CLASS; i++) {
+      if (i != c && !seqs[i].empty() && seqs[i].front() < s)
+        return false;
+    }
+    return true;
+  }
+
+  // everything else waits for the links before it
+  return seqs[NL_EVENT_LINK].empty() || s < seqs[NL_EVENT_LINK].front();
+}
+
+} // namespace basebox
@@ -0,0 +1,71 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+#include "nl_obj.h"
+
+namespace basebox {
+
+/**
+ * Queue of netlink events that interleaves the classes of events.
+ *
+ * All events are still applied one by one on the netlink thread, the queue
+ * only picks the order. Links are a dependency of everything else, a link
+ * event is only handed out after all events received before it, and blocks
+ * all events received after it. Bridge fdb entries (L2) and addresses,
+ * neighbours and routes (L3) do not depend on each other and are handed out
+ * round robin, so a burst of route updates does not hold back the fdb.
+ * Remote VTEP fdb entries depend on the underlay and are kept in order with
+ * L3. Within a class events keep the order they were received in.
+ */
+class nl_event_queue final {
+public:
+  enum nl_event_class {
+    NL_EVENT_LINK,
+    NL_EVENT_L2,
+    NL_EVENT_L3,
+    NL_MAX_EVENT_CLASS,
+  };
+
+  nl_event_queue() : seq(0), next_class(0), selected(NL_MAX_EVENT_CLASS) {}
+
+  void emplace(int action, struct nl_object *old_obj,
+               struct nl_object *new_obj);
+
+  /**
+   * next event that can be applied, the queue must not be empty
+   */
+  const nl_obj &front() noexcept;
+
+  // remove the event returned by front
+  void pop() noexcept;
+
+  bool empty() const noexcept { return size() == 0; }
+  size_t size() const noexcept;
+  size_t size(enum nl_event_class c) const noexcept {
+    return queues[c].size();
+  }
+
+  // pending link events, in the order they were received
+  const std::deque<nl_obj> &links() const noexcept {
+    return queues[NL_EVENT_LINK];
+  }
+
+private:
+  std::deque<nl_obj> queues[NL_MAX_EVENT_CLASS];
+  // arrival of each queued event
+  std::deque<uint64_t> seqs[NL_MAX_EVENT_CLASS];
+  uint64_t seq;
+  unsigned next_class;          // class served first by the next front
+  enum nl_event_class selected; // class of the last front
+
+  static enum nl_event_class class_of(const nl_obj &obj) noexcept;
+  bool ready(unsigned c) const noexcept;
+};
+
+} // namespace basebox
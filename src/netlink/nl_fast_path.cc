@@ -0,0 +1,276 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+
+#include <glog/logging.h>
+#include <linux/neighbour.h>
+#include <linux/rtnetlink.h>
+
+#include "nl_fast_path.h"
+
+namespace basebox {
+
+// walk the attributes following a fixed size header of a message
+template <typename F>
+static int for_each_attr(const struct nlmsghdr *hdr, size_t fixed_len, F f) {
+  if (hdr->nlmsg_len < NLMSG_LENGTH(fixed_len))
+    return -EINVAL;
+
+  const uint8_t *p =
+      static_cast<const uint8_t *>(NLMSG_DATA(hdr)) + NLMSG_ALIGN(fixed_len);
+  size_t len = hdr->nlmsg_len - NLMSG_LENGTH(NLMSG_ALIGN(fixed_len));
+
+  while (len >= sizeof(struct rtattr)) {
+    const struct rtattr *rta = reinterpret_cast<const struct rtattr *>(p);
+    if (rta->rta_len < sizeof(struct rtattr) || rta->rta_len > len)
+      return -EINVAL;
+
+    f(rta->rta_type, static_cast<const uint8_t *>(RTA_DATA(rta)),
+      RTA_PAYLOAD(rta));
+
+    size_t step = RTA_ALIGN(rta->rta_len);
+    if (step >= len)
+      break;
+    p += step;
+    len -= step;
+  }
+
+  return 0;
+}
+
+template <typename T>
+static void get_attr(const uint8_t *data, size_t len, T *v) {
+  if (len >= sizeof(*v))
+    memcpy(v, data, sizeof(*v));
+}
+
+// FNV-1a
+static uint64_t fingerprint(uint64_t h, const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    h ^= data[i];
+    h *= UINT64_C(0x100000001b3);
+  }
+  return h;
+}
+
+static void split_addr(const uint8_t addr[16], uint64_t *hi, uint64_t *lo) {
+  memcpy(hi, addr, sizeof(*hi));
+  memcpy(lo, addr + 8, sizeof(*lo));
+}
+
+int nl_parse_neigh(const struct nlmsghdr *hdr, nl_neigh_msg *msg) noexcept {
+  const struct ndmsg *ndm = static_cast<const struct ndmsg *>(NLMSG_DATA(hdr));
+
+  memset(msg, 0, sizeof(*msg));
+  if (hdr->nlmsg_len < NLMSG_LENGTH(sizeof(*ndm)))
+    return -EINVAL;
+
+  msg->family = ndm->ndm_family;
+  msg->ifindex = ndm->ndm_ifindex;
+  msg->state = ndm->ndm_state;
+  msg->flags = ndm->ndm_flags;
+  msg->type = ndm->ndm_type;
+
+  return for_each_attr(
+      hdr, sizeof(*ndm), [msg](int type, const uint8_t *data, size_t len) {
+        switch (type) {
+        case NDA_DST:
+          if (len <= sizeof(msg->dst)) {
+            memcpy(msg->dst, data, len);
+            msg->dst_len = len;
+          }
+          break;
+        case NDA_LLADDR:
+          if (len == sizeof(msg->lladdr)) {
+            memcpy(msg->lladdr, data, len);
+            msg->has_lladdr = true;
+          }
+          break;
+        case NDA_VLAN:
+          get_attr(data, len, &msg->vlan);
+          break;
+        case NDA_MASTER:
+          get_attr(data, len, &msg->master);
+          break;
+        default:
+          break;
+        }
+      });
+}
+
+int nl_parse_route(const struct nlmsghdr *hdr, nl_route_msg *msg) noexcept {
+  const struct rtmsg *rtm = static_cast<const struct rtmsg *>(NLMSG_DATA(hdr));
+  uint64_t h = UINT64_C(0xcbf29ce484222325);
+
+  memset(msg, 0, sizeof(*msg));
+  if (hdr->nlmsg_len < NLMSG_LENGTH(sizeof(*rtm)))
+    return -EINVAL;
+
+  msg->family = rtm->rtm_family;
+  msg->dst_len = rtm->rtm_dst_len;
+  msg->tos = rtm->rtm_tos;
+  msg->protocol = rtm->rtm_protocol;
+  msg->scope = rtm->rtm_scope;
+  msg->type = rtm->rtm_type;
+  msg->flags = rtm->rtm_flags;
+  msg->table = rtm->rtm_table;
+  h = fingerprint(h, reinterpret_cast<const uint8_t *>(rtm), sizeof(*rtm));
+
+  int rv = for_each_attr(
+      hdr, sizeof(*rtm), [msg, &h](int type, const uint8_t *data, size_t len) {
+        switch (type) {
+        case RTA_CACHEINFO:
+        case RTA_EXPIRES:
+          // changes over time without the route changing
+          return;
+        case RTA_DST:
+          if (len <= sizeof(msg->dst))
+            memcpy(msg->dst, data, len);
+          break;
+        case RTA_GATEWAY:
+          if (len <= sizeof(msg->gateway)) {
+            memcpy(msg->gateway, data, len);
+            msg->has_gateway = true;
+          }
+          break;
+        case RTA_OIF:
+          get_attr(data, len, &msg->oif);
+          break;
+        case RTA_PRIORITY:
+          get_attr(data, len, &msg->priority);
+          break;
+        case RTA_TABLE:
+          get_attr(data, len, &msg->table);
+          break;
+        case RTA_MULTIPATH:
+          msg->multipath = true;
+          break;
+        default:
+          break;
+        }
+
+        uint16_t t = type;
+        h = fingerprint(h, reinterpret_cast<const uint8_t *>(&t), sizeof(t));
+        h = fingerprint(h, data, len);
+      });
+
+  msg->fingerprint = h;
+  return rv;
+}
+
+bool nl_fast_path::is_redundant(const struct nlmsghdr *hdr) noexcept {
+  switch (hdr->nlmsg_type) {
+  case RTM_NEWNEIGH:
+  case RTM_DELNEIGH:
+    return neigh_redundant(hdr);
+  case RTM_NEWROUTE:
+  case RTM_DELROUTE:
+    return route_redundant(hdr);
+  default:
+    return false;
+  }
+}
+
+// link layer address is resolved and handed to the switch in these states
+static bool nud_resolved(uint16_t state) {
+  return state & (NUD_REACHABLE | NUD_STALE | NUD_DELAY | NUD_PROBE |
+                  NUD_PERMANENT | NUD_NOARP);
+}
+
+// states of a resolved neighbour told apart by baseboxd, e.g. the neighbour
+// proxy only answers for confirmed neighbours
+static uint16_t nud_class(uint16_t state) {
+  return state & (NUD_REACHABLE | NUD_PERMANENT | NUD_NOARP);
+}
+
+bool nl_fast_path::neigh_redundant(const struct nlmsghdr *hdr) noexcept {
+  nl_neigh_msg msg;
+
+  if (nl_parse_neigh(hdr, &msg) < 0)
+    return false;
+
+  // fdb entries are handled by the bridge
+  if (msg.family != AF_INET && msg.family != AF_INET6)
+    return false;
+
+  neigh_key key{0, 0, msg.ifindex, msg.family};
+  split_addr(msg.dst, &key.addr_hi, &key.addr_lo);
+
+  if (hdr->nlmsg_type == RTM_DELNEIGH) {
+    neighs.erase(key);
+    return false;
+  }
+
+  neigh_state state{UINT64_C(0xffff) << 48, msg.state, msg.flags};
+  if (msg.has_lladdr) {
+    state.lladdr = 0;
+    for (auto b : msg.lladdr)
+      state.lladdr = state.lladdr << 8 | b;
+  }
+
+  try {
+    auto it = neighs.emplace(key, state);
+    if (it.second)
+      return false;
+
+    neigh_state &old = *it.first;
+    bool redundant = nud_resolved(old.state) && nud_resolved(state.state) &&
+                     nud_class(old.state) == nud_class(state.state) &&
+                     old.lladdr == state.lladdr && old.flags == state.flags;
+
+    old = state;
+    if (redundant) {
+      suppressed++;
+      return true;
+    }
+  } catch (std::exception &e) {
+    LOG(ERROR) << __FUNCTION__ << ": caught " << e.what();
+  }
+
+  return false;
+}
+
+bool nl_fast_path::route_redundant(const struct nlmsghdr *hdr) noexcept {
+  nl_route_msg msg;
+
+  if (nl_parse_route(hdr, &msg) < 0)
+    return false;
+
+  route_key key{0, 0, msg.table, msg.priority, msg.family, msg.dst_len,
+                msg.tos};
+  split_addr(msg.dst, &key.dst_hi, &key.dst_lo);
+
+  if (hdr->nlmsg_type == RTM_DELROUTE) {
+    routes.erase(key);
+    return false;
+  }
+
+  try {
+    auto it = routes.emplace(key, msg.fingerprint);
+    if (it.second)
+      return false;
+
+    if (*it.first == msg.fingerprint) {
+      suppressed++;
+      return true;
+    }
+
+    *it.first = msg.fingerprint;
+  } catch (std::exception &e) {
+    LOG(ERROR) << __FUNCTION__ << ": caught " << e.what();
+  }
+
+  return false;
+}
+
+void nl_fast_path::clear() noexcept {
+  neighs.clear();
+  routes.clear();
+}
+
+} // namespace basebox
@@ -0,0 +1,144 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstdint>
+
+#include <linux/netlink.h>
+
+#include "nl_flat_map.h"
+
+namespace basebox {
+
+// RTM_NEWNEIGH and RTM_DELNEIGH decoded from the wire
+struct nl_neigh_msg {
+  uint8_t family;
+  uint8_t flags;
+  uint8_t type;
+  uint8_t dst_len;
+  uint16_t state;
+  uint16_t vlan;
+  int32_t ifindex;
+  uint32_t master;
+  uint8_t dst[16];
+  uint8_t lladdr[6];
+  bool has_lladdr;
+};
+
+// RTM_NEWROUTE and RTM_DELROUTE decoded from the wire
+struct nl_route_msg {
+  uint8_t family;
+  uint8_t dst_len;
+  uint8_t tos;
+  uint8_t protocol;
+  uint8_t scope;
+  uint8_t type;
+  bool has_gateway;
+  bool multipath;
+  uint32_t flags;
+  uint32_t table;
+  uint32_t priority;
+  uint32_t oif;
+  uint8_t dst[16];
+  uint8_t gateway[16];
+  uint64_t fingerprint; // hash of all attributes but the cache info
+};
+
+/**
+ * parse a neighbour message in place, no memory is allocated
+ *
+ * @returns 0 on success, -EINVAL if the message is malformed
+ */
+int nl_parse_neigh(const struct nlmsghdr *hdr, nl_neigh_msg *msg) noexcept;
+
+/**
+ * parse a route message in place, no memory is allocated
+ *
+ * @returns 0 on success, -EINVAL if the message is malformed
+ */
+int nl_parse_route(const struct nlmsghdr *hdr, nl_route_msg *msg) noexcept;
+
+/**
+ * Drops neighbour and route messages before libnl parses them.
+ *
+ * Most neighbour messages are NUD refreshes of resolved neighbours
+ * (stale, delay, probe) that do not change the link layer address, and
+ * route messages are often re-announcements of an unchanged route. Both
+ * cost an object allocation, a cache lookup, a diff and a clone into nl_obj
+ * each. The last relevant state of every neighbour and route is kept in
+ * flat tables and messages not changing it are dropped. A neighbour
+ * becoming or ceasing to be reachable, permanent or noarp is passed on, the
+ * cached state of these is used by the neighbour proxy.
+ */
+class nl_fast_path final {
+public:
+  nl_fast_path() : suppressed(0) {}
+
+  /**
+   * @returns true if the message does not change anything baseboxd acts on
+   */
+  bool is_redundant(const struct nlmsghdr *hdr) noexcept;
+
+  // to be called if the caches were changed behind our back
+  void clear() noexcept;
+
+  uint64_t get_suppressed() const noexcept { return suppressed; }
+
+private:
+  struct neigh_key {
+    uint64_t addr_hi;
+    uint64_t addr_lo;
+    int32_t ifindex;
+    uint8_t family;
+
+    bool operator==(const neigh_key &o) const {
+      return addr_hi == o.addr_hi && addr_lo == o.addr_lo &&
+             ifindex == o.ifindex && family == o.family;
+    }
+  };
+
+  struct neigh_state {
+    uint64_t lladdr; // 0xffff << 48 if there is none
+    uint16_t state;
+    uint8_t flags;
+  };
+
+  struct route_key {
+    uint64_t dst_hi;
+    uint64_t dst_lo;
+    uint32_t table;
+    uint32_t priority;
+    uint8_t family;
+    uint8_t dst_len;
+    uint8_t tos;
+
+    bool operator==(const route_key &o) const {
+      return dst_hi == o.dst_hi && dst_lo == o.dst_lo && table == o.table &&
+             priority == o.priority && family == o.family &&
+             dst_len == o.dst_len && tos == o.tos;
+    }
+  };
+
+  struct key_hash {
+    size_t operator()(const neigh_key &k) const noexcept {
+      return nl_hash_mix(k.addr_hi ^ nl_hash_mix(k.addr_lo) ^
+                         ((uint64_t)k.ifindex << 8 | k.family));
+    }
+    size_t operator()(const route_key &k) const noexcept {
+      return nl_hash_mix(k.dst_hi ^ nl_hash_mix(k.dst_lo) ^
+                         ((uint64_t)k.table << 32 | k.priority) ^
+                         ((uint64_t)k.family << 16 | k.dst_len << 8 | k.tos));
+    }
+  };
+
+  nl_flat_map<neigh_key, neigh_state, key_hash> neighs;
+  nl_flat_map<route_key, uint64_t, key_hash> routes; // route fingerprints
+  uint64_t suppressed;
+
+  bool neigh_redundant(const struct nlmsghdr *hdr) noexcept;
+  bool route_redundant(const struct nlmsghdr *hdr) noexcept;
+};
+
+} // namespace basebox
@@ -0,0 +1,388 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <deque>
+#include <utility>
+
+#include <glog/logging.h>
+#include <netlink/addr.h>
+
+#include "nl_fib_aggregator.h"
+#include "nl_output.h"
+
+namespace basebox {
+
+nl_fib_aggregator::nl_fib_aggregator(add_func add, del_func del)
+    : add(std::move(add)), del(std::move(del)), rib_routes(0) {}
+
+nl_fib_aggregator::~nl_fib_aggregator() = default;
+
+int nl_fib_aggregator::add_route(nl_addr *dst, uint32_t l3_interface_id,
+                                 bool is_ecmp) {
+  nh_t nh = (static_cast<nh_t>(is_ecmp) << 32) | l3_interface_id;
+  return update(dst, true, nh);
+}
+
+int nl_fib_aggregator::del_route(nl_addr *dst) {
+  return update(dst, false, NH_INHERIT);
+}
+
+void nl_fib_aggregator::clear() noexcept {
+  for (int i = 0; i < 2; i++) {
+    root[i].reset();
+    fib[i].clear();
+  }
+  rib_routes = 0;
+}
+
+int nl_fib_aggregator::get_bit(const addr_t &a, unsigned pos) noexcept {
+  return (a[pos / 8] >> (7 - pos % 8)) & 1;
+}
+
+unsigned nl_fib_aggregator::common_prefix(const addr_t &a, const addr_t &b,
+                                          unsigned max) noexcept {
+  unsigned len = 0;
+  for (unsigned i = 0; i < a.size() && len < max; i++) {
+    uint8_t x = a[i] ^ b[i];
+    if (x == 0) {
+      len += 8;
+      continue;
+    }
+    len += __builtin_clz(x) - 24;
+    break;
+  }
+  return std::min(len, max);
+}
+
+nl_fib_aggregator::addr_t nl_fib_aggregator::mask(const addr_t &a,
+                                                  unsigned len) noexcept {
+  addr_t m{};
+  unsigned bytes = len / 8;
+  std::copy(a.begin(), a.begin() + bytes, m.begin());
+  if (len % 8)
+    m[bytes] = a[bytes] & (0xff << (8 - len % 8));
+  return m;
+}
+
+bool nl_fib_aggregator::contains(const prefix &p, const addr_t &a) noexcept {
+  return common_prefix(p.addr, a, p.len) == p.len;
+}
+
+nl_fib_aggregator::fwd_state
+nl_fib_aggregator::merge(const fwd_state &a, const fwd_state &b) noexcept {
+  if (a.nh == NH_MIXED || b.nh == NH_MIXED)
+    return {NH_MIXED, false};
+
+  bool inherits =
+      a.nh == NH_INHERIT || a.partial || b.nh == NH_INHERIT || b.partial;
+
+  if (a.nh == NH_INHERIT && b.nh == NH_INHERIT)
+    return {NH_INHERIT, false};
+
+  if (a.nh != NH_INHERIT && b.nh != NH_INHERIT && a.nh != b.nh)
+    return {NH_MIXED, false};
+
+  return {a.nh != NH_INHERIT ? a.nh : b.nh, inherits};
+}
+
+nl_fib_aggregator::fwd_state
+nl_fib_aggregator::resolve(const fwd_state &s, nh_t nh) noexcept {
+  if (s.nh == NH_MIXED)
+    return s;
+
+  if (s.nh == NH_INHERIT)
+    return {nh, false};
+
+  if (!s.partial || s.nh == nh)
+    return {s.nh, false};
+
+  return {NH_MIXED, false};
+}
+
+nl_fib_aggregator::nh_t
+nl_fib_aggregator::resolve_nh(const fwd_state &s, nh_t inherited) noexcept {
+  if (s.nh == NH_INHERIT)
+    return inherited;
+
+  if (s.nh == NH_MIXED || !s.partial)
+    return s.nh;
+
+  return s.nh == inherited ? inherited : NH_MIXED;
+}
+
+void nl_fib_aggregator::compute_state(node *n) noexcept {
+  fwd_state half[2];
+
+  for (int b = 0; b < 2; b++) {
+    const node *c = n->child[b].get();
+
+    if (c == nullptr) {
+      half[b] = {NH_INHERIT, false};
+    } else if (c->len == n->len + 1) {
+      half[b] = c->state;
+    } else {
+      // compressed edge, the skipped space is not routed below n
+      half[b] = merge(c->state, {NH_INHERIT, false});
+    }
+  }
+
+  n->state = merge(half[0], half[1]);
+  if (n->has_route)
+    n->state = resolve(n->state, n->nh);
+}
+
+nl_fib_aggregator::node *nl_fib_aggregator::insert(int idx, const addr_t &addr,
+                                                   uint8_t len) {
+  node *n = root[idx].get();
+
+  while (n->len != len) {
+    int b = get_bit(addr, n->len);
+    node *c = n->child[b].get();
+
+    if (c == nullptr) {
+      n->child[b].reset(new node(addr, len, n));
+      return n->child[b].get();
+    }
+
+    unsigned cpl = common_prefix(c->addr, addr, std::min(c->len, len));
+    if (cpl == c->len) {
+      n = c;
+      continue;
+    }
+
+    // split the edge to c
+    std::unique_ptr<node> old = std::move(n->child[b]);
+
+    if (cpl == len) {
+      node *x = new node(addr, len, n);
+      n->child[b].reset(x);
+      old->parent = x;
+      x->child[get_bit(old->addr, len)] = std::move(old);
+      return x;
+    }
+
+    node *m = new node(mask(addr, cpl), cpl, n);
+    n->child[b].reset(m);
+    int ob = get_bit(old->addr, cpl);
+    old->parent = m;
+    m->child[ob] = std::move(old);
+    m->child[!ob].reset(new node(addr, len, m));
+    return m->child[!ob].get();
+  }
+
+  return n;
+}
+
+nl_fib_aggregator::node *nl_fib_aggregator::remove(node *n) {
+  n->has_route = false;
+  n->nh = NH_INHERIT;
+
+  // drop nodes that are neither routes nor branching points
+  while (n->parent && !n->has_route && !(n->child[0] && n->child[1])) {
+    node *parent = n->parent;
+    int b = parent->child[1].get() == n;
+    std::unique_ptr<node> only =
+        std::move(n->child[0] ? n->child[0] : n->child[1]);
+
+    if (only)
+      only->parent = parent;
+
+    parent->child[b] = std::move(only); // frees n
+    n = parent;
+  }
+
+  return n;
+}
+
+int nl_fib_aggregator::update(nl_addr *dst, bool set, nh_t nh) {
+  assert(dst);
+
+  int family = nl_addr_get_family(dst);
+  int idx;
+
+  switch (family) {
+  case AF_INET:
+    idx = 0;
+    break;
+  case AF_INET6:
+    idx = 1;
+    break;
+  default:
+    LOG(ERROR) << __FUNCTION__ << ": unsupported family " << family;
+    return -EINVAL;
+  }
+
+  unsigned len = nl_addr_get_prefixlen(dst);
+  addr_t a{};
+  memcpy(a.data(), nl_addr_get_binary_addr(dst),
+         std::min<size_t>(nl_addr_get_len(dst), a.size()));
+  a = mask(a, len);
+
+  if (!root[idx])
+    root[idx].reset(new node(addr_t{}, 0, nullptr));
+
+  // remember the state along the path to detect where programming changes
+  std::deque<std::pair<const node *, fwd_state>> old;
+  for (node *n = root[idx].get();
+       n && n->len <= len && common_prefix(n->addr, a, n->len) == n->len;) {
+    old.emplace_back(n, n->state);
+    if (n->len == len)
+      break;
+    n = n->child[get_bit(a, n->len)].get();
+  }
+
+  node *start;
+  if (set) {
+    node *n = insert(idx, a, len);
+    if (n->has_route && n->nh == nh)
+      return 0;
+
+    if (!n->has_route)
+      rib_routes++;
+
+    n->has_route = true;
+    n->nh = nh;
+    start = n;
+  } else {
+    const node *n = old.size() ? old.back().first : nullptr;
+    if (n == nullptr || n->len != len || !n->has_route) {
+      VLOG(1) << __FUNCTION__ << ": route not found dst=" << dst;
+      return -ENODATA;
+    }
+
+    rib_routes--;
+    start = remove(const_cast<node *>(n));
+  }
+
+  for (node *p = start; p; p = p->parent)
+    compute_state(p);
+
+  // find the topmost node of the path where the programming may differ
+  nh_t inherited = NH_INHERIT;
+  node *n = root[idx].get();
+  while (true) {
+    auto it = std::find_if(old.begin(), old.end(),
+                           [n](const std::pair<const node *, fwd_state> &o) {
+                             return o.first == n;
+                           });
+    if (it == old.end())
+      break; // new node
+
+    if (resolve_nh(it->second, inherited) != NH_MIXED ||
+        resolve_nh(n->state, inherited) != NH_MIXED || n->len >= len)
+      break;
+
+    node *next = n->child[get_bit(a, n->len)].get();
+    if (next == nullptr || next->len > len ||
+        common_prefix(next->addr, a, next->len) != next->len)
+      break;
+
+    if (n->has_route)
+      inherited = n->nh;
+    n = next;
+  }
+
+  return reprogram(idx, n, inherited);
+}
+
+void nl_fib_aggregator::emit(const node *n, nh_t inherited,
+                             fib_t *out) const {
+  nh_t uniform = resolve_nh(n->state, inherited);
+
+  if (uniform != NH_MIXED) {
+    if (uniform != inherited)
+      out->emplace(prefix{n->addr, n->len}, uniform);
+    return;
+  }
+
+  nh_t own = inherited;
+  if (n->has_route) {
+    own = n->nh;
+    if (own != inherited)
+      out->emplace(prefix{n->addr, n->len}, own);
+  }
+
+  for (const auto &c : n->child) {
+    if (c)
+      emit(c.get(), own, out);
+  }
+}
+
+int nl_fib_aggregator::reprogram(int idx, const node *n, nh_t inherited) {
+  fib_t fresh;
+  emit(n, inherited, &fresh);
+
+  fib_t &cur = fib[idx];
+  prefix p{n->addr, n->len};
+  std::deque<prefix> stale;
+
+  for (auto it = cur.lower_bound(p);
+       it != cur.end() && contains(p, it->first.addr); ++it) {
+    if (fresh.find(it->first) == fresh.end())
+      stale.push_back(it->first);
+  }
+
+  auto build = [idx](const prefix &p) {
+    std::unique_ptr<nl_addr, decltype(&nl_addr_put)> a(
+        nl_addr_build(idx ? AF_INET6 : AF_INET, p.addr.data(), idx ? 16 : 4),
+        nl_addr_put);
+    if (a)
+      nl_addr_set_prefixlen(a.get(), p.len);
+    return a;
+  };
+
+  int rv = 0;
+
+  // make before break: add and update first
+  for (const auto &e : fresh) {
+    auto it = cur.find(e.first);
+    if (it != cur.end() && it->second == e.second)
+      continue;
+
+    auto a = build(e.first);
+    if (!a) {
+      LOG(ERROR) << __FUNCTION__ << ": out of memory";
+      return -ENOMEM;
+    }
+
+    int r = add(a.get(), e.second & 0xffffffff, e.second >> 32,
+                it != cur.end());
+    if (r < 0) {
+      LOG(ERROR) << __FUNCTION__ << ": failed to program dst=" << a.get()
+                 << " rv=" << r;
+      rv = r;
+      continue;
+    }
+
+    cur[e.first] = e.second;
+  }
+
+  for (const auto &s : stale) {
+    auto a = build(s);
+    if (!a) {
+      LOG(ERROR) << __FUNCTION__ << ": out of memory";
+      return -ENOMEM;
+    }
+
+    int r = del(a.get());
+    if (r < 0) {
+      LOG(ERROR) << __FUNCTION__ << ": failed to remove dst=" << a.get()
+                 << " rv=" << r;
+      rv = r;
+    }
+
+    cur.erase(s);
+  }
+
+  VLOG(2) << __FUNCTION__ << ": rib_routes=" << rib_routes
+          << " fib_entries=" << fib_size() << " (" << fresh.size()
+          << " in subtree, " << stale.size() << " removed)";
+
+  return rv;
+}
+
+} // namespace basebox
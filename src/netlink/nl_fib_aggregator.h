@@ -0,0 +1,143 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+
+extern "C" {
+struct nl_addr;
+}
+
+namespace basebox {
+
+/**
+ * Incremental FIB aggregation in front of the unicast routing table.
+ *
+ * The kernel routes (RIB) are kept in a path compressed binary trie per
+ * address family. From the trie a minimal equivalent set of prefixes is
+ * derived (ORTC style): covered prefixes pointing to the same next hop as
+ * their covering prefix are suppressed and sibling prefixes having the same
+ * next hop are merged into their parent. Only the resulting set is sent to
+ * the switch and only the part of the trie affected by a change is
+ * recomputed.
+ *
+ * A next hop is identified by its l3 interface id and whether it is an ecmp
+ * group, which is exactly what the switch needs to reference. The prefixes of
+ * local addresses are added with l3 interface id 0, which sends to the
+ * controller, so they are aggregated like any other route.
+ */
+class nl_fib_aggregator final {
+public:
+  // called to program or update a prefix in the switch
+  typedef std::function<int(nl_addr *dst, uint32_t l3_interface_id,
+                            bool is_ecmp, bool update_route)>
+      add_func;
+  // called to remove a prefix from the switch
+  typedef std::function<int(nl_addr *dst)> del_func;
+
+  nl_fib_aggregator(add_func add, del_func del);
+  ~nl_fib_aggregator();
+
+  /**
+   * add or update a route
+   *
+   * @returns <0 on error
+   */
+  int add_route(nl_addr *dst, uint32_t l3_interface_id, bool is_ecmp);
+
+  /**
+   * remove a route
+   *
+   * @returns -ENODATA if the route is unknown, <0 on other errors
+   */
+  int del_route(nl_addr *dst);
+
+  /**
+   * drop all state without touching the switch
+   */
+  void clear() noexcept;
+
+  size_t rib_size() const noexcept { return rib_routes; }
+  size_t fib_size() const noexcept { return fib[0].size() + fib[1].size(); }
+
+private:
+  typedef std::array<uint8_t, 16> addr_t;
+
+  // packed next hop: is_ecmp << 32 | l3_interface_id
+  typedef uint64_t nh_t;
+
+  static constexpr nh_t NH_INHERIT = UINT64_MAX;
+  static constexpr nh_t NH_MIXED = UINT64_MAX - 1;
+
+  /**
+   * forwarding state of a subtree independent of covering routes:
+   *  - nh == NH_INHERIT: all addresses use the covering route
+   *  - nh == NH_MIXED: different next hops are used
+   *  - otherwise all addresses use nh, or nh and the covering route if
+   *    partial is set
+   */
+  struct fwd_state {
+    nh_t nh;
+    bool partial;
+  };
+
+  struct node {
+    node(const addr_t &addr, uint8_t len, node *parent)
+        : addr(addr), len(len), has_route(false), nh(NH_INHERIT),
+          state{NH_INHERIT, false}, parent(parent) {}
+
+    addr_t addr;
+    uint8_t len;
+    bool has_route;
+    nh_t nh;
+    fwd_state state;
+    node *parent;
+    std::unique_ptr<node> child[2];
+  };
+
+  struct prefix {
+    addr_t addr;
+    uint8_t len;
+
+    bool operator<(const prefix &o) const {
+      return addr < o.addr || (addr == o.addr && len < o.len);
+    }
+  };
+
+  typedef std::map<prefix, nh_t> fib_t;
+
+  add_func add;
+  del_func del;
+
+  // index 0: AF_INET, index 1: AF_INET6
+  std::unique_ptr<node> root[2];
+  fib_t fib[2];
+  size_t rib_routes;
+
+  int update(nl_addr *dst, bool set, nh_t nh);
+
+  static int get_bit(const addr_t &a, unsigned pos) noexcept;
+  static unsigned common_prefix(const addr_t &a, const addr_t &b,
+                                unsigned max) noexcept;
+  static addr_t mask(const addr_t &a, unsigned len) noexcept;
+  static bool contains(const prefix &p, const addr_t &a) noexcept;
+
+  static fwd_state merge(const fwd_state &a, const fwd_state &b) noexcept;
+  static fwd_state resolve(const fwd_state &s, nh_t nh) noexcept;
+  static nh_t resolve_nh(const fwd_state &s, nh_t inherited) noexcept;
+  static void compute_state(node *n) noexcept;
+
+  node *insert(int idx, const addr_t &addr, uint8_t len);
+  node *remove(node *n);
+
+  void emit(const node *n, nh_t inherited, fib_t *out) const;
+  int reprogram(int idx, const node *n, nh_t inherited);
+};
+
+} // namespace basebox
@@ -0,0 +1,160 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace basebox {
+
+// 64 bit finalizer of murmur3, spreads all input bits over the result
+inline uint64_t nl_hash_mix(uint64_t h) noexcept {
+  h ^= h >> 33;
+  h *= UINT64_C(0xff51afd7ed558ccd);
+  h ^= h >> 33;
+  h *= UINT64_C(0xc4ceb9fe1a85ec53);
+  h ^= h >> 33;
+  return h;
+}
+
+/**
+ * open addressing hash map with linear probing
+ *
+ * Entries are stored inline in a single array, a separate array of one byte
+ * tags (7 bits of the hash) is probed first, so a lookup usually touches a
+ * single cache line of tags and a single entry. Erase uses backward shifting,
+ * hence there are no tombstones.
+ *
+ * Pointers returned are invalidated by emplace and erase.
+ */
+template <typename K, typename V, typename H = std::hash<K>>
+class nl_flat_map final {
+public:
+  typedef std::pair<K, V> value_type;
+
+  nl_flat_map() : count(0) {}
+
+  V *find(const K &key) noexcept {
+    if (count == 0)
+      return nullptr;
+
+    size_t h = hasher(key);
+    uint8_t t = tag(h);
+    for (size_t i = h & mask();; i = (i + 1) & mask()) {
+      if (ctrl[i] == 0)
+        return nullptr;
+      if (ctrl[i] == t && slots[i].first == key)
+        return &slots[i].second;
+    }
+  }
+
+  const V *find(const K &key) const noexcept {
+    return const_cast<nl_flat_map *>(this)->find(key);
+  }
+
+  /**
+   * @returns pointer to the value and true if the key was inserted
+   */
+  std::pair<V *, bool> emplace(const K &key, V value) {
+    V *v = find(key);
+    if (v)
+      return std::make_pair(v, false);
+
+    if ((count + 1) * 8 > ctrl.size() * 7)
+      rehash(ctrl.size() ? ctrl.size() * 2 : 16);
+
+    size_t i = insert_slot(hasher(key));
+    ctrl[i] = tag(hasher(key));
+    slots[i] = value_type(key, std::move(value));
+    count++;
+    return std::make_pair(&slots[i].second, true);
+  }
+
+  bool erase(const K &key) noexcept {
+    if (count == 0)
+      return false;
+
+    size_t h = hasher(key);
+    uint8_t t = tag(h);
+    size_t i = h & mask();
+    for (;; i = (i + 1) & mask()) {
+      if (ctrl[i] == 0)
+        return false;
+      if (ctrl[i] == t && slots[i].first == key)
+        break;
+    }
+
+    // shift back following entries that are not at their home slot
+    for (size_t j = (i + 1) & mask(); ctrl[j]; j = (j + 1) & mask()) {
+      size_t home = hasher(slots[j].first) & mask();
+      bool movable =
+          (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+      if (movable) {
+        ctrl[i] = ctrl[j];
+        slots[i] = std::move(slots[j]);
+        i = j;
+      }
+    }
+
+    ctrl[i] = 0;
+    slots[i] = value_type();
+    count--;
+    return true;
+  }
+
+  template <typename F> void for_each(F f) const {
+    for (size_t i = 0; i < ctrl.size(); i++) {
+      if (ctrl[i])
+        f(slots[i].first, slots[i].second);
+    }
+  }
+
+  void clear() noexcept {
+    ctrl.clear();
+    slots.clear();
+    count = 0;
+  }
+
+  size_t size() const noexcept { return count; }
+  bool empty() const noexcept { return count == 0; }
+
+private:
+  std::vector<uint8_t> ctrl; // 0: empty, otherwise 0x80 | 7 bits of hash
+  std::vector<value_type> slots;
+  size_t count;
+  H hasher;
+
+  size_t mask() const noexcept { return ctrl.size() - 1; }
+  static uint8_t tag(size_t h) noexcept {
+    return 0x80 | (h >> (sizeof(size_t) * 8 - 7));
+  }
+
+  size_t insert_slot(size_t h) const noexcept {
+    size_t i = h & mask();
+    while (ctrl[i])
+      i = (i + 1) & mask();
+    return i;
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<uint8_t> old_ctrl(capacity, 0);
+    std::vector<value_type> old_slots(capacity);
+    old_ctrl.swap(ctrl);
+    old_slots.swap(slots);
+
+    for (size_t i = 0; i < old_ctrl.size(); i++) {
+      if (old_ctrl[i] == 0)
+        continue;
+      size_t j = insert_slot(hasher(old_slots[i].first));
+      ctrl[j] = old_ctrl[i];
+      slots[j] = std::move(old_slots[i]);
+    }
+  }
+};
+
+} // namespace basebox
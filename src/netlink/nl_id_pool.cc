@@ -0,0 +1,170 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <exception>
+
+#include <glog/logging.h>
+
+#include "nl_id_pool.h"
+#include "utils/snapshot_file.h"
+
+namespace basebox {
+
+static const uint32_t id_pools_magic = 0x42424e4c; // "BBNL"
+static const uint32_t id_pools_version = 2;
+
+struct id_pools_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t n_pools;
+};
+
+struct id_pool_header {
+  uint32_t next;
+  uint32_t n_ids;
+};
+
+// followed by key_len uint32_t
+struct id_pool_entry {
+  uint32_t id;
+  uint32_t key_len;
+};
+
+uint32_t nl_id_pool::allocate(const key &k) {
+  auto it = ids.find(k);
+  if (it != ids.end())
+    return it->second;
+
+  uint32_t id;
+  auto r = reserved.find(k);
+  if (r != reserved.end()) {
+    id = r->second;
+    reserved.erase(r);
+    VLOG(2) << __FUNCTION__ << ": claimed reserved id=" << id;
+  } else {
+    id = next++;
+  }
+
+  ids.emplace(k, id);
+  return id;
+}
+
+void nl_id_pool::release(const key &k) noexcept { ids.erase(k); }
+
+std::map<nl_id_pool::key, uint32_t> nl_id_pool::drop_reserved() noexcept {
+  std::map<key, uint32_t> dropped;
+
+  dropped.swap(reserved);
+  return dropped;
+}
+
+nl_id_pools::nl_id_pools() {
+  // first id of each pool, by nl_id_pool_t
+  pools.emplace_back(1);           // NL_ID_L3_ECMP
+  pools.emplace_back(10);          // NL_ID_VXLAN_TUNNEL
+  pools.emplace_back(1 << 16 | 1); // NL_ID_VXLAN_PORT
+  pools.emplace_back(1);           // NL_ID_VXLAN_NEXT_HOP
+  pools.emplace_back(1);           // NL_ID_VXLAN_NEXT_HOP_GROUP
+  pools.emplace_back(1);           // NL_ID_VXLAN_PORT_TENANT
+  pools.emplace_back(1);           // NL_ID_VXLAN_NEXT_HOP_GROUP_MEMBER
+  assert(pools.size() == NL_ID_MAX);
+}
+
+int nl_id_pools::save(const std::string &path) const noexcept {
+  std::vector<uint8_t> buf;
+
+  try {
+    snapshot_append(&buf, id_pools_header{id_pools_magic, id_pools_version,
+                                          (uint32_t)pools.size()});
+    for (const auto &p : pools) {
+      // reserved ids are still in the switch until they are dropped
+      snapshot_append(&buf,
+                      id_pool_header{p.next, (uint32_t)(p.ids.size() +
+                                                        p.reserved.size())});
+      for (const auto *m : {&p.ids, &p.reserved}) {
+        for (const auto &e : *m) {
+          snapshot_append(&buf,
+                          id_pool_entry{e.second, (uint32_t)e.first.size()});
+          for (auto v : e.first)
+            snapshot_append(&buf, v);
+        }
+      }
+    }
+  } catch (std::exception &e) {
+    LOG(ERROR) << __FUNCTION__ << ": failed to serialize: " << e.what();
+    return -ENOMEM;
+  }
+
+  return snapshot_write(path, buf);
+}
+
+int nl_id_pools::load(const std::string &path) noexcept {
+  std::vector<uint8_t> buf;
+  id_pools_header hdr;
+  size_t off = 0;
+  size_t n = 0;
+
+  int rv = snapshot_read(path, &buf);
+  if (rv < 0)
+    return rv;
+
+  if (!snapshot_consume(buf, &off, &hdr) || hdr.magic != id_pools_magic ||
+      hdr.version != id_pools_version || hdr.n_pools != pools.size()) {
+    LOG(ERROR) << __FUNCTION__ << ": " << path << " is not an id snapshot";
+    return -EINVAL;
+  }
+
+  std::vector<std::pair<uint32_t, std::map<nl_id_pool::key, uint32_t>>>
+      loaded;
+  try {
+    for (uint32_t i = 0; i < hdr.n_pools; i++) {
+      id_pool_header ph;
+      if (!snapshot_consume(buf, &off, &ph))
+        return -EINVAL;
+
+      loaded.emplace_back(ph.next, std::map<nl_id_pool::key, uint32_t>());
+      for (uint32_t j = 0; j < ph.n_ids; j++) {
+        id_pool_entry e;
+        if (!snapshot_consume(buf, &off, &e) ||
+            e.key_len > (buf.size() - off) / sizeof(uint32_t))
+          return -EINVAL;
+
+        nl_id_pool::key k(e.key_len);
+        for (auto &v : k)
+          snapshot_consume(buf, &off, &v);
+        loaded.back().second.emplace(std::move(k), e.id);
+      }
+    }
+  } catch (std::exception &e) {
+    return -ENOMEM;
+  }
+
+  if (off != buf.size()) {
+    LOG(ERROR) << __FUNCTION__ << ": " << path << " has trailing data";
+    return -EINVAL;
+  }
+
+  for (size_t i = 0; i < pools.size(); i++) {
+    pools[i].next = std::max(pools[i].next, loaded[i].first);
+    pools[i].reserved = std::move(loaded[i].second);
+    n += pools[i].reserved.size();
+  }
+
+  LOG(INFO) << __FUNCTION__ << ": reserved " << n << " ids from " << path;
+  return 0;
+}
+
+size_t nl_id_pools::drop_reserved() noexcept {
+  size_t n = 0;
+
+  for (auto &p : pools)
+    n += p.drop_reserved().size();
+
+  return n;
+}
+
+} // namespace basebox
@@ -0,0 +1,89 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace basebox {
+
+/**
+ * Ids of switch objects allocated by the netlink subsystems.
+ *
+ * An id is allocated for the key of an object, e.g. the vni of a tunnel
+ * tenant or the members of an ECMP group. The ids in use are persisted next
+ * to the controller's state snapshot. A restarted baseboxd reserves them and
+ * hands out the same id once an object with the same key is created again,
+ * so the objects already in the switch keep their ids. Other ids are counted
+ * up and never reused.
+ */
+class nl_id_pool final {
+public:
+  typedef std::vector<uint32_t> key;
+
+  explicit nl_id_pool(uint32_t first) : next(first) {}
+
+  uint32_t allocate(const key &k);
+  void release(const key &k) noexcept;
+
+  /**
+   * forget the reserved ids that were not claimed
+   *
+   * @returns the keys and ids dropped, the objects are still in the switch
+   */
+  std::map<key, uint32_t> drop_reserved() noexcept;
+
+private:
+  friend class nl_id_pools;
+
+  uint32_t next;
+  std::map<key, uint32_t> ids;      // in use
+  std::map<key, uint32_t> reserved; // in use before the restart
+};
+
+class nl_id_pools final {
+public:
+  enum nl_id_pool_t {
+    NL_ID_L3_ECMP,
+    NL_ID_VXLAN_TUNNEL,
+    NL_ID_VXLAN_PORT,
+    NL_ID_VXLAN_NEXT_HOP,
+    NL_ID_VXLAN_NEXT_HOP_GROUP,
+    // relations, only the keys are used
+    NL_ID_VXLAN_PORT_TENANT,           // port id, tunnel id
+    NL_ID_VXLAN_NEXT_HOP_GROUP_MEMBER, // group id, next hop id
+    NL_ID_MAX,
+  };
+
+  nl_id_pools();
+
+  nl_id_pool &get(enum nl_id_pool_t id) noexcept { return pools[id]; }
+
+  /**
+   * @returns 0 on success, negative errno otherwise
+   */
+  int save(const std::string &path) const noexcept;
+
+  /**
+   * reserve the ids of a previous instance
+   *
+   * @returns 0 on success, -ENOENT if there is no snapshot, other negative
+   * errno if the snapshot is unusable
+   */
+  int load(const std::string &path) noexcept;
+
+  size_t drop_reserved() noexcept;
+
+private:
+  nl_id_pools(const nl_id_pools &) = delete;
+  nl_id_pools &operator=(const nl_id_pools &) = delete;
+
+  std::vector<nl_id_pool> pools; // by nl_id_pool_t
+};
+
+} // namespace basebox
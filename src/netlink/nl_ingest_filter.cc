@@ -0,0 +1,197 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include <arpa/inet.h>
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "nl_ingest_filter.h"
+
+DEFINE_string(nl_route_tables, "",
+              "Comma separated route table ids to offload (empty: all)");
+DEFINE_string(nl_route_protocols, "",
+              "Comma separated route protocols to offload (empty: all)");
+DEFINE_string(nl_families, "",
+              "Comma separated address families to offload, inet and/or "
+              "inet6 (empty: both)");
+DEFINE_bool(nl_switch_neighbours_only, false,
+            "Ignore neighbours on interfaces not backed by switch ports");
+
+namespace basebox {
+
+// offsets into a route or neighbour message, both start with the family
+static const uint32_t off_nlmsg_type = offsetof(struct nlmsghdr, nlmsg_type);
+static const uint32_t off_family = NLMSG_HDRLEN;
+static const uint32_t off_rtm_table =
+    NLMSG_HDRLEN + offsetof(struct rtmsg, rtm_table);
+static const uint32_t off_rtm_protocol =
+    NLMSG_HDRLEN + offsetof(struct rtmsg, rtm_protocol);
+
+static const uint32_t bpf_accept = 0xffffffff;
+static const uint32_t bpf_drop = 0;
+
+template <typename T>
+static void parse_list(const std::string &flag, const std::string &list,
+                       uint32_t max, std::set<T> *values) {
+  std::istringstream ss(list);
+  std::string item;
+
+  while (std::getline(ss, item, ',')) {
+    if (item.empty())
+      continue;
+
+    char *end = nullptr;
+    unsigned long v = strtoul(item.c_str(), &end, 0);
+    if (*end != '\0' || v > max)
+      LOG(FATAL) << __FUNCTION__ << ": invalid value '" << item << "' in --"
+                 << flag;
+
+    values->insert(v);
+  }
+}
+
+nl_ingest_filter::nl_ingest_filter()
+    : switch_neighbours_only(FLAGS_nl_switch_neighbours_only) {
+  std::istringstream ss(FLAGS_nl_families);
+  std::string item;
+
+  parse_list("nl_route_tables", FLAGS_nl_route_tables, UINT32_MAX, &tables);
+  parse_list("nl_route_protocols", FLAGS_nl_route_protocols, UINT8_MAX,
+             &protocols);
+
+  while (std::getline(ss, item, ',')) {
+    if (item == "inet")
+      families.insert(AF_INET);
+    else if (item == "inet6")
+      families.insert(AF_INET6);
+    else if (!item.empty())
+      LOG(FATAL) << __FUNCTION__ << ": invalid family '" << item
+                 << "' in --nl_families";
+  }
+}
+
+bool nl_ingest_filter::accept_route(uint8_t family, uint32_t table,
+                                    uint8_t protocol) const noexcept {
+  return (families.empty() || families.count(family)) &&
+         (tables.empty() || tables.count(table)) &&
+         (protocols.empty() || protocols.count(protocol));
+}
+
+bool nl_ingest_filter::accept_neigh(uint8_t family) const noexcept {
+  if (family != AF_INET && family != AF_INET6)
+    return true; // fdb entries
+
+  return families.empty() || families.count(family);
+}
+
+std::vector<struct sock_filter> nl_ingest_filter::bpf_program() const {
+  std::vector<struct sock_filter> route;
+  std::vector<struct sock_filter> neigh;
+  std::vector<struct sock_filter> prog;
+
+  // continues after the check if the byte at off is one of values
+  auto check = [&route](uint32_t off, const std::set<uint8_t> &values) {
+    if (values.empty())
+      return;
+
+    uint8_t n = values.size();
+    route.push_back(BPF_STMT(BPF_LD | BPF_B | BPF_ABS, off));
+    for (auto v : values)
+      route.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, v, n--, 0));
+    route.push_back(BPF_STMT(BPF_RET | BPF_K, bpf_drop));
+  };
+
+  std::set<uint8_t> small_tables;
+  for (auto t : tables)
+    small_tables.insert(t > UINT8_MAX ? RT_TABLE_COMPAT : t);
+
+  check(off_family, families);
+  check(off_rtm_table, small_tables);
+  check(off_rtm_protocol, protocols);
+  route.push_back(BPF_STMT(BPF_RET | BPF_K, bpf_accept));
+
+  std::set<uint8_t> dropped;
+  if (!families.empty()) {
+    for (uint8_t family : {AF_INET, AF_INET6}) {
+      if (!families.count(family))
+        dropped.insert(family);
+    }
+  }
+
+  if (!dropped.empty()) {
+    uint8_t n = dropped.size();
+    neigh.push_back(BPF_STMT(BPF_LD | BPF_B | BPF_ABS, off_family));
+    for (auto family : dropped)
+      neigh.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, family, n--, 0));
+  }
+  neigh.push_back(BPF_STMT(BPF_RET | BPF_K, bpf_accept));
+  neigh.push_back(BPF_STMT(BPF_RET | BPF_K, bpf_drop));
+
+  // jump offsets are limited to 8 bits
+  if (route.size() + 2 > UINT8_MAX)
+    return prog;
+
+  // dispatch on the message type, the type is loaded in network byte order
+  uint8_t to_route = 4, to_neigh = 2 + route.size();
+  prog.push_back(BPF_STMT(BPF_LD | BPF_H | BPF_ABS, off_nlmsg_type));
+  prog.push_back(
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohs(RTM_NEWROUTE), to_route--, 0));
+  prog.push_back(
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohs(RTM_DELROUTE), to_route--, 0));
+  prog.push_back(
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohs(RTM_NEWNEIGH), to_neigh--, 0));
+  prog.push_back(
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohs(RTM_DELNEIGH), to_neigh--, 0));
+  prog.push_back(BPF_STMT(BPF_RET | BPF_K, bpf_accept));
+  prog.insert(prog.end(), route.begin(), route.end());
+  prog.insert(prog.end(), neigh.begin(), neigh.end());
+
+  return prog;
+}
+
+int nl_ingest_filter::attach(int fd) const noexcept {
+  if (tables.empty() && protocols.empty() && families.empty())
+    return 0;
+
+  try {
+    std::vector<struct sock_filter> prog = bpf_program();
+    if (prog.empty()) {
+      LOG(WARNING) << __FUNCTION__
+                   << ": too many values for a socket filter, filtering in "
+                      "user space only";
+      return 0;
+    }
+
+    struct sock_fprog fprog = {static_cast<unsigned short>(prog.size()),
+                               prog.data()};
+
+    int rv = setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog,
+                        sizeof(fprog));
+    if (rv < 0) {
+      rv = -errno;
+      LOG(ERROR) << __FUNCTION__
+                 << ": failed to attach socket filter: " << strerror(-rv);
+      return rv;
+    }
+
+    VLOG(1) << __FUNCTION__ << ": attached socket filter with " << prog.size()
+            << " instructions";
+  } catch (std::exception &e) {
+    LOG(ERROR) << __FUNCTION__ << ": caught " << e.what();
+    return -ENOMEM;
+  }
+
+  return 0;
+}
+
+} // namespace basebox
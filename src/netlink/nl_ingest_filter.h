@@ -0,0 +1,63 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+#include <linux/filter.h>
+
+namespace basebox {
+
+/**
+ * Selection of the kernel state baseboxd ingests.
+ *
+ * Routes can be restricted to route tables, protocols and address families,
+ * neighbours to address families and interfaces backed by switch ports. An
+ * empty selection accepts everything.
+ *
+ * The checks on the fixed size message headers are compiled into a BPF
+ * socket filter, so the kernel drops those messages before they are
+ * received. Table ids above 255 and the interface check are only applied
+ * in user space.
+ */
+class nl_ingest_filter final {
+public:
+  // configured from the command line
+  nl_ingest_filter();
+
+  bool enabled() const noexcept {
+    return !tables.empty() || !protocols.empty() || !families.empty() ||
+           switch_neighbours_only;
+  }
+
+  bool accept_route(uint8_t family, uint32_t table,
+                    uint8_t protocol) const noexcept;
+
+  // the interface check is left to the caller, see neighbours_on_ports
+  bool accept_neigh(uint8_t family) const noexcept;
+
+  // neighbours on interfaces not backed by switch ports are dropped
+  bool neighbours_on_ports() const noexcept { return switch_neighbours_only; }
+
+  /**
+   * attach the BPF filter to the socket, nothing is attached if the header
+   * checks accept everything
+   *
+   * @returns 0 on success, negative errno otherwise
+   */
+  int attach(int fd) const noexcept;
+
+private:
+  std::set<uint32_t> tables;
+  std::set<uint8_t> protocols;
+  std::set<uint8_t> families; // AF_INET and AF_INET6
+  bool switch_neighbours_only;
+
+  std::vector<struct sock_filter> bpf_program() const;
+};
+
+} // namespace basebox
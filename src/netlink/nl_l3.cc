@@ -4,10 +4,12 @@
 
 #include <net/if.h>
 #include <memory>
-#include <tuple>
-#include <unordered_map>
+#include <cassert>
+#include <set>
 #include <utility>
+#include <vector>
 
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <netlink/route/addr.h>
 #include <netlink/route/link.h>
@@ -16,64 +18,128 @@
 #include <netlink/route/route.h>
 
 #include "cnetlink.h"
-#include "nl_hashing.h"
+#include "nl_fib_aggregator.h"
+#include "nl_flat_map.h"
 #include "nl_l3.h"
 #include "nl_output.h"
 #include "nl_vlan.h"
 #include "sai.h"
 #include "utils/rofl-utils.h"
 
-namespace std {
+DEFINE_bool(fib_aggregation, false,
+            "Aggregate routes before programming the unicast routing table");
 
-template <> struct hash<rofl::caddress_ll> {
-  using argument_type = rofl::caddress_ll;
-  using result_type = std::size_t;
-  result_type operator()(argument_type const &lla) const noexcept {
-    return std::hash<uint64_t>{}(lla.get_mac());
+namespace basebox {
+
+// l3 interface id of the routes sending packets to the controller, the
+// prefixes of local addresses use it
+static const uint32_t to_controller = 0;
+
+class l3_interface final {
+public:
+  l3_interface(uint32_t l3_interface_id = 0)
+      : l3_interface_id(l3_interface_id), refcnt(1) {}
+
+  uint32_t l3_interface_id;
+  int refcnt;
+};
+
+/**
+ * next hop mapping key: <port_id, vid, src_mac, dst_mac> packed into 128 bit
+ *
+ * hi: src_mac << 16 | dst_mac >> 32
+ * lo: dst_mac << 32 | port_id << 12 | vid
+ *
+ * port_id uses 20 bits, which covers the port number and the port type set by
+ * nbi::combine_port_type.
+ */
+struct l3_interface_key {
+  uint64_t hi;
+  uint64_t lo;
+
+  l3_interface_key() : hi(0), lo(0) {}
+  l3_interface_key(uint32_t port_id, uint16_t vid,
+                   const rofl::caddress_ll &src_mac,
+                   const rofl::caddress_ll &dst_mac)
+      : hi(src_mac.get_mac() << 16 | dst_mac.get_mac() >> 32),
+        lo(dst_mac.get_mac() << 32 | (uint64_t)(port_id & 0xfffff) << 12 |
+           (vid & 0xfff)) {
+    assert(port_id <= 0xfffff);
+  }
+
+  bool operator==(const l3_interface_key &o) const {
+    return hi == o.hi && lo == o.lo;
   }
 };
 
-template <class T, class A> struct hash<std::set<T, A>> {
-  using argument_type = std::set<T, A>;
-  using result_type = std::size_t;
-  result_type operator()(argument_type const &arg) const noexcept {
-    result_type seed = 0;
-    for (const auto v : arg) {
-      hash_combine(seed, v);
-    }
-    return seed;
+// termination mac key: <port_id, vid, mac, ethertype> packed into 128 bit
+struct termination_mac_key {
+  uint64_t hi; // mac << 16 | vid
+  uint64_t lo; // port_id << 16 | ethertype
+
+  termination_mac_key() : hi(0), lo(0) {}
+  termination_mac_key(uint32_t port_id, uint16_t vid,
+                      const rofl::caddress_ll &mac, uint16_t eth_type)
+      : hi(mac.get_mac() << 16 | vid),
+        lo((uint64_t)port_id << 16 | eth_type) {}
+
+  bool operator==(const termination_mac_key &o) const {
+    return hi == o.hi && lo == o.lo;
   }
 };
 
-} // namespace std
+struct packed_key_hash {
+  template <typename T> size_t operator()(const T &k) const noexcept {
+    return nl_hash_mix(k.hi ^ nl_hash_mix(k.lo));
+  }
+};
 
-namespace basebox {
+// ECMP mapping key: sorted member l3 interface ids and their fingerprint
+struct l3_ecmp_key {
+  std::vector<uint32_t> ids;
+  uint64_t fingerprint;
 
-class l3_interface final {
-public:
-  l3_interface(uint32_t l3_interface_id)
-      : l3_interface_id(l3_interface_id), refcnt(1) {}
+  l3_ecmp_key() : fingerprint(0) {}
+  explicit l3_ecmp_key(const std::set<uint32_t> &members)
+      : ids(members.begin(), members.end()), fingerprint(ids.size()) {
+    for (auto id : ids)
+      fingerprint = nl_hash_mix(fingerprint ^ id);
+  }
 
-  uint32_t l3_interface_id;
-  int refcnt;
+  bool operator==(const l3_ecmp_key &o) const {
+    return fingerprint == o.fingerprint && ids == o.ids;
+  }
+};
+
+struct l3_ecmp_key_hash {
+  size_t operator()(const l3_ecmp_key &k) const noexcept {
+    return k.fingerprint;
+  }
 };
 
-// next hop mapping key: <port_id, vid, src_mac, dst_mac>
-std::unordered_multimap<
-    std::tuple<int, uint16_t, rofl::caddress_ll, rofl::caddress_ll>,
-    l3_interface>
+nl_flat_map<l3_interface_key, l3_interface, packed_key_hash>
     l3_interface_mapping;
 
-// key: source port_id, vid, src_mac, ethertype ; value: refcount
-std::unordered_multimap<std::tuple<int, uint16_t, rofl::caddress_ll, uint16_t>,
-                        int>
-    termination_mac_mapping;
+// value: refcount
+nl_flat_map<termination_mac_key, int, packed_key_hash> termination_mac_mapping;
 
-// ECMP mapping
-std::unordered_multimap<std::set<uint32_t>, l3_interface> l3_ecmp_mapping;
+nl_flat_map<l3_ecmp_key, l3_interface, l3_ecmp_key_hash> l3_ecmp_mapping;
 
 nl_l3::nl_l3(std::shared_ptr<nl_vlan> vlan, cnetlink *nl)
-    : sw(nullptr), vlan(std::move(vlan)), nl(nl) {}
+    : sw(nullptr), vlan(std::move(vlan)), nl(nl) {
+  if (FLAGS_fib_aggregation) {
+    LOG(INFO) << __FUNCTION__ << ": fib aggregation enabled";
+    fib.reset(new nl_fib_aggregator(
+        [this](nl_addr *dst, uint32_t l3_interface_id, bool is_ecmp,
+               bool update_route) {
+          return sw_add_l3_unicast_route(dst, l3_interface_id, is_ecmp,
+                                         update_route);
+        },
+        [this](nl_addr *dst) { return sw_del_l3_unicast_route(dst); }));
+  }
+}
+
+nl_l3::~nl_l3() = default;
 
 rofl::caddress_ll libnl_lladdr_2_rofl(const struct nl_addr *lladdr) {
   // XXX check for family
@@ -191,16 +257,7 @@ int nl_l3::add_l3_addr(struct rtnl_addr *a) {
   }
 
   // get v4 dst (local v4 addr)
-  auto prefixlen = rtnl_addr_get_prefixlen(a);
   auto addr = rtnl_addr_get_local(a);
-  rofl::caddress_in4 ipv4_dst = libnl_in4addr_2_rofl(addr, &rv);
-  rofl::caddress_in4 mask = rofl::build_mask_in4(prefixlen);
-
-  if (rv < 0) {
-    // TODO shall we remove the l3_termination mac?
-    LOG(ERROR) << __FUNCTION__ << ": could not parse addr " << addr;
-    return rv;
-  }
 
   if (is_loopback) {
     auto p = nl_addr_alloc(255);
@@ -212,15 +269,10 @@ int nl_l3::add_l3_addr(struct rtnl_addr *a) {
       return 0;
     }
 
-    if (prefixlen == 32)
-      rv = sw->l3_unicast_host_add(ipv4_dst, 0, false, false);
-    else
-      rv = sw->l3_unicast_route_add(ipv4_dst, mask, 0, false, false);
-
-    return rv;
+    return add_l3_unicast_route(addr, to_controller, false, false);
   }
 
-  rv = sw->l3_unicast_route_add(ipv4_dst, mask, 0, false, false);
+  rv = add_l3_unicast_route(addr, to_controller, false, false);
   if (rv < 0) {
     // TODO shall we remove the l3_termination mac?
     LOG(ERROR) << __FUNCTION__ << ": failed to setup l3 addr " << addr;
@@ -269,14 +321,16 @@ int nl_l3::add_l3_addr_v6(struct rtnl_addr *a) {
     }
 
     // All link local addresses have a prefix length of /10
-    rofl::caddress_in6 mask = rofl::build_mask_in6(10);
+    std::unique_ptr<nl_addr, decltype(&nl_addr_put)> ll_dst(
+        nl_addr_clone(addr), nl_addr_put);
+    nl_addr_set_prefixlen(ll_dst.get(), 10);
 
     VLOG(2) << __FUNCTION__ << ": added link local addr " << OBJ_CAST(a);
-    rv = sw->l3_unicast_route_add(ipv6_dst, mask, 0, false, false);
+    rv = add_l3_unicast_route(ll_dst.get(), to_controller, false, false);
     if (rv < 0) {
       LOG(ERROR) << __FUNCTION__
                  << ": could not add unicast route ipv6_dst=" << ipv6_dst
-                 << ", mask=" << mask;
+                 << "/10";
       return rv;
     }
   }
@@ -299,16 +353,7 @@ int nl_l3::add_l3_addr_v6(struct rtnl_addr *a) {
     return rv;
   }
 
-  auto prefixlen = rtnl_addr_get_prefixlen(a);
-  rofl::caddress_in6 ipv6_dst = libnl_in6addr_2_rofl(addr, &rv);
-  rofl::caddress_in6 mask = rofl::build_mask_in6(prefixlen);
-
-  if (rv < 0) {
-    LOG(ERROR) << __FUNCTION__ << ": could not parse addr " << addr;
-    return rv;
-  }
-
-  rv = sw->l3_unicast_route_add(ipv6_dst, mask, 0, false, false);
+  rv = add_l3_unicast_route(addr, to_controller, false, false);
   if (rv < 0) {
     LOG(ERROR) << __FUNCTION__ << ": failed to setup address " << OBJ_CAST(a);
     return rv;
@@ -343,21 +388,7 @@ int nl_l3::add_lo_addr_v6(struct rtnl_addr *a) {
     return rv;
   }
 
-  auto prefixlen = rtnl_addr_get_prefixlen(a);
-  rofl::caddress_in6 ipv6_dst = libnl_in6addr_2_rofl(addr, &rv);
-  auto mask = rofl::build_mask_in6(prefixlen);
-
-  if (rv < 0) {
-    LOG(ERROR) << __FUNCTION__ << ": could not parse addr " << addr;
-    return rv;
-  }
-
-  if (prefixlen == 128)
-    rv = sw->l3_unicast_host_add(ipv6_dst, 0, false, false);
-  else
-    rv = sw->l3_unicast_route_add(ipv6_dst, mask, 0, false, false);
-
-  return rv;
+  return add_l3_unicast_route(addr, to_controller, false, false);
 }
 
 int nl_l3::del_l3_addr(struct rtnl_addr *a) {
@@ -374,38 +405,10 @@ int nl_l3::del_l3_addr(struct rtnl_addr *a) {
 
   struct nl_addr *addr = rtnl_addr_get_local(a);
 
-  int prefixlen = nl_addr_get_prefixlen(addr);
-
   // XXX TODO remove vlan
 
-  if (family == AF_INET) {
-    rofl::caddress_in4 ipv4_dst = libnl_in4addr_2_rofl(addr, &rv);
-    if (rv < 0) {
-      LOG(ERROR) << __FUNCTION__ << ": could not parse addr " << addr;
-      return rv;
-    }
-
-    if (prefixlen == 32) {
-      rv = sw->l3_unicast_host_remove(ipv4_dst);
-    } else {
-      rofl::caddress_in4 mask = rofl::build_mask_in4(prefixlen);
-      rv = sw->l3_unicast_route_remove(ipv4_dst, mask);
-    }
-  } else {
-    assert(family == AF_INET6);
-    rofl::caddress_in6 ipv6_dst = libnl_in6addr_2_rofl(addr, &rv);
-    if (rv < 0) {
-      LOG(ERROR) << __FUNCTION__ << ": could not parse addr " << addr;
-      return rv;
-    }
-
-    if (prefixlen == 128) {
-      rv = sw->l3_unicast_host_remove(ipv6_dst);
-    } else {
-      rofl::caddress_in6 mask = rofl::build_mask_in6(prefixlen);
-      rv = sw->l3_unicast_route_remove(ipv6_dst, mask);
-    }
-  }
+  assert(family == AF_INET || family == AF_INET6);
+  rv = del_l3_unicast_route(addr);
 
   struct rtnl_link *link = rtnl_addr_get_link(a);
   if (link == nullptr) {
@@ -564,8 +567,8 @@ int nl_l3::add_l3_neigh(struct rtnl_neigh *n) {
 
   for (auto cb = std::begin(nh_callbacks); cb != std::end(nh_callbacks);) {
     if (cb->second.nh.ifindex == rtnl_neigh_get_ifindex(n) &&
-        nl_addr_get_family(cb->second.np.addr) == rtnl_neigh_get_family(n) &&
-        nl_addr_cmp(cb->second.np.addr, rtnl_neigh_get_dst(n)) == 0) {
+        nl_addr_get_family(cb->second.nh.nh) == rtnl_neigh_get_family(n) &&
+        nl_addr_cmp(cb->second.nh.nh, rtnl_neigh_get_dst(n)) == 0) {
       // XXX TODO add l3_interface?
       cb->first->nh_reachable_notification(cb->second);
       cb = nh_callbacks.erase(cb);
@@ -675,54 +678,34 @@ int nl_l3::update_l3_neigh(struct rtnl_neigh *n_old, struct rtnl_neigh *n_new) {
     VLOG(2) << __FUNCTION__ << " : source old mac " << s_mac << " dst old mac  "
             << n_ll_old << " dst new mac " << n_ll_new;
 
-    auto l3_if_old_tuple =
-        std::make_tuple(port_id, vid, libnl_lladdr_2_rofl(s_mac),
-                        libnl_lladdr_2_rofl(n_ll_old));
-    auto l3_if_new_tuple =
-        std::make_tuple(port_id, vid, libnl_lladdr_2_rofl(s_mac),
-                        libnl_lladdr_2_rofl(n_ll_new));
+    l3_interface_key l3_if_old_key(port_id, vid, libnl_lladdr_2_rofl(s_mac),
+                                   libnl_lladdr_2_rofl(n_ll_old));
+    l3_interface_key l3_if_new_key(port_id, vid, libnl_lladdr_2_rofl(s_mac),
+                                   libnl_lladdr_2_rofl(n_ll_new));
 
     // Obtain l3_interface_id
-    auto it_range = l3_interface_mapping.equal_range(l3_if_old_tuple);
-    if (it_range.first == l3_interface_mapping.end()) {
+    l3_interface *l3_if = l3_interface_mapping.find(l3_if_old_key);
+    if (l3_if == nullptr) {
       LOG(ERROR) << __FUNCTION__ << ": could not retrieve neighbor";
       return -EINVAL;
     }
 
-    uint32_t l3_interface_id = 0;
-    auto it = it_range.first;
-    for (; it != it_range.second; ++it) {
-      if (l3_if_old_tuple == it->first) {
-        l3_interface_id = it->second.l3_interface_id;
-
-        rv = sw->l3_egress_update(port_id, vid, libnl_lladdr_2_rofl(s_mac),
-                                  libnl_lladdr_2_rofl(n_ll_new),
-                                  &l3_interface_id);
-        if (rv < 0) {
-          VLOG(2) << __FUNCTION__ << ": failed to add neighbor";
-          return -EINVAL;
-        }
-        break;
-
-      } else {
-        VLOG(2) << __FUNCTION__ << ": skipping interface";
-      }
-    }
-
-    if (it_range.first == it_range.second) {
-      LOG(ERROR) << __FUNCTION__ << ": could not update neighbor";
+    if (l3_interface_mapping.find(l3_if_new_key)) {
+      LOG(ERROR) << __FUNCTION__ << ": neighbor already present";
       return -EINVAL;
     }
 
-    it_range = l3_interface_mapping.equal_range(l3_if_new_tuple);
-    if (it_range.first != l3_interface_mapping.end()) {
-      LOG(ERROR) << __FUNCTION__ << ": neighbor already present";
+    l3_interface entry = *l3_if;
+    rv = sw->l3_egress_update(port_id, vid, libnl_lladdr_2_rofl(s_mac),
+                              libnl_lladdr_2_rofl(n_ll_new),
+                              &entry.l3_interface_id);
+    if (rv < 0) {
+      VLOG(2) << __FUNCTION__ << ": failed to add neighbor";
       return -EINVAL;
     }
 
-    l3_interface_mapping.erase(it->first);
-    l3_interface_mapping.emplace(
-        std::make_pair(l3_if_new_tuple, l3_interface(l3_interface_id)));
+    l3_interface_mapping.erase(l3_if_old_key);
+    l3_interface_mapping.emplace(l3_if_new_key, entry);
 
   } else {
     // nothing changed besides the nud
@@ -808,10 +791,10 @@ int nl_l3::add_l3_egress(int ifindex, const uint16_t vid,
   // setup egress L3 Unicast group
   rofl::caddress_ll src_mac = libnl_lladdr_2_rofl(s_mac);
   rofl::caddress_ll dst_mac = libnl_lladdr_2_rofl(d_mac);
-  auto l3_if_tuple = std::make_tuple(port_id, vid, src_mac, dst_mac);
-  auto it = l3_interface_mapping.equal_range(l3_if_tuple);
+  l3_interface_key l3_if_key(port_id, vid, src_mac, dst_mac);
+  l3_interface *l3_if = l3_interface_mapping.find(l3_if_key);
 
-  if (it.first == l3_interface_mapping.end()) {
+  if (l3_if == nullptr) {
     rv = sw->l3_egress_create(port_id, vid, src_mac, dst_mac, l3_interface_id);
 
     if (rv < 0) {
@@ -822,18 +805,12 @@ int nl_l3::add_l3_egress(int ifindex, const uint16_t vid,
       return rv;
     }
 
-    l3_interface_mapping.emplace(
-        std::make_pair(l3_if_tuple, l3_interface(*l3_interface_id)));
+    l3_interface_mapping.emplace(l3_if_key, l3_interface(*l3_interface_id));
   } else {
-    for (auto i = it.first; i != it.second; ++i) {
-      if (i->first == l3_if_tuple) {
-        if (l3_interface_id)
-          *l3_interface_id = i->second.l3_interface_id;
-        i->second.refcnt++;
-        rv = 0;
-        break;
-      }
-    }
+    if (l3_interface_id)
+      *l3_interface_id = l3_if->l3_interface_id;
+    l3_if->refcnt++;
+    rv = 0;
   }
 
   return rv;
@@ -853,32 +830,30 @@ int nl_l3::del_l3_egress(int ifindex, uint16_t vid, const struct nl_addr *s_mac,
 
   rofl::caddress_ll src_mac = libnl_lladdr_2_rofl(s_mac);
   rofl::caddress_ll dst_mac = libnl_lladdr_2_rofl(d_mac);
-  auto l3_if_tuple = std::make_tuple(port_id, vid, src_mac, dst_mac);
-  auto it = l3_interface_mapping.equal_range(l3_if_tuple);
-
-  for (auto i = it.first; i != it.second; ++i) {
-    if (i->first == l3_if_tuple) {
-      i->second.refcnt--;
-      VLOG(2) << __FUNCTION__ << ": port_id=" << port_id << ", vid=" << vid
-              << ", s_mac=" << s_mac << ", d_mac=" << d_mac
-              << ", refcnt=" << i->second.refcnt;
-
-      if (i->second.refcnt == 0) {
-        // remove egress L3 Unicast group
-        int rv = sw->l3_egress_remove(i->second.l3_interface_id);
-
-        l3_interface_mapping.erase(i);
-
-        if (rv < 0) {
-          LOG(ERROR) << __FUNCTION__
-                     << ": failed to setup l3 egress port_id=" << port_id
-                     << ", vid=" << vid << ", src_mac=" << src_mac
-                     << ", dst_mac=" << dst_mac << "; rv=" << rv;
-          return rv;
-        }
+  l3_interface_key l3_if_key(port_id, vid, src_mac, dst_mac);
+  l3_interface *l3_if = l3_interface_mapping.find(l3_if_key);
+
+  if (l3_if) {
+    l3_if->refcnt--;
+    VLOG(2) << __FUNCTION__ << ": port_id=" << port_id << ", vid=" << vid
+            << ", s_mac=" << s_mac << ", d_mac=" << d_mac
+            << ", refcnt=" << l3_if->refcnt;
+
+    if (l3_if->refcnt == 0) {
+      // remove egress L3 Unicast group
+      int rv = sw->l3_egress_remove(l3_if->l3_interface_id);
+
+      l3_interface_mapping.erase(l3_if_key);
+
+      if (rv < 0) {
+        LOG(ERROR) << __FUNCTION__
+                   << ": failed to setup l3 egress port_id=" << port_id
+                   << ", vid=" << vid << ", src_mac=" << src_mac
+                   << ", dst_mac=" << dst_mac << "; rv=" << rv;
+        return rv;
       }
-      return 0;
     }
+    return 0;
   }
 
   LOG(ERROR) << __FUNCTION__
@@ -897,6 +872,7 @@ int nl_l3::add_l3_route(struct rtnl_route *r) {
   switch (rtnl_route_get_type(r)) {
   case RTN_UNICAST:
     rv = add_l3_unicast_route(r, false);
+    notify_route_changed(r);
     break;
   case RTN_UNSPEC:
   case RTN_LOCAL:
@@ -948,6 +924,7 @@ int nl_l3::update_l3_route(struct rtnl_route *r_old, struct rtnl_route *r_new) {
   switch (rtnl_route_get_type(r_old)) {
   case RTN_UNICAST:
     rv = update_l3_unicast_route(r_old, r_new);
+    notify_route_changed(r_new);
     break;
   case RTN_UNSPEC:
   case RTN_LOCAL:
@@ -975,8 +952,11 @@ int nl_l3::del_l3_route(struct rtnl_route *r) {
   assert(r);
 
   switch (rtnl_route_get_type(r)) {
-  case RTN_UNICAST:
-    return del_l3_unicast_route(r, false);
+  case RTN_UNICAST: {
+    int rv = del_l3_unicast_route(r, false);
+    notify_route_changed(r);
+    return rv;
+  }
   case RTN_UNSPEC:
   case RTN_LOCAL:
   case RTN_BROADCAST:
@@ -1000,24 +980,14 @@ int nl_l3::add_l3_termination(uint32_t port_id, uint16_t vid,
   int rv = 0;
 
   // lookup if this already exists
-  auto needle = std::make_tuple(port_id, vid, mac, static_cast<uint16_t>(af));
-  auto tmac_lookup_range = termination_mac_mapping.equal_range(needle);
-  auto i = tmac_lookup_range.first;
-  for (; i != tmac_lookup_range.second; ++i) {
-    if (i->first == needle) {
-      // found, increment refcount
-      i->second++;
-      return 0;
-    }
+  termination_mac_key needle(port_id, vid, mac, static_cast<uint16_t>(af));
+  auto tmac = termination_mac_mapping.emplace(needle, 1);
+  if (!tmac.second) {
+    // found, increment refcount
+    (*tmac.first)++;
+    return 0;
   }
 
-  // not found, add
-  if (tmac_lookup_range.first != termination_mac_mapping.end())
-    termination_mac_mapping.emplace_hint(tmac_lookup_range.first,
-                                         std::move(needle), 1);
-  else
-    termination_mac_mapping.emplace(std::move(needle), 1);
-
   switch (af) {
   case AF_INET:
     rv = sw->l3_termination_add(port_id, vid, mac);
@@ -1043,20 +1013,11 @@ int nl_l3::del_l3_termination(uint32_t port_id, uint16_t vid,
           << ", vid=" << vid << ", mac=" << mac << ", af=" << af;
 
   // lookup if this already exists
-  auto needle = std::make_tuple(port_id, vid, mac, static_cast<uint16_t>(af));
-  auto tmac_lookup_range = termination_mac_mapping.equal_range(needle);
-  auto i = tmac_lookup_range.first;
-  for (; i != tmac_lookup_range.second; ++i) {
-    if (i->first == needle) {
-      // found, decrement refcount
-      --i->second;
-      VLOG(4) << __FUNCTION__ << ": found new refcount=" << i->second;
-      break;
-    }
-  }
+  termination_mac_key needle(port_id, vid, mac, static_cast<uint16_t>(af));
+  int *refcnt = termination_mac_mapping.find(needle);
 
   // check if not found
-  if (i == termination_mac_mapping.end()) {
+  if (refcnt == nullptr) {
     LOG(WARNING)
         << __FUNCTION__
         << ": tried to delete a non existing termination mac for port_id="
@@ -1064,9 +1025,13 @@ int nl_l3::del_l3_termination(uint32_t port_id, uint16_t vid,
     return 0;
   }
 
+  // found, decrement refcount
+  --(*refcnt);
+  VLOG(4) << __FUNCTION__ << ": found new refcount=" << *refcnt;
+
   // still existing references
-  if (i->second > 0) {
-    VLOG(4) << __FUNCTION__ << ": got references " << i->second;
+  if (*refcnt > 0) {
+    VLOG(4) << __FUNCTION__ << ": got references " << *refcnt;
     return 0;
   }
 
@@ -1084,7 +1049,7 @@ int nl_l3::del_l3_termination(uint32_t port_id, uint16_t vid,
     break;
   }
 
-  termination_mac_mapping.erase(i);
+  termination_mac_mapping.erase(needle);
 
   return rv;
 }
@@ -1179,42 +1144,60 @@ void nl_l3::notify_on_net_reachable(net_reachable *f,
 
 void nl_l3::notify_on_nh_reachable(nh_reachable *f,
                                    struct nh_params p) noexcept {
+  // a next hop is waited for once per listener and network
+  for (const auto &cb : nh_callbacks) {
+    if (cb.first == f && cb.second.nh.ifindex == p.nh.ifindex &&
+        cb.second.np.ifindex == p.np.ifindex &&
+        nl_addr_cmp(cb.second.nh.nh, p.nh.nh) == 0 &&
+        nl_addr_cmp(cb.second.np.addr, p.np.addr) == 0)
+      return;
+  }
+
   nh_callbacks.emplace_back(f, p);
 }
 
+void nl_l3::notify_on_route_changed(route_changed *f) noexcept {
+  route_callbacks.push_back(f);
+}
+
+void nl_l3::notify_route_changed(rtnl_route *r) noexcept {
+  for (auto f : route_callbacks)
+    f->route_changed_notification(r);
+}
+
 int nl_l3::get_l3_interface_id(rtnl_neigh *n, uint32_t *l3_interface_id) {
   assert(l3_interface_id);
 
   struct nl_addr *d_mac = rtnl_neigh_get_lladdr(n);
-  int ifindex = rtnl_neigh_get_ifindex(n);
-  std::unique_ptr<rtnl_link, decltype(&rtnl_link_put)> link(
-      nl->get_link_by_ifindex(ifindex), &rtnl_link_put);
+  nl_link_desc link;
 
-  if (link == nullptr)
+  if (nl->get_link_desc(rtnl_neigh_get_ifindex(n), &link) < 0 ||
+      !link.has_mac)
     return -EINVAL;
 
-  uint16_t vid = vlan->get_vid(link.get());
-  auto s_mac = rtnl_link_get_addr(link.get());
-  uint32_t port_id = nl->get_port_id(ifindex);
-  rofl::caddress_ll src_mac = libnl_lladdr_2_rofl(s_mac);
+  rofl::caddress_ll src_mac(link.mac, ETH_ALEN);
   rofl::caddress_ll dst_mac = libnl_lladdr_2_rofl(d_mac);
-  auto needle = std::make_tuple(port_id, vid, src_mac, dst_mac);
+  l3_interface *l3_if = l3_interface_mapping.find(
+      l3_interface_key(link.port_id, link.vid, src_mac, dst_mac));
 
-  auto it = l3_interface_mapping.equal_range(needle);
-
-  if (it.first == l3_interface_mapping.end()) {
+  if (l3_if == nullptr)
     return -ENODATA;
-  }
 
-  for (auto i = it.first; i != it.second; ++i) {
-    if (i->first == needle) {
-      *l3_interface_id = i->second.l3_interface_id;
-      return 0;
-    }
-  }
+  *l3_interface_id = l3_if->l3_interface_id;
+  return 0;
+}
 
-  // not found either
-  return -ENODATA;
+bool nl_l3::is_host_prefix(const struct nl_addr *addr) {
+  int prefixlen = nl_addr_get_prefixlen(addr);
+
+  switch (nl_addr_get_family(addr)) {
+  case AF_INET:
+    return prefixlen == 32;
+  case AF_INET6:
+    return prefixlen == 128;
+  default:
+    return false;
+  }
 }
 
 int nl_l3::add_l3_unicast_route(nl_addr *rt_dst, uint32_t l3_interface_id,
@@ -1224,6 +1207,16 @@ int nl_l3::add_l3_unicast_route(nl_addr *rt_dst, uint32_t l3_interface_id,
     return -EINVAL;
   }
 
+  // host routes go to the host table and are not aggregated
+  if (fib && !is_host_prefix(rt_dst))
+    return fib->add_route(rt_dst, l3_interface_id, is_ecmp);
+
+  return sw_add_l3_unicast_route(rt_dst, l3_interface_id, is_ecmp,
+                                 update_route);
+}
+
+int nl_l3::sw_add_l3_unicast_route(nl_addr *rt_dst, uint32_t l3_interface_id,
+                                   bool is_ecmp, bool update_route) {
   auto dst_af = nl_addr_get_family(rt_dst);
   int prefixlen = nl_addr_get_prefixlen(rt_dst);
   int rv = 0;
@@ -1258,6 +1251,13 @@ int nl_l3::add_l3_unicast_route(nl_addr *rt_dst, uint32_t l3_interface_id,
 }
 
 int nl_l3::del_l3_unicast_route(nl_addr *rt_dst) {
+  if (fib && !is_host_prefix(rt_dst))
+    return fib->del_route(rt_dst);
+
+  return sw_del_l3_unicast_route(rt_dst);
+}
+
+int nl_l3::sw_del_l3_unicast_route(nl_addr *rt_dst) {
   int rv;
   // remove route pointing to group
   int prefixlen = nl_addr_get_prefixlen(rt_dst);
@@ -1292,40 +1292,33 @@ int nl_l3::add_l3_ecmp_route(rtnl_route *r,
 
   int rv = 0;
   uint32_t l3_ecmp_id = -1;
-  static uint32_t l3_ecmp_id_next = 1;
-  auto it_range = l3_ecmp_mapping.equal_range(l3_interface_ids);
-  auto i = it_range.first;
+  l3_ecmp_key key(l3_interface_ids);
+  l3_interface *ecmp = l3_ecmp_mapping.find(key);
 
   // check if an ecmp ID already exists
-  for (; i != it_range.second; ++i) {
-    if (i->first == l3_interface_ids) {
-      i->second.refcnt++;
-      l3_ecmp_id = i->second.l3_interface_id;
-
-      VLOG(2) << __FUNCTION__
-              << ": found ecmp id: " << i->second.l3_interface_id
-              << ", refcnt=" << i->second.refcnt;
-      break;
-    }
+  if (ecmp) {
+    ecmp->refcnt++;
+    l3_ecmp_id = ecmp->l3_interface_id;
+
+    VLOG(2) << __FUNCTION__ << ": found ecmp id: " << ecmp->l3_interface_id
+            << ", refcnt=" << ecmp->refcnt;
   }
 
   // no l3_ecmp_id found -> create a new one
   if (l3_ecmp_id == (uint32_t)-1) {
-    l3_ecmp_id = l3_ecmp_id_next;
+    // the members are l3 interface ids, which survive a warm restart
+    nl_id_pool &ids = nl->get_id_pool(nl_id_pools::NL_ID_L3_ECMP);
+    l3_ecmp_id = ids.allocate(key.ids);
     rv = sw->l3_ecmp_add(l3_ecmp_id, l3_interface_ids);
     if (rv < 0) {
       LOG(ERROR) << __FUNCTION__
                  << ": failed to create l3 ecmp id=" << l3_ecmp_id;
-
+      ids.release(key.ids);
       return -EINVAL;
     }
 
     // register the new l3_ecmp_id
-    l3_ecmp_mapping.emplace(
-        std::make_pair(l3_interface_ids, l3_interface(l3_ecmp_id)));
-
-    // increment l3_ecmp_id
-    l3_ecmp_id_next++;
+    l3_ecmp_mapping.emplace(key, l3_interface(l3_ecmp_id));
   }
 
   // create route
@@ -1344,9 +1337,10 @@ int nl_l3::del_l3_ecmp_route(rtnl_route *r,
                              const std::set<uint32_t> &l3_interface_ids) {
   assert(r);
 
-  auto it_range = l3_ecmp_mapping.equal_range(l3_interface_ids);
+  l3_ecmp_key key(l3_interface_ids);
+  l3_interface *ecmp = l3_ecmp_mapping.find(key);
 
-  if (it_range.first == l3_ecmp_mapping.end()) {
+  if (ecmp == nullptr) {
     LOG(ERROR) << __FUNCTION__ << ": ecmp group not found for route " << r;
     if (VLOG_IS_ON(4)) {
       std::string str;
@@ -1358,28 +1352,18 @@ int nl_l3::del_l3_ecmp_route(rtnl_route *r,
     return -EINVAL;
   }
 
-  for (auto i = it_range.first; i != it_range.second; ++i) {
-    if (i->first == l3_interface_ids) {
-      // found
-      i->second.refcnt--;
-      VLOG(4) << __FUNCTION__ << ": found l3 interface id for ecmp route id="
-              << i->second.l3_interface_id << ", refcount=" << i->second.refcnt
-              << ", route " << OBJ_CAST(r);
+  ecmp->refcnt--;
+  VLOG(4) << __FUNCTION__ << ": found l3 interface id for ecmp route id="
+          << ecmp->l3_interface_id << ", refcount=" << ecmp->refcnt
+          << ", route " << OBJ_CAST(r);
 
-      if (i->second.refcnt <= 0) {
-        int rv = sw->l3_ecmp_remove(i->second.l3_interface_id);
-        l3_ecmp_mapping.erase(i);
-        return rv;
-      } else
-        return 0;
-    }
-  }
-
-  LOG(ERROR) << __FUNCTION__
-             << ": tried to delete invalid ecmp interface for route "
-             << OBJ_CAST(r);
+  if (ecmp->refcnt > 0)
+    return 0;
 
-  return -EINVAL;
+  int rv = sw->l3_ecmp_remove(ecmp->l3_interface_id);
+  l3_ecmp_mapping.erase(key);
+  nl->get_id_pool(nl_id_pools::NL_ID_L3_ECMP).release(key.ids);
+  return rv;
 }
 
 int nl_l3::add_l3_unicast_route(rtnl_route *r, bool update_route) {
@@ -27,13 +27,14 @@ class caddress_in4;
 namespace basebox {
 
 class cnetlink;
+class nl_fib_aggregator;
 class nl_vlan;
 class switch_interface;
 
 class nl_l3 {
 public:
   nl_l3(std::shared_ptr<nl_vlan> vlan, cnetlink *nl);
-  ~nl_l3() {}
+  ~nl_l3();
 
   int init() noexcept;
 
@@ -62,10 +63,13 @@ public:
 
   void notify_on_net_reachable(net_reachable *f, struct net_params p) noexcept;
   void notify_on_nh_reachable(nh_reachable *f, struct nh_params p) noexcept;
+  // unlike the above, f is notified until the end of nl_l3
+  void notify_on_route_changed(route_changed *f) noexcept;
   // void notify_on_nh_resovled(nh_resolved *f, struct nh_params p) noexcept;
 
 private:
   int get_l3_interface_id(rtnl_neigh *n, uint32_t *l3_interface_id);
+  void notify_route_changed(rtnl_route *r) noexcept;
 
   int add_l3_termination(uint32_t port_id, uint16_t vid,
                          const rofl::caddress_ll &mac, int af) noexcept;
@@ -80,6 +84,10 @@ private:
                            bool is_ecmp, bool update_route);
   int del_l3_unicast_route(nl_addr *rt_dst);
 
+  int sw_add_l3_unicast_route(nl_addr *rt_dst, uint32_t l3_interface_id,
+                              bool is_ecmp, bool update_route);
+  int sw_del_l3_unicast_route(nl_addr *rt_dst);
+
   int add_l3_ecmp_route(rtnl_route *r,
                         const std::set<uint32_t> &l3_interface_ids,
                         bool update_route);
@@ -96,12 +104,15 @@ private:
                     const struct nl_addr *d_mac);
 
   bool is_link_local_address(const struct nl_addr *addr);
+  bool is_host_prefix(const struct nl_addr *addr);
 
   switch_interface *sw;
   std::shared_ptr<nl_vlan> vlan;
   cnetlink *nl;
+  std::unique_ptr<nl_fib_aggregator> fib;
   std::deque<std::pair<net_reachable *, net_params>> net_callbacks;
   std::deque<std::pair<nh_reachable *, nh_params>> nh_callbacks;
+  std::deque<route_changed *> route_callbacks;
 };
 
 } // namespace basebox
@@ -7,6 +7,10 @@
 #include <netlink/addr.h>
 #include <glog/logging.h>
 
+extern "C" {
+struct rtnl_route;
+}
+
 namespace basebox {
 
 struct net_params {
@@ -71,4 +75,11 @@ public:
   virtual void nh_reachable_notification(struct nh_params) noexcept = 0;
 };
 
+class route_changed {
+public:
+  virtual ~route_changed() = default;
+  // a unicast route was added, updated or deleted
+  virtual void route_changed_notification(struct rtnl_route *) noexcept = 0;
+};
+
 } // namespace basebox
@@ -0,0 +1,43 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "nl_link_desc.h"
+
+namespace basebox {
+
+const nl_link_desc *nl_link_desc_cache::set(const nl_link_desc &desc) {
+  if (desc.ifindex <= 0 || desc.ifindex > max_ifindex)
+    return nullptr;
+
+  if ((size_t)desc.ifindex >= descs.size())
+    descs.resize(desc.ifindex + 1, nl_link_desc());
+
+  descs[desc.ifindex] = desc;
+  return &descs[desc.ifindex];
+}
+
+void nl_link_desc_cache::invalidate(int ifindex) noexcept {
+  if (ifindex <= 0)
+    return;
+
+  if ((size_t)ifindex < descs.size())
+    descs[ifindex].ifindex = 0;
+
+  // slaves and vlans take their port and vid from the changed link, they
+  // may have links on top of them in turn
+  for (auto &d : descs) {
+    if (d.ifindex && (d.master == ifindex || d.link == ifindex)) {
+      int dependent = d.ifindex;
+      d.ifindex = 0;
+      invalidate(dependent);
+    }
+  }
+}
+
+void nl_link_desc_cache::clear() noexcept {
+  for (auto &d : descs)
+    d.ifindex = 0;
+}
+
+} // namespace basebox
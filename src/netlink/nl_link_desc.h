@@ -0,0 +1,70 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <linux/if_ether.h>
+
+#include "netlink-utils.h"
+
+namespace basebox {
+
+// attributes of a link looked up by the neighbour, route and l2 paths
+struct nl_link_desc {
+  int ifindex; // 0 if the slot is unused
+  int master;
+  int link;         // lower link of a vlan, 0 if there is none
+  uint32_t port_id; // 0 if the link is not on the switch
+  uint32_t mtu;
+  uint16_t vid;
+  enum link_type type;
+  bool tagged; // vlan interface
+  bool has_mac;
+  uint8_t mac[ETH_ALEN];
+};
+
+/**
+ * Descriptors of links indexed by ifindex.
+ *
+ * Deriving the port id, type and vid of a link takes a link cache lookup,
+ * string compares on the link kind and a lookup of the tap or lag. Neighbour
+ * and route events do this several times each. The descriptors are computed
+ * once and dropped when the link, its master or its lower link changes, a
+ * lookup is a single array index. Links with an ifindex beyond max_ifindex
+ * are not cached.
+ */
+class nl_link_desc_cache final {
+public:
+  nl_link_desc_cache() = default;
+
+  // nullptr if the link is not cached
+  const nl_link_desc *get(int ifindex) const noexcept {
+    if (ifindex <= 0 || (size_t)ifindex >= descs.size() ||
+        descs[ifindex].ifindex != ifindex)
+      return nullptr;
+
+    return &descs[ifindex];
+  }
+
+  // nullptr if the link cannot be cached
+  const nl_link_desc *set(const nl_link_desc &desc);
+
+  // drops the link and the links depending on it
+  void invalidate(int ifindex) noexcept;
+  void clear() noexcept;
+
+private:
+  nl_link_desc_cache(const nl_link_desc_cache &) = delete;
+  nl_link_desc_cache &operator=(const nl_link_desc_cache &) = delete;
+
+  static const int max_ifindex = 1 << 16;
+
+  std::vector<nl_link_desc> descs; // by ifindex
+};
+
+} // namespace basebox
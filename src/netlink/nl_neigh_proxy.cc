@@ -0,0 +1,326 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include <arpa/inet.h>
+#include <linux/neighbour.h>
+#include <net/if_arp.h>
+#include <netinet/icmp6.h>
+#include <netinet/ip6.h>
+
+#include <glog/logging.h>
+#include <netlink/route/link.h>
+#include <netlink/route/link/bridge.h>
+#include <netlink/route/link/vlan.h>
+#include <netlink/route/neighbour.h>
+
+#include "cnetlink.h"
+#include "netlink-utils.h"
+#include "nl_neigh_proxy.h"
+#include "sai.h"
+#include "utils/metrics.h"
+#include "utils/utils.h"
+
+namespace basebox {
+
+// ARP for IPv4 over ethernet
+struct arp_ether_ip {
+  uint16_t htype;
+  uint16_t ptype;
+  uint8_t hlen;
+  uint8_t plen;
+  uint16_t oper;
+  uint8_t sha[ETH_ALEN];
+  uint8_t spa[4];
+  uint8_t tha[ETH_ALEN];
+  uint8_t tpa[4];
+} __attribute__((packed));
+
+static const size_t na_len = sizeof(struct nd_neighbor_advert) +
+                             sizeof(struct nd_opt_hdr) + ETH_ALEN;
+
+static uint16_t icmp6_checksum(const struct ip6_hdr *ip6) noexcept {
+  uint16_t len = ntohs(ip6->ip6_plen);
+  uint32_t sum = len + IPPROTO_ICMPV6;
+
+  auto add = [&sum](const uint8_t *d, size_t n) {
+    for (size_t i = 0; i + 1 < n; i += 2)
+      sum += d[i] << 8 | d[i + 1];
+    if (n & 1)
+      sum += d[n - 1] << 8;
+  };
+
+  add(ip6->ip6_src.s6_addr, sizeof(ip6->ip6_src));
+  add(ip6->ip6_dst.s6_addr, sizeof(ip6->ip6_dst));
+  add(reinterpret_cast<const uint8_t *>(ip6 + 1), len);
+
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+
+  return htons(~sum & 0xffff);
+}
+
+static metric_counter &proxy_counter(const char *name, const char *help) {
+  return metrics_registry::get().counter(name, help);
+}
+
+nl_neigh_proxy::nl_neigh_proxy(cnetlink *nl)
+    : nl(nl), swi(nullptr),
+      answered(proxy_counter("baseboxd_neigh_proxy_answered_total",
+                             "ARP requests and neighbour solicitations "
+                             "answered from the neighbour cache")),
+      missed(proxy_counter("baseboxd_neigh_proxy_missed_total",
+                           "ARP requests and neighbour solicitations "
+                           "without a resolved neighbour")) {}
+
+bool nl_neigh_proxy::answer(rtnl_link *br_link, uint32_t port_id,
+                            packet *p) noexcept {
+  if (swi == nullptr || p->len < sizeof(struct ethhdr))
+    return false;
+
+  auto *hdr = reinterpret_cast<basebox::vlan_hdr *>(p->data);
+  uint16_t ethertype = ntohs(hdr->eth.h_proto);
+  size_t offset = sizeof(struct ethhdr);
+  uint16_t vid;
+
+  if (ethertype == ETH_P_8021Q) {
+    if (p->len < sizeof(*hdr))
+      return false;
+
+    vid = ntohs(hdr->vlan) & 0xfff;
+    ethertype = ntohs(hdr->h_proto);
+    offset = sizeof(*hdr);
+  } else {
+    rtnl_link_bridge_vlan *br_vlan = rtnl_link_bridge_get_port_vlan(br_link);
+    if (br_vlan == nullptr)
+      return false;
+
+    vid = br_vlan->pvid;
+  }
+
+  int br_ifindex = rtnl_link_get_master(br_link);
+  if (br_ifindex == 0)
+    return false;
+
+  switch (ethertype) {
+  case ETH_P_ARP:
+    return answer_arp(port_id, p, offset, br_ifindex, vid);
+  case ETH_P_IPV6:
+    return answer_ns(port_id, p, offset, br_ifindex, vid);
+  default:
+    return false;
+  }
+}
+
+int nl_neigh_proxy::get_vlan_interface(int br_ifindex, uint16_t vid) const
+    noexcept {
+  // untagged traffic of the bridge's own pvid ends on the bridge itself
+  rtnl_link *br = nl->get_link(br_ifindex, AF_BRIDGE);
+  if (br) {
+    rtnl_link_bridge_vlan *br_vlan = rtnl_link_bridge_get_port_vlan(br);
+    if (br_vlan && br_vlan->pvid == vid)
+      return br_ifindex;
+  }
+
+  struct {
+    uint16_t vid;
+    int ifindex;
+  } search = {vid, 0};
+
+  std::unique_ptr<rtnl_link, decltype(&rtnl_link_put)> filter(rtnl_link_alloc(),
+                                                              &rtnl_link_put);
+  if (!filter)
+    LOG(FATAL) << __FUNCTION__ << ": out of memory";
+
+  rtnl_link_set_family(filter.get(), AF_UNSPEC);
+  rtnl_link_set_link(filter.get(), br_ifindex);
+
+  nl_cache_foreach_filter(nl->get_cache(cnetlink::NL_LINK_CACHE),
+                          OBJ_CAST(filter.get()),
+                          [](struct nl_object *obj, void *arg) {
+                            auto *s = static_cast<decltype(search) *>(arg);
+                            auto *l = LINK_CAST(obj);
+
+                            if (rtnl_link_is_vlan(l) &&
+                                rtnl_link_vlan_get_id(l) == s->vid)
+                              s->ifindex = rtnl_link_get_ifindex(l);
+                          },
+                          &search);
+
+  return search.ifindex;
+}
+
+struct rtnl_neigh *nl_neigh_proxy::lookup(int br_ifindex, uint16_t vid,
+                                          int family, const uint8_t *ip) const
+    noexcept {
+  int ifindex = get_vlan_interface(br_ifindex, vid);
+  if (ifindex == 0)
+    return nullptr;
+
+  std::unique_ptr<nl_addr, decltype(&nl_addr_put)> dst(
+      nl_addr_build(family, ip, family == AF_INET ? 4 : 16), nl_addr_put);
+  if (!dst)
+    LOG(FATAL) << __FUNCTION__ << ": out of memory";
+
+  rtnl_neigh *n = nl->get_neighbour(ifindex, dst.get());
+  if (n == nullptr)
+    return nullptr;
+
+  // stale bindings are left to the kernel to revalidate. The cached state
+  // follows the kernel, the fast path passes on changes of these bits.
+  nl_addr *lladdr = rtnl_neigh_get_lladdr(n);
+  if (!(rtnl_neigh_get_state(n) &
+        (NUD_REACHABLE | NUD_PERMANENT | NUD_NOARP)) ||
+      lladdr == nullptr || nl_addr_get_len(lladdr) != ETH_ALEN) {
+    rtnl_neigh_put(n);
+    return nullptr;
+  }
+
+  return n;
+}
+
+bool nl_neigh_proxy::answer_arp(uint32_t port_id, packet *p, size_t offset,
+                                int br_ifindex, uint16_t vid) noexcept {
+  static const uint8_t any[4] = {0, 0, 0, 0};
+
+  if (p->len < offset + sizeof(arp_ether_ip))
+    return false;
+
+  auto *eth = reinterpret_cast<struct ethhdr *>(p->data);
+  auto *arp = reinterpret_cast<arp_ether_ip *>(p->data + offset);
+
+  if (ntohs(arp->htype) != ARPHRD_ETHER || ntohs(arp->ptype) != ETH_P_IP ||
+      arp->hlen != ETH_ALEN || arp->plen != sizeof(arp->tpa) ||
+      ntohs(arp->oper) != ARPOP_REQUEST)
+    return false;
+
+  // probes and gratuitous arp have to reach the bridge
+  if (memcmp(arp->spa, any, sizeof(any)) == 0 ||
+      memcmp(arp->spa, arp->tpa, sizeof(arp->tpa)) == 0)
+    return false;
+
+  rtnl_neigh *n = lookup(br_ifindex, vid, AF_INET, arp->tpa);
+  if (n == nullptr) {
+    missed.add();
+    return false;
+  }
+
+  uint8_t mac[ETH_ALEN];
+  memcpy(mac, nl_addr_get_binary_addr(rtnl_neigh_get_lladdr(n)), ETH_ALEN);
+  rtnl_neigh_put(n);
+
+  // the owner asking for its own address
+  if (memcmp(mac, arp->sha, ETH_ALEN) == 0)
+    return false;
+
+  VLOG(2) << __FUNCTION__ << ": answering arp request on port_id=" << port_id
+          << ", vid=" << vid;
+
+  // turn the request into the reply, the vlan tag is kept
+  uint8_t spa[sizeof(arp->spa)];
+  memcpy(spa, arp->spa, sizeof(spa));
+
+  memcpy(eth->h_dest, arp->sha, ETH_ALEN);
+  memcpy(eth->h_source, mac, ETH_ALEN);
+  arp->oper = htons(ARPOP_REPLY);
+  memcpy(arp->tha, arp->sha, ETH_ALEN);
+  memcpy(arp->sha, mac, ETH_ALEN);
+  memcpy(arp->spa, arp->tpa, sizeof(arp->spa));
+  memcpy(arp->tpa, spa, sizeof(arp->tpa));
+
+  return send(port_id, p);
+}
+
+bool nl_neigh_proxy::answer_ns(uint32_t port_id, packet *p, size_t offset,
+                               int br_ifindex, uint16_t vid) noexcept {
+  if (p->len < offset + sizeof(struct ip6_hdr) +
+                   sizeof(struct nd_neighbor_solicit))
+    return false;
+
+  auto *eth = reinterpret_cast<struct ethhdr *>(p->data);
+  auto *ip6 = reinterpret_cast<struct ip6_hdr *>(p->data + offset);
+  auto *ns = reinterpret_cast<struct nd_neighbor_solicit *>(ip6 + 1);
+
+  if (ip6->ip6_nxt != IPPROTO_ICMPV6 || ip6->ip6_hlim != 255 ||
+      ns->nd_ns_type != ND_NEIGHBOR_SOLICIT || ns->nd_ns_code != 0)
+    return false;
+
+  // duplicate address detection has to reach the bridge
+  if (IN6_IS_ADDR_UNSPECIFIED(&ip6->ip6_src))
+    return false;
+
+  rtnl_neigh *n = lookup(br_ifindex, vid, AF_INET6, ns->nd_ns_target.s6_addr);
+  if (n == nullptr) {
+    missed.add();
+    return false;
+  }
+
+  uint8_t mac[ETH_ALEN];
+  memcpy(mac, nl_addr_get_binary_addr(rtnl_neigh_get_lladdr(n)), ETH_ALEN);
+  bool router = rtnl_neigh_get_flags(n) & NTF_ROUTER;
+  rtnl_neigh_put(n);
+
+  // the owner asking for its own address
+  if (memcmp(mac, eth->h_source, ETH_ALEN) == 0)
+    return false;
+
+  VLOG(2) << __FUNCTION__ << ": answering neighbour solicitation on port_id="
+          << port_id << ", vid=" << vid;
+
+  size_t len = offset + sizeof(struct ip6_hdr) + na_len;
+  auto *r = static_cast<packet *>(std::malloc(sizeof(packet) + len));
+  if (r == nullptr)
+    LOG(FATAL) << __FUNCTION__ << ": out of memory";
+
+  r->len = len;
+  memset(r->data, 0, len);
+
+  // ethernet and vlan header
+  memcpy(r->data, p->data, offset);
+  auto *r_eth = reinterpret_cast<struct ethhdr *>(r->data);
+  memcpy(r_eth->h_dest, eth->h_source, ETH_ALEN);
+  memcpy(r_eth->h_source, mac, ETH_ALEN);
+
+  auto *r_ip6 = reinterpret_cast<struct ip6_hdr *>(r->data + offset);
+  r_ip6->ip6_flow = htonl(6 << 28);
+  r_ip6->ip6_plen = htons(na_len);
+  r_ip6->ip6_nxt = IPPROTO_ICMPV6;
+  r_ip6->ip6_hlim = 255;
+  r_ip6->ip6_src = ns->nd_ns_target;
+  r_ip6->ip6_dst = ip6->ip6_src;
+
+  auto *na = reinterpret_cast<struct nd_neighbor_advert *>(r_ip6 + 1);
+  na->nd_na_type = ND_NEIGHBOR_ADVERT;
+  na->nd_na_flags_reserved = ND_NA_FLAG_SOLICITED | ND_NA_FLAG_OVERRIDE;
+  if (router)
+    na->nd_na_flags_reserved |= ND_NA_FLAG_ROUTER;
+  na->nd_na_target = ns->nd_ns_target;
+
+  auto *opt = reinterpret_cast<struct nd_opt_hdr *>(na + 1);
+  opt->nd_opt_type = ND_OPT_TARGET_LINKADDR;
+  opt->nd_opt_len = 1; // in units of 8 octets
+  memcpy(opt + 1, mac, ETH_ALEN);
+
+  na->nd_na_cksum = icmp6_checksum(r_ip6);
+
+  std::free(p);
+  return send(port_id, r);
+}
+
+bool nl_neigh_proxy::send(uint32_t port_id, packet *p) noexcept {
+  // the packet is freed by the switch in any case
+  int rv = swi->enqueue(port_id, p);
+  if (rv < 0)
+    VLOG(1) << __FUNCTION__ << ": failed to send reply to port_id=" << port_id
+            << ": " << rv;
+  else
+    answered.add();
+
+  return true;
+}
+
+} // namespace basebox
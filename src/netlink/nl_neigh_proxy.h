@@ -0,0 +1,64 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstdint>
+
+extern "C" {
+struct nl_addr;
+struct rtnl_link;
+struct rtnl_neigh;
+}
+
+namespace basebox {
+
+class cnetlink;
+class metric_counter;
+class switch_interface;
+struct packet;
+
+/**
+ * Answers ARP requests and neighbour solicitations of bridged hosts.
+ *
+ * Every ARP and ND frame of a bridged vlan is punted and written to the tap
+ * of its port, and the Linux bridge floods it to all other taps of the vlan.
+ * If the kernel already resolved the target on the vlan's interface, the
+ * reply is built from the neighbour cache and sent back out of the switch
+ * port instead. Only misses, probes and gratuitous announcements reach the
+ * bridge.
+ */
+class nl_neigh_proxy final {
+public:
+  explicit nl_neigh_proxy(cnetlink *nl);
+
+  void register_switch_interface(switch_interface *swi) { this->swi = swi; }
+
+  /**
+   * answer a request received on the bridge port br_link
+   *
+   * @returns true if the request was answered, the packet is consumed then
+   */
+  bool answer(rtnl_link *br_link, uint32_t port_id, packet *p) noexcept;
+
+private:
+  nl_neigh_proxy(const nl_neigh_proxy &) = delete;
+  nl_neigh_proxy &operator=(const nl_neigh_proxy &) = delete;
+
+  cnetlink *nl;
+  switch_interface *swi;
+  metric_counter &answered;
+  metric_counter &missed;
+
+  int get_vlan_interface(int br_ifindex, uint16_t vid) const noexcept;
+  struct rtnl_neigh *lookup(int br_ifindex, uint16_t vid, int family,
+                            const uint8_t *ip) const noexcept;
+  bool answer_arp(uint32_t port_id, packet *p, size_t offset, int br_ifindex,
+                  uint16_t vid) noexcept;
+  bool answer_ns(uint32_t port_id, packet *p, size_t offset, int br_ifindex,
+                 uint16_t vid) noexcept;
+  bool send(uint32_t port_id, packet *p) noexcept;
+};
+
+} // namespace basebox
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <chrono>
+
 #include <netlink/cache.h>
 #include <netlink/object.h>
 
@@ -27,6 +29,11 @@ public:
     return new_obj;
   }
 
+  // time the event was received from the kernel
+  std::chrono::steady_clock::time_point get_received() const {
+    return received;
+  }
+
 private:
   struct nl_object *get_obj() const {
     struct nl_object *obj;
@@ -50,6 +57,7 @@ private:
   int action;
   struct nl_object *old_obj;
   struct nl_object *new_obj;
+  std::chrono::steady_clock::time_point received;
 };
 
 } // namespace basebox
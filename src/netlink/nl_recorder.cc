@@ -0,0 +1,230 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/netlink.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "nl_recorder.h"
+
+namespace basebox {
+
+static const char capture_magic[8] = {'B', 'B', 'N', 'L', 'C', 'A', 'P', '1'};
+static const uint32_t capture_version = 1;
+
+static uint64_t record_size(uint32_t len) noexcept {
+  return sizeof(nl_capture_record) + ((len + 7) & ~7u);
+}
+
+static uint64_t to_ns(std::chrono::nanoseconds d) noexcept { return d.count(); }
+
+uint64_t nl_capture_next(const uint8_t *ring, uint64_t ring_size,
+                         uint64_t pos) noexcept {
+  auto rec = reinterpret_cast<const nl_capture_record *>(ring + pos);
+
+  pos += record_size(rec->len);
+  if (ring_size - pos < sizeof(nl_capture_record))
+    return 0;
+
+  rec = reinterpret_cast<const nl_capture_record *>(ring + pos);
+  return rec->len ? pos : 0;
+}
+
+nl_recorder::~nl_recorder() {
+  if (map)
+    munmap(map, map_size);
+  if (fd != -1)
+    close(fd);
+}
+
+int nl_recorder::open(const std::string &path, size_t ring_size) {
+  int rv;
+
+  if (ring_size < 2 * record_size(UINT16_MAX))
+    return -EINVAL;
+
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    rv = -errno;
+    LOG(ERROR) << __FUNCTION__ << ": failed to open " << path << ": "
+               << strerror(-rv);
+    fd = -1;
+    return rv;
+  }
+
+  // allocate the whole file, a full disk must not fault the netlink thread
+  map_size = sizeof(nl_capture_header) + ring_size;
+  rv = posix_fallocate(fd, 0, map_size);
+  if (rv != 0) {
+    LOG(ERROR) << __FUNCTION__ << ": failed to allocate " << map_size
+               << " bytes for " << path << ": " << strerror(rv);
+    return -rv;
+  }
+
+  void *m = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (m == MAP_FAILED) {
+    rv = -errno;
+    LOG(ERROR) << __FUNCTION__ << ": failed to map " << path << ": "
+               << strerror(-rv);
+    return rv;
+  }
+  map = static_cast<uint8_t *>(m);
+
+  nl_capture_header *h = header();
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, capture_magic, sizeof(h->magic));
+  h->version = capture_version;
+  h->header_size = sizeof(*h);
+  h->ring_size = ring_size;
+  h->realtime_ns = to_ns(std::chrono::system_clock::now().time_since_epoch());
+  h->monotonic_ns = to_ns(std::chrono::steady_clock::now().time_since_epoch());
+
+  LOG(INFO) << __FUNCTION__ << ": recording netlink messages to " << path;
+
+  return 0;
+}
+
+void nl_recorder::evict(uint64_t begin, uint64_t end) noexcept {
+  nl_capture_header *h = header();
+
+  while (h->records && h->head >= begin && h->head < end) {
+    h->head = nl_capture_next(ring(), h->ring_size, h->head);
+    h->records--;
+    h->dropped++;
+  }
+}
+
+void nl_recorder::record(const struct nlmsghdr *hdr) noexcept {
+  if (map == nullptr)
+    return;
+
+  nl_capture_header *h = header();
+  uint64_t size = record_size(hdr->nlmsg_len);
+
+  if (size > h->ring_size / 2) {
+    h->dropped++;
+    return;
+  }
+
+  if (h->ring_size - h->tail < size) {
+    // records behind the wrap cannot be reached anymore
+    evict(h->tail, h->ring_size);
+    if (h->ring_size - h->tail >= sizeof(nl_capture_record))
+      reinterpret_cast<nl_capture_record *>(ring() + h->tail)->len = 0;
+    h->tail = 0;
+  }
+  evict(h->tail, h->tail + size);
+
+  auto rec = reinterpret_cast<nl_capture_record *>(ring() + h->tail);
+  rec->len = hdr->nlmsg_len;
+  rec->reserved = 0;
+  rec->timestamp_ns =
+      to_ns(std::chrono::steady_clock::now().time_since_epoch());
+  memcpy(rec + 1, hdr, hdr->nlmsg_len);
+
+  // the header is updated last, a crash leaves the ring consistent
+  if (h->records == 0)
+    h->head = h->tail;
+  h->tail += size;
+  h->records++;
+}
+
+nl_capture_reader::~nl_capture_reader() {
+  if (map)
+    munmap(const_cast<uint8_t *>(map), map_size);
+}
+
+int nl_capture_reader::open(const std::string &path) {
+  struct stat st;
+  int rv = 0;
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    rv = -errno;
+    LOG(ERROR) << __FUNCTION__ << ": failed to open " << path << ": "
+               << strerror(-rv);
+    return rv;
+  }
+
+  if (fstat(fd, &st) < 0) {
+    rv = -errno;
+  } else if ((size_t)st.st_size < sizeof(nl_capture_header)) {
+    rv = -EINVAL;
+  } else {
+    map_size = st.st_size;
+    void *m = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED)
+      rv = -errno;
+    else
+      map = static_cast<const uint8_t *>(m);
+  }
+  close(fd);
+
+  if (rv < 0) {
+    LOG(ERROR) << __FUNCTION__ << ": failed to map " << path << ": "
+               << strerror(-rv);
+    return rv;
+  }
+
+  const nl_capture_header *h = header();
+  if (memcmp(h->magic, capture_magic, sizeof(h->magic)) != 0 ||
+      h->version != capture_version || h->header_size != sizeof(*h) ||
+      map_size - sizeof(*h) < h->ring_size || h->head >= h->ring_size ||
+      h->tail > h->ring_size) {
+    LOG(ERROR) << __FUNCTION__ << ": " << path << " is not a valid capture";
+    return -EINVAL;
+  }
+
+  rewind();
+  return 0;
+}
+
+void nl_capture_reader::rewind() noexcept {
+  pos = header()->head;
+  left = header()->records;
+}
+
+bool nl_capture_reader::next(uint64_t *timestamp_ns,
+                             const struct nlmsghdr **hdr) noexcept {
+  const nl_capture_header *h = header();
+  const uint8_t *ring = map + sizeof(*h);
+
+  if (left == 0)
+    return false;
+
+  auto rec = reinterpret_cast<const nl_capture_record *>(ring + pos);
+  if (h->ring_size - pos < sizeof(*rec) ||
+      h->ring_size - pos < record_size(rec->len) ||
+      rec->len < sizeof(struct nlmsghdr)) {
+    LOG(ERROR) << __FUNCTION__ << ": corrupt record at offset " << pos;
+    left = 0;
+    return false;
+  }
+
+  *timestamp_ns = rec->timestamp_ns;
+  *hdr = reinterpret_cast<const struct nlmsghdr *>(rec + 1);
+
+  pos = nl_capture_next(ring, h->ring_size, pos);
+  left--;
+
+  return true;
+}
+
+uint64_t nl_capture_reader::get_records() const noexcept {
+  return header()->records;
+}
+
+uint64_t nl_capture_reader::get_dropped() const noexcept {
+  return header()->dropped;
+}
+
+} // namespace basebox
@@ -0,0 +1,115 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+extern "C" {
+struct nlmsghdr;
+}
+
+namespace basebox {
+
+/**
+ * Capture file layout, all values in host byte order.
+ *
+ * The header is followed by a ring of records. Every record is a
+ * nl_capture_record followed by the netlink message padded to 8 bytes. A
+ * record length of 0, or less than a record header left before the end of
+ * the ring, wraps around to the start of the ring.
+ */
+struct nl_capture_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t ring_size;
+  uint64_t head;    // offset of the oldest record in the ring
+  uint64_t tail;    // offset of the next record
+  uint64_t records; // records in the ring
+  uint64_t dropped; // records overwritten or too large
+  uint64_t realtime_ns;
+  uint64_t monotonic_ns; // taken together with realtime_ns
+};
+
+struct nl_capture_record {
+  uint32_t len; // of the netlink message
+  uint32_t reserved;
+  uint64_t timestamp_ns; // CLOCK_MONOTONIC
+};
+
+/**
+ * Ring file of the raw netlink messages received by cnetlink.
+ *
+ * The file is mapped into memory and only written by the netlink thread, so
+ * recording a message is a copy and the ring survives a crash of baseboxd.
+ * When the ring is full the oldest records are overwritten.
+ */
+class nl_recorder final {
+public:
+  nl_recorder() : fd(-1), map(nullptr), map_size(0) {}
+  ~nl_recorder();
+
+  // returns 0 on success or a negative errno
+  int open(const std::string &path, size_t ring_size);
+
+  void record(const struct nlmsghdr *hdr) noexcept;
+
+private:
+  nl_recorder(const nl_recorder &) = delete;
+  nl_recorder &operator=(const nl_recorder &) = delete;
+
+  int fd;
+  uint8_t *map;
+  size_t map_size;
+
+  nl_capture_header *header() noexcept {
+    return reinterpret_cast<nl_capture_header *>(map);
+  }
+  uint8_t *ring() noexcept { return map + sizeof(nl_capture_header); }
+
+  void evict(uint64_t begin, uint64_t end) noexcept;
+};
+
+/**
+ * Reads the records of a capture, oldest first.
+ */
+class nl_capture_reader final {
+public:
+  nl_capture_reader() : map(nullptr), map_size(0), pos(0), left(0) {}
+  ~nl_capture_reader();
+
+  // returns 0 on success or a negative errno
+  int open(const std::string &path);
+
+  // rewinds to the oldest record
+  void rewind() noexcept;
+
+  // returns false after the last record
+  bool next(uint64_t *timestamp_ns, const struct nlmsghdr **hdr) noexcept;
+
+  uint64_t get_records() const noexcept;
+  uint64_t get_dropped() const noexcept;
+
+private:
+  nl_capture_reader(const nl_capture_reader &) = delete;
+  nl_capture_reader &operator=(const nl_capture_reader &) = delete;
+
+  const uint8_t *map;
+  size_t map_size;
+  uint64_t pos;
+  uint64_t left;
+
+  const nl_capture_header *header() const noexcept {
+    return reinterpret_cast<const nl_capture_header *>(map);
+  }
+};
+
+// offset of the record following the one at pos, wrapped around the ring
+uint64_t nl_capture_next(const uint8_t *ring, uint64_t ring_size,
+                         uint64_t pos) noexcept;
+
+} // namespace basebox
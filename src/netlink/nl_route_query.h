@@ -51,6 +51,8 @@ public:
     if ((err = nl_connect(sock, NETLINK_ROUTE)) < 0)
       LOG(FATAL) << __FUNCTION__ << ": Unable to connect netlink socket: %s"
                  << nl_geterror(err);
+    // the socket is reused, an ack would be read as the next reply
+    nl_socket_disable_auto_ack(sock);
   }
 
   ~nl_route_query() { nl_socket_free(sock); }
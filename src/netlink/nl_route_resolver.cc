@@ -0,0 +1,104 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <memory>
+
+#include <glog/logging.h>
+#include <netlink/addr.h>
+#include <netlink/route/route.h>
+
+#include "nl_route_query.h"
+#include "nl_route_resolver.h"
+
+namespace basebox {
+
+nl_route_resolver::nl_route_resolver(unsigned workers) : stopped(false) {
+  for (unsigned i = 0; i < workers; i++)
+    this->workers.emplace_back(&nl_route_resolver::work, this);
+}
+
+nl_route_resolver::~nl_route_resolver() {
+  {
+    std::lock_guard<std::mutex> lock(requests_mutex);
+    stopped = true;
+  }
+  requests_cv.notify_all();
+
+  for (auto &w : workers)
+    w.join();
+
+  for (auto &r : requests) {
+    nl_addr_put(r.dst);
+    r.route.set_value(nullptr);
+  }
+}
+
+std::future<struct rtnl_route *>
+nl_route_resolver::resolve(struct nl_addr *dst) {
+  // libnl reference counts are not atomic, the workers get a copy
+  request r{nl_addr_clone(dst), {}};
+  if (r.dst == nullptr)
+    LOG(FATAL) << __FUNCTION__ << ": out of memory";
+
+  auto route = r.route.get_future();
+  {
+    std::lock_guard<std::mutex> lock(requests_mutex);
+    requests.emplace_back(std::move(r));
+  }
+  requests_cv.notify_one();
+
+  return route;
+}
+
+std::vector<struct rtnl_route *>
+nl_route_resolver::resolve(const std::vector<struct nl_addr *> &dsts) {
+  std::vector<std::future<struct rtnl_route *>> pending;
+  std::vector<struct rtnl_route *> routes;
+
+  pending.reserve(dsts.size());
+  {
+    std::lock_guard<std::mutex> lock(requests_mutex);
+    for (auto dst : dsts) {
+      request r{nl_addr_clone(dst), {}};
+      if (r.dst == nullptr)
+        LOG(FATAL) << __FUNCTION__ << ": out of memory";
+
+      pending.emplace_back(r.route.get_future());
+      requests.emplace_back(std::move(r));
+    }
+  }
+  requests_cv.notify_all();
+
+  routes.reserve(pending.size());
+  for (auto &p : pending)
+    routes.push_back(p.get());
+
+  VLOG(2) << __FUNCTION__ << ": resolved " << routes.size() << " routes";
+
+  return routes;
+}
+
+void nl_route_resolver::work() noexcept {
+  std::unique_ptr<nl_route_query> rq;
+
+  for (;;) {
+    std::unique_lock<std::mutex> lock(requests_mutex);
+    requests_cv.wait(lock, [this] { return stopped || !requests.empty(); });
+    if (stopped)
+      return;
+
+    request r = std::move(requests.front());
+    requests.pop_front();
+    lock.unlock();
+
+    if (!rq)
+      rq.reset(new nl_route_query());
+
+    struct rtnl_route *route = rq->query_route(r.dst);
+    nl_addr_put(r.dst);
+    r.route.set_value(route);
+  }
+}
+
+} // namespace basebox
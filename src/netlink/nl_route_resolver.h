@@ -0,0 +1,59 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+struct nl_addr;
+struct rtnl_route;
+}
+
+namespace basebox {
+
+/**
+ * Resolves the kernel's route to a destination off the netlink thread.
+ *
+ * Every worker owns one route query socket, opened on its first lookup and
+ * kept until the resolver is destroyed. Lookups are queued to the workers,
+ * a batch is spread over all of them and waited for once.
+ */
+class nl_route_resolver final {
+public:
+  explicit nl_route_resolver(unsigned workers);
+  ~nl_route_resolver();
+
+  /**
+   * the route has to be freed using rtnl_route_put, it is nullptr if the
+   * resolver is shut down
+   */
+  std::future<struct rtnl_route *> resolve(struct nl_addr *dst);
+  std::vector<struct rtnl_route *>
+  resolve(const std::vector<struct nl_addr *> &dsts);
+
+private:
+  nl_route_resolver(const nl_route_resolver &) = delete;
+  nl_route_resolver &operator=(const nl_route_resolver &) = delete;
+
+  struct request {
+    struct nl_addr *dst; // owned by the request
+    std::promise<struct rtnl_route *> route;
+  };
+
+  std::vector<std::thread> workers;
+  std::deque<request> requests;
+  std::mutex requests_mutex;
+  std::condition_variable requests_cv;
+  bool stopped;
+
+  void work() noexcept;
+};
+
+} // namespace basebox
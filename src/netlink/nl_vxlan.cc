@@ -5,15 +5,21 @@
 #include <cassert>
 #include <chrono>
 #include <deque>
+#include <set>
 #include <string>
 #include <thread>
 #include <tuple>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
+#include <netinet/in.h>
+
+#include <netlink/addr.h>
 #include <netlink/cache.h>
 #include <netlink/route/link.h>
 #include <netlink/route/neighbour.h>
+#include <netlink/route/route.h>
 #include <netlink/route/link/bridge.h>
 #include <netlink/route/link/vxlan.h>
 
@@ -23,7 +29,8 @@
 #include "nl_hashing.h"
 #include "nl_l3.h"
 #include "nl_output.h"
-#include "nl_route_query.h"
+#include "nl_route_resolver.h"
+#include "nl_vlan.h"
 #include "nl_vxlan.h"
 
 namespace basebox {
@@ -97,13 +104,25 @@ struct endpoint_port {
   }
 };
 
+// ecmp group of the tunnel next hops towards a remote endpoint
+struct tunnel_nh_group {
+  int refcnt;
+  uint32_t group_id;
+  int ifindex; // vxlan link waiting for unresolved next hops
+  std::set<uint32_t> nh_ids;
+  tunnel_nh_group(uint32_t group_id, int ifindex)
+      : refcnt(1), group_id(group_id), ifindex(ifindex) {}
+};
+
 struct endpoint_tunnel_port {
   int refcnt; // counts direct usage of l2 addresses and all zero address
   uint32_t lport_id;
-  uint32_t nh_id;
+  uint32_t nh_id; // next hop group if ecmp is set
+  bool ecmp;
   std::map<uint32_t, unsigned> refcnt_vni; // ref count per vni
-  endpoint_tunnel_port(uint32_t lport_id, uint32_t nh_id, uint32_t vni)
-      : refcnt(1), lport_id(lport_id), nh_id(nh_id) {
+  endpoint_tunnel_port(uint32_t lport_id, uint32_t nh_id, bool ecmp,
+                       uint32_t vni)
+      : refcnt(1), lport_id(lport_id), nh_id(nh_id), ecmp(ecmp) {
     refcnt_vni[vni] = 1;
   }
 };
@@ -159,6 +178,30 @@ static std::unordered_multimap<endpoint_port, endpoint_tunnel_port> endpoint_id;
 
 static std::map<uint32_t, tunnel_nh> tunnel_next_hop2tnh;
 
+// by remote ipv4 address
+static std::map<uint32_t, tunnel_nh_group> tunnel_next_hop_groups;
+
+// keys of the persisted ids, access ports and endpoints differ in length
+static nl_id_pool::key access_port_key(uint32_t pport, uint16_t vid) {
+  return {pport, vid};
+}
+
+static nl_id_pool::key endpoint_key(const endpoint_port &ep) {
+  return {ep.local_ipv4, ep.remote_ipv4, ep.initiator_udp_dst_port};
+}
+
+static nl_id_pool::key next_hop_key(const tunnel_nh &tnh) {
+  return {(uint32_t)(tnh.smac >> 32), (uint32_t)tnh.smac,
+          (uint32_t)(tnh.dmac >> 32), (uint32_t)tnh.dmac,
+          tnh.pv.pport,               tnh.pv.vid};
+}
+
+static uint32_t get_ipv4(nl_addr *addr) {
+  uint32_t ipv4 = 0;
+  memcpy(&ipv4, nl_addr_get_binary_addr(addr), sizeof(ipv4));
+  return ntohl(ipv4);
+}
+
 static struct access_tunnel_port get_access_tunnel_port(uint32_t pport,
                                                         uint16_t vlan) {
   assert(pport);
@@ -186,8 +229,17 @@ static struct access_tunnel_port get_access_tunnel_port(uint32_t pport,
   return invalid;
 }
 
-nl_vxlan::nl_vxlan(std::shared_ptr<nl_l3> l3, cnetlink *nl)
-    : sw(nullptr), bridge(nullptr), l3(std::move(l3)), nl(nl) {}
+// route lookups to remote endpoints running in parallel
+static const unsigned route_resolvers = 4;
+
+nl_vxlan::nl_vxlan(std::shared_ptr<nl_vlan> vlan, std::shared_ptr<nl_l3> l3,
+                   cnetlink *nl)
+    : resolver(new nl_route_resolver(route_resolvers)), sw(nullptr),
+      bridge(nullptr), vlan(std::move(vlan)), l3(std::move(l3)), nl(nl) {
+  this->l3->notify_on_route_changed(this);
+}
+
+nl_vxlan::~nl_vxlan() { clear_prefetched_routes(); }
 
 int nl_vxlan::init() {
   nl_cache *c = nl->get_cache(cnetlink::NL_LINK_CACHE);
@@ -248,6 +300,7 @@ int nl_vxlan::init() {
                             },
                             &neighs);
 
+    prefetch_routes(neighs);
     for (auto neigh : neighs) {
       auto br_link = nl->get_link(rtnl_link_get_ifindex(link), AF_BRIDGE);
       rv = add_l2_neigh(neigh, link, br_link);
@@ -256,6 +309,7 @@ int nl_vxlan::init() {
                    << ") to add l2 neigh " << OBJ_CAST(link);
       }
     }
+    clear_prefetched_routes();
   }
 
   return 0;
@@ -284,16 +338,145 @@ void nl_vxlan::net_reachable_notification(struct net_params params) noexcept {
 }
 
 void nl_vxlan::nh_reachable_notification(struct nh_params p) noexcept {
+  if (nl_addr_get_family(p.np.addr) == AF_INET) {
+    uint32_t remote_ipv4 = get_ipv4(p.np.addr);
+
+    // a next hop of an existing ecmp group
+    if (tunnel_next_hop_groups.count(remote_ipv4)) {
+      resync_next_hop_group(remote_ipv4);
+      return;
+    }
+  }
+
   // call create endpoint?
   net_reachable_notification(p.np);
 }
 
+void nl_vxlan::route_changed_notification(struct rtnl_route *r) noexcept {
+  nl_addr *dst = rtnl_route_get_dst(r);
+
+  if (tunnel_next_hop_groups.empty() || dst == nullptr ||
+      nl_addr_get_family(dst) != AF_INET)
+    return;
+
+  unsigned prefixlen = nl_addr_get_prefixlen(dst);
+  uint32_t mask = prefixlen ? ~0U << (32 - prefixlen) : 0;
+  uint32_t net =
+      nl_addr_get_len(dst) >= sizeof(uint32_t) ? get_ipv4(dst) & mask : 0;
+  std::deque<uint32_t> remotes;
+
+  for (const auto &g : tunnel_next_hop_groups) {
+    if ((g.first & mask) == net)
+      remotes.push_back(g.first);
+  }
+
+  if (remotes.empty())
+    return;
+
+  // the kernel decides which of the covering routes is used, the routes to
+  // all affected remotes are resolved as one batch
+  std::vector<std::unique_ptr<nl_addr, decltype(&nl_addr_put)>> addrs;
+  std::vector<nl_addr *> batch;
+  for (auto remote_ipv4 : remotes) {
+    uint32_t addr = htonl(remote_ipv4);
+    addrs.emplace_back(nl_addr_build(AF_INET, &addr, sizeof(addr)),
+                       &nl_addr_put);
+    if (addrs.back())
+      batch.push_back(addrs.back().get());
+  }
+
+  prefetch_routes(batch);
+  for (auto remote_ipv4 : remotes)
+    resync_next_hop_group(remote_ipv4);
+  clear_prefetched_routes();
+}
+
 void nl_vxlan::register_switch_interface(switch_interface *sw) {
   this->sw = sw;
 }
 
 void nl_vxlan::register_bridge(nl_bridge *bridge) { this->bridge = bridge; }
 
+nl_id_pool &nl_vxlan::ids(enum nl_id_pools::nl_id_pool_t id) noexcept {
+  return nl->get_id_pool(id);
+}
+
+int nl_vxlan::port_tenant_add(uint32_t lport_id, uint32_t tunnel_id) {
+  int rv = sw->tunnel_port_tenant_add(lport_id, tunnel_id);
+
+  if (rv == 0)
+    ids(nl_id_pools::NL_ID_VXLAN_PORT_TENANT).allocate({lport_id, tunnel_id});
+  return rv;
+}
+
+int nl_vxlan::port_tenant_remove(uint32_t lport_id, uint32_t tunnel_id) {
+  ids(nl_id_pools::NL_ID_VXLAN_PORT_TENANT).release({lport_id, tunnel_id});
+  return sw->tunnel_port_tenant_remove(lport_id, tunnel_id);
+}
+
+int nl_vxlan::next_hop_group_member_add(uint32_t group_id, uint32_t nh_id) {
+  int rv = sw->tunnel_next_hop_group_member_add(group_id, nh_id);
+
+  if (rv == 0)
+    ids(nl_id_pools::NL_ID_VXLAN_NEXT_HOP_GROUP_MEMBER)
+        .allocate({group_id, nh_id});
+  return rv;
+}
+
+int nl_vxlan::next_hop_group_member_remove(uint32_t group_id,
+                                           uint32_t nh_id) {
+  ids(nl_id_pools::NL_ID_VXLAN_NEXT_HOP_GROUP_MEMBER)
+      .release({group_id, nh_id});
+  return sw->tunnel_next_hop_group_member_remove(group_id, nh_id);
+}
+
+size_t nl_vxlan::delete_unclaimed() noexcept {
+  size_t n = 0;
+
+  // references first: memberships, then the ports using the next hops
+  for (const auto &e :
+       ids(nl_id_pools::NL_ID_VXLAN_PORT_TENANT).drop_reserved()) {
+    sw->tunnel_port_tenant_remove(e.first[0], e.first[1]);
+    n++;
+  }
+
+  for (const auto &e :
+       ids(nl_id_pools::NL_ID_VXLAN_NEXT_HOP_GROUP_MEMBER).drop_reserved()) {
+    sw->tunnel_next_hop_group_member_remove(e.first[0], e.first[1]);
+    n++;
+  }
+
+  for (auto pool :
+       {nl_id_pools::NL_ID_VXLAN_PORT, nl_id_pools::NL_ID_VXLAN_NEXT_HOP_GROUP,
+        nl_id_pools::NL_ID_VXLAN_NEXT_HOP, nl_id_pools::NL_ID_VXLAN_TUNNEL}) {
+    for (const auto &e : ids(pool).drop_reserved()) {
+      int rv;
+
+      switch (pool) {
+      case nl_id_pools::NL_ID_VXLAN_PORT:
+        rv = sw->tunnel_port_delete(e.second);
+        break;
+      case nl_id_pools::NL_ID_VXLAN_NEXT_HOP_GROUP:
+        rv = sw->tunnel_next_hop_group_delete(e.second);
+        break;
+      case nl_id_pools::NL_ID_VXLAN_NEXT_HOP:
+        rv = sw->tunnel_next_hop_delete(e.second);
+        break;
+      default:
+        rv = sw->tunnel_tenant_delete(e.second);
+        break;
+      }
+
+      if (rv < 0)
+        LOG(WARNING) << __FUNCTION__ << ": failed to delete id=" << e.second
+                     << " of pool " << pool << ", rv=" << rv;
+      n++;
+    }
+  }
+
+  return n;
+}
+
 // XXX TODO alter this function to pass the vni instead of tunnel_id
 int nl_vxlan::create_access_port(rtnl_link *br_link, uint32_t tunnel_id,
                                  const std::string &access_port_name,
@@ -314,6 +497,8 @@ int nl_vxlan::create_access_port(rtnl_link *br_link, uint32_t tunnel_id,
     return -EINVAL;
   }
 
+  uint32_t port_id = ids(nl_id_pools::NL_ID_VXLAN_PORT)
+                         .allocate(access_port_key(pport_no, vid));
   std::string port_name = access_port_name;
   port_name += "." + std::to_string(vid);
 
@@ -325,12 +510,12 @@ int nl_vxlan::create_access_port(rtnl_link *br_link, uint32_t tunnel_id,
   int cnt = 0;
   do {
     VLOG(3) << __FUNCTION__ << ": rv=" << rv << ", cnt=" << cnt << std::showbase
-            << std::hex << ", port_id=" << port_id_cnt
+            << std::hex << ", port_id=" << port_id
             << ", port_name=" << port_name << std::dec
             << ", pport_no=" << pport_no << ", vid=" << vid
             << ", untagged=" << untagged;
     // XXX TODO this is totally crap even if it works for now
-    rv = sw->tunnel_access_port_create(port_id_cnt, port_name, pport_no, vid,
+    rv = sw->tunnel_access_port_create(port_id, port_name, pport_no, vid,
                                        untagged);
 
     cnt++;
@@ -341,43 +526,45 @@ int nl_vxlan::create_access_port(rtnl_link *br_link, uint32_t tunnel_id,
     LOG(ERROR) << __FUNCTION__
                << ": failed to create access port tunnel_id=" << tunnel_id
                << ", vid=" << vid << ", port:" << access_port_name;
+    ids(nl_id_pools::NL_ID_VXLAN_PORT).release(access_port_key(pport_no, vid));
     return rv;
   }
 
   VLOG(3) << __FUNCTION__
-          << ": calling tunnel_port_tenant_add port_id=" << port_id_cnt
+          << ": calling tunnel_port_tenant_add port_id=" << port_id
           << ", tunnel_id=" << tunnel_id;
-  rv = sw->tunnel_port_tenant_add(port_id_cnt, tunnel_id);
+  rv = port_tenant_add(port_id, tunnel_id);
 
   if (rv < 0) {
-    LOG(ERROR) << __FUNCTION__ << ": failed to add tunnel port " << port_id_cnt
+    LOG(ERROR) << __FUNCTION__ << ": failed to add tunnel port " << port_id
                << " to tenant " << tunnel_id;
     delete_access_port(br_link, pport_no, vid, false);
+    ids(nl_id_pools::NL_ID_VXLAN_PORT).release(access_port_key(pport_no, vid));
     return rv;
   }
 
   if (bridge->is_port_flooding(br_link)) {
-    rv = enable_flooding(tunnel_id, port_id_cnt);
+    rv = enable_flooding(tunnel_id, port_id);
     if (rv < 0) {
       LOG(ERROR) << __FUNCTION__
-                 << ": failed to add flooding for lport=" << port_id_cnt
+                 << ": failed to add flooding for lport=" << port_id
                  << " in tenant=" << tunnel_id;
-      disable_flooding(tunnel_id, port_id_cnt);
-      sw->tunnel_port_tenant_remove(port_id_cnt, tunnel_id);
+      disable_flooding(tunnel_id, port_id);
+      port_tenant_remove(port_id, tunnel_id);
       delete_access_port(br_link, pport_no, vid, false);
+      ids(nl_id_pools::NL_ID_VXLAN_PORT)
+          .release(access_port_key(pport_no, vid));
       return rv;
     }
   }
 
   // XXX TODO check if access port is already existing?
   access_port_ids.emplace(std::make_pair(
-      pport_vlan(pport_no, vid), access_tunnel_port(port_id_cnt, tunnel_id)));
+      pport_vlan(pport_no, vid), access_tunnel_port(port_id, tunnel_id)));
 
   // optionally return lport
   if (lport)
-    *lport = port_id_cnt;
-
-  port_id_cnt++;
+    *lport = port_id;
 
   return 0;
 }
@@ -412,10 +599,11 @@ int nl_vxlan::delete_access_port(rtnl_link *br_link, uint32_t pport_no,
   if (bridge->is_port_flooding(br_link)) {
     disable_flooding(it->second.tunnel_id, it->second.lport_id);
   }
-  sw->tunnel_port_tenant_remove(it->second.lport_id, it->second.tunnel_id);
+  port_tenant_remove(it->second.lport_id, it->second.tunnel_id);
   sw->tunnel_port_delete(it->second.lport_id);
 
   access_port_ids.erase(it);
+  ids(nl_id_pools::NL_ID_VXLAN_PORT).release(access_port_key(pport_no, vid));
 
   return 0;
 }
@@ -465,27 +653,29 @@ int nl_vxlan::create_vni(rtnl_link *link) {
   }
 
   // create tenant on switch
-  rv = sw->tunnel_tenant_create(this->tunnel_id_cnt, vni);
+  tunnel_id = ids(nl_id_pools::NL_ID_VXLAN_TUNNEL).allocate({vni});
+  rv = sw->tunnel_tenant_create(tunnel_id, vni);
 
   if (rv < 0) {
     LOG(ERROR) << __FUNCTION__ << ": failed to create tunnel tenant tunnel_id="
-               << this->tunnel_id_cnt << ", vni=" << vni << ", rv=" << rv;
+               << tunnel_id << ", vni=" << vni << ", rv=" << rv;
+    ids(nl_id_pools::NL_ID_VXLAN_TUNNEL).release({vni});
     return -EINVAL;
   }
 
   // enable tunnel_id
-  rv = sw->overlay_tunnel_add(this->tunnel_id_cnt);
+  rv = sw->overlay_tunnel_add(tunnel_id);
 
   if (rv < 0) {
     LOG(ERROR) << __FUNCTION__
                << ": failed to add overlay tunnel tunnel_id=" << tunnel_id
                << ", rv=" << rv;
-    sw->tunnel_tenant_delete(this->tunnel_id_cnt);
+    sw->tunnel_tenant_delete(tunnel_id);
+    ids(nl_id_pools::NL_ID_VXLAN_TUNNEL).release({vni});
     return -EINVAL;
   }
 
-  vni2tunnel.emplace(vni, this->tunnel_id_cnt);
-  this->tunnel_id_cnt++;
+  vni2tunnel.emplace(vni, tunnel_id);
 
   return rv;
 }
@@ -523,6 +713,7 @@ int nl_vxlan::remove_vni(rtnl_link *link) {
   }
 
   vni2tunnel.erase(v2t_it);
+  ids(nl_id_pools::NL_ID_VXLAN_TUNNEL).release({vni});
 
   return 0;
 }
@@ -594,7 +785,8 @@ int nl_vxlan::create_endpoint(rtnl_link *vxlan_link, rtnl_link *br_link,
   }
 
   uint32_t next_hop_id = 0;
-  rv = create_next_hop(vxlan_link, remote_addr, &next_hop_id);
+  bool ecmp = false;
+  rv = create_next_hop(vxlan_link, remote_addr, &next_hop_id, &ecmp);
   if (rv == -ENETUNREACH) {
     // NH network not reachable (route missing)
     l3->notify_on_net_reachable(
@@ -612,18 +804,21 @@ int nl_vxlan::create_endpoint(rtnl_link *vxlan_link, rtnl_link *br_link,
   }
 
   rv = create_endpoint(vxlan_link, local_.get(), remote_addr, next_hop_id,
-                       &lport_id);
+                       ecmp, &lport_id);
 
   if (rv < 0) {
-    delete_next_hop(next_hop_id);
+    if (ecmp)
+      delete_next_hop_group(get_ipv4(remote_addr));
+    else
+      delete_next_hop(next_hop_id);
     LOG(ERROR) << __FUNCTION__ << ": failed to create endpoint";
     return -EINVAL;
   }
 
-  rv = sw->tunnel_port_tenant_add(lport_id, tunnel_id);
+  rv = port_tenant_add(lport_id, tunnel_id);
   if (rv < 0) {
+    // releases the next hop as well
     delete_endpoint(vxlan_link, local_.get(), remote_addr);
-    delete_next_hop(next_hop_id);
     LOG(ERROR) << __FUNCTION__ << ": tunnel_port_tenant_add returned rv=" << rv
                << " for lport_id=" << lport_id << " tunnel_id=" << tunnel_id;
     return -EINVAL;
@@ -639,9 +834,8 @@ int nl_vxlan::create_endpoint(rtnl_link *vxlan_link, rtnl_link *br_link,
                  << ": failed to add flooding for lport=" << lport_id
                  << " in tenant=" << tunnel_id;
       disable_flooding(tunnel_id, lport_id);
-      sw->tunnel_port_tenant_remove(lport_id, tunnel_id);
+      port_tenant_remove(lport_id, tunnel_id);
       delete_endpoint(vxlan_link, local_.get(), remote_addr);
-      delete_next_hop(next_hop_id);
     }
   }
 
@@ -684,7 +878,7 @@ int nl_vxlan::create_endpoint(rtnl_link *vxlan_link, rtnl_link *br_link,
 
 int nl_vxlan::create_endpoint(rtnl_link *vxlan_link, nl_addr *local_,
                               nl_addr *group_, uint32_t _next_hop_id,
-                              uint32_t *lport_id) {
+                              bool ecmp, uint32_t *lport_id) {
   assert(group_);
   assert(local_);
   assert(vxlan_link);
@@ -738,35 +932,41 @@ int nl_vxlan::create_endpoint(rtnl_link *vxlan_link, nl_addr *local_,
   }
 
   // create endpoint port
+  uint32_t port_id =
+      ids(nl_id_pools::NL_ID_VXLAN_PORT).allocate(endpoint_key(ep));
   VLOG(3) << __FUNCTION__ << std::hex << std::showbase
-          << ": calling tunnel_enpoint_create lport_id=" << lport_id
+          << ": calling tunnel_enpoint_create lport_id=" << port_id
           << ", name=" << rtnl_link_get_name(vxlan_link)
           << ", remote=" << remote_ipv4 << ", local=" << local_ipv4
           << ", ttl=" << ttl << ", next_hop_id=" << _next_hop_id
+          << ", ecmp=" << ecmp
           << ", terminator_udp_dst_port=" << terminator_udp_dst_port
           << ", initiator_udp_dst_port=" << initiator_udp_dst_port
           << ", use_entropy=" << use_entropy;
   rv = sw->tunnel_enpoint_create(
-      this->port_id_cnt, std::string(rtnl_link_get_name(vxlan_link)),
-      remote_ipv4, local_ipv4, ttl, _next_hop_id, terminator_udp_dst_port,
-      initiator_udp_dst_port, udp_src_port_if_no_entropy, use_entropy);
+      port_id, std::string(rtnl_link_get_name(vxlan_link)),
+      remote_ipv4, local_ipv4, ttl, _next_hop_id, ecmp,
+      terminator_udp_dst_port, initiator_udp_dst_port,
+      udp_src_port_if_no_entropy, use_entropy);
 
   if (rv != 0) {
     LOG(ERROR) << __FUNCTION__
                << ": failed to create tunnel enpoint lport_id=" << std::hex
-               << std::showbase << lport_id
+               << std::showbase << port_id
                << ", name=" << rtnl_link_get_name(vxlan_link)
                << ", remote=" << remote_ipv4 << ", local=" << local_ipv4
                << ", ttl=" << ttl << ", next_hop_id=" << _next_hop_id
+               << ", ecmp=" << ecmp
                << ", terminator_udp_dst_port=" << terminator_udp_dst_port
                << ", initiator_udp_dst_port=" << initiator_udp_dst_port
                << ", use_entropy=" << use_entropy << ", rv=" << rv;
+    ids(nl_id_pools::NL_ID_VXLAN_PORT).release(endpoint_key(ep));
     return -EINVAL;
   }
 
-  endpoint_id.emplace(
-      ep, endpoint_tunnel_port(this->port_id_cnt, _next_hop_id, vni));
-  *lport_id = this->port_id_cnt++;
+  endpoint_id.emplace(ep,
+                      endpoint_tunnel_port(port_id, _next_hop_id, ecmp, vni));
+  *lport_id = port_id;
   return 0;
 }
 
@@ -777,7 +977,7 @@ int nl_vxlan::enable_flooding(uint32_t tunnel_id, uint32_t lport_id) {
           << ", tunnel_id=" << tunnel_id;
   rv = sw->add_l2_overlay_flood(tunnel_id, lport_id);
   if (rv < 0) {
-    LOG(ERROR) << __FUNCTION__ << ": failed to add tunnel port " << port_id_cnt
+    LOG(ERROR) << __FUNCTION__ << ": failed to add tunnel port " << lport_id
                << " to flooding for tenant " << tunnel_id;
     return -EINVAL;
   }
@@ -793,7 +993,7 @@ int nl_vxlan::disable_flooding(uint32_t tunnel_id, uint32_t lport_id) {
   rv = sw->del_l2_overlay_flood(tunnel_id, lport_id);
   if (rv < 0) {
     LOG(ERROR) << __FUNCTION__ << ": failed to remove tunnel port "
-               << port_id_cnt << " from flooding group in tenant " << tunnel_id;
+               << lport_id << " from flooding group in tenant " << tunnel_id;
     return -EINVAL;
   }
 
@@ -910,7 +1110,7 @@ int nl_vxlan::delete_endpoint(rtnl_link *vxlan_link, nl_addr *local_,
   disable_flooding(tunnel_id, lport_id); // TODO needed?
 
   if (refcnt_vni == 0) {
-    rv = sw->tunnel_port_tenant_remove(lport_id, tunnel_id);
+    rv = port_tenant_remove(lport_id, tunnel_id);
 
     if (rv < 0) {
       LOG(ERROR) << __FUNCTION__ << ": failed to remove port=" << lport_id
@@ -929,30 +1129,83 @@ int nl_vxlan::delete_endpoint(rtnl_link *vxlan_link, nl_addr *local_,
     }
 
     // delete next hop
-    rv = delete_next_hop(ep_it->second.nh_id);
+    if (ep_it->second.ecmp)
+      rv = delete_next_hop_group(ep_it->first.remote_ipv4);
+    else
+      rv = delete_next_hop(ep_it->second.nh_id);
 
+    ids(nl_id_pools::NL_ID_VXLAN_PORT).release(endpoint_key(ep_it->first));
     endpoint_id.erase(ep_it);
   }
 
   return rv;
 }
 
-int nl_vxlan::create_next_hop(rtnl_link *vxlan_link, nl_addr *remote,
-                              uint32_t *next_hop_id) {
-  int rv;
-  std::packaged_task<struct rtnl_route *(struct nl_addr *)> task(
-      [](struct nl_addr *addr) {
-        nl_route_query rq;
-        return rq.query_route(addr);
-      });
-  std::future<struct rtnl_route *> result = task.get_future();
-  std::thread(std::move(task), remote).detach();
-
-  VLOG(4) << __FUNCTION__ << ": wait for task to finish";
-  result.wait();
-  VLOG(4) << __FUNCTION__ << ": task finished";
-  std::unique_ptr<rtnl_route, void (*)(rtnl_route *)> route(result.get(),
-                                                            &rtnl_route_put);
+static std::string route_key(nl_addr *addr) {
+  char buf[INET6_ADDRSTRLEN + 5];
+  return nl_addr2str(addr, buf, sizeof(buf));
+}
+
+// the endpoints of a vxlan link are resolved as one batch
+void nl_vxlan::prefetch_routes(const std::deque<rtnl_neigh *> &neighs) {
+  std::vector<nl_addr *> remotes;
+
+  for (auto neigh : neighs) {
+    nl_addr *remote = rtnl_neigh_get_dst(neigh);
+
+    if (remote == nullptr || !nl_addr_iszero(rtnl_neigh_get_lladdr(neigh)) ||
+        nl_addr_get_family(remote) != AF_INET)
+      continue;
+
+    remotes.push_back(remote);
+  }
+
+  prefetch_routes(remotes);
+}
+
+void nl_vxlan::prefetch_routes(const std::vector<nl_addr *> &dsts) {
+  std::vector<nl_addr *> remotes;
+
+  for (auto remote : dsts) {
+    if (prefetched_routes.emplace(route_key(remote), nullptr).second)
+      remotes.push_back(remote);
+  }
+
+  if (remotes.size() < 2)
+    return;
+
+  auto routes = resolver->resolve(remotes);
+  for (size_t i = 0; i < remotes.size(); i++)
+    prefetched_routes[route_key(remotes[i])] = routes[i];
+}
+
+void nl_vxlan::clear_prefetched_routes() noexcept {
+  for (auto &r : prefetched_routes) {
+    if (r.second)
+      rtnl_route_put(r.second);
+  }
+  prefetched_routes.clear();
+}
+
+// the route has to be freed using rtnl_route_put
+struct rtnl_route *nl_vxlan::resolve_route(nl_addr *remote) {
+  auto it = prefetched_routes.find(route_key(remote));
+
+  if (it != prefetched_routes.end() && it->second) {
+    struct rtnl_route *route = it->second;
+    // used once, a second endpoint to the same remote asks again
+    it->second = nullptr;
+    return route;
+  }
+
+  VLOG(4) << __FUNCTION__ << ": wait for route to " << remote;
+  return resolver->resolve(remote).get();
+}
+
+int nl_vxlan::get_underlay_neighbours(nl_addr *remote, int ifindex,
+                                      std::deque<rtnl_neigh *> *neighs) {
+  std::unique_ptr<rtnl_route, void (*)(rtnl_route *)> route(
+      resolve_route(remote), &rtnl_route_put);
 
   if (route.get() == nullptr) {
     LOG(ERROR) << __FUNCTION__ << ": could not retrieve route to " << remote;
@@ -963,16 +1216,9 @@ int nl_vxlan::create_next_hop(rtnl_link *vxlan_link, nl_addr *remote,
 
   VLOG(2) << __FUNCTION__ << ": route " << OBJ_CAST(route.get()) << " with "
           << nnh << " next hop(s)";
-  // XXX TODO implement ecmp
-  if (nnh > 1) {
-    // ecmp
-    LOG(WARNING) << __FUNCTION__
-                 << ": ecmp not supported, only first next hop will be used.";
-  }
 
-  std::deque<struct rtnl_neigh *> neighs;
   std::deque<nh_stub> unresolved_nh;
-  rv = l3->get_neighbours_of_route(route.get(), &neighs, &unresolved_nh);
+  int rv = l3->get_neighbours_of_route(route.get(), neighs, &unresolved_nh);
 
   if (rv == -ENETUNREACH)
     return rv;
@@ -980,41 +1226,38 @@ int nl_vxlan::create_next_hop(rtnl_link *vxlan_link, nl_addr *remote,
   for (auto nh : unresolved_nh) {
     VLOG(3) << __FUNCTION__ << ": got unresolved nh ifindex=" << nh.ifindex
             << ", nh=" << nh.nh;
-    l3->notify_on_nh_reachable(
-        this,
-        nh_params{net_params{remote, rtnl_link_get_ifindex(vxlan_link)}, nh});
+    l3->notify_on_nh_reachable(this,
+                               nh_params{net_params{remote, ifindex}, nh});
   }
 
-  if (neighs.size() == 0) {
-    LOG(ERROR) << __FUNCTION__ << ": neighs.size()=" << neighs.size();
-    return -EDESTADDRREQ;
-  }
-
-  // XXX TODO for ecmp we may need to resolve a neigh if neighs.size!=nnh
+  return nnh;
+}
 
-  std::unique_ptr<rtnl_neigh, decltype(&rtnl_neigh_put)> neigh(neighs.front(),
-                                                               &rtnl_neigh_put);
-  neighs.pop_front();
+int nl_vxlan::create_next_hop(rtnl_link *vxlan_link, nl_addr *remote,
+                              uint32_t *next_hop_id, bool *ecmp) {
+  std::deque<struct rtnl_neigh *> neighs;
+  int rv = get_underlay_neighbours(remote, rtnl_link_get_ifindex(vxlan_link),
+                                   &neighs);
 
-  // clean others
-  for (auto n : neighs)
-    rtnl_neigh_put(n);
+  if (rv < 0)
+    return rv;
 
-  rv = create_next_hop(neigh.get(), next_hop_id);
-  if (rv < 0) {
-    LOG(ERROR) << __FUNCTION__ << ": failed to create next hop "
-               << OBJ_CAST(neigh.get());
-    return -EINVAL;
+  if (neighs.size() == 0) {
+    LOG(ERROR) << __FUNCTION__ << ": neighs.size()=" << neighs.size();
+    return -EDESTADDRREQ;
   }
 
-  return rv;
+  // every endpoint uses a group, even with a single path, as the endpoint
+  // port cannot be moved to a group later. The group follows the route, next
+  // hops resolved later are added to it.
+  *ecmp = true;
+  return create_next_hop_group(vxlan_link, remote, &neighs, next_hop_id);
 }
 
 int nl_vxlan::create_next_hop(rtnl_neigh *neigh, uint32_t *next_hop_id) {
   int rv;
 
   assert(neigh);
-  assert(next_hop_id_cnt);
 
   // get outgoing interface
   uint32_t ifindex = rtnl_neigh_get_ifindex(neigh);
@@ -1051,7 +1294,11 @@ int nl_vxlan::create_next_hop(rtnl_neigh *neigh, uint32_t *next_hop_id) {
   }
 
   uint64_t dst_mac = nlall2uint64(addr);
-  uint16_t vlan_id = 1; // XXX TODO currently hardcoded to vid 1
+  uint16_t vlan_id = vlan->get_vid(local_link);
+  if (vlan_id == 0) {
+    LOG(ERROR) << __FUNCTION__ << ": no vlan for link " << OBJ_CAST(local_link);
+    return -EINVAL;
+  }
   auto tnh = tunnel_nh(src_mac, dst_mac, physical_port, vlan_id);
   auto tnh_it = tunnel_next_hop_id.equal_range(tnh);
 
@@ -1067,32 +1314,34 @@ int nl_vxlan::create_next_hop(rtnl_neigh *neigh, uint32_t *next_hop_id) {
   }
 
   // create next hop
+  uint32_t nh_id =
+      ids(nl_id_pools::NL_ID_VXLAN_NEXT_HOP).allocate(next_hop_key(tnh));
   VLOG(3) << __FUNCTION__ << std::hex << std::showbase
-          << ": calling tunnel_next_hop_create next_hop_id=" << next_hop_id_cnt
+          << ": calling tunnel_next_hop_create next_hop_id=" << nh_id
           << ", src_mac=" << src_mac << ", dst_mac=" << dst_mac
           << ", physical_port=" << physical_port << ", vlan_id=" << vlan_id;
-  rv = sw->tunnel_next_hop_create(next_hop_id_cnt, src_mac, dst_mac,
-                                  physical_port, vlan_id);
+  rv = sw->tunnel_next_hop_create(nh_id, src_mac, dst_mac, physical_port,
+                                  vlan_id);
 
   if (rv < 0) {
     LOG(ERROR) << __FUNCTION__ << ": tunnel_next_hop_create returned rv=" << rv
-               << " for the following parameter: next_hop_id="
-               << next_hop_id_cnt << ", src_mac=" << src_mac
-               << ", dst_mac=" << dst_mac << ", physical_port=" << physical_port
+               << " for the following parameter: next_hop_id=" << nh_id
+               << ", src_mac=" << src_mac << ", dst_mac=" << dst_mac
+               << ", physical_port=" << physical_port
                << ", vlan_id=" << vlan_id;
+    ids(nl_id_pools::NL_ID_VXLAN_NEXT_HOP).release(next_hop_key(tnh));
     return rv;
   }
 
-  tunnel_next_hop_id.emplace(tnh, next_hop_id_cnt);
-  tunnel_next_hop2tnh.emplace(next_hop_id_cnt, tnh);
-  *next_hop_id = next_hop_id_cnt++;
+  tunnel_next_hop_id.emplace(tnh, nh_id);
+  tunnel_next_hop2tnh.emplace(nh_id, tnh);
+  *next_hop_id = nh_id;
 
   return rv;
 }
 
 int nl_vxlan::delete_next_hop(rtnl_neigh *neigh) {
   assert(neigh);
-  assert(next_hop_id_cnt); // XXX TODO implement better id counting
 
   // get outgoing interface
   uint32_t ifindex = rtnl_neigh_get_ifindex(neigh);
@@ -1128,7 +1377,11 @@ int nl_vxlan::delete_next_hop(rtnl_neigh *neigh) {
   }
 
   uint64_t dst_mac = nlall2uint64(addr);
-  uint16_t vlan_id = 1; // XXX TODO currently hardcoded to vid 1
+  uint16_t vlan_id = vlan->get_vid(local_link);
+  if (vlan_id == 0) {
+    LOG(ERROR) << __FUNCTION__ << ": no vlan for link " << OBJ_CAST(local_link);
+    return -EINVAL;
+  }
   auto tnh = tunnel_nh(src_mac, dst_mac, physical_port, vlan_id);
 
   return delete_next_hop(tnh);
@@ -1179,11 +1432,162 @@ int nl_vxlan::delete_next_hop(const struct tunnel_nh &tnh) {
 
     tunnel_next_hop2tnh.erase(it->second.nh_id);
     tunnel_next_hop_id.erase(it);
+    ids(nl_id_pools::NL_ID_VXLAN_NEXT_HOP).release(next_hop_key(tnh));
   }
 
   return 0;
 }
 
+int nl_vxlan::create_next_hop_group(rtnl_link *vxlan_link, nl_addr *remote,
+                                    std::deque<rtnl_neigh *> *neighs,
+                                    uint32_t *group_id) {
+  uint32_t remote_ipv4 = get_ipv4(remote);
+  auto it = tunnel_next_hop_groups.find(remote_ipv4);
+
+  if (it != tunnel_next_hop_groups.end()) {
+    VLOG(1) << __FUNCTION__ << ": found a tunnel next hop group match using "
+            << "group_id=" << it->second.group_id;
+    for (auto n : *neighs)
+      rtnl_neigh_put(n);
+    neighs->clear();
+
+    it->second.refcnt++;
+    *group_id = it->second.group_id;
+    return 0;
+  }
+
+  uint32_t id =
+      ids(nl_id_pools::NL_ID_VXLAN_NEXT_HOP_GROUP).allocate({remote_ipv4});
+  VLOG(3) << __FUNCTION__ << ": calling tunnel_next_hop_group_create group_id="
+          << id << ", remote=" << remote;
+  int rv = sw->tunnel_next_hop_group_create(id);
+  if (rv < 0) {
+    LOG(ERROR) << __FUNCTION__
+               << ": tunnel_next_hop_group_create returned rv=" << rv
+               << " for group_id=" << id;
+    for (auto n : *neighs)
+      rtnl_neigh_put(n);
+    neighs->clear();
+    ids(nl_id_pools::NL_ID_VXLAN_NEXT_HOP_GROUP).release({remote_ipv4});
+    return rv;
+  }
+
+  it = tunnel_next_hop_groups
+           .emplace(remote_ipv4,
+                    tunnel_nh_group(id, rtnl_link_get_ifindex(vxlan_link)))
+           .first;
+  sync_next_hop_group(&it->second, neighs);
+  *group_id = id;
+
+  return 0;
+}
+
+int nl_vxlan::delete_next_hop_group(uint32_t remote_ipv4) {
+  auto it = tunnel_next_hop_groups.find(remote_ipv4);
+
+  if (it == tunnel_next_hop_groups.end()) {
+    LOG(WARNING) << __FUNCTION__ << ": tried to delete invalid next hop group";
+    return -EINVAL;
+  }
+
+  if (--it->second.refcnt > 0)
+    return 0;
+
+  uint32_t group_id = it->second.group_id;
+  for (auto nh_id : it->second.nh_ids) {
+    next_hop_group_member_remove(group_id, nh_id);
+    delete_next_hop(nh_id);
+  }
+
+  int rv = sw->tunnel_next_hop_group_delete(group_id);
+  if (rv < 0) {
+    LOG(ERROR) << __FUNCTION__
+               << ": failed to delete next hop group group_id=" << group_id
+               << ", rv=" << rv;
+  }
+
+  tunnel_next_hop_groups.erase(it);
+  ids(nl_id_pools::NL_ID_VXLAN_NEXT_HOP_GROUP).release({remote_ipv4});
+
+  return 0;
+}
+
+// makes the resolved neighbours the members of the group, consumes neighs
+void nl_vxlan::sync_next_hop_group(struct tunnel_nh_group *group,
+                                   std::deque<rtnl_neigh *> *neighs) {
+  std::set<uint32_t> nh_ids;
+
+  for (auto n : *neighs) {
+    uint32_t nh_id;
+
+    // takes a reference on the next hop, existing members hold one already
+    if (create_next_hop(n, &nh_id) == 0) {
+      if (!nh_ids.insert(nh_id).second || group->nh_ids.count(nh_id))
+        delete_next_hop(nh_id);
+    }
+    rtnl_neigh_put(n);
+  }
+  neighs->clear();
+
+  for (auto it = nh_ids.begin(); it != nh_ids.end();) {
+    if (group->nh_ids.count(*it)) {
+      ++it;
+      continue;
+    }
+
+    int rv = next_hop_group_member_add(group->group_id, *it);
+    if (rv < 0) {
+      LOG(ERROR) << __FUNCTION__ << ": failed to add next_hop_id=" << *it
+                 << " to group_id=" << group->group_id << ", rv=" << rv;
+      delete_next_hop(*it);
+      it = nh_ids.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  for (auto nh_id : group->nh_ids) {
+    if (nh_ids.count(nh_id))
+      continue;
+
+    next_hop_group_member_remove(group->group_id, nh_id);
+    delete_next_hop(nh_id);
+  }
+
+  VLOG(1) << __FUNCTION__ << ": group_id=" << group->group_id << " has "
+          << nh_ids.size() << " member(s)";
+  group->nh_ids = std::move(nh_ids);
+}
+
+void nl_vxlan::resync_next_hop_group(uint32_t remote_ipv4) {
+  auto it = tunnel_next_hop_groups.find(remote_ipv4);
+
+  if (it == tunnel_next_hop_groups.end())
+    return;
+
+  uint32_t addr = htonl(remote_ipv4);
+  std::unique_ptr<nl_addr, decltype(&nl_addr_put)> remote(
+      nl_addr_build(AF_INET, &addr, sizeof(addr)), &nl_addr_put);
+  std::deque<rtnl_neigh *> neighs;
+
+  if (remote.get() == nullptr) {
+    LOG(ERROR) << __FUNCTION__ << ": out of memory";
+    return;
+  }
+
+  int rv = get_underlay_neighbours(remote.get(), it->second.ifindex, &neighs);
+  if (rv < 0) {
+    // the endpoint is kept, traffic resumes with the next route
+    VLOG(1) << __FUNCTION__ << ": no route to " << remote.get()
+            << ", group_id=" << it->second.group_id << " is left unchanged";
+    for (auto n : neighs)
+      rtnl_neigh_put(n);
+    return;
+  }
+
+  sync_next_hop_group(&it->second, &neighs);
+}
+
 int nl_vxlan::add_l2_neigh(rtnl_neigh *neigh, rtnl_link *link,
                            rtnl_link *br_link) {
   assert(link);
@@ -1270,7 +1674,7 @@ int nl_vxlan::add_l2_neigh(rtnl_neigh *neigh, rtnl_link *link,
 
       } else {
         // existing remote but new tunnel_id/vni on link
-        rv = sw->tunnel_port_tenant_add(lport, tunnel_id);
+        rv = port_tenant_add(lport, tunnel_id);
         ep_it->second.refcnt++;
         ep_it->second.refcnt_vni[vni]++;
 
@@ -1490,7 +1894,7 @@ int nl_vxlan::delete_l2_neigh_endpoint(rtnl_link *vxlan_link, nl_addr *local,
 
   if (refcnt_vni == 0) {
     auto lport_id = ep_it->second.lport_id;
-    rv = sw->tunnel_port_tenant_remove(lport_id, tunnel_id);
+    rv = port_tenant_remove(lport_id, tunnel_id);
 
     if (rv < 0) {
       LOG(ERROR) << __FUNCTION__ << ": failed to remove port=" << lport_id
@@ -1510,7 +1914,10 @@ int nl_vxlan::delete_l2_neigh_endpoint(rtnl_link *vxlan_link, nl_addr *local,
     }
 
     // delete next hop
-    rv = delete_next_hop(ep_it->second.nh_id);
+    if (ep_it->second.ecmp)
+      rv = delete_next_hop_group(ep_it->first.remote_ipv4);
+    else
+      rv = delete_next_hop(ep_it->second.nh_id);
 
     endpoint_id.erase(ep_it);
   }
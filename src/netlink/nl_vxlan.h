@@ -5,15 +5,20 @@
 #pragma once
 
 #include <cstdint>
+#include <deque>
 #include <map>
 #include <memory>
+#include <string>
+#include <vector>
 
+#include "nl_id_pool.h"
 #include "nl_l3_interfaces.h"
 
 extern "C" {
 struct nl_addr;
 struct rtnl_link;
 struct rtnl_neigh;
+struct rtnl_route;
 }
 
 namespace basebox {
@@ -21,18 +26,23 @@ namespace basebox {
 class cnetlink;
 class nl_l3;
 class nl_bridge;
+class nl_route_resolver;
+class nl_vlan;
 class switch_interface;
 struct tunnel_nh;
+struct tunnel_nh_group;
 
-class nl_vxlan : public net_reachable, nh_reachable {
+class nl_vxlan : public net_reachable, nh_reachable, route_changed {
 public:
-  nl_vxlan(std::shared_ptr<nl_l3> l3, cnetlink *nl);
-  ~nl_vxlan() {}
+  nl_vxlan(std::shared_ptr<nl_vlan> vlan, std::shared_ptr<nl_l3> l3,
+           cnetlink *nl);
+  ~nl_vxlan();
 
   int init();
 
   void net_reachable_notification(struct net_params) noexcept override;
   void nh_reachable_notification(struct nh_params) noexcept override;
+  void route_changed_notification(struct rtnl_route *r) noexcept override;
 
   int create_vni(rtnl_link *link);
   int remove_vni(rtnl_link *link);
@@ -58,20 +68,49 @@ public:
   int create_endpoint(rtnl_link *vxlan_link);
   int delete_endpoint(rtnl_link *vxlan_link);
 
+  /**
+   * delete the tunnel objects of a previous instance that were not created
+   * again after a warm restart
+   *
+   * @returns the number of objects deleted
+   */
+  size_t delete_unclaimed() noexcept;
+
 private:
   int create_endpoint(rtnl_link *vxlan_link, rtnl_link *br_link,
                       nl_addr *group);
   int create_endpoint(rtnl_link *vxlan_link, nl_addr *local_, nl_addr *group_,
-                      uint32_t _next_hop_id, uint32_t *_port_id);
+                      uint32_t _next_hop_id, bool ecmp, uint32_t *_port_id);
   int delete_endpoint(rtnl_link *vxlan_link, nl_addr *local_, nl_addr *group_);
 
+  void prefetch_routes(const std::deque<rtnl_neigh *> &neighs);
+  void prefetch_routes(const std::vector<nl_addr *> &dsts);
+  void clear_prefetched_routes() noexcept;
+  struct rtnl_route *resolve_route(nl_addr *remote);
+
+  int get_underlay_neighbours(nl_addr *remote, int ifindex,
+                              std::deque<rtnl_neigh *> *neighs);
   int create_next_hop(rtnl_link *vxlan_link, nl_addr *remote,
-                      uint32_t *next_hop_id);
+                      uint32_t *next_hop_id, bool *ecmp);
   int create_next_hop(rtnl_neigh *neigh, uint32_t *_next_hop_id);
   int delete_next_hop(rtnl_neigh *neigh);
   int delete_next_hop(uint32_t nh_id);
   int delete_next_hop(const struct tunnel_nh &);
 
+  int create_next_hop_group(rtnl_link *vxlan_link, nl_addr *remote,
+                            std::deque<rtnl_neigh *> *neighs,
+                            uint32_t *group_id);
+  int delete_next_hop_group(uint32_t remote_ipv4);
+  void sync_next_hop_group(struct tunnel_nh_group *group,
+                           std::deque<rtnl_neigh *> *neighs);
+  void resync_next_hop_group(uint32_t remote_ipv4);
+
+  // memberships are tracked in the id pools to be found after a restart
+  int port_tenant_add(uint32_t lport_id, uint32_t tunnel_id);
+  int port_tenant_remove(uint32_t lport_id, uint32_t tunnel_id);
+  int next_hop_group_member_add(uint32_t group_id, uint32_t nh_id);
+  int next_hop_group_member_remove(uint32_t group_id, uint32_t nh_id);
+
   int enable_flooding(uint32_t tunnel_id, uint32_t lport_id);
   int disable_flooding(uint32_t tunnel_id, uint32_t lport_id);
 
@@ -83,15 +122,18 @@ private:
                                nl_addr *remote, nl_addr *neigh_mac);
   int delete_l2_neigh(uint32_t tunnel_id, nl_addr *neigh_mac);
 
-  // XXX TODO handle these better and prevent id overflow
-  uint32_t next_hop_id_cnt = 1;
-  uint32_t port_id_cnt = 1 << 16 | 1;
-  uint32_t tunnel_id_cnt = 10;
+  // ids are allocated from the pools of cnetlink
+  nl_id_pool &ids(enum nl_id_pools::nl_id_pool_t id) noexcept;
 
   std::map<uint32_t, int> vni2tunnel;
 
+  std::unique_ptr<nl_route_resolver> resolver;
+  // routes to remote endpoints resolved ahead of their creation
+  std::map<std::string, struct rtnl_route *> prefetched_routes;
+
   switch_interface *sw;
   nl_bridge *bridge;
+  std::shared_ptr<nl_vlan> vlan;
   std::shared_ptr<nl_l3> l3;
   cnetlink *nl;
 };
@@ -7,16 +7,35 @@
 #include <sys/resource.h>
 
 #include "tap_io.h"
+#include "utils/metrics.h"
 
 namespace basebox {
 
-static inline void release_packets(std::deque<std::pair<int, packet *>> &q) {
+static inline size_t release_packets(std::deque<std::pair<int, packet *>> &q) {
   for (auto i : q) {
     std::free(i.second);
   }
+  return q.size();
 }
 
-tap_io::tap_io() : thread(1) {
+static metric_counter &tap_counter(const char *name, const char *help) {
+  return metrics_registry::get().counter(name, help);
+}
+
+tap_io::tap_io()
+    : thread(1),
+      rx_packets(tap_counter("baseboxd_tap_rx_packets_total",
+                             "Packets read from tap interfaces")),
+      rx_dropped(tap_counter("baseboxd_tap_rx_dropped_total",
+                             "Failed reads from tap interfaces")),
+      tx_packets(tap_counter("baseboxd_tap_tx_packets_total",
+                             "Packets written to tap interfaces")),
+      tx_dropped(tap_counter("baseboxd_tap_tx_dropped_total",
+                             "Packets dropped instead of written to tap "
+                             "interfaces")),
+      pout_queue_depth(metrics_registry::get().gauge(
+          "baseboxd_queue_depth", "Number of events waiting in a queue",
+          {{"queue", "pout_queue"}})) {
   struct rlimit limit;
   int rv = getrlimit(RLIMIT_NOFILE, &limit);
 
@@ -58,6 +77,7 @@ void tap_io::unregister_tap(int fd) {
 void tap_io::enqueue(int fd, packet *pkt) {
   if (fd < 0) {
     std::free(pkt);
+    tx_dropped.add();
     return;
   }
 
@@ -65,8 +85,10 @@ void tap_io::enqueue(int fd, packet *pkt) {
     // store pkt in outgoing queue
     std::lock_guard<std::mutex> guard(pout_queue_mutex);
     pout_queue.emplace_back(std::make_pair(fd, pkt));
+    pout_queue_depth.add(1);
   } else {
     std::free(pkt);
+    tx_dropped.add();
     return;
   }
 
@@ -104,6 +126,7 @@ void tap_io::handle_read_event(rofl::cthread &thread, int fd) {
 
   if (pkt == nullptr) {
     LOG(ERROR) << __FUNCTION__ << ": no mem left";
+    rx_dropped.add();
     return;
   }
 
@@ -113,8 +136,10 @@ void tap_io::handle_read_event(rofl::cthread &thread, int fd) {
     VLOG(3) << __FUNCTION__ << ": read " << pkt->len << " bytes from fd=" << fd
             << " into pkt=" << pkt << " tid=" << pthread_self();
     assert(td->cb);
+    rx_packets.add();
     td->cb->enqueue_to_switch(td->port_id, pkt);
   } else {
+    rx_dropped.add();
     // error occured (or non-blocking)
     switch (errno) {
     case EAGAIN:
@@ -162,11 +187,11 @@ void tap_io::tx() {
       case EIO:
         // tap not enabled drop packet
         VLOG(1) << __FUNCTION__ << ": EIO";
-        release_packets(out_queue);
+        dropped(release_packets(out_queue));
         return;
       default:
         // will drop packets
-        release_packets(out_queue);
+        dropped(release_packets(out_queue));
         LOG(ERROR) << __FUNCTION__ << ": unknown error occurred rc=" << rc
                    << " errno=" << errno << " '" << strerror(errno);
         return;
@@ -174,9 +199,16 @@ void tap_io::tx() {
     }
     std::free(pkt.second);
     out_queue.pop_front();
+    tx_packets.add();
+    pout_queue_depth.add(-1);
   }
 }
 
+void tap_io::dropped(size_t n) noexcept {
+  tx_dropped.add(n);
+  pout_queue_depth.add(-(int64_t)n);
+}
+
 void tap_io::handle_events() {
   std::lock_guard<std::mutex> guard(events_mutex);
 
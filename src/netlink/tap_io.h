@@ -8,6 +8,9 @@
 
 namespace basebox {
 
+class metric_counter;
+class metric_gauge;
+
 class tap_io : public rofl::cthread_env {
 public:
   struct tap_io_details {
@@ -45,7 +48,14 @@ private:
   std::deque<std::pair<int, packet *>> pin_queue;
   std::vector<tap_io_details> sw_cbs;
 
+  metric_counter &rx_packets;
+  metric_counter &rx_dropped;
+  metric_counter &tx_packets;
+  metric_counter &tx_dropped;
+  metric_gauge &pout_queue_depth;
+
   void tx();
+  void dropped(size_t n) noexcept;
   void handle_events();
 
 protected:
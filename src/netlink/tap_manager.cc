@@ -2,9 +2,15 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <linux/if_tun.h>
+#include <sys/ioctl.h>
+#include <utility>
+
 #include <glog/logging.h>
 #include <netlink/route/link.h>
-#include <utility>
 
 #include "cnetlink.h"
 #include "ctapdev.h"
@@ -215,6 +221,29 @@ int tap_manager::update_mtu(rtnl_link *link) {
   return 0;
 }
 
+int tap_manager::set_carrier(rtnl_link *link, bool up) {
+  assert(link);
+
+  std::lock_guard<std::mutex> lock{tn_mutex};
+  auto fd_it = tap_names2fds.find(std::string(rtnl_link_get_name(link)));
+  if (fd_it == tap_names2fds.end()) {
+    LOG(ERROR) << __FUNCTION__ << ": tap_dev not found";
+    return -EINVAL;
+  }
+
+  int carrier = up;
+  if (ioctl(fd_it->second, TUNSETCARRIER, &carrier) < 0) {
+    int rv = -errno;
+    LOG(ERROR) << __FUNCTION__ << ": failed to set carrier of "
+               << rtnl_link_get_name(link) << ": " << strerror(-rv);
+    return rv;
+  }
+
+  VLOG(2) << __FUNCTION__ << ": carrier of " << rtnl_link_get_name(link)
+          << (up ? " on" : " off");
+  return 0;
+}
+
 int tap_manager::tapdev_removed(int ifindex, const std::string &portname) {
   int rv = 0;
   bool port_removed(false);
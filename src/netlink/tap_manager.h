@@ -79,6 +79,7 @@ public:
   int tapdev_removed(int ifindex, const std::string &portname);
   void tapdev_ready(rtnl_link *link);
   int update_mtu(rtnl_link *link);
+  int set_carrier(rtnl_link *link, bool up);
 
 private:
   tap_manager(const tap_manager &other) = delete; // non construction-copyable
@@ -2,24 +2,86 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <chrono>
 #include <cstdio>
 #include <cstring>
+#include <deque>
 #include <thread>
+#include <vector>
 
+#include <gflags/gflags.h>
 #include <linux/if_ether.h>
 #include <grpc++/grpc++.h>
 
 #include "controller.h"
 #include "ofdpa_client.h"
 #include "ofdpa_datatypes.h"
+#include "utils/latency_histogram.h"
 #include "utils/utils.h"
 #include "utils/rofl-utils.h"
 
+DECLARE_string(state_snapshot);
+DECLARE_int32(state_snapshot_interval);
+DECLARE_int32(warm_restart_holdoff);
+
 namespace basebox {
 
+// OpenFlow objects in wire format as stored in the shadow state
+template <typename T> static std::vector<uint8_t> pack_wire(T obj) {
+  std::vector<uint8_t> buf(obj.length());
+  obj.pack(buf.data(), buf.size());
+  return buf;
+}
+
+template <typename T> static of_reconciler::flow to_shadow_flow(const T &f) {
+  return of_reconciler::flow{f.get_table_id(),     f.get_priority(),
+                             f.get_cookie(),       f.get_idle_timeout(),
+                             f.get_hard_timeout(), f.get_flags(),
+                             pack_wire(f.get_match()),
+                             pack_wire(f.get_instructions())};
+}
+
+static rofl::openflow::cofflowmod
+from_shadow_flow(uint8_t version, const of_reconciler::flow &f,
+                 uint8_t command) {
+  rofl::openflow::cofflowmod fm(version);
+  std::vector<uint8_t> match(f.match);
+  std::vector<uint8_t> instructions(f.instructions);
+
+  fm.set_command(command);
+  fm.set_table_id(f.table_id);
+  fm.set_priority(f.priority);
+  fm.set_cookie(f.cookie);
+  fm.set_idle_timeout(f.idle_timeout);
+  fm.set_hard_timeout(f.hard_timeout);
+  fm.set_flags(f.flags);
+  fm.set_out_port(rofl::openflow13::OFPP_ANY);
+  fm.set_out_group(rofl::openflow13::OFPG_ANY);
+  fm.set_match().unpack(match.data(), match.size());
+  if (instructions.size())
+    fm.set_instructions().unpack(instructions.data(), instructions.size());
+
+  return fm;
+}
+
+static rofl::openflow::cofgroupmod
+from_shadow_group(uint8_t version, const of_reconciler::group &g,
+                  uint16_t command) {
+  rofl::openflow::cofgroupmod gm(version);
+  std::vector<uint8_t> buckets(g.buckets);
+
+  gm.set_command(command);
+  gm.set_type(g.type);
+  gm.set_group_id(g.group_id);
+  if (buckets.size())
+    gm.set_buckets().unpack(buckets.data(), buckets.size());
+
+  return gm;
+}
+
 void controller::handle_conn_established(rofl::crofdpt &dpt,
                                          const rofl::cauxid &auxid) {
   VLOG(1) << __FUNCTION__ << ": dpt=" << dpt << " on auxid=" << auxid;
@@ -86,6 +148,22 @@ void controller::handle_dpt_open(rofl::crofdpt &dpt) {
     subscribe_to(flags);
 
   connected = true;
+
+  {
+    // flooding groups that changed while the switch was gone
+    std::lock_guard<std::mutex> lock(l2_domain_mutex);
+    schedule_l2_flood_update();
+  }
+
+  {
+    // a warm restart reconciles once the state is replayed, otherwise the
+    // switch may still hold entries of the previous connection
+    std::lock_guard<std::mutex> lock(shadow_mutex);
+    if (adopting || shadow.empty())
+      return;
+  }
+
+  start_reconciliation(dpt);
 }
 
 void controller::handle_dpt_close(const rofl::cdptid &dptid) {
@@ -105,6 +183,27 @@ void controller::handle_dpt_close(const rofl::cdptid &dptid) {
       // we keep the tunnel_dlf_flood for now
     }
 
+    {
+      std::lock_guard<std::mutex> lock(l3_placement_mutex);
+      placement.clear();
+    }
+
+    {
+      // the shadow is kept, the tables of the switch are reconciled with it
+      // once it is back
+      std::lock_guard<std::mutex> lock(shadow_mutex);
+      reconcile_pending = 0;
+      adopting = false;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(egress_mutex);
+      // the switch state is not taken over anymore
+      for (const auto &r : reserved_egress_ids)
+        freed_egress_interfaces_ids.insert(r.second);
+      reserved_egress_ids.clear();
+    }
+
     // TODO check dptid and dptid?
     rofl::crofdpt &dpt = set_dpt(dptid, true);
 
@@ -217,6 +316,12 @@ void controller::handle_flow_removed(rofl::crofdpt &dpt,
           << " pkt received: " << std::endl
           << msg;
 
+  {
+    std::lock_guard<std::mutex> lock(shadow_mutex);
+    shadow.flow_remove_strict(msg.get_table_id(), msg.get_priority(),
+                              pack_wire(msg.get_match()));
+  }
+
   switch (msg.get_table_id()) {
   case OFDPA_FLOW_TABLE_ID_BRIDGING:
     handle_bridging_table_rm(msg);
@@ -283,6 +388,12 @@ void controller::handle_error_message(rofl::crofdpt &dpt,
           << " pkt received: " << std::endl
           << msg;
 
+  if (msg.get_err_type() == rofl::openflow13::OFPET_FLOW_MOD_FAILED &&
+      msg.get_err_code() == rofl::openflow13::OFPFMFC_TABLE_FULL) {
+    handle_flow_table_full(msg);
+    return;
+  }
+
   LOG(WARNING) << __FUNCTION__ << ": not implemented";
 }
 
@@ -326,6 +437,14 @@ void controller::handle_port_desc_stats_reply(
     bb_thread.add_timer(
         this, TIMER_port_stats_request,
         rofl::ctimespec().expire_in(port_stats_request_interval));
+    bb_thread.add_timer(this, TIMER_l3_rebalance,
+                        rofl::ctimespec().expire_in(l3_rebalance_interval));
+
+    std::lock_guard<std::mutex> lock(shadow_mutex);
+    if (adopting)
+      bb_thread.add_timer(
+          this, TIMER_warm_restart,
+          rofl::ctimespec().expire_in(FLAGS_warm_restart_holdoff));
 
   } catch (std::exception &e) {
     LOG(ERROR) << __FUNCTION__ << ": unknown error " << e.what();
@@ -355,7 +474,19 @@ void controller::handle_experimenter_message(
     case QUERY_FLOW_ENTRIES:
       dpt.send_experimenter_message(auxid, xidExperimenterCAR, experimenterId,
                                     RECEIVED_FLOW_ENTRIES_QUERY);
-      nb->resend_state();
+      {
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        if (adopting) {
+          // reconciled once the warm restart is finished
+          break;
+        }
+        if (shadow.flow_count() == 0 && shadow.group_count() == 0) {
+          // nothing programmed yet through this connection
+          nb->resend_state();
+          break;
+        }
+      }
+      start_reconciliation(dpt);
       break;
     }
   }
@@ -386,6 +517,337 @@ void controller::handle_port_stats_reply(
   stats_array = msg.get_port_stats_array();
 }
 
+rofl_result_t
+controller::shadowed_flow_mod_message(const rofl::cauxid &auxid,
+                                      const rofl::openflow::cofflowmod &fm) {
+  rofl::crofdpt &dpt = set_dpt(dptid, true);
+
+  {
+    std::lock_guard<std::mutex> lock(shadow_mutex);
+    switch (fm.get_command()) {
+    case rofl::openflow13::OFPFC_ADD:
+    case rofl::openflow13::OFPFC_MODIFY:
+    case rofl::openflow13::OFPFC_MODIFY_STRICT:
+      shadow.flow_add(to_shadow_flow(fm));
+      break;
+    case rofl::openflow13::OFPFC_DELETE_STRICT:
+      shadow.flow_remove_strict(fm.get_table_id(), fm.get_priority(),
+                                pack_wire(fm.get_match()));
+      break;
+    case rofl::openflow13::OFPFC_DELETE:
+      shadow.flow_remove(of_reconciler::flow_filter{
+          fm.get_table_id(), fm.get_cookie(), fm.get_cookie_mask(),
+          fm.get_out_port(), fm.get_out_group(), pack_wire(fm.get_match())});
+      break;
+    default:
+      break;
+    }
+
+    if (adopting)
+      return ROFL_SUCCESS;
+  }
+
+  latency_trace::message_sent();
+  return dpt.send_flow_mod_message(auxid, fm);
+}
+
+rofl_result_t
+controller::shadowed_group_mod_message(const rofl::cauxid &auxid,
+                                       const rofl::openflow::cofgroupmod &gm) {
+  rofl::crofdpt &dpt = set_dpt(dptid, true);
+
+  {
+    std::lock_guard<std::mutex> lock(shadow_mutex);
+    switch (gm.get_command()) {
+    case rofl::openflow13::OFPGC_ADD:
+    case rofl::openflow13::OFPGC_MODIFY:
+      shadow.group_add(of_reconciler::group{gm.get_group_id(), gm.get_type(),
+                                            pack_wire(gm.get_buckets())});
+      break;
+    case rofl::openflow13::OFPGC_DELETE:
+      shadow.group_remove(gm.get_group_id());
+      break;
+    default:
+      break;
+    }
+
+    if (adopting)
+      return ROFL_SUCCESS;
+  }
+
+  latency_trace::message_sent();
+  return dpt.send_group_mod_message(auxid, gm);
+}
+
+void controller::start_reconciliation(rofl::crofdpt &dpt) {
+  const uint16_t stats_flags = 0;
+  const int timeout_in_secs = 10;
+  uint32_t xid = 0;
+
+  {
+    std::lock_guard<std::mutex> lock(shadow_mutex);
+    if (reconcile_pending) {
+      VLOG(1) << __FUNCTION__ << ": reconciliation already running";
+      return;
+    }
+
+    switch_flows.clear();
+    switch_groups.clear();
+    reconcile_pending = 2;
+  }
+
+  rofl::openflow::cofflow_stats_request request(dpt.get_version());
+  request.set_table_id(rofl::openflow13::OFPTT_ALL);
+  request.set_out_port(rofl::openflow13::OFPP_ANY);
+  request.set_out_group(rofl::openflow13::OFPG_ANY);
+
+  dpt.send_flow_stats_request(rofl::cauxid(0), stats_flags, request,
+                              timeout_in_secs, &xid);
+  VLOG(2) << __FUNCTION__ << ": flow stats request sent, xid=" << xid;
+
+  dpt.send_group_desc_stats_request(rofl::cauxid(0), stats_flags,
+                                    timeout_in_secs, &xid);
+  VLOG(2) << __FUNCTION__ << ": group desc request sent, xid=" << xid;
+}
+
+void controller::handle_flow_stats_reply(
+    rofl::crofdpt &dpt, const rofl::cauxid &auxid,
+    rofl::openflow::cofmsg_flow_stats_reply &msg) {
+  VLOG(2) << __FUNCTION__ << ": dpt=" << dpt << " on auxid=" << auxid;
+
+  {
+    std::lock_guard<std::mutex> lock(shadow_mutex);
+    if (reconcile_pending == 0)
+      return;
+
+    auto &array = msg.get_flow_stats_array();
+    for (auto id : array.keys())
+      switch_flows.push_back(to_shadow_flow(array.get_flow_stats(id)));
+
+    if (msg.get_stats_flags() & rofl::openflow13::OFPMPF_REPLY_MORE)
+      return;
+
+    if (--reconcile_pending)
+      return;
+  }
+
+  reconcile(dpt);
+}
+
+void controller::handle_flow_stats_reply_timeout(rofl::crofdpt &dpt,
+                                                 uint32_t xid) {
+  LOG(WARNING) << __FUNCTION__ << ": xid=" << xid
+               << ", falling back to resending the complete state";
+
+  {
+    std::lock_guard<std::mutex> lock(shadow_mutex);
+    reconcile_pending = 0;
+  }
+
+  nb->resend_state();
+}
+
+void controller::handle_group_desc_stats_reply(
+    rofl::crofdpt &dpt, const rofl::cauxid &auxid,
+    rofl::openflow::cofmsg_group_desc_stats_reply &msg) {
+  VLOG(2) << __FUNCTION__ << ": dpt=" << dpt << " on auxid=" << auxid;
+
+  {
+    std::lock_guard<std::mutex> lock(shadow_mutex);
+    if (reconcile_pending == 0)
+      return;
+
+    auto &array = msg.get_group_desc_stats_array();
+    for (auto id : array.keys()) {
+      auto &desc = array.get_group_desc_stats(id);
+      switch_groups.push_back(of_reconciler::group{
+          desc.get_group_id(), desc.get_group_type(),
+          pack_wire(desc.get_buckets())});
+    }
+
+    if (msg.get_stats_flags() & rofl::openflow13::OFPMPF_REPLY_MORE)
+      return;
+
+    if (--reconcile_pending)
+      return;
+  }
+
+  reconcile(dpt);
+}
+
+void controller::handle_group_desc_stats_reply_timeout(rofl::crofdpt &dpt,
+                                                       uint32_t xid) {
+  LOG(WARNING) << __FUNCTION__ << ": xid=" << xid
+               << ", falling back to resending the complete state";
+
+  {
+    std::lock_guard<std::mutex> lock(shadow_mutex);
+    reconcile_pending = 0;
+  }
+
+  nb->resend_state();
+}
+
+void controller::reconcile(rofl::crofdpt &dpt) {
+  of_reconciler::plan plan;
+
+  {
+    std::lock_guard<std::mutex> lock(shadow_mutex);
+    shadow.diff(switch_flows, switch_groups, &plan);
+    switch_flows.clear();
+    switch_groups.clear();
+  }
+
+  LOG(INFO) << __FUNCTION__ << ": " << plan.size()
+            << " changes needed to reconcile the switch state";
+
+  if (plan.size() == 0)
+    return;
+
+  try {
+    uint8_t version = dpt.get_version();
+
+    // groups referenced by flows or other groups first
+    for (const auto &g : plan.add_groups)
+      dpt.send_group_mod_message(
+          rofl::cauxid(0),
+          from_shadow_group(version, g, rofl::openflow13::OFPGC_ADD));
+    for (const auto &g : plan.modify_groups)
+      dpt.send_group_mod_message(
+          rofl::cauxid(0),
+          from_shadow_group(version, g, rofl::openflow13::OFPGC_MODIFY));
+    dpt.send_barrier_request(rofl::cauxid(0));
+
+    for (const auto &f : plan.add_flows)
+      dpt.send_flow_mod_message(
+          rofl::cauxid(0),
+          from_shadow_flow(version, f, rofl::openflow13::OFPFC_ADD));
+    for (const auto &f : plan.remove_flows)
+      dpt.send_flow_mod_message(
+          rofl::cauxid(0),
+          from_shadow_flow(version, f, rofl::openflow13::OFPFC_DELETE_STRICT));
+    dpt.send_barrier_request(rofl::cauxid(0));
+
+    for (auto group_id : plan.remove_groups) {
+      rofl::openflow::cofgroupmod gm(version);
+      gm.set_command(rofl::openflow13::OFPGC_DELETE);
+      gm.set_group_id(group_id);
+      dpt.send_group_mod_message(rofl::cauxid(0), gm);
+    }
+
+    uint32_t xid = 0;
+    dpt.send_barrier_request(rofl::cauxid(0), 1, &xid);
+    VLOG(2) << __FUNCTION__ << ": sent barrier with xid=" << (unsigned)xid;
+  } catch (rofl::eRofConnNotConnected &e) {
+    LOG(ERROR) << __FUNCTION__ << ": not connected msg=" << e.what();
+  } catch (std::exception &e) {
+    LOG(ERROR) << __FUNCTION__ << ": caught unknown exception: " << e.what();
+  }
+}
+
+void controller::load_state_snapshot() noexcept {
+  if (FLAGS_state_snapshot.empty())
+    return;
+
+  state_snapshot snapshot;
+  int rv = snapshot.load(FLAGS_state_snapshot);
+
+  if (rv == 0) {
+    {
+      std::lock_guard<std::mutex> lock(egress_mutex);
+      egress_interface_id = snapshot.egress_interface_id;
+      freed_egress_interfaces_ids = snapshot.freed_egress_interface_ids;
+      for (const auto &e : snapshot.egress_interfaces)
+        reserved_egress_ids.emplace(e.second, e.first);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(shadow_mutex);
+      shadow.add_owned_cookies(snapshot.owned_cookies);
+      shadow.add_owned_groups(snapshot.owned_group_ids);
+      adopting = true;
+    }
+
+    LOG(INFO) << __FUNCTION__ << ": warm restart from "
+              << FLAGS_state_snapshot << " with "
+              << snapshot.egress_interfaces.size() << " l3 interfaces";
+  } else if (rv != -ENOENT) {
+    LOG(WARNING) << __FUNCTION__ << ": ignoring " << FLAGS_state_snapshot
+                 << ": " << strerror(-rv);
+  }
+
+  bb_thread.add_timer(
+      this, TIMER_state_snapshot,
+      rofl::ctimespec().expire_in(FLAGS_state_snapshot_interval));
+}
+
+void controller::save_state_snapshot() noexcept {
+  state_snapshot snapshot;
+
+  try {
+    {
+      std::lock_guard<std::mutex> lock(egress_mutex);
+      snapshot.egress_interface_id = egress_interface_id;
+      snapshot.freed_egress_interface_ids = freed_egress_interfaces_ids;
+      snapshot.egress_interfaces = egress_interfaces;
+      // still present in the switch
+      for (const auto &r : reserved_egress_ids)
+        snapshot.egress_interfaces.emplace(r.second, r.first);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(shadow_mutex);
+      snapshot.owned_cookies = shadow.get_owned_cookies();
+      snapshot.owned_group_ids = shadow.get_owned_groups();
+    }
+  } catch (std::exception &e) {
+    LOG(ERROR) << __FUNCTION__ << ": caught unknown exception: " << e.what();
+    return;
+  }
+
+  snapshot.save(FLAGS_state_snapshot);
+}
+
+void controller::finish_warm_restart() noexcept {
+  size_t unclaimed;
+
+  {
+    std::lock_guard<std::mutex> lock(egress_mutex);
+    // groups not claimed by the replayed state are removed by the
+    // reconciliation, their ids can be reused
+    unclaimed = reserved_egress_ids.size();
+    for (const auto &r : reserved_egress_ids)
+      freed_egress_interfaces_ids.insert(r.second);
+    reserved_egress_ids.clear();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(shadow_mutex);
+    if (!adopting)
+      return;
+    adopting = false;
+  }
+
+  LOG(INFO) << __FUNCTION__ << ": warm restart finished, " << unclaimed
+            << " l3 interfaces of the previous state unclaimed";
+
+  try {
+    start_reconciliation(set_dpt(dptid, true));
+  } catch (std::exception &e) {
+    LOG(ERROR) << __FUNCTION__ << ": caught unknown exception: " << e.what();
+  }
+}
+
+// tunnel objects of the previous instance are still in the switch while the
+// state is replayed, creating them again takes them over
+int controller::adopt_tunnel_object(int rv) noexcept {
+  if (rv != ofdpa::OfdpaStatus::OFDPA_E_EXISTS)
+    return rv;
+
+  std::lock_guard<std::mutex> lock(shadow_mutex);
+  return adopting ? 0 : rv;
+}
+
 void controller::handle_timeout(rofl::cthread &thread, uint32_t timer_id) {
   try {
     switch (timer_id) {
@@ -396,6 +858,31 @@ void controller::handle_timeout(rofl::cthread &thread, uint32_t timer_id) {
       if (connected)
         request_port_stats();
       break;
+    case TIMER_l3_rebalance:
+      thread.add_timer(this, TIMER_l3_rebalance,
+                       rofl::ctimespec().expire_in(l3_rebalance_interval));
+      if (connected)
+        rebalance_l3_host_entries();
+      break;
+    case TIMER_l2_flood_update: {
+      // the pending vlans are kept while disconnected, the timer is armed
+      // again in handle_dpt_open
+      std::lock_guard<std::mutex> lock(l2_domain_mutex);
+      l2_flood_update_scheduled = false;
+      if (connected)
+        update_l2_flood_groups();
+    } break;
+    case TIMER_state_snapshot:
+      thread.add_timer(
+          this, TIMER_state_snapshot,
+          rofl::ctimespec().expire_in(FLAGS_state_snapshot_interval));
+      if (connected)
+        save_state_snapshot();
+      break;
+    case TIMER_warm_restart:
+      if (connected)
+        finish_warm_restart();
+      break;
     default:
       rofl::crofbase::handle_timeout(thread, timer_id);
       break;
@@ -455,6 +942,113 @@ void controller::handle_bridging_table_rm(
   nb->fdb_timeout(port_no, vid, eth_dst);
 }
 
+// OpenFlow 1.3 flow mod layout as echoed back in error messages
+static const size_t flow_mod_table_id_offset = 24;
+static const size_t flow_mod_match_offset = 48;
+static const uint16_t oxm_class_openflow_basic = 0x8000;
+static const uint8_t oxm_field_ipv4_dst = 12;
+static const uint8_t oxm_field_ipv6_dst = 27;
+
+/**
+ * parse the destination of a failed unicast routing flow mod
+ *
+ * @returns 0 if the destination was found
+ */
+static int parse_routing_flow_mod(const uint8_t *data, size_t len,
+                                  l3_placement::host_key *key, bool *masked,
+                                  unsigned *prefixlen) {
+  if (len < flow_mod_match_offset + 4)
+    return -EINVAL;
+
+  uint16_t match_len;
+  memcpy(&match_len, data + flow_mod_match_offset + 2, sizeof(match_len));
+  size_t end = std::min(len, flow_mod_match_offset + ntohs(match_len));
+
+  for (size_t p = flow_mod_match_offset + 4; p + 4 <= end;) {
+    uint32_t hdr;
+    memcpy(&hdr, data + p, sizeof(hdr));
+    hdr = ntohl(hdr);
+
+    uint16_t oxm_class = hdr >> 16;
+    uint8_t oxm_field = (hdr >> 9) & 0x7f;
+    size_t oxm_len = hdr & 0xff;
+
+    if (oxm_class == oxm_class_openflow_basic &&
+        (oxm_field == oxm_field_ipv4_dst || oxm_field == oxm_field_ipv6_dst)) {
+      size_t addr_len = (oxm_field == oxm_field_ipv4_dst) ? 4 : 16;
+
+      if (p + 4 + addr_len > len)
+        return -ENODATA;
+
+      key->family = (oxm_field == oxm_field_ipv4_dst) ? AF_INET : AF_INET6;
+      key->addr.fill(0);
+      memcpy(key->addr.data(), data + p + 4, addr_len);
+      *masked = (hdr >> 8) & 1;
+      *prefixlen = addr_len * 8;
+
+      if (*masked) {
+        if (p + 4 + 2 * addr_len > len)
+          return -ENODATA;
+
+        *prefixlen = 0;
+        for (size_t i = 0; i < addr_len; i++) {
+          uint8_t m = data[p + 4 + addr_len + i];
+
+          key->addr[i] &= m;
+          *prefixlen += __builtin_popcount(m);
+        }
+      }
+      return 0;
+    }
+
+    p += 4 + oxm_len;
+  }
+
+  return -ENODATA;
+}
+
+void controller::handle_flow_table_full(rofl::openflow::cofmsg_error &msg) {
+  const rofl::cmemory &body = msg.get_body();
+  const uint8_t *data = body.somem();
+  size_t len = body.length();
+
+  if (len <= flow_mod_table_id_offset) {
+    LOG(ERROR) << __FUNCTION__ << ": flow table full, no data";
+    return;
+  }
+
+  unsigned table_id = data[flow_mod_table_id_offset];
+  if (table_id != OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING) {
+    LOG(ERROR) << __FUNCTION__ << ": flow table full table_id=" << table_id;
+    return;
+  }
+
+  l3_placement::host_key key;
+  bool masked = false;
+  unsigned prefixlen = 0;
+  if (parse_routing_flow_mod(data, len, &key, &masked, &prefixlen) < 0) {
+    LOG(ERROR) << __FUNCTION__
+               << ": unicast routing table full, failed to parse entry";
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(l3_placement_mutex);
+
+  if (masked) {
+    placement.table_full(l3_placement::L3_TABLE_LPM);
+    placement.route_failed(key, prefixlen);
+    return;
+  }
+
+  placement.table_full(l3_placement::L3_TABLE_HOST);
+
+  l3_placement::host_entry entry;
+  if (placement.spill(key, &entry)) {
+    VLOG(1) << __FUNCTION__ << ": moving host entry to lpm table";
+    l3_unicast_host_program(key, entry, false);
+  }
+}
+
 int controller::enqueue(uint32_t port_id, packet *pkt) noexcept {
   using rofl::openflow::cofport;
   using std::map;
@@ -631,7 +1225,7 @@ int controller::overlay_tunnel_add(uint32_t tunnel_id) noexcept {
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    dpt.send_flow_mod_message(
+    shadowed_flow_mod_message(
         rofl::cauxid(0),
         fm_driver.enable_overlay_tunnel(dpt.get_version(), tunnel_id));
   } catch (rofl::eRofBaseNotFound &e) {
@@ -651,7 +1245,7 @@ int controller::overlay_tunnel_remove(uint32_t tunnel_id) noexcept {
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    dpt.send_flow_mod_message(
+    shadowed_flow_mod_message(
         rofl::cauxid(0),
         fm_driver.disable_overlay_tunnel(dpt.get_version(), tunnel_id));
   } catch (rofl::eRofBaseNotFound &e) {
@@ -672,7 +1266,7 @@ int controller::l2_addr_remove_all_in_vlan(uint32_t port,
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    dpt.send_flow_mod_message(rofl::cauxid(0),
+    shadowed_flow_mod_message(rofl::cauxid(0),
                               fm_driver.remove_bridging_unicast_vlan_all(
                                   dpt.get_version(), port, vid));
     VLOG(2) << __FUNCTION__ << ": port=" << port << ", vid=" << vid;
@@ -689,6 +1283,53 @@ int controller::l2_addr_remove_all_in_vlan(uint32_t port,
   return rv;
 }
 
+int controller::l2_addr_flush(uint32_t port, uint16_t vid) noexcept {
+  int rv = 0;
+
+  if (port == 0 && vid == 0)
+    return -EINVAL;
+
+  try {
+    rofl::crofdpt &dpt = set_dpt(dptid, true);
+    std::set<uint16_t> vids;
+
+    if (vid) {
+      vids.insert(vid);
+    } else {
+      // the bridging entries of a port point to its l2 interface group of a
+      // vlan
+      std::lock_guard<std::mutex> lock(shadow_mutex);
+      for (auto group_id : shadow.get_group_ids()) {
+        uint16_t v = (group_id >> 16) & 0xfff;
+        if (group_id == fm_driver.group_id_l2_interface(port, v))
+          vids.insert(v);
+      }
+    }
+
+    for (auto v : vids) {
+      rofl::openflow::cofflowmod fm =
+          fm_driver.remove_bridging_unicast_vlan_all(dpt.get_version(), port,
+                                                     v);
+      if (port == 0)
+        fm.set_out_group(rofl::openflow13::OFPG_ANY);
+      shadowed_flow_mod_message(rofl::cauxid(0), fm);
+    }
+
+    VLOG(2) << __FUNCTION__ << ": port=" << port << ", vid=" << vid
+            << ", flushed vids=" << vids.size();
+  } catch (rofl::eRofBaseNotFound &e) {
+    LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
+    rv = -EINVAL;
+  } catch (rofl::eRofConnNotConnected &e) {
+    LOG(ERROR) << ": not connected msg=" << e.what();
+    rv = -ENOTCONN;
+  } catch (std::exception &e) {
+    LOG(ERROR) << ": caught unknown exception: " << e.what();
+    rv = -EINVAL;
+  }
+  return rv;
+}
+
 int controller::l2_addr_add(uint32_t port, uint16_t vid,
                             const rofl::caddress_ll &mac, bool filtered,
                             bool permanent) noexcept {
@@ -700,7 +1341,7 @@ int controller::l2_addr_add(uint32_t port, uint16_t vid,
       fm_driver.set_idle_timeout(300);
 
     // XXX have the knowlege here about filtered/unfiltered?
-    dpt.send_flow_mod_message(rofl::cauxid(0),
+    shadowed_flow_mod_message(rofl::cauxid(0),
                               fm_driver.add_bridging_unicast_vlan(
                                   dpt.get_version(), port, vid, mac, filtered));
 
@@ -725,7 +1366,7 @@ int controller::l2_addr_remove(uint32_t port, uint16_t vid,
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    dpt.send_flow_mod_message(rofl::cauxid(0),
+    shadowed_flow_mod_message(rofl::cauxid(0),
                               fm_driver.remove_bridging_unicast_vlan(
                                   dpt.get_version(), port, vid, mac));
   } catch (rofl::eRofBaseNotFound &e) {
@@ -751,7 +1392,7 @@ int controller::l2_overlay_addr_add(uint32_t lport, uint32_t tunnel_id,
     if (!permanent)
       fm_driver.set_idle_timeout(300);
 
-    dpt.send_flow_mod_message(rofl::cauxid(0),
+    shadowed_flow_mod_message(rofl::cauxid(0),
                               fm_driver.add_bridging_unicast_overlay(
                                   dpt.get_version(), lport, tunnel_id, mac));
 
@@ -777,12 +1418,12 @@ int controller::l2_overlay_addr_remove(uint32_t tunnel_id, uint32_t lport_id,
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
     if (lport_id) {
-      dpt.send_flow_mod_message(
+      shadowed_flow_mod_message(
           rofl::cauxid(0), fm_driver.remove_bridging_unicast_overlay_all_lport(
                                dpt.get_version(), lport_id));
       dpt.send_barrier_request(rofl::cauxid(0));
     } else {
-      dpt.send_flow_mod_message(rofl::cauxid(0),
+      shadowed_flow_mod_message(rofl::cauxid(0),
                                 fm_driver.remove_bridging_unicast_overlay(
                                     dpt.get_version(), tunnel_id, mac));
     }
@@ -804,7 +1445,7 @@ int controller::l3_termination_add(uint32_t sport, uint16_t vid,
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    rv = dpt.send_flow_mod_message(rofl::cauxid(0),
+    rv = shadowed_flow_mod_message(rofl::cauxid(0),
                                    fm_driver.enable_tmac_ipv4_unicast_mac(
                                        dpt.get_version(), sport, vid, dmac));
   } catch (rofl::eRofBaseNotFound &e) {
@@ -826,7 +1467,7 @@ int controller::l3_termination_add_v6(uint32_t sport, uint16_t vid,
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    dpt.send_flow_mod_message(rofl::cauxid(0),
+    shadowed_flow_mod_message(rofl::cauxid(0),
                               fm_driver.enable_tmac_ipv6_unicast_mac(
                                   dpt.get_version(), sport, vid, dmac));
   } catch (rofl::eRofBaseNotFound &e) {
@@ -848,7 +1489,7 @@ int controller::l3_termination_remove(uint32_t sport, uint16_t vid,
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    dpt.send_flow_mod_message(rofl::cauxid(0),
+    shadowed_flow_mod_message(rofl::cauxid(0),
                               fm_driver.disable_tmac_ipv4_unicast_mac(
                                   dpt.get_version(), sport, vid, dmac));
   } catch (rofl::eRofBaseNotFound &e) {
@@ -870,7 +1511,7 @@ int controller::l3_termination_remove_v6(
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    dpt.send_flow_mod_message(rofl::cauxid(0),
+    shadowed_flow_mod_message(rofl::cauxid(0),
                               fm_driver.disable_tmac_ipv6_unicast_mac(
                                   dpt.get_version(), sport, vid, dmac));
   } catch (rofl::eRofBaseNotFound &e) {
@@ -893,19 +1534,26 @@ int controller::l3_egress_create(uint32_t port, uint16_t vid,
                                  uint32_t *l3_interface_id) noexcept {
   int rv = 0;
   uint32_t _egress_interface_id;
-  bool increment = false;
-
-  if (freed_egress_interfaces_ids.size()) {
+  state_snapshot::egress_interface params{port, vid, src_mac.get_mac(),
+                                          dst_mac.get_mac()};
+  std::lock_guard<std::mutex> lock(egress_mutex);
+  auto reserved = reserved_egress_ids.find(params);
+
+  if (reserved != reserved_egress_ids.end()) {
+    // keep the id the group got before the restart
+    _egress_interface_id = reserved->second;
+    reserved_egress_ids.erase(reserved);
+  } else if (freed_egress_interfaces_ids.size()) {
     _egress_interface_id = *freed_egress_interfaces_ids.begin();
+    freed_egress_interfaces_ids.erase(freed_egress_interfaces_ids.begin());
   } else {
-    _egress_interface_id = egress_interface_id;
-    increment = true;
+    _egress_interface_id = egress_interface_id++;
   }
 
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
     // TODO unfiltered interface
-    dpt.send_group_mod_message(
+    shadowed_group_mod_message(
         rofl::cauxid(0),
         fm_driver.enable_group_l3_unicast(
             dpt.get_version(), _egress_interface_id, src_mac, dst_mac,
@@ -921,12 +1569,7 @@ int controller::l3_egress_create(uint32_t port, uint16_t vid,
     rv = -EINVAL;
   }
 
-  if (increment) {
-    egress_interface_id++;
-  } else {
-    freed_egress_interfaces_ids.erase(freed_egress_interfaces_ids.begin());
-  }
-
+  egress_interfaces[_egress_interface_id] = params;
   *l3_interface_id = _egress_interface_id;
   return rv;
 }
@@ -940,7 +1583,7 @@ int controller::l3_egress_update(uint32_t port, uint16_t vid,
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
     // TODO unfiltered interface
-    dpt.send_group_mod_message(
+    shadowed_group_mod_message(
         rofl::cauxid(0),
         fm_driver.enable_group_l3_unicast(
             dpt.get_version(), *l3_interface_id, src_mac, dst_mac,
@@ -956,6 +1599,10 @@ int controller::l3_egress_update(uint32_t port, uint16_t vid,
     rv = -EINVAL;
   }
 
+  std::lock_guard<std::mutex> lock(egress_mutex);
+  egress_interfaces[*l3_interface_id] = state_snapshot::egress_interface{
+      port, vid, src_mac.get_mac(), dst_mac.get_mac()};
+
   return rv;
 }
 
@@ -963,7 +1610,7 @@ int controller::l3_egress_remove(uint32_t l3_interface_id) noexcept {
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    dpt.send_group_mod_message(
+    shadowed_group_mod_message(
         rofl::cauxid(0),
         fm_driver.disable_group_l3_unicast(dpt.get_version(), l3_interface_id));
   } catch (rofl::eRofBaseNotFound &e) {
@@ -977,6 +1624,8 @@ int controller::l3_egress_remove(uint32_t l3_interface_id) noexcept {
     rv = -EINVAL;
   }
 
+  std::lock_guard<std::mutex> lock(egress_mutex);
+  egress_interfaces.erase(l3_interface_id);
   if (l3_interface_id == egress_interface_id + 1) {
     egress_interface_id--;
     // TODO free even more ids from set?
@@ -987,31 +1636,75 @@ int controller::l3_egress_remove(uint32_t l3_interface_id) noexcept {
   return rv;
 }
 
-int controller::l3_unicast_host_add(const rofl::caddress_in4 &ipv4_dst,
-                                    uint32_t l3_interface_id, bool is_ecmp,
-                                    bool update_route) noexcept {
-  int rv = 0;
+static l3_placement::host_key host_key_in4(const rofl::caddress_in4 &addr) {
+  l3_placement::host_key key{AF_INET, {}};
+  uint32_t nbo = addr.get_addr_nbo();
+  memcpy(key.addr.data(), &nbo, sizeof(nbo));
+  return key;
+}
 
-  if (l3_interface_id > 0x0fffffff)
-    return -EINVAL;
+static l3_placement::host_key host_key_in6(const rofl::caddress_in6 &addr) {
+  l3_placement::host_key key{AF_INET6, {}};
+  addr.pack(key.addr.data(), key.addr.size());
+  return key;
+}
 
-  if (is_ecmp && l3_interface_id == 0)
-    return -EINVAL;
+// a route is keyed by its prefix, as echoed back in a failed flow mod
+static l3_placement::host_key route_key(l3_placement::host_key key,
+                                        const l3_placement::host_key &mask,
+                                        unsigned *prefixlen) {
+  *prefixlen = 0;
+  for (size_t i = 0; i < key.addr.size(); i++) {
+    key.addr[i] &= mask.addr[i];
+    *prefixlen += __builtin_popcount(mask.addr[i]);
+  }
+  return key;
+}
+
+int controller::l3_unicast_host_program(const l3_placement::host_key &key,
+                                        const l3_placement::host_entry &entry,
+                                        bool update_route) noexcept {
+  int rv = 0;
+  uint32_t l3_interface_id = entry.l3_interface_id;
+  bool lpm = entry.table == l3_placement::L3_TABLE_LPM;
 
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
 
     if (l3_interface_id) {
-      if (is_ecmp)
+      if (entry.is_ecmp)
         l3_interface_id = fm_driver.group_id_l3_ecmp(l3_interface_id);
       else
         l3_interface_id = fm_driver.group_id_l3_unicast(l3_interface_id);
     }
 
-    dpt.send_flow_mod_message(
-        rofl::cauxid(0),
-        fm_driver.enable_ipv4_unicast_host(dpt.get_version(), ipv4_dst,
-                                           l3_interface_id, update_route));
+    if (key.family == AF_INET) {
+      rofl::caddress_in4 ipv4_dst;
+      uint32_t nbo;
+      memcpy(&nbo, key.addr.data(), sizeof(nbo));
+      ipv4_dst.set_addr_nbo(nbo);
+
+      shadowed_flow_mod_message(
+          rofl::cauxid(0),
+          lpm ? fm_driver.enable_ipv4_unicast_lpm(dpt.get_version(), ipv4_dst,
+                                                  rofl::build_mask_in4(32),
+                                                  l3_interface_id)
+              : fm_driver.enable_ipv4_unicast_host(
+                    dpt.get_version(), ipv4_dst, l3_interface_id,
+                    update_route));
+    } else {
+      rofl::caddress_in6 ipv6_dst;
+      ipv6_dst.unpack(key.addr.data(), key.addr.size());
+
+      shadowed_flow_mod_message(
+          rofl::cauxid(0),
+          lpm ? fm_driver.enable_ipv6_unicast_lpm(dpt.get_version(), ipv6_dst,
+                                                  rofl::build_mask_in6(128),
+                                                  l3_interface_id)
+              : fm_driver.enable_ipv6_unicast_host(
+                    dpt.get_version(), ipv6_dst, l3_interface_id,
+                    update_route));
+    }
   } catch (rofl::eRofBaseNotFound &e) {
     LOG(ERROR) << ": caught rofl::eRofBaseNotFound : dptid : " << dptid;
     rv = -EINVAL;
@@ -1026,33 +1719,41 @@ int controller::l3_unicast_host_add(const rofl::caddress_in4 &ipv4_dst,
   return rv;
 }
 
-int controller::l3_unicast_host_add(const rofl::caddress_in6 &ipv6_dst,
-                                    uint32_t l3_interface_id, bool is_ecmp,
-                                    bool update_route) noexcept {
+int controller::l3_unicast_host_unprogram(
+    const l3_placement::host_key &key,
+    enum l3_placement::l3_table table) noexcept {
   int rv = 0;
-
-  if (l3_interface_id > 0x0fffffff)
-    return -EINVAL;
-
-  if (is_ecmp && l3_interface_id == 0)
-    return -EINVAL;
+  bool lpm = table == l3_placement::L3_TABLE_LPM;
 
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
 
-    if (l3_interface_id) {
-      if (is_ecmp)
-        l3_interface_id = fm_driver.group_id_l3_ecmp(l3_interface_id);
-      else
-        l3_interface_id = fm_driver.group_id_l3_unicast(l3_interface_id);
-    }
+    if (key.family == AF_INET) {
+      rofl::caddress_in4 ipv4_dst;
+      uint32_t nbo;
+      memcpy(&nbo, key.addr.data(), sizeof(nbo));
+      ipv4_dst.set_addr_nbo(nbo);
 
-    dpt.send_flow_mod_message(
-        rofl::cauxid(0),
-        fm_driver.enable_ipv6_unicast_host(dpt.get_version(), ipv6_dst,
-                                           l3_interface_id, update_route));
+      shadowed_flow_mod_message(
+          rofl::cauxid(0),
+          lpm ? fm_driver.disable_ipv4_unicast_lpm(dpt.get_version(), ipv4_dst,
+                                                   rofl::build_mask_in4(32))
+              : fm_driver.disable_ipv4_unicast_host(dpt.get_version(),
+                                                    ipv4_dst));
+    } else {
+      rofl::caddress_in6 ipv6_dst;
+      ipv6_dst.unpack(key.addr.data(), key.addr.size());
+
+      shadowed_flow_mod_message(
+          rofl::cauxid(0),
+          lpm ? fm_driver.disable_ipv6_unicast_lpm(dpt.get_version(), ipv6_dst,
+                                                   rofl::build_mask_in6(128))
+              : fm_driver.disable_ipv6_unicast_host(dpt.get_version(),
+                                                    ipv6_dst));
+    }
+    dpt.send_barrier_request(rofl::cauxid(0));
   } catch (rofl::eRofBaseNotFound &e) {
-    LOG(ERROR) << ": caught rofl::eRofBaseNotFound : dptid : " << dptid;
+    LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
     rv = -EINVAL;
   } catch (rofl::eRofConnNotConnected &e) {
     LOG(ERROR) << ": not connected msg=" << e.what();
@@ -1065,56 +1766,99 @@ int controller::l3_unicast_host_add(const rofl::caddress_in6 &ipv6_dst,
   return rv;
 }
 
-int controller::l3_unicast_host_remove(
-    const rofl::caddress_in4 &ipv4_dst) noexcept {
-  int rv = 0;
+void controller::rebalance_l3_host_entries() noexcept {
+  std::deque<std::pair<l3_placement::host_key, l3_placement::host_entry>>
+      candidates;
+  std::lock_guard<std::mutex> lock(l3_placement_mutex);
 
-  try {
-    rofl::crofdpt &dpt = set_dpt(dptid, true);
+  placement.get_rebalance_candidates(l3_rebalance_batch, &candidates);
+  if (candidates.empty())
+    return;
 
-    dpt.send_flow_mod_message(
-        rofl::cauxid(0),
-        fm_driver.disable_ipv4_unicast_host(dpt.get_version(), ipv4_dst));
-    dpt.send_barrier_request(rofl::cauxid(0));
-  } catch (rofl::eRofBaseNotFound &e) {
-    LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
-    rv = -EINVAL;
-  } catch (rofl::eRofConnNotConnected &e) {
-    LOG(ERROR) << ": not connected msg=" << e.what();
-    rv = -ENOTCONN;
-  } catch (std::exception &e) {
-    LOG(ERROR) << ": caught unknown exception: " << e.what();
-    rv = -EINVAL;
+  VLOG(1) << __FUNCTION__ << ": moving " << candidates.size()
+          << " host entries back to the host table, "
+          << placement.get_spilled() << " spilled";
+
+  for (auto &c : candidates) {
+    c.second.table = l3_placement::L3_TABLE_HOST;
+
+    // make before break
+    if (l3_unicast_host_program(c.first, c.second, false) < 0)
+      break;
+
+    placement.moved_to_host(c.first);
+    l3_unicast_host_unprogram(c.first, l3_placement::L3_TABLE_LPM);
   }
+}
+
+int controller::l3_unicast_host_add(const rofl::caddress_in4 &ipv4_dst,
+                                    uint32_t l3_interface_id, bool is_ecmp,
+                                    bool update_route) noexcept {
+  if (l3_interface_id > 0x0fffffff)
+    return -EINVAL;
+
+  if (is_ecmp && l3_interface_id == 0)
+    return -EINVAL;
+
+  auto key = host_key_in4(ipv4_dst);
+  std::lock_guard<std::mutex> lock(l3_placement_mutex);
+  l3_placement::host_entry entry{
+      placement.place_host(key, l3_interface_id, is_ecmp), l3_interface_id,
+      is_ecmp};
+
+  int rv = l3_unicast_host_program(key, entry, update_route);
+  if (rv < 0 && !update_route)
+    placement.remove_host(key);
 
   return rv;
 }
 
-int controller::l3_unicast_host_remove(
-    const rofl::caddress_in6 &ipv6_dst) noexcept {
-  int rv = 0;
+int controller::l3_unicast_host_add(const rofl::caddress_in6 &ipv6_dst,
+                                    uint32_t l3_interface_id, bool is_ecmp,
+                                    bool update_route) noexcept {
+  if (l3_interface_id > 0x0fffffff)
+    return -EINVAL;
 
-  try {
-    rofl::crofdpt &dpt = set_dpt(dptid, true);
+  if (is_ecmp && l3_interface_id == 0)
+    return -EINVAL;
 
-    dpt.send_flow_mod_message(
-        rofl::cauxid(0),
-        fm_driver.disable_ipv6_unicast_host(dpt.get_version(), ipv6_dst));
-    dpt.send_barrier_request(rofl::cauxid(0));
-  } catch (rofl::eRofBaseNotFound &e) {
-    LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
-    rv = -EINVAL;
-  } catch (rofl::eRofConnNotConnected &e) {
-    LOG(ERROR) << ": not connected msg=" << e.what();
-    rv = -ENOTCONN;
-  } catch (std::exception &e) {
-    LOG(ERROR) << ": caught unknown exception: " << e.what();
-    rv = -EINVAL;
-  }
+  auto key = host_key_in6(ipv6_dst);
+  std::lock_guard<std::mutex> lock(l3_placement_mutex);
+  l3_placement::host_entry entry{
+      placement.place_host(key, l3_interface_id, is_ecmp), l3_interface_id,
+      is_ecmp};
+
+  int rv = l3_unicast_host_program(key, entry, update_route);
+  if (rv < 0 && !update_route)
+    placement.remove_host(key);
 
   return rv;
 }
 
+int controller::l3_unicast_host_remove(
+    const rofl::caddress_in4 &ipv4_dst) noexcept {
+  auto key = host_key_in4(ipv4_dst);
+  std::lock_guard<std::mutex> lock(l3_placement_mutex);
+  auto table = placement.remove_host(key);
+
+  if (table == l3_placement::L3_TABLE_NONE)
+    table = l3_placement::L3_TABLE_HOST;
+
+  return l3_unicast_host_unprogram(key, table);
+}
+
+int controller::l3_unicast_host_remove(
+    const rofl::caddress_in6 &ipv6_dst) noexcept {
+  auto key = host_key_in6(ipv6_dst);
+  std::lock_guard<std::mutex> lock(l3_placement_mutex);
+  auto table = placement.remove_host(key);
+
+  if (table == l3_placement::L3_TABLE_NONE)
+    table = l3_placement::L3_TABLE_HOST;
+
+  return l3_unicast_host_unprogram(key, table);
+}
+
 int controller::l3_unicast_route_add(const rofl::caddress_in4 &ipv4_dst,
                                      const rofl::caddress_in4 &mask,
                                      uint32_t l3_interface_id, bool is_ecmp,
@@ -1137,10 +1881,17 @@ int controller::l3_unicast_route_add(const rofl::caddress_in4 &ipv4_dst,
         l3_interface_id = fm_driver.group_id_l3_unicast(l3_interface_id);
     }
 
-    dpt.send_flow_mod_message(
+    shadowed_flow_mod_message(
         rofl::cauxid(0),
         fm_driver.enable_ipv4_unicast_lpm(dpt.get_version(), ipv4_dst, mask,
                                           l3_interface_id));
+
+    // an update of a counted prefix is not counted again
+    unsigned prefixlen;
+    auto key =
+        route_key(host_key_in4(ipv4_dst), host_key_in4(mask), &prefixlen);
+    std::lock_guard<std::mutex> lock(l3_placement_mutex);
+    placement.route_added(key, prefixlen);
   } catch (rofl::eRofBaseNotFound &e) {
     LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
     rv = -EINVAL;
@@ -1177,10 +1928,17 @@ int controller::l3_unicast_route_add(const rofl::caddress_in6 &ipv6_dst,
         l3_interface_id = fm_driver.group_id_l3_unicast(l3_interface_id);
     }
 
-    dpt.send_flow_mod_message(
+    shadowed_flow_mod_message(
         rofl::cauxid(0),
         fm_driver.enable_ipv6_unicast_lpm(dpt.get_version(), ipv6_dst, mask,
                                           l3_interface_id));
+
+    // an update of a counted prefix is not counted again
+    unsigned prefixlen;
+    auto key =
+        route_key(host_key_in6(ipv6_dst), host_key_in6(mask), &prefixlen);
+    std::lock_guard<std::mutex> lock(l3_placement_mutex);
+    placement.route_added(key, prefixlen);
   } catch (rofl::eRofBaseNotFound &e) {
     LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
     rv = -EINVAL;
@@ -1212,7 +1970,7 @@ int controller::l3_ecmp_add(uint32_t l3_ecmp_id,
         [&](uint32_t id) { return fm_driver.group_id_l3_unicast(id); });
 
     l3_ecmp_id = fm_driver.group_id_l3_ecmp(l3_ecmp_id);
-    dpt.send_group_mod_message(
+    shadowed_group_mod_message(
         rofl::cauxid(0),
         fm_driver.enable_group_l3_ecmp(dpt.get_version(), l3_ecmp_id,
                                        l3_interface_groups));
@@ -1240,7 +1998,7 @@ int controller::l3_ecmp_remove(uint32_t l3_ecmp_id) noexcept {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
 
     l3_ecmp_id = fm_driver.group_id_l3_ecmp(l3_ecmp_id);
-    dpt.send_group_mod_message(
+    shadowed_group_mod_message(
         rofl::cauxid(0),
         fm_driver.disable_group_l3_ecmp(dpt.get_version(), l3_ecmp_id));
   } catch (rofl::eRofBaseNotFound &e) {
@@ -1265,10 +2023,16 @@ int controller::l3_unicast_route_remove(
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
 
-    dpt.send_flow_mod_message(
+    shadowed_flow_mod_message(
         rofl::cauxid(0),
         fm_driver.disable_ipv4_unicast_lpm(dpt.get_version(), ipv4_dst, mask));
     dpt.send_barrier_request(rofl::cauxid(0));
+
+    unsigned prefixlen;
+    auto key =
+        route_key(host_key_in4(ipv4_dst), host_key_in4(mask), &prefixlen);
+    std::lock_guard<std::mutex> lock(l3_placement_mutex);
+    placement.route_removed(key, prefixlen);
   } catch (rofl::eRofBaseNotFound &e) {
     LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
     rv = -EINVAL;
@@ -1291,10 +2055,16 @@ int controller::l3_unicast_route_remove(
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
 
-    dpt.send_flow_mod_message(
+    shadowed_flow_mod_message(
         rofl::cauxid(0),
         fm_driver.disable_ipv6_unicast_lpm(dpt.get_version(), ipv6_dst, mask));
     dpt.send_barrier_request(rofl::cauxid(0));
+
+    unsigned prefixlen;
+    auto key =
+        route_key(host_key_in6(ipv6_dst), host_key_in6(mask), &prefixlen);
+    std::lock_guard<std::mutex> lock(l3_placement_mutex);
+    placement.route_removed(key, prefixlen);
   } catch (rofl::eRofBaseNotFound &e) {
     LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
     rv = -EINVAL;
@@ -1313,7 +2083,7 @@ int controller::ingress_port_vlan_accept_all(uint32_t port) noexcept {
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    dpt.send_flow_mod_message(
+    shadowed_flow_mod_message(
         rofl::cauxid(0),
         fm_driver.enable_port_vid_allow_all(dpt.get_version(), port));
   } catch (rofl::eRofBaseNotFound &e) {
@@ -1333,7 +2103,7 @@ int controller::ingress_port_vlan_drop_accept_all(uint32_t port) noexcept {
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    dpt.send_flow_mod_message(
+    shadowed_flow_mod_message(
         rofl::cauxid(0),
         fm_driver.disable_port_vid_allow_all(dpt.get_version(), port));
   } catch (rofl::eRofBaseNotFound &e) {
@@ -1355,14 +2125,14 @@ int controller::ingress_port_vlan_add(uint32_t port, uint16_t vid,
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
     if (pvid) {
-      dpt.send_flow_mod_message(
+      shadowed_flow_mod_message(
           rofl::cauxid(0),
           fm_driver.enable_port_vid_ingress(dpt.get_version(), port, vid));
-      dpt.send_flow_mod_message(
+      shadowed_flow_mod_message(
           rofl::cauxid(0),
           fm_driver.enable_port_pvid_ingress(dpt.get_version(), port, vid));
     } else {
-      dpt.send_flow_mod_message(
+      shadowed_flow_mod_message(
           rofl::cauxid(0),
           fm_driver.enable_port_vid_ingress(dpt.get_version(), port, vid));
     }
@@ -1385,14 +2155,14 @@ int controller::ingress_port_vlan_remove(uint32_t port, uint16_t vid,
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
     if (pvid) {
-      dpt.send_flow_mod_message(
+      shadowed_flow_mod_message(
           rofl::cauxid(0),
           fm_driver.disable_port_pvid_ingress(dpt.get_version(), port, vid));
-      dpt.send_flow_mod_message(
+      shadowed_flow_mod_message(
           rofl::cauxid(0),
           fm_driver.disable_port_vid_ingress(dpt.get_version(), port, vid));
     } else {
-      dpt.send_flow_mod_message(
+      shadowed_flow_mod_message(
           rofl::cauxid(0),
           fm_driver.disable_port_vid_ingress(dpt.get_version(), port, vid));
     }
@@ -1416,7 +2186,7 @@ int controller::egress_port_vlan_accept_all(uint32_t port) noexcept {
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    dpt.send_group_mod_message(rofl::cauxid(0),
+    shadowed_group_mod_message(rofl::cauxid(0),
                                fm_driver.enable_group_l2_unfiltered_interface(
                                    dpt.get_version(), port));
   } catch (rofl::eRofBaseNotFound &e) {
@@ -1436,7 +2206,7 @@ int controller::egress_port_vlan_drop_accept_all(uint32_t port) noexcept {
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    dpt.send_group_mod_message(rofl::cauxid(0),
+    shadowed_group_mod_message(rofl::cauxid(0),
                                fm_driver.disable_group_l2_unfiltered_interface(
                                    dpt.get_version(), port));
   } catch (rofl::eRofBaseNotFound &e) {
@@ -1460,7 +2230,7 @@ int controller::egress_port_vlan_add(uint32_t port, uint16_t vid,
     rofl::crofdpt &dpt = set_dpt(dptid, true);
     rofl::openflow::cofgroupmod gm = fm_driver.enable_group_l2_interface(
         dpt.get_version(), port, vid, untagged);
-    dpt.send_group_mod_message(rofl::cauxid(0), gm);
+    shadowed_group_mod_message(rofl::cauxid(0), gm);
   } catch (rofl::eRofBaseNotFound &e) {
     LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
     rv = -EINVAL;
@@ -1479,7 +2249,7 @@ int controller::egress_port_vlan_remove(uint32_t port, uint16_t vid) noexcept {
   try {
     // remove filtered egress interface
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    dpt.send_group_mod_message(
+    shadowed_group_mod_message(
         rofl::cauxid(0),
         fm_driver.disable_group_l2_interface(dpt.get_version(), port, vid));
     uint32_t xid = 0;
@@ -1521,7 +2291,7 @@ int controller::add_l2_overlay_flood(uint32_t tunnel_id,
     for (auto lport : tunnel_dlf_it->second)
       LOG(INFO) << __FUNCTION__ << ": lport=" << lport;
 
-    dpt.send_group_mod_message(rofl::cauxid(0),
+    shadowed_group_mod_message(rofl::cauxid(0),
                                fm_driver.enable_group_l2_overlay_flood(
                                    dpt.get_version(), tunnel_id, tunnel_id,
                                    tunnel_dlf_it->second,
@@ -1530,7 +2300,7 @@ int controller::add_l2_overlay_flood(uint32_t tunnel_id,
     dpt.send_barrier_request(rofl::cauxid(0));
 
     //   if (tunnel_dlf_it->second.size() == 1) {
-    dpt.send_flow_mod_message(
+    shadowed_flow_mod_message(
         rofl::cauxid(0),
         fm_driver.add_bridging_dlf_overlay(
             dpt.get_version(), tunnel_id,
@@ -1574,16 +2344,16 @@ int controller::del_l2_overlay_flood(uint32_t tunnel_id,
 
     if (tunnel_dlf_it->second.size()) {
       // create/update new L2 flooding group
-      dpt.send_group_mod_message(rofl::cauxid(0),
+      shadowed_group_mod_message(rofl::cauxid(0),
                                  fm_driver.enable_group_l2_overlay_flood(
                                      dpt.get_version(), tunnel_id, tunnel_id,
                                      tunnel_dlf_it->second, true));
     } else {
-      dpt.send_flow_mod_message(
+      shadowed_flow_mod_message(
           rofl::cauxid(0),
           fm_driver.remove_bridging_dlf_overlay(dpt.get_version(), tunnel_id));
       dpt.send_barrier_request(rofl::cauxid(0));
-      dpt.send_group_mod_message(rofl::cauxid(0),
+      shadowed_group_mod_message(rofl::cauxid(0),
                                  fm_driver.disable_group_l2_overlay_flood(
                                      dpt.get_version(), tunnel_id, tunnel_id));
     }
@@ -1603,44 +2373,61 @@ int controller::del_l2_overlay_flood(uint32_t tunnel_id,
 
 int controller::egress_bridge_port_vlan_add(uint32_t port, uint16_t vid,
                                             bool untagged) noexcept {
+  return egress_bridge_port_vlan_range_add(port, vid, vid, untagged);
+}
+
+int controller::egress_bridge_port_vlan_remove(uint32_t port,
+                                               uint16_t vid) noexcept {
+  return egress_bridge_port_vlan_range_remove(port, vid, vid);
+}
+
+int controller::ingress_port_vlan_range_add(uint32_t port, uint16_t vid_start,
+                                            uint16_t vid_end,
+                                            uint16_t pvid) noexcept {
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    std::set<uint32_t> l2_dom_set;
-
-    // create filtered egress interface
-    rv = egress_port_vlan_add(port, vid, untagged);
-    if (rv < 0)
-      return rv;
-    dpt.send_barrier_request(rofl::cauxid(0));
-
-    {
-      std::lock_guard<std::mutex> lock(l2_domain_mutex);
-      // get set of group_ids for this vid
-      auto l2_dom_it = l2_domain.find(vid);
-      if (l2_dom_it == l2_domain.end()) {
-        std::set<uint32_t> empty_set;
-        l2_dom_it = l2_domain.emplace(vid, empty_set).first;
-      }
-
-      // insert group_id to set
-      l2_dom_it->second.insert(fm_driver.group_id_l2_interface(port, vid));
-      l2_dom_set = l2_dom_it->second; // copy set to minimize lock
+    for (uint32_t vid = vid_start; vid <= vid_end; vid++) {
+      shadowed_flow_mod_message(
+          rofl::cauxid(0),
+          fm_driver.enable_port_vid_ingress(dpt.get_version(), port, vid));
+      if (vid == pvid)
+        shadowed_flow_mod_message(
+            rofl::cauxid(0),
+            fm_driver.enable_port_pvid_ingress(dpt.get_version(), port, vid));
     }
+  } catch (rofl::eRofBaseNotFound &e) {
+    LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
+    rv = -EINVAL;
+  } catch (rofl::eRofConnNotConnected &e) {
+    LOG(ERROR) << ": not connected msg=" << e.what();
+    rv = -ENOTCONN;
+  } catch (std::exception &e) {
+    LOG(ERROR) << ": caught unknown exception: " << e.what();
+    rv = -EINVAL;
+  }
+  return rv;
+}
 
-    // create/update new L2 flooding group
-    dpt.send_group_mod_message(
-        rofl::cauxid(0),
-        fm_driver.enable_group_l2_flood(dpt.get_version(), vid, vid, l2_dom_set,
-                                        (l2_dom_set.size() != 1)));
-
-    if (l2_dom_set.size() == 1) { // send barrier + DLF on creation
-      dpt.send_barrier_request(rofl::cauxid(0));
-      dpt.send_flow_mod_message(
+int controller::ingress_port_vlan_range_remove(uint32_t port,
+                                               uint16_t vid_start,
+                                               uint16_t vid_end,
+                                               uint16_t pvid) noexcept {
+  int rv = 0;
+  try {
+    rofl::crofdpt &dpt = set_dpt(dptid, true);
+    for (uint32_t vid = vid_start; vid <= vid_end; vid++) {
+      if (vid == pvid)
+        shadowed_flow_mod_message(
+            rofl::cauxid(0),
+            fm_driver.disable_port_pvid_ingress(dpt.get_version(), port, vid));
+      shadowed_flow_mod_message(
           rofl::cauxid(0),
-          fm_driver.add_bridging_dlf_vlan(
-              dpt.get_version(), vid, fm_driver.group_id_l2_flood(vid, vid)));
+          fm_driver.disable_port_vid_ingress(dpt.get_version(), port, vid));
     }
+    uint32_t xid = 0;
+    dpt.send_barrier_request(rofl::cauxid(0), 1, &xid);
+    VLOG(2) << __FUNCTION__ << ": sent barrier with xid=" << (unsigned)xid;
   } catch (rofl::eRofBaseNotFound &e) {
     LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
     rv = -EINVAL;
@@ -1654,55 +2441,64 @@ int controller::egress_bridge_port_vlan_add(uint32_t port, uint16_t vid,
   return rv;
 }
 
-int controller::egress_bridge_port_vlan_remove(uint32_t port,
-                                               uint16_t vid) noexcept {
+int controller::egress_bridge_port_vlan_range_add(uint32_t port,
+                                                  uint16_t vid_start,
+                                                  uint16_t vid_end,
+                                                  bool untagged) noexcept {
   int rv = 0;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
-    std::set<uint32_t> l2_dom_set;
+    std::lock_guard<std::mutex> lock(l2_domain_mutex);
 
-    {
-      std::lock_guard<std::mutex> lock(l2_domain_mutex);
-      // get set of group_ids for this vid
-      auto l2_dom_it = l2_domain.find(vid);
-      if (l2_dom_it == l2_domain.end()) {
-        // vid not present
-        return 0;
+    // interface groups pending to be removed have to be gone before
+    for (uint32_t vid = vid_start; vid <= vid_end; vid++) {
+      if (l2_domain.is_leaving(vid, port)) {
+        update_l2_flood_groups();
+        break;
       }
-
-      // remove group_id from set
-      l2_dom_it->second.erase(fm_driver.group_id_l2_interface(port, vid));
-      l2_dom_set = l2_dom_it->second; // copy set to minimize lock
     }
 
-    if (l2_dom_set.size()) {
-      // update L2 flooding group
-      dpt.send_group_mod_message(
-          rofl::cauxid(0), fm_driver.enable_group_l2_flood(
-                               dpt.get_version(), vid, vid, l2_dom_set, true));
-    } else {
-      // remove DLF + L2 flooding group
-      dpt.send_flow_mod_message(
-          rofl::cauxid(0),
-          fm_driver.remove_bridging_dlf_vlan(dpt.get_version(), vid));
-      dpt.send_barrier_request(rofl::cauxid(0));
-      dpt.send_group_mod_message(
-          rofl::cauxid(0),
-          fm_driver.disable_group_l2_flood(dpt.get_version(), vid, vid));
-    }
+    // create filtered egress interfaces before referencing them
+    for (uint32_t vid = vid_start; vid <= vid_end; vid++)
+      shadowed_group_mod_message(rofl::cauxid(0),
+                                 fm_driver.enable_group_l2_interface(
+                                     dpt.get_version(), port, vid, untagged));
+    dpt.send_barrier_request(rofl::cauxid(0));
 
-    uint32_t xid = 0;
-    dpt.send_barrier_request(rofl::cauxid(0), 1, &xid);
-    VLOG(2) << __FUNCTION__ << ": sent barrier with xid=" << (unsigned)xid;
+    for (uint32_t vid = vid_start; vid <= vid_end; vid++)
+      l2_domain.join(vid, fm_driver.group_id_l2_interface(port, vid));
+    schedule_l2_flood_update();
 
-    // remove filtered egress interface
-    rv = egress_port_vlan_remove(port, vid);
+    VLOG(2) << __FUNCTION__ << ": port=" << port << ", vids=" << vid_start
+            << "-" << vid_end << ", untagged=" << untagged;
+  } catch (rofl::eRofBaseNotFound &e) {
+    LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
+    rv = -EINVAL;
+  } catch (rofl::eRofConnNotConnected &e) {
+    LOG(ERROR) << ": not connected msg=" << e.what();
+    rv = -ENOTCONN;
+  } catch (std::exception &e) {
+    LOG(ERROR) << ": caught unknown exception: " << e.what();
+    rv = -EINVAL;
+  }
+  return rv;
+}
 
-    if (rv < 0) {
-      LOG(ERROR) << __FUNCTION__ << ": failed to remove vid=" << vid
-                 << " from port=" << port;
-    }
+int controller::egress_bridge_port_vlan_range_remove(
+    uint32_t port, uint16_t vid_start, uint16_t vid_end) noexcept {
+  int rv = 0;
+  try {
+    set_dpt(dptid, true);
+    std::lock_guard<std::mutex> lock(l2_domain_mutex);
+
+    // the filtered egress interfaces are removed after the flooding groups
+    // got updated
+    for (uint32_t vid = vid_start; vid <= vid_end; vid++)
+      l2_domain.leave(vid, port, fm_driver.group_id_l2_interface(port, vid));
+    schedule_l2_flood_update();
 
+    VLOG(2) << __FUNCTION__ << ": port=" << port << ", vids=" << vid_start
+            << "-" << vid_end;
   } catch (rofl::eRofBaseNotFound &e) {
     LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
     rv = -EINVAL;
@@ -1716,25 +2512,101 @@ int controller::egress_bridge_port_vlan_remove(uint32_t port,
   return rv;
 }
 
+void controller::schedule_l2_flood_update() {
+  if (l2_flood_update_scheduled || !l2_domain.has_pending())
+    return;
+
+  bb_thread.add_timer(
+      this, TIMER_l2_flood_update,
+      rofl::ctimespec().expire_in(0, l2_flood_batch_window * 1000000));
+  l2_flood_update_scheduled = true;
+}
+
+void controller::update_l2_flood_groups() noexcept {
+  std::deque<l2_flood_domains::update> updates;
+
+  try {
+    rofl::crofdpt &dpt = set_dpt(dptid, true);
+
+    // keep the pending vlans until they can be written
+    if (!dpt.is_established())
+      return;
+
+    l2_domain.collect(&updates);
+    if (updates.empty())
+      return;
+
+    // create/update L2 flooding groups, remove DLF of the empty ones
+    for (const auto &u : updates) {
+      if (u.members.size()) {
+        shadowed_group_mod_message(
+            rofl::cauxid(0),
+            fm_driver.enable_group_l2_flood(dpt.get_version(), u.vid, u.vid,
+                                            u.members, u.programmed));
+      } else if (u.programmed) {
+        shadowed_flow_mod_message(
+            rofl::cauxid(0),
+            fm_driver.remove_bridging_dlf_vlan(dpt.get_version(), u.vid));
+      }
+    }
+    dpt.send_barrier_request(rofl::cauxid(0));
+
+    // DLF on creation, remove L2 flooding groups that became empty
+    for (const auto &u : updates) {
+      if (u.members.size() && !u.programmed) {
+        shadowed_flow_mod_message(
+            rofl::cauxid(0),
+            fm_driver.add_bridging_dlf_vlan(
+                dpt.get_version(), u.vid,
+                fm_driver.group_id_l2_flood(u.vid, u.vid)));
+      } else if (u.members.empty() && u.programmed) {
+        shadowed_group_mod_message(rofl::cauxid(0),
+                                   fm_driver.disable_group_l2_flood(
+                                       dpt.get_version(), u.vid, u.vid));
+      }
+    }
+    dpt.send_barrier_request(rofl::cauxid(0));
+
+    // remove filtered egress interfaces of ports that left
+    for (const auto &u : updates) {
+      for (auto port : u.released)
+        shadowed_group_mod_message(rofl::cauxid(0),
+                                   fm_driver.disable_group_l2_interface(
+                                       dpt.get_version(), port, u.vid));
+    }
+
+    uint32_t xid = 0;
+    dpt.send_barrier_request(rofl::cauxid(0), 1, &xid);
+    VLOG(2) << __FUNCTION__ << ": updated " << updates.size()
+            << " flooding groups, sent barrier with xid=" << (unsigned)xid;
+  } catch (rofl::eRofBaseNotFound &e) {
+    LOG(ERROR) << ": caught rofl::eRofBaseNotFound";
+  } catch (rofl::eRofConnNotConnected &e) {
+    LOG(ERROR) << ": not connected msg=" << e.what();
+  } catch (std::exception &e) {
+    LOG(ERROR) << ": caught unknown exception: " << e.what();
+  }
+}
+
 int controller::subscribe_to(enum swi_flags flags) noexcept {
   int rv = 0;
   this->flags = this->flags | flags;
   try {
     rofl::crofdpt &dpt = set_dpt(dptid, true);
     if (flags & switch_interface::SWIF_ARP) {
-      dpt.send_flow_mod_message(rofl::cauxid(0),
+      shadowed_flow_mod_message(rofl::cauxid(0),
                                 fm_driver.enable_policy_arp(dpt.get_version()));
     }
-    dpt.send_flow_mod_message(rofl::cauxid(0),
+    shadowed_flow_mod_message(rofl::cauxid(0),
                               fm_driver.enable_policy_8021d(dpt.get_version()));
 
     // Adding policy entry so that the multicast packets reach the switch
     // The ff02:: address is a permanent multicast address with a link scope
-    dpt.send_flow_mod_message(
+    shadowed_flow_mod_message(
         rofl::cauxid(0), fm_driver.enable_policy_ipv6_multicast(
                              dpt.get_version(), rofl::caddress_in6("ff02::"),
                              rofl::build_mask_in6(16)));
-    dpt.send_flow_mod_message(
+    shadowed_flow_mod_message(
         rofl::cauxid(0), fm_driver.enable_policy_ipv4_multicast(
                              dpt.get_version(), rofl::caddress_in4("224.0.0.0"),
                              rofl::build_mask_in4(24)));
@@ -1812,7 +2684,7 @@ int controller::get_statistics(uint64_t port_no, uint32_t number_of_counters,
 
 int controller::tunnel_tenant_create(uint32_t tunnel_id,
                                      uint32_t vni) noexcept {
-  return ofdpa->ofdpaTunnelTenantCreate(tunnel_id, vni);
+  return adopt_tunnel_object(ofdpa->ofdpaTunnelTenantCreate(tunnel_id, vni));
 }
 
 int controller::tunnel_tenant_delete(uint32_t tunnel_id) noexcept {
@@ -1822,8 +2694,8 @@ int controller::tunnel_tenant_delete(uint32_t tunnel_id) noexcept {
 int controller::tunnel_next_hop_create(uint32_t next_hop_id, uint64_t src_mac,
                                        uint64_t dst_mac, uint32_t physical_port,
                                        uint16_t vlan_id) noexcept {
-  return ofdpa->ofdpaTunnelNextHopCreate(next_hop_id, src_mac, dst_mac,
-                                         physical_port, vlan_id);
+  return adopt_tunnel_object(ofdpa->ofdpaTunnelNextHopCreate(
+      next_hop_id, src_mac, dst_mac, physical_port, vlan_id));
 }
 
 int controller::tunnel_next_hop_modify(uint32_t next_hop_id, uint64_t src_mac,
@@ -1837,13 +2709,33 @@ int controller::tunnel_next_hop_delete(uint32_t next_hop_id) noexcept {
   return ofdpa->ofdpaTunnelNextHopDelete(next_hop_id);
 }
 
+int controller::tunnel_next_hop_group_create(uint32_t group_id) noexcept {
+  return adopt_tunnel_object(
+      ofdpa->ofdpaTunnelEcmpNextHopGroupCreate(group_id));
+}
+
+int controller::tunnel_next_hop_group_delete(uint32_t group_id) noexcept {
+  return ofdpa->ofdpaTunnelEcmpNextHopGroupDelete(group_id);
+}
+
+int controller::tunnel_next_hop_group_member_add(
+    uint32_t group_id, uint32_t next_hop_id) noexcept {
+  return adopt_tunnel_object(
+      ofdpa->ofdpaTunnelEcmpNextHopGroupMemberAdd(group_id, next_hop_id));
+}
+
+int controller::tunnel_next_hop_group_member_remove(
+    uint32_t group_id, uint32_t next_hop_id) noexcept {
+  return ofdpa->ofdpaTunnelEcmpNextHopGroupMemberDelete(group_id, next_hop_id);
+}
+
 int controller::tunnel_access_port_create(uint32_t port_id,
                                           const std::string &port_name,
                                           uint32_t physical_port,
                                           uint16_t vlan_id,
                                           bool untagged) noexcept {
-  return ofdpa->ofdpaTunnelAccessPortCreate(port_id, port_name, physical_port,
-                                            vlan_id, untagged);
+  return adopt_tunnel_object(ofdpa->ofdpaTunnelAccessPortCreate(
+      port_id, port_name, physical_port, vlan_id, untagged));
 }
 
 int controller::tunnel_port_delete(uint32_t port_id) noexcept {
@@ -1852,19 +2744,20 @@ int controller::tunnel_port_delete(uint32_t port_id) noexcept {
 
 int controller::tunnel_enpoint_create(
     uint32_t port_id, const std::string &port_name, uint32_t remote_ipv4,
-    uint32_t local_ipv4, uint32_t ttl, uint32_t next_hop_id,
+    uint32_t local_ipv4, uint32_t ttl, uint32_t next_hop_id, bool ecmp,
     uint32_t terminator_udp_dst_port, uint32_t initiator_udp_dst_port,
     uint32_t udp_src_port_if_no_entropy, bool use_entropy) noexcept {
 
-  return ofdpa->ofdpaTunnelEndpointPortCreate(
-      port_id, port_name, remote_ipv4, local_ipv4, ttl, next_hop_id,
+  return adopt_tunnel_object(ofdpa->ofdpaTunnelEndpointPortCreate(
+      port_id, port_name, remote_ipv4, local_ipv4, ttl, next_hop_id, ecmp,
       terminator_udp_dst_port, initiator_udp_dst_port,
-      udp_src_port_if_no_entropy, use_entropy);
+      udp_src_port_if_no_entropy, use_entropy));
 }
 
 int controller::tunnel_port_tenant_add(uint32_t lport_id,
                                        uint32_t tunnel_id) noexcept {
-  int rv = ofdpa->ofdpaTunnelPortTenantAdd(lport_id, tunnel_id);
+  int rv =
+      adopt_tunnel_object(ofdpa->ofdpaTunnelPortTenantAdd(lport_id, tunnel_id));
 
   if (rv < 0) {
     LOG(ERROR) << __FUNCTION__ << ": failed to add port " << lport_id
@@ -1887,6 +2780,12 @@ int controller::tunnel_port_tenant_remove(uint32_t lport_id,
     VLOG(2) << __FUNCTION__ << ": rv=" << rv << ", cnt=" << cnt
             << ", lport_id=" << lport_id << ", tunnel_id=" << tunnel_id;
 
+    // not a member, e.g. after the switch restarted
+    if (rv == ofdpa::OfdpaStatus::OFDPA_E_NOT_FOUND) {
+      rv = 0;
+      break;
+    }
+
     cnt++;
     std::this_thread::sleep_for(10ms);
   } while (rv < 0 && cnt < 50);
@@ -7,8 +7,10 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#include <deque>
 #include <exception>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <set>
@@ -20,7 +22,11 @@
 #include <rofl/common/crofdpt.h>
 #include <rofl/ofdpa/rofl_ofdpa_fm_driver.hpp>
 
+#include "l2_flood_domains.h"
+#include "l3_placement.h"
+#include "of_reconciler.h"
 #include "sai.h"
+#include "state_snapshot.h"
 
 namespace basebox {
 
@@ -59,10 +65,12 @@ public:
              uint16_t ofdpa_grpc_port = 50051)
       : nb(std::move(nb)), bb_thread(1), egress_interface_id(1),
         default_idle_timeout(0), connected(false), ofdpa(nullptr),
-        ofdpa_grpc_port(ofdpa_grpc_port) {
+        ofdpa_grpc_port(ofdpa_grpc_port), l2_flood_update_scheduled(false),
+        reconcile_pending(0), adopting(false) {
     this->nb->register_switch(this);
     rofl::crofbase::set_versionbitmap(versionbitmap);
     bb_thread.start();
+    load_state_snapshot();
   }
 
   ~controller() override {}
@@ -135,6 +143,20 @@ protected:
       rofl::crofdpt &dpt, const rofl::cauxid &auxid,
       rofl::openflow::cofmsg_port_stats_reply &msg) override;
 
+  void handle_flow_stats_reply(
+      rofl::crofdpt &dpt, const rofl::cauxid &auxid,
+      rofl::openflow::cofmsg_flow_stats_reply &msg) override;
+
+  void handle_flow_stats_reply_timeout(rofl::crofdpt &dpt,
+                                       uint32_t xid) override;
+
+  void handle_group_desc_stats_reply(
+      rofl::crofdpt &dpt, const rofl::cauxid &auxid,
+      rofl::openflow::cofmsg_group_desc_stats_reply &msg) override;
+
+  void handle_group_desc_stats_reply_timeout(rofl::crofdpt &dpt,
+                                             uint32_t xid) override;
+
   void handle_timeout(rofl::cthread &thread, uint32_t timer_id) override;
 
 public:
@@ -148,6 +170,7 @@ public:
   int overlay_tunnel_remove(uint32_t tunnel_id) noexcept override;
 
   int l2_addr_remove_all_in_vlan(uint32_t port, uint16_t vid) noexcept override;
+  int l2_addr_flush(uint32_t port, uint16_t vid) noexcept override;
   int l2_addr_add(uint32_t port, uint16_t vid, const rofl::caddress_ll &mac,
                   bool filtered, bool permanent) noexcept override;
   int l2_addr_remove(uint32_t port, uint16_t vid,
@@ -232,6 +255,18 @@ public:
   int egress_bridge_port_vlan_remove(uint32_t port,
                                      uint16_t vid) noexcept override;
 
+  int ingress_port_vlan_range_add(uint32_t port, uint16_t vid_start,
+                                  uint16_t vid_end,
+                                  uint16_t pvid) noexcept override;
+  int ingress_port_vlan_range_remove(uint32_t port, uint16_t vid_start,
+                                     uint16_t vid_end,
+                                     uint16_t pvid) noexcept override;
+  int egress_bridge_port_vlan_range_add(uint32_t port, uint16_t vid_start,
+                                        uint16_t vid_end,
+                                        bool untagged) noexcept override;
+  int egress_bridge_port_vlan_range_remove(uint32_t port, uint16_t vid_start,
+                                           uint16_t vid_end) noexcept override;
+
   int get_statistics(uint64_t port_no, uint32_t number_of_counters,
                      const sai_port_stat_t *counter_ids,
                      uint64_t *counters) noexcept override;
@@ -254,13 +289,19 @@ public:
                              uint64_t dst_mac, uint32_t physical_port,
                              uint16_t vlan_id) noexcept override;
   int tunnel_next_hop_delete(uint32_t next_hop_id) noexcept override;
+  int tunnel_next_hop_group_create(uint32_t group_id) noexcept override;
+  int tunnel_next_hop_group_delete(uint32_t group_id) noexcept override;
+  int tunnel_next_hop_group_member_add(uint32_t group_id,
+                                       uint32_t next_hop_id) noexcept override;
+  int tunnel_next_hop_group_member_remove(
+      uint32_t group_id, uint32_t next_hop_id) noexcept override;
 
   int tunnel_access_port_create(uint32_t port_id, const std::string &port_name,
                                 uint32_t physical_port, uint16_t vlan_id,
                                 bool untagged) noexcept override;
   int tunnel_enpoint_create(uint32_t port_id, const std::string &port_name,
                             uint32_t remote_ipv4, uint32_t local_ipv4,
-                            uint32_t ttl, uint32_t next_hop_id,
+                            uint32_t ttl, uint32_t next_hop_id, bool ecmp,
                             uint32_t terminator_udp_dst_port,
                             uint32_t initiator_udp_dst_port,
                             uint32_t udp_src_port_if_no_entropy,
@@ -282,26 +323,48 @@ private:
   rofl::cdptid dptid;
   rofl::openflow::rofl_ofdpa_fm_driver fm_driver;
   std::mutex l2_domain_mutex;
-  std::map<uint16_t, std::set<uint32_t>> l2_domain;
+  l2_flood_domains l2_domain;
   std::map<uint16_t, std::set<uint32_t>> lag;
   std::map<uint16_t, std::set<uint32_t>> tunnel_dlf_flood;
   std::mutex conn_mutex;
   rofl::cthread bb_thread;
   std::mutex stats_mutex;
   rofl::openflow::cofportstatsarray stats_array;
+  std::mutex egress_mutex;
   uint32_t egress_interface_id;
   std::set<uint32_t> freed_egress_interfaces_ids;
+  std::map<uint32_t, state_snapshot::egress_interface> egress_interfaces;
+  // ids of the previous instance not yet claimed after a warm restart
+  std::map<state_snapshot::egress_interface, uint32_t> reserved_egress_ids;
   uint16_t default_idle_timeout;
   bool connected;
   std::shared_ptr<ofdpa_client> ofdpa;
   uint16_t ofdpa_grpc_port;
+  std::mutex l3_placement_mutex;
+  l3_placement placement;
+  bool l2_flood_update_scheduled; // protected by l2_domain_mutex
+
+  // desired switch state and reconciliation against the switch tables
+  std::mutex shadow_mutex;
+  of_reconciler shadow;
+  int reconcile_pending; // number of outstanding multipart replies
+  std::deque<of_reconciler::flow> switch_flows;
+  std::deque<of_reconciler::group> switch_groups;
+  bool adopting; // warm restart, the switch state is rebuilt without sending
 
   enum timer_t {
     /* handle_timeout will be called as well from crofbase, hence we need some
        id head room */
-    TIMER_port_stats_request = 10 // timer_id for querying port statistics
+    TIMER_port_stats_request = 10, // timer_id for querying port statistics
+    TIMER_l3_rebalance = 11,       // timer_id for moving back host entries
+    TIMER_l2_flood_update = 12,    // timer_id for writing flooding groups
+    TIMER_state_snapshot = 13,     // timer_id for persisting the state
+    TIMER_warm_restart = 14,       // timer_id for ending the warm restart
   };
   const int port_stats_request_interval = 2; // time in seconds
+  const int l3_rebalance_interval = 5;       // time in seconds
+  const size_t l3_rebalance_batch = 64;      // host entries per interval
+  const long l2_flood_batch_window = 20;     // time in milliseconds
 
   /* OF handler */
   void handle_srcmac_table(rofl::crofdpt &dpt,
@@ -311,6 +374,36 @@ private:
                              rofl::openflow::cofmsg_packet_in &msg);
 
   void handle_bridging_table_rm(rofl::openflow::cofmsg_flow_removed &msg);
+  void handle_flow_table_full(rofl::openflow::cofmsg_error &msg);
+
+  /* host entry placement */
+  int l3_unicast_host_program(const l3_placement::host_key &key,
+                              const l3_placement::host_entry &entry,
+                              bool update_route) noexcept;
+  int l3_unicast_host_unprogram(const l3_placement::host_key &key,
+                                enum l3_placement::l3_table table) noexcept;
+  void rebalance_l3_host_entries() noexcept;
+
+  /* flooding groups, to be called with l2_domain_mutex held */
+  void schedule_l2_flood_update();
+  void update_l2_flood_groups() noexcept;
+
+  /* flow-mods and group-mods recorded in the shadow state */
+  rofl_result_t
+  shadowed_flow_mod_message(const rofl::cauxid &auxid,
+                            const rofl::openflow::cofflowmod &fm);
+  rofl_result_t
+  shadowed_group_mod_message(const rofl::cauxid &auxid,
+                             const rofl::openflow::cofgroupmod &gm);
+
+  void start_reconciliation(rofl::crofdpt &dpt);
+  void reconcile(rofl::crofdpt &dpt);
+
+  /* warm restart */
+  void load_state_snapshot() noexcept;
+  void save_state_snapshot() noexcept;
+  void finish_warm_restart() noexcept;
+  int adopt_tunnel_object(int rv) noexcept;
 }; // class controller
 
 } // end of namespace basebox
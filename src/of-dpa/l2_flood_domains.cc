@@ -0,0 +1,61 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <glog/logging.h>
+
+#include "l2_flood_domains.h"
+
+namespace basebox {
+
+void l2_flood_domains::join(uint16_t vid, uint32_t group_id) {
+  domains[vid].members.insert(group_id);
+  dirty.insert(vid);
+}
+
+bool l2_flood_domains::leave(uint16_t vid, uint32_t port, uint32_t group_id) {
+  auto it = domains.find(vid);
+
+  if (it == domains.end())
+    return false;
+
+  it->second.members.erase(group_id);
+  it->second.leaving.insert(port);
+  dirty.insert(vid);
+
+  return true;
+}
+
+bool l2_flood_domains::is_leaving(uint16_t vid, uint32_t port) const {
+  auto it = domains.find(vid);
+  return it != domains.end() && it->second.leaving.count(port);
+}
+
+void l2_flood_domains::collect(std::deque<update> *updates) {
+  for (auto vid : dirty) {
+    auto it = domains.find(vid);
+
+    if (it == domains.end())
+      continue;
+
+    domain &dom = it->second;
+    updates->push_back(update{vid, dom.members, dom.programmed,
+                              std::deque<uint32_t>(dom.leaving.begin(),
+                                                   dom.leaving.end())});
+
+    dom.leaving.clear();
+    dom.programmed = !dom.members.empty();
+    if (!dom.programmed)
+      domains.erase(it);
+  }
+
+  VLOG(3) << __FUNCTION__ << ": " << dirty.size() << " vlans updated";
+  dirty.clear();
+}
+
+void l2_flood_domains::clear() noexcept {
+  domains.clear();
+  dirty.clear();
+}
+
+} // namespace basebox
@@ -0,0 +1,68 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <set>
+
+namespace basebox {
+
+/**
+ * Membership of the per vlan L2 flooding groups.
+ *
+ * Ports joining or leaving a vlan only mark the vlan as dirty, the changes of
+ * a batch window are collected at once so that each flooding group is
+ * written a single time per window. L2 interface groups of leaving ports are
+ * released together with the update, as they can only be removed once the
+ * flooding group does not reference them anymore.
+ */
+class l2_flood_domains final {
+public:
+  struct update {
+    uint16_t vid;
+    std::set<uint32_t> members;    // group ids of the l2 interface groups
+    bool programmed;               // flooding group exists in the switch
+    std::deque<uint32_t> released; // ports to remove the interface group of
+  };
+
+  void join(uint16_t vid, uint32_t group_id);
+
+  /**
+   * @returns false if the vlan is unknown
+   */
+  bool leave(uint16_t vid, uint32_t port, uint32_t group_id);
+
+  /**
+   * @returns true if the port left the vlan, but the interface group is not
+   * yet released
+   */
+  bool is_leaving(uint16_t vid, uint32_t port) const;
+
+  bool has_pending() const noexcept { return !dirty.empty(); }
+
+  /**
+   * take all pending changes, the switch is expected to be updated
+   * accordingly
+   */
+  void collect(std::deque<update> *updates);
+
+  void clear() noexcept;
+
+private:
+  struct domain {
+    domain() : programmed(false) {}
+
+    std::set<uint32_t> members;
+    std::set<uint32_t> leaving;
+    bool programmed;
+  };
+
+  std::map<uint16_t, domain> domains;
+  std::set<uint16_t> dirty;
+};
+
+} // namespace basebox
@@ -0,0 +1,211 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "l3_placement.h"
+
+DEFINE_int32(l3_host_table_size, 0,
+             "Number of host entries in the unicast routing table (0: learn "
+             "from the switch)");
+DEFINE_int32(l3_lpm_table_size, 0,
+             "Number of LPM entries in the unicast routing table (0: learn "
+             "from the switch)");
+
+namespace basebox {
+
+l3_placement::l3_placement()
+    : host_used(0), lpm_used(0), spilled(0),
+      host_capacity(std::max(FLAGS_l3_host_table_size, 0)),
+      lpm_capacity(std::max(FLAGS_l3_lpm_table_size, 0)),
+      host_capacity_learned(false), lpm_capacity_learned(false) {}
+
+bool l3_placement::has_room(enum l3_table table, size_t n) const noexcept {
+  switch (table) {
+  case L3_TABLE_HOST:
+    return host_capacity == 0 || host_used + n <= host_capacity;
+  case L3_TABLE_LPM:
+    return lpm_capacity == 0 || lpm_used + n <= lpm_capacity;
+  default:
+    return false;
+  }
+}
+
+enum l3_placement::l3_table
+l3_placement::place_host(const host_key &key, uint32_t l3_interface_id,
+                         bool is_ecmp) noexcept {
+  auto it = hosts.find(key);
+
+  if (it != hosts.end()) {
+    // update in place
+    it->second.l3_interface_id = l3_interface_id;
+    it->second.is_ecmp = is_ecmp;
+    return it->second.table;
+  }
+
+  host_entry entry{L3_TABLE_HOST, l3_interface_id, is_ecmp};
+
+  if (!has_room(L3_TABLE_HOST) && has_room(L3_TABLE_LPM)) {
+    VLOG(2) << __FUNCTION__ << ": host table full (" << host_used
+            << " entries), using lpm table";
+    entry.table = L3_TABLE_LPM;
+  }
+
+  if (entry.table == L3_TABLE_HOST) {
+    host_used++;
+  } else {
+    lpm_used++;
+    spilled++;
+  }
+
+  hosts.emplace(key, entry);
+  return entry.table;
+}
+
+enum l3_placement::l3_table
+l3_placement::remove_host(const host_key &key) noexcept {
+  auto it = hosts.find(key);
+
+  if (it == hosts.end())
+    return L3_TABLE_NONE;
+
+  enum l3_table table = it->second.table;
+
+  if (table == L3_TABLE_HOST) {
+    host_used--;
+  } else {
+    lpm_used--;
+    spilled--;
+  }
+
+  hosts.erase(it);
+  relax_capacity();
+  return table;
+}
+
+void l3_placement::route_added(const host_key &prefix,
+                               unsigned prefixlen) noexcept {
+  if (routes.emplace(prefix, prefixlen).second)
+    lpm_used++;
+}
+
+void l3_placement::route_removed(const host_key &prefix,
+                                 unsigned prefixlen) noexcept {
+  if (routes.erase(std::make_pair(prefix, prefixlen)) == 0)
+    return;
+
+  lpm_used--;
+  relax_capacity();
+}
+
+// unlike a removed route this keeps the capacity just learned from the failure
+void l3_placement::route_failed(const host_key &prefix,
+                                unsigned prefixlen) noexcept {
+  if (routes.erase(std::make_pair(prefix, prefixlen)))
+    lpm_used--;
+}
+
+// the failed entry is already accounted for in used. A learned capacity is
+// at least 1, since 0 would mean unknown and forget the table being full.
+static size_t learned_capacity(size_t used) noexcept {
+  return std::max<size_t>(used, 2) - 1;
+}
+
+void l3_placement::table_full(enum l3_table table) noexcept {
+  switch (table) {
+  case L3_TABLE_HOST:
+    host_capacity = learned_capacity(host_used);
+    host_capacity_learned = true;
+    LOG(WARNING) << __FUNCTION__
+                 << ": host table full, capacity=" << host_capacity;
+    break;
+  case L3_TABLE_LPM:
+    lpm_capacity = learned_capacity(lpm_used);
+    lpm_capacity_learned = true;
+    LOG(WARNING) << __FUNCTION__
+                 << ": lpm table full, capacity=" << lpm_capacity;
+    break;
+  default:
+    break;
+  }
+}
+
+bool l3_placement::spill(const host_key &key, host_entry *entry) noexcept {
+  auto it = hosts.find(key);
+
+  if (it == hosts.end() || it->second.table != L3_TABLE_HOST)
+    return false;
+
+  if (!has_room(L3_TABLE_LPM)) {
+    LOG(ERROR) << __FUNCTION__ << ": no room left in host and lpm table";
+    return false;
+  }
+
+  it->second.table = L3_TABLE_LPM;
+  host_used--;
+  lpm_used++;
+  spilled++;
+
+  *entry = it->second;
+  return true;
+}
+
+// the entries other tables or applications held when the switch reported the
+// table to be full may be gone, a capacity learned back then would keep the
+// table small for good
+void l3_placement::relax_capacity() noexcept {
+  if (host_capacity_learned && host_used * 2 < host_capacity) {
+    host_capacity = std::max(FLAGS_l3_host_table_size, 0);
+    host_capacity_learned = false;
+    VLOG(1) << __FUNCTION__ << ": host table capacity reset";
+  }
+
+  if (lpm_capacity_learned && lpm_used * 2 < lpm_capacity) {
+    lpm_capacity = std::max(FLAGS_l3_lpm_table_size, 0);
+    lpm_capacity_learned = false;
+    VLOG(1) << __FUNCTION__ << ": lpm table capacity reset";
+  }
+}
+
+void l3_placement::get_rebalance_candidates(
+    size_t max,
+    std::deque<std::pair<host_key, host_entry>> *candidates) const noexcept {
+  if (spilled == 0)
+    return;
+
+  for (const auto &h : hosts) {
+    if (candidates->size() == max ||
+        !has_room(L3_TABLE_HOST, candidates->size() + 1))
+      break;
+
+    if (h.second.table == L3_TABLE_LPM)
+      candidates->emplace_back(h);
+  }
+}
+
+void l3_placement::moved_to_host(const host_key &key) noexcept {
+  auto it = hosts.find(key);
+
+  if (it == hosts.end() || it->second.table != L3_TABLE_LPM)
+    return;
+
+  it->second.table = L3_TABLE_HOST;
+  lpm_used--;
+  spilled--;
+  host_used++;
+  relax_capacity();
+}
+
+void l3_placement::clear() noexcept {
+  hosts.clear();
+  routes.clear();
+  host_used = 0;
+  lpm_used = 0;
+  spilled = 0;
+}
+
+} // namespace basebox
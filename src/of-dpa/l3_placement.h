@@ -0,0 +1,120 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <set>
+#include <utility>
+
+namespace basebox {
+
+/**
+ * Placement of host entries (/32, /128) in the unicast routing table.
+ *
+ * Host entries are preferably stored in the host table. If the host table is
+ * full they spill over into the LPM table as full length prefixes and are
+ * moved back once room is available again. The capacity of a table is either
+ * configured or learned from table full errors reported by the switch. A
+ * learned capacity is dropped again once the table is well below it.
+ */
+class l3_placement final {
+public:
+  enum l3_table {
+    L3_TABLE_NONE,
+    L3_TABLE_HOST,
+    L3_TABLE_LPM,
+  };
+
+  struct host_key {
+    int family;
+    std::array<uint8_t, 16> addr; // network byte order
+
+    bool operator<(const host_key &o) const {
+      return family < o.family || (family == o.family && addr < o.addr);
+    }
+  };
+
+  struct host_entry {
+    enum l3_table table;
+    uint32_t l3_interface_id;
+    bool is_ecmp;
+  };
+
+  l3_placement();
+
+  /**
+   * select the table for a new or updated host entry
+   */
+  enum l3_table place_host(const host_key &key, uint32_t l3_interface_id,
+                           bool is_ecmp) noexcept;
+
+  /**
+   * forget a host entry
+   *
+   * @returns the table the entry was placed in or L3_TABLE_NONE
+   */
+  enum l3_table remove_host(const host_key &key) noexcept;
+
+  // prefixes other than host entries stored in the LPM table, counted once
+  // they were sent to the switch
+  void route_added(const host_key &prefix, unsigned prefixlen) noexcept;
+  void route_removed(const host_key &prefix, unsigned prefixlen) noexcept;
+
+  /**
+   * the switch reported the table to be full
+   */
+  void table_full(enum l3_table table) noexcept;
+
+  /**
+   * the switch rejected a prefix, it is not counted anymore
+   */
+  void route_failed(const host_key &prefix, unsigned prefixlen) noexcept;
+
+  /**
+   * move a host entry that failed in the host table to the LPM table
+   *
+   * @returns true if the entry has to be reprogrammed using entry
+   */
+  bool spill(const host_key &key, host_entry *entry) noexcept;
+
+  /**
+   * collect spilled host entries that fit into the host table again
+   */
+  void get_rebalance_candidates(
+      size_t max,
+      std::deque<std::pair<host_key, host_entry>> *candidates) const noexcept;
+
+  void moved_to_host(const host_key &key) noexcept;
+
+  /**
+   * drop all entries, learned capacities are kept
+   */
+  void clear() noexcept;
+
+  size_t get_spilled() const noexcept { return spilled; }
+
+private:
+  std::map<host_key, host_entry> hosts;
+  std::set<std::pair<host_key, unsigned>> routes; // by prefix, prefixlen
+
+  size_t host_used;
+  size_t lpm_used;
+  size_t spilled;
+
+  // 0 means unknown
+  size_t host_capacity;
+  size_t lpm_capacity;
+  bool host_capacity_learned;
+  bool lpm_capacity_learned;
+
+  bool has_room(enum l3_table table, size_t n = 1) const noexcept;
+  void relax_capacity() noexcept;
+};
+
+} // namespace basebox
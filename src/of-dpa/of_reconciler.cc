@@ -0,0 +1,283 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "of_reconciler.h"
+
+namespace basebox {
+
+// OpenFlow 1.3 constants used while parsing the wire format
+static const uint8_t ofptt_all = 0xff;
+static const uint32_t ofpp_any = 0xffffffff;
+static const uint32_t ofpg_any = 0xffffffff;
+static const uint32_t ofpg_all = 0xfffffffc;
+static const uint16_t ofpit_write_actions = 3;
+static const uint16_t ofpit_apply_actions = 4;
+static const uint16_t ofpat_output = 0;
+static const uint16_t ofpat_group = 22;
+static const size_t ofp_match_header_len = 4;
+static const size_t ofp_instruction_actions_len = 8;
+
+static inline uint16_t get_be16(const uint8_t *p) { return p[0] << 8 | p[1]; }
+
+static inline uint32_t get_be32(const uint8_t *p) {
+  return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+of_reconciler::tlvs of_reconciler::split_tlvs(const uint8_t *buf, size_t len,
+                                              size_t len_off) {
+  tlvs v;
+
+  while (len >= len_off + 2) {
+    size_t l = get_be16(buf + len_off);
+    if (l < len_off + 2 || l > len)
+      break; // malformed
+
+    v.emplace_back(buf, buf + l);
+    buf += l;
+    len -= l;
+  }
+
+  return v;
+}
+
+of_reconciler::tlvs
+of_reconciler::match_fields(const std::vector<uint8_t> &match) {
+  tlvs v;
+
+  if (match.size() < ofp_match_header_len)
+    return v;
+
+  // length of the match excluding padding
+  size_t len = std::min<size_t>(get_be16(match.data() + 2), match.size());
+  size_t off = ofp_match_header_len;
+
+  while (off + 4 <= len) {
+    size_t l = 4 + match[off + 3];
+    if (off + l > len)
+      break; // malformed
+
+    v.emplace_back(match.begin() + off, match.begin() + off + l);
+    off += l;
+  }
+
+  return v;
+}
+
+std::vector<uint8_t> of_reconciler::canonical(tlvs v) {
+  std::vector<uint8_t> c;
+
+  std::sort(v.begin(), v.end());
+  for (const auto &t : v)
+    c.insert(c.end(), t.begin(), t.end());
+
+  return c;
+}
+
+of_reconciler::flow_key
+of_reconciler::make_key(uint8_t table_id, uint16_t priority,
+                        const std::vector<uint8_t> &match) {
+  return flow_key{table_id, priority, canonical(match_fields(match))};
+}
+
+bool of_reconciler::has_output(const std::vector<uint8_t> &instructions,
+                               uint32_t out_port, uint32_t out_group) {
+  if (out_port == ofpp_any && out_group == ofpg_any)
+    return true;
+
+  for (const auto &inst :
+       split_tlvs(instructions.data(), instructions.size(), 2)) {
+    uint16_t type = get_be16(inst.data());
+
+    if ((type != ofpit_write_actions && type != ofpit_apply_actions) ||
+        inst.size() < ofp_instruction_actions_len)
+      continue;
+
+    for (const auto &action :
+         split_tlvs(inst.data() + ofp_instruction_actions_len,
+                    inst.size() - ofp_instruction_actions_len, 2)) {
+      if (action.size() < 8)
+        continue;
+
+      uint16_t atype = get_be16(action.data());
+      uint32_t arg = get_be32(action.data() + 4);
+
+      if ((atype == ofpat_output && out_port != ofpp_any && arg == out_port) ||
+          (atype == ofpat_group && out_group != ofpg_any && arg == out_group))
+        return true;
+    }
+  }
+
+  return false;
+}
+
+int of_reconciler::group_rank(uint32_t group_id) noexcept {
+  // OF-DPA encodes the group type in the upper 4 bits of the group id
+  switch (group_id >> 28) {
+  case 0:  // L2 interface
+  case 11: // L2 unfiltered interface
+    return 0;
+  case 1: // L2 rewrite
+  case 2: // L3 unicast
+  case 5: // L3 interface
+  case 8: // L2 overlay
+    return 1;
+  case 3: // L2 multicast
+  case 4: // L2 flood
+  case 6: // L3 multicast
+  case 7: // L3 ECMP
+    return 2;
+  default:
+    return 3;
+  }
+}
+
+bool of_reconciler::is_owned(const flow &f) const noexcept {
+  uint32_t cookie_class = f.cookie >> 32;
+
+  return cookie_class != 0 &&
+         owned_cookies.count(std::make_pair(f.table_id, cookie_class));
+}
+
+void of_reconciler::flow_add(const flow &f) {
+  if (f.cookie >> 32)
+    owned_cookies.emplace(f.table_id, f.cookie >> 32);
+  flows[make_key(f.table_id, f.priority, f.match)] = f;
+}
+
+void of_reconciler::flow_remove_strict(uint8_t table_id, uint16_t priority,
+                                       const std::vector<uint8_t> &match) {
+  flows.erase(make_key(table_id, priority, match));
+}
+
+void of_reconciler::flow_remove(const flow_filter &filter) {
+  tlvs fields = match_fields(filter.match);
+
+  for (auto it = flows.begin(); it != flows.end();) {
+    const flow &f = it->second;
+    bool covered =
+        (filter.table_id == ofptt_all || filter.table_id == f.table_id) &&
+        (f.cookie & filter.cookie_mask) ==
+            (filter.cookie & filter.cookie_mask) &&
+        has_output(f.instructions, filter.out_port, filter.out_group);
+
+    if (covered) {
+      tlvs own = match_fields(f.match);
+      for (const auto &field : fields) {
+        if (std::find(own.begin(), own.end(), field) == own.end()) {
+          covered = false;
+          break;
+        }
+      }
+    }
+
+    if (covered)
+      it = flows.erase(it);
+    else
+      ++it;
+  }
+}
+
+void of_reconciler::group_add(const group &g) {
+  owned_groups.insert(g.group_id);
+  groups[g.group_id] = g;
+}
+
+void of_reconciler::group_remove(uint32_t group_id) {
+  if (group_id == ofpg_all)
+    groups.clear();
+  else
+    groups.erase(group_id);
+}
+
+void of_reconciler::diff(const std::deque<flow> &switch_flows,
+                         const std::deque<group> &switch_groups,
+                         plan *p) const {
+  // groups
+  std::map<uint32_t, const group *> present;
+  for (const auto &g : switch_groups)
+    present.emplace(g.group_id, &g);
+
+  for (const auto &g : groups) {
+    auto it = present.find(g.first);
+
+    if (it == present.end()) {
+      p->add_groups.push_back(g.second);
+      continue;
+    }
+
+    const group &s = *it->second;
+    if (s.type != g.second.type ||
+        canonical(split_tlvs(s.buckets.data(), s.buckets.size(), 0)) !=
+            canonical(split_tlvs(g.second.buckets.data(),
+                                 g.second.buckets.size(), 0)))
+      p->modify_groups.push_back(g.second);
+  }
+
+  for (const auto &s : present) {
+    if (groups.find(s.first) == groups.end() && owned_groups.count(s.first))
+      p->remove_groups.push_back(s.first);
+  }
+
+  // flows
+  std::set<flow_key> seen;
+  for (const auto &s : switch_flows) {
+    flow_key key = make_key(s.table_id, s.priority, s.match);
+    auto it = flows.find(key);
+
+    if (it == flows.end()) {
+      if (is_owned(s))
+        p->remove_flows.push_back(s);
+      continue;
+    }
+
+    seen.insert(key);
+
+    if (canonical(split_tlvs(s.instructions.data(), s.instructions.size(),
+                             2)) !=
+        canonical(split_tlvs(it->second.instructions.data(),
+                             it->second.instructions.size(), 2)))
+      p->add_flows.push_back(it->second);
+  }
+
+  for (const auto &f : flows) {
+    if (seen.find(f.first) == seen.end())
+      p->add_flows.push_back(f.second);
+  }
+
+  // referenced groups first when adding, last when removing
+  std::stable_sort(p->add_groups.begin(), p->add_groups.end(),
+                   [](const group &a, const group &b) {
+                     return group_rank(a.group_id) < group_rank(b.group_id);
+                   });
+  std::stable_sort(p->remove_groups.begin(), p->remove_groups.end(),
+                   [](uint32_t a, uint32_t b) {
+                     return group_rank(a) > group_rank(b);
+                   });
+
+  VLOG(1) << __FUNCTION__ << ": flows desired=" << flows.size()
+          << " present=" << switch_flows.size()
+          << " add=" << p->add_flows.size()
+          << " remove=" << p->remove_flows.size()
+          << "; groups desired=" << groups.size()
+          << " present=" << switch_groups.size()
+          << " add=" << p->add_groups.size()
+          << " modify=" << p->modify_groups.size()
+          << " remove=" << p->remove_groups.size();
+}
+
+std::vector<uint32_t> of_reconciler::get_group_ids() const {
+  std::vector<uint32_t> ids;
+
+  ids.reserve(groups.size());
+  for (const auto &g : groups)
+    ids.push_back(g.first);
+
+  return ids;
+}
+
+} // namespace basebox
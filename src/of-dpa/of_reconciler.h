@@ -0,0 +1,164 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace basebox {
+
+/**
+ * Shadow of the flow and group tables programmed into the switch.
+ *
+ * Every flow-mod and group-mod sent to the switch is recorded, which yields
+ * the desired state of the switch. The flow and group tables read back from
+ * the switch are compared to it and only the difference has to be sent.
+ *
+ * Matches, instructions and buckets are kept in OpenFlow 1.3 wire format and
+ * compared independent of the order of OXM fields, instructions and buckets.
+ */
+class of_reconciler final {
+public:
+  struct flow {
+    uint8_t table_id;
+    uint16_t priority;
+    uint64_t cookie;
+    uint16_t idle_timeout;
+    uint16_t hard_timeout;
+    uint16_t flags;
+    std::vector<uint8_t> match;        // struct ofp_match
+    std::vector<uint8_t> instructions; // list of struct ofp_instruction
+  };
+
+  struct group {
+    uint32_t group_id;
+    uint8_t type;
+    std::vector<uint8_t> buckets; // list of struct ofp_bucket
+  };
+
+  struct flow_filter {
+    uint8_t table_id;
+    uint64_t cookie;
+    uint64_t cookie_mask;
+    uint32_t out_port;
+    uint32_t out_group;
+    std::vector<uint8_t> match;
+  };
+
+  /**
+   * changes to be applied to the switch in the given order, groups are
+   * sorted such that referenced groups are created before and removed after
+   * the groups and flows referencing them
+   */
+  struct plan {
+    std::deque<group> add_groups;
+    std::deque<group> modify_groups;
+    std::deque<flow> add_flows;
+    std::deque<flow> remove_flows;
+    std::deque<uint32_t> remove_groups;
+
+    size_t size() const noexcept {
+      return add_groups.size() + modify_groups.size() + add_flows.size() +
+             remove_flows.size() + remove_groups.size();
+    }
+  };
+
+  // flow-mod ADD, MODIFY and MODIFY_STRICT
+  void flow_add(const flow &f);
+  // flow-mod DELETE_STRICT or flow removed by the switch
+  void flow_remove_strict(uint8_t table_id, uint16_t priority,
+                          const std::vector<uint8_t> &match);
+  // flow-mod DELETE
+  void flow_remove(const flow_filter &filter);
+
+  // group-mod ADD and MODIFY
+  void group_add(const group &g);
+  // group-mod DELETE, OFPG_ALL removes all groups
+  void group_remove(uint32_t group_id);
+
+  /**
+   * compute the changes needed to get from the current switch state to the
+   * desired state
+   */
+  void diff(const std::deque<flow> &switch_flows,
+            const std::deque<group> &switch_groups, plan *p) const;
+
+  // table id and upper half of the cookies of flows sent to the switch
+  typedef std::set<std::pair<uint8_t, uint32_t>> cookie_classes;
+
+  // cookies baseboxd owns, a restarted instance takes them over
+  const cookie_classes &get_owned_cookies() const noexcept {
+    return owned_cookies;
+  }
+  void add_owned_cookies(const cookie_classes &cookies) {
+    owned_cookies.insert(cookies.begin(), cookies.end());
+  }
+
+  // ids of the groups baseboxd wrote, a restarted instance takes them over
+  const std::set<uint32_t> &get_owned_groups() const noexcept {
+    return owned_groups;
+  }
+  void add_owned_groups(const std::set<uint32_t> &group_ids) {
+    owned_groups.insert(group_ids.begin(), group_ids.end());
+  }
+
+  // nothing recorded and nothing to take over from the switch
+  bool empty() const noexcept {
+    return flows.empty() && groups.empty() && owned_cookies.empty() &&
+           owned_groups.empty();
+  }
+
+  size_t flow_count() const noexcept { return flows.size(); }
+  size_t group_count() const noexcept { return groups.size(); }
+
+  // ids of the recorded groups in ascending order
+  std::vector<uint32_t> get_group_ids() const;
+
+private:
+  typedef std::vector<std::vector<uint8_t>> tlvs;
+
+  struct flow_key {
+    uint8_t table_id;
+    uint16_t priority;
+    std::vector<uint8_t> match; // sorted OXM TLVs
+
+    bool operator<(const flow_key &o) const {
+      if (table_id != o.table_id)
+        return table_id < o.table_id;
+      if (priority != o.priority)
+        return priority < o.priority;
+      return match < o.match;
+    }
+  };
+
+  std::map<flow_key, flow> flows;
+  std::map<uint32_t, group> groups;
+
+  // unknown flows are only removed if their cookie class was ever used by
+  // baseboxd in the same table. The OF-DPA defaults and other agents use
+  // other cookies, flows with a zero upper half are never owned.
+  cookie_classes owned_cookies;
+
+  // likewise unknown groups are only removed if baseboxd ever wrote a group
+  // with the same id, the ids stay owned after the group is deleted
+  std::set<uint32_t> owned_groups;
+
+  static flow_key make_key(uint8_t table_id, uint16_t priority,
+                           const std::vector<uint8_t> &match);
+  static tlvs split_tlvs(const uint8_t *buf, size_t len, size_t len_off);
+  static tlvs match_fields(const std::vector<uint8_t> &match);
+  static std::vector<uint8_t> canonical(tlvs v);
+  static bool has_output(const std::vector<uint8_t> &instructions,
+                         uint32_t out_port, uint32_t out_group);
+  static int group_rank(uint32_t group_id) noexcept;
+  bool is_owned(const flow &f) const noexcept;
+};
+
+} // namespace basebox
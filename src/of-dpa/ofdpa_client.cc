@@ -127,6 +127,90 @@ ofdpa_client::ofdpaTunnelNextHopModify(uint32_t next_hop_id, uint64_t src_mac,
   return response.status();
 }
 
+OfdpaStatus::OfdpaStatusCode
+ofdpa_client::ofdpaTunnelEcmpNextHopGroupCreate(
+    uint32_t ecmp_next_hop_group_id) {
+  ::TunnelEcmpNextHopGroupCreate request;
+  request.set_ecmp_next_hop_group_id(ecmp_next_hop_group_id);
+  ::OfdpaTunnelEcmpNextHopGroupConfig *config = request.mutable_config();
+  config->set_protocol(OFDPA_TUNNEL_PROTO_VXLAN);
+
+  ::OfdpaStatus response;
+  ::ClientContext context;
+
+  ::Status rv =
+      stub_->ofdpaTunnelEcmpNextHopGroupCreate(&context, request, &response);
+
+  if (not rv.ok()) {
+    // LOG status
+    return ofdpa::OfdpaStatus::OFDPA_E_RPC;
+  }
+
+  return response.status();
+}
+
+OfdpaStatus::OfdpaStatusCode
+ofdpa_client::ofdpaTunnelEcmpNextHopGroupDelete(
+    uint32_t ecmp_next_hop_group_id) {
+  ::EcmpNextHopGroupId request;
+  request.set_ecmp_next_hop_group_id(ecmp_next_hop_group_id);
+
+  ::OfdpaStatus response;
+  ::ClientContext context;
+
+  ::Status rv =
+      stub_->ofdpaTunnelEcmpNextHopGroupDelete(&context, request, &response);
+
+  if (not rv.ok()) {
+    // LOG status
+    return ofdpa::OfdpaStatus::OFDPA_E_RPC;
+  }
+
+  return response.status();
+}
+
+OfdpaStatus::OfdpaStatusCode
+ofdpa_client::ofdpaTunnelEcmpNextHopGroupMemberAdd(
+    uint32_t ecmp_next_hop_group_id, uint32_t next_hop_id) {
+  ::TunnelEcmpNextHopGroupMember request;
+  request.set_ecmp_next_hop_group_id(ecmp_next_hop_group_id);
+  request.set_next_hop_id(next_hop_id);
+
+  ::OfdpaStatus response;
+  ::ClientContext context;
+
+  ::Status rv =
+      stub_->ofdpaTunnelEcmpNextHopGroupMemberAdd(&context, request, &response);
+
+  if (not rv.ok()) {
+    // LOG status
+    return ofdpa::OfdpaStatus::OFDPA_E_RPC;
+  }
+
+  return response.status();
+}
+
+OfdpaStatus::OfdpaStatusCode
+ofdpa_client::ofdpaTunnelEcmpNextHopGroupMemberDelete(
+    uint32_t ecmp_next_hop_group_id, uint32_t next_hop_id) {
+  ::TunnelEcmpNextHopGroupMember request;
+  request.set_ecmp_next_hop_group_id(ecmp_next_hop_group_id);
+  request.set_next_hop_id(next_hop_id);
+
+  ::OfdpaStatus response;
+  ::ClientContext context;
+
+  ::Status rv = stub_->ofdpaTunnelEcmpNextHopGroupMemberDelete(
+      &context, request, &response);
+
+  if (not rv.ok()) {
+    // LOG status
+    return ofdpa::OfdpaStatus::OFDPA_E_RPC;
+  }
+
+  return response.status();
+}
+
 TunnelPortCreate make_tunnel_port(uint32_t port_id,
                                   const std::string &port_name,
                                   OfdpaTunnelPortType type) {
@@ -150,6 +234,7 @@ OfdpaAccessPortConfig make_access_port_config(uint32_t physical_port,
 
 OfdpaEndpointConfig make_endpoint_config(uint32_t remote, uint32_t local,
                                          uint32_t ttl, uint32_t next_hop_id,
+                                         bool ecmp,
                                          uint32_t terminator_udp_dst_port,
                                          uint32_t initiator_udp_dst_port,
                                          uint32_t udp_src_port_if_no_entropy,
@@ -159,6 +244,7 @@ OfdpaEndpointConfig make_endpoint_config(uint32_t remote, uint32_t local,
   config.set_local_endpoint(local);
   config.set_ttl(ttl);
   config.set_next_hop_id(next_hop_id);
+  config.set_ecmp(ecmp); // next_hop_id is an ecmp next hop group
 
   OfdpaVxlanProtoInfo *info = config.mutable_info()->mutable_vxlan_info();
   info->set_initiator_udp_dst_port(initiator_udp_dst_port);   /* remote port */
@@ -190,7 +276,7 @@ OfdpaStatus::OfdpaStatusCode ofdpa_client::ofdpaTunnelAccessPortCreate(
 
 OfdpaStatus::OfdpaStatusCode ofdpa_client::ofdpaTunnelEndpointPortCreate(
     uint32_t port_id, const std::string &port_name, uint32_t remote_ipv4,
-    uint32_t local_ipv4, uint32_t ttl, uint32_t next_hop_id,
+    uint32_t local_ipv4, uint32_t ttl, uint32_t next_hop_id, bool ecmp,
     uint32_t terminator_udp_dst_port, uint32_t initiator_udp_dst_port,
     uint32_t udp_src_port_if_no_entropy, bool use_entropy) {
   // XXX TODO check parameters
@@ -200,8 +286,9 @@ OfdpaStatus::OfdpaStatusCode ofdpa_client::ofdpaTunnelEndpointPortCreate(
       ->mutable_config()
       ->mutable_endpoint_config()
       ->CopyFrom(make_endpoint_config(
-          remote_ipv4, local_ipv4, ttl, next_hop_id, terminator_udp_dst_port,
-          initiator_udp_dst_port, udp_src_port_if_no_entropy, use_entropy));
+          remote_ipv4, local_ipv4, ttl, next_hop_id, ecmp,
+          terminator_udp_dst_port, initiator_udp_dst_port,
+          udp_src_port_if_no_entropy, use_entropy));
 
   return ofdpaTunnelPortCreate(request);
 }
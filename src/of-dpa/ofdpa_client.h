@@ -37,6 +37,20 @@ public:
                            uint64_t dst_mac, uint32_t physical_port,
                            uint16_t vlan_id);
 
+  ofdpa::OfdpaStatus::OfdpaStatusCode
+  ofdpaTunnelEcmpNextHopGroupCreate(uint32_t ecmp_next_hop_group_id);
+
+  ofdpa::OfdpaStatus::OfdpaStatusCode
+  ofdpaTunnelEcmpNextHopGroupDelete(uint32_t ecmp_next_hop_group_id);
+
+  ofdpa::OfdpaStatus::OfdpaStatusCode
+  ofdpaTunnelEcmpNextHopGroupMemberAdd(uint32_t ecmp_next_hop_group_id,
+                                       uint32_t next_hop_id);
+
+  ofdpa::OfdpaStatus::OfdpaStatusCode
+  ofdpaTunnelEcmpNextHopGroupMemberDelete(uint32_t ecmp_next_hop_group_id,
+                                          uint32_t next_hop_id);
+
   ofdpa::OfdpaStatus::OfdpaStatusCode
   ofdpaTunnelAccessPortCreate(uint32_t port_id, const std::string &port_name,
                               uint32_t physical_port, uint16_t vlan_id,
@@ -44,7 +58,7 @@ public:
 
   ofdpa::OfdpaStatus::OfdpaStatusCode ofdpaTunnelEndpointPortCreate(
       uint32_t port_id, const std::string &port_name, uint32_t remote_ipv4,
-      uint32_t local_ipv4, uint32_t ttl, uint32_t next_hop_id,
+      uint32_t local_ipv4, uint32_t ttl, uint32_t next_hop_id, bool ecmp,
       uint32_t terminator_udp_dst_port, uint32_t initiator_udp_dst_port,
       uint32_t udp_src_port_if_no_entropy, bool use_entropy);
 
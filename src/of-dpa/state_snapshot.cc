@@ -0,0 +1,130 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cerrno>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "state_snapshot.h"
+#include "utils/snapshot_file.h"
+
+namespace basebox {
+
+static const uint32_t snapshot_magic = 0x42425353; // "BBSS"
+static const uint32_t snapshot_version = 3;
+
+struct snapshot_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t egress_interface_id;
+  uint32_t n_freed_egress_interface_ids;
+  uint32_t n_egress_interfaces;
+  uint32_t n_owned_cookies;
+  uint32_t n_owned_group_ids;
+};
+
+struct snapshot_egress_interface {
+  uint32_t id;
+  uint32_t port;
+  uint16_t vid;
+  uint16_t pad[3];
+  uint64_t src_mac;
+  uint64_t dst_mac;
+};
+
+struct snapshot_owned_cookie {
+  uint8_t table_id;
+  uint8_t pad[3];
+  uint32_t cookie_class;
+};
+
+int state_snapshot::save(const std::string &path) const noexcept {
+  std::vector<uint8_t> buf;
+
+  try {
+    snapshot_append(&buf,
+                    snapshot_header{snapshot_magic, snapshot_version,
+                                    egress_interface_id,
+                                    (uint32_t)freed_egress_interface_ids.size(),
+                                    (uint32_t)egress_interfaces.size(),
+                                    (uint32_t)owned_cookies.size(),
+                                    (uint32_t)owned_group_ids.size()});
+    for (auto id : freed_egress_interface_ids)
+      snapshot_append(&buf, id);
+    for (const auto &e : egress_interfaces)
+      snapshot_append(&buf, snapshot_egress_interface{
+                                e.first, e.second.port, e.second.vid,
+                                {0, 0, 0}, e.second.src_mac,
+                                e.second.dst_mac});
+    for (const auto &c : owned_cookies)
+      snapshot_append(&buf,
+                      snapshot_owned_cookie{c.first, {0, 0, 0}, c.second});
+    for (auto id : owned_group_ids)
+      snapshot_append(&buf, id);
+  } catch (std::exception &e) {
+    LOG(ERROR) << __FUNCTION__ << ": failed to serialize: " << e.what();
+    return -ENOMEM;
+  }
+
+  return snapshot_write(path, buf);
+}
+
+int state_snapshot::load(const std::string &path) noexcept {
+  std::vector<uint8_t> buf;
+  snapshot_header hdr;
+  size_t off = 0;
+
+  int rv = snapshot_read(path, &buf);
+  if (rv < 0)
+    return rv;
+
+  if (!snapshot_consume(buf, &off, &hdr) || hdr.magic != snapshot_magic ||
+      hdr.version != snapshot_version) {
+    LOG(ERROR) << __FUNCTION__ << ": " << path << " is not a snapshot";
+    return -EINVAL;
+  }
+
+  state_snapshot s;
+  try {
+    s.egress_interface_id = hdr.egress_interface_id;
+    for (uint32_t i = 0; i < hdr.n_freed_egress_interface_ids; i++) {
+      uint32_t id;
+      if (!snapshot_consume(buf, &off, &id))
+        return -EINVAL;
+      s.freed_egress_interface_ids.insert(id);
+    }
+    for (uint32_t i = 0; i < hdr.n_egress_interfaces; i++) {
+      snapshot_egress_interface e;
+      if (!snapshot_consume(buf, &off, &e))
+        return -EINVAL;
+      s.egress_interfaces.emplace(
+          e.id, egress_interface{e.port, e.vid, e.src_mac, e.dst_mac});
+    }
+    for (uint32_t i = 0; i < hdr.n_owned_cookies; i++) {
+      snapshot_owned_cookie c;
+      if (!snapshot_consume(buf, &off, &c))
+        return -EINVAL;
+      s.owned_cookies.emplace(c.table_id, c.cookie_class);
+    }
+    for (uint32_t i = 0; i < hdr.n_owned_group_ids; i++) {
+      uint32_t id;
+      if (!snapshot_consume(buf, &off, &id))
+        return -EINVAL;
+      s.owned_group_ids.insert(id);
+    }
+  } catch (std::exception &e) {
+    return -ENOMEM;
+  }
+
+  if (off != buf.size()) {
+    LOG(ERROR) << __FUNCTION__ << ": " << path << " has trailing data";
+    return -EINVAL;
+  }
+
+  *this = std::move(s);
+  return 0;
+}
+
+} // namespace basebox
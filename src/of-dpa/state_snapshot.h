@@ -0,0 +1,69 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+namespace basebox {
+
+/**
+ * Switch state persisted across restarts of baseboxd.
+ *
+ * The snapshot holds the identifiers baseboxd allocated for objects in the
+ * switch, so that a restarted baseboxd programs the same objects under the
+ * same identifiers and the switch tables only have to be reconciled instead
+ * of being rewritten.
+ *
+ * The file is a sequence of fixed size records in host byte order, it is
+ * written to a temporary file first and renamed, hence a reader either sees
+ * the previous or the new snapshot.
+ */
+struct state_snapshot {
+  struct egress_interface {
+    uint32_t port;
+    uint16_t vid;
+    uint64_t src_mac;
+    uint64_t dst_mac;
+
+    bool operator<(const egress_interface &o) const {
+      if (port != o.port)
+        return port < o.port;
+      if (vid != o.vid)
+        return vid < o.vid;
+      if (src_mac != o.src_mac)
+        return src_mac < o.src_mac;
+      return dst_mac < o.dst_mac;
+    }
+  };
+
+  state_snapshot() : egress_interface_id(1) {}
+
+  // l3 unicast group allocator of the controller
+  uint32_t egress_interface_id;
+  std::set<uint32_t> freed_egress_interface_ids;
+  std::map<uint32_t, egress_interface> egress_interfaces;
+
+  // table id and upper half of the cookies of flows written by baseboxd
+  std::set<std::pair<uint8_t, uint32_t>> owned_cookies;
+  // ids of the groups written by baseboxd
+  std::set<uint32_t> owned_group_ids;
+
+  /**
+   * @returns 0 on success, negative errno otherwise
+   */
+  int save(const std::string &path) const noexcept;
+
+  /**
+   * @returns 0 on success, -ENOENT if there is no snapshot, other negative
+   * errno if the snapshot is unusable
+   */
+  int load(const std::string &path) noexcept;
+};
+
+} // namespace basebox
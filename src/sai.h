@@ -45,6 +45,11 @@ public:
 
   virtual int l2_addr_remove_all_in_vlan(uint32_t port,
                                          uint16_t vid) noexcept = 0;
+  /**
+   * remove all bridging entries of a port, of a vlan or of a port in a vlan,
+   * a port or vid of 0 matches all
+   */
+  virtual int l2_addr_flush(uint32_t port, uint16_t vid) noexcept = 0;
   virtual int l2_addr_add(uint32_t port, uint16_t vid,
                           const rofl::caddress_ll &mac, bool filtered,
                           bool permanent) noexcept = 0;
@@ -134,6 +139,21 @@ public:
   virtual int egress_bridge_port_vlan_remove(uint32_t port,
                                              uint16_t vid) noexcept = 0;
 
+  // ranges of vids [vid_start, vid_end], the pvid is handled if in range
+  virtual int ingress_port_vlan_range_add(uint32_t port, uint16_t vid_start,
+                                          uint16_t vid_end,
+                                          uint16_t pvid) noexcept = 0;
+  virtual int ingress_port_vlan_range_remove(uint32_t port, uint16_t vid_start,
+                                             uint16_t vid_end,
+                                             uint16_t pvid) noexcept = 0;
+  virtual int egress_bridge_port_vlan_range_add(uint32_t port,
+                                                uint16_t vid_start,
+                                                uint16_t vid_end,
+                                                bool untagged) noexcept = 0;
+  virtual int
+  egress_bridge_port_vlan_range_remove(uint32_t port, uint16_t vid_start,
+                                       uint16_t vid_end) noexcept = 0;
+
   virtual int enqueue(uint32_t port_id, basebox::packet *pkt) noexcept = 0;
   virtual int subscribe_to(enum swi_flags flags) noexcept = 0;
 
@@ -155,14 +175,25 @@ public:
                                      uint16_t vlan_id) noexcept = 0;
   virtual int tunnel_next_hop_delete(uint32_t next_hop_id) noexcept = 0;
 
+  // ecmp groups of tunnel next hops
+  virtual int tunnel_next_hop_group_create(uint32_t group_id) noexcept = 0;
+  virtual int tunnel_next_hop_group_delete(uint32_t group_id) noexcept = 0;
+  virtual int
+  tunnel_next_hop_group_member_add(uint32_t group_id,
+                                   uint32_t next_hop_id) noexcept = 0;
+  virtual int
+  tunnel_next_hop_group_member_remove(uint32_t group_id,
+                                      uint32_t next_hop_id) noexcept = 0;
+
   virtual int tunnel_access_port_create(uint32_t port_id,
                                         const std::string &port_name,
                                         uint32_t physical_port,
                                         uint16_t vlan_id,
                                         bool untagged) noexcept = 0;
+  // next_hop_id is a next hop group if ecmp is set
   virtual int tunnel_enpoint_create(
       uint32_t port_id, const std::string &port_name, uint32_t remote_ipv4,
-      uint32_t local_ipv4, uint32_t ttl, uint32_t next_hop_id,
+      uint32_t local_ipv4, uint32_t ttl, uint32_t next_hop_id, bool ecmp,
       uint32_t terminator_udp_dst_port, uint32_t initiator_udp_dst_port,
       uint32_t udp_src_port_if_no_entropy, bool use_entropy) noexcept = 0;
   virtual int tunnel_port_delete(uint32_t port_id) noexcept = 0;
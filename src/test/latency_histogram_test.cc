@@ -0,0 +1,99 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+#include "utils/latency_histogram.h"
+
+namespace basebox {
+
+TEST(latency_histogram, buckets_bound_the_relative_error) {
+  uint64_t lower = 0;
+
+  for (size_t b = 0; b < latency_histogram::n_buckets; b++) {
+    uint64_t upper = latency_histogram::bucket_upper_bound(b);
+
+    ASSERT_GE(upper, lower) << "bucket " << b;
+    EXPECT_EQ(latency_histogram::bucket_of(lower), b);
+    EXPECT_EQ(latency_histogram::bucket_of(upper), b);
+    EXPECT_LE(upper - lower, upper / 32) << "bucket " << b;
+
+    lower = upper + 1;
+  }
+
+  // EXPECT_EQ takes references, the constants have no out of line definition
+  uint64_t max_value = latency_histogram::max_value;
+  size_t last = latency_histogram::n_buckets - 1;
+  EXPECT_EQ(lower - 1, max_value);
+  EXPECT_EQ(latency_histogram::bucket_of(UINT64_MAX), last);
+}
+
+TEST(latency_histogram, small_values_are_exact) {
+  for (uint64_t v = 0; v < 64; v++) {
+    EXPECT_EQ(latency_histogram::bucket_of(v), v);
+    EXPECT_EQ(latency_histogram::bucket_upper_bound(v), v);
+  }
+}
+
+TEST(latency_histogram, empty_snapshot) {
+  latency_histogram h;
+  auto s = h.get_snapshot();
+
+  EXPECT_EQ(s.count, 0u);
+  EXPECT_EQ(s.percentile(50), 0u);
+  EXPECT_EQ(s.percentile(100), 0u);
+}
+
+TEST(latency_histogram, percentiles) {
+  latency_histogram h;
+
+  for (uint64_t v = 1; v <= 10000; v++)
+    h.record(v);
+
+  auto s = h.get_snapshot();
+  EXPECT_EQ(s.count, 10000u);
+  EXPECT_EQ(s.sum, 10000u * 10001 / 2);
+  EXPECT_EQ(s.max, 10000u);
+
+  EXPECT_EQ(s.percentile(0), 1u);
+  EXPECT_EQ(s.percentile(100), 10000u);
+
+  for (double p : {1.0, 10.0, 50.0, 90.0, 99.0, 99.9}) {
+    double exact = p * 100;
+    uint64_t v = s.percentile(p);
+
+    // the upper bound of the bucket, never below the exact value
+    EXPECT_GE(v, exact) << "p" << p;
+    EXPECT_LE(v, exact * 1.032) << "p" << p;
+  }
+}
+
+TEST(latency_histogram, percentile_is_capped_by_max) {
+  latency_histogram h;
+
+  h.record(1000);
+  auto s = h.get_snapshot();
+
+  // 1000 falls into the bucket of 992 to 1007
+  EXPECT_EQ(latency_histogram::bucket_upper_bound(
+                latency_histogram::bucket_of(1000)),
+            1007u);
+  EXPECT_EQ(s.percentile(50), 1000u);
+}
+
+TEST(latency_histogram, durations_are_recorded_in_microseconds) {
+  latency_histogram h;
+
+  h.record(std::chrono::milliseconds(3));
+  h.record(std::chrono::steady_clock::duration(-1));
+
+  auto s = h.get_snapshot();
+  EXPECT_EQ(s.count, 2u);
+  EXPECT_EQ(s.sum, 3000u);
+  EXPECT_EQ(s.buckets[0], 1u);
+}
+
+} // namespace basebox
@@ -0,0 +1,192 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <netlink/addr.h>
+
+#include "netlink/nl_fib_aggregator.h"
+
+namespace basebox {
+
+// the routes programmed into the switch, by "addr/len"
+class fib_aggregator_test : public ::testing::Test {
+protected:
+  std::map<std::string, uint32_t> fib;
+  unsigned adds = 0;
+  unsigned dels = 0;
+
+  nl_fib_aggregator agg{
+      [this](nl_addr *dst, uint32_t l3_interface_id, bool is_ecmp,
+             bool update_route) {
+        EXPECT_EQ(fib.count(key(dst)) != 0, update_route);
+        fib[key(dst)] = l3_interface_id | (is_ecmp ? 0x80000000 : 0);
+        adds++;
+        return 0;
+      },
+      [this](nl_addr *dst) {
+        EXPECT_EQ(fib.erase(key(dst)), 1u);
+        dels++;
+        return 0;
+      }};
+
+  static std::string key(nl_addr *a) {
+    char buf[INET6_ADDRSTRLEN + 4];
+    return nl_addr2str(a, buf, sizeof(buf));
+  }
+
+  static std::unique_ptr<nl_addr, decltype(&nl_addr_put)>
+  prefix(const char *s) {
+    nl_addr *a = nullptr;
+    EXPECT_EQ(nl_addr_parse(s, AF_UNSPEC, &a), 0) << s;
+    return std::unique_ptr<nl_addr, decltype(&nl_addr_put)>(a, nl_addr_put);
+  }
+
+  int add(const char *dst, uint32_t nh) {
+    return agg.add_route(prefix(dst).get(), nh, false);
+  }
+
+  int del(const char *dst) { return agg.del_route(prefix(dst).get()); }
+};
+
+TEST_F(fib_aggregator_test, covered_route_with_same_next_hop_is_suppressed) {
+  ASSERT_EQ(add("10.0.0.0/8", 1), 0);
+  ASSERT_EQ(add("10.1.0.0/16", 1), 0);
+
+  EXPECT_EQ(agg.rib_size(), 2u);
+  EXPECT_EQ(fib, (std::map<std::string, uint32_t>{{"10.0.0.0/8", 1}}));
+
+  // a different next hop has to be programmed
+  ASSERT_EQ(add("10.1.0.0/16", 2), 0);
+  EXPECT_EQ(fib, (std::map<std::string, uint32_t>{{"10.0.0.0/8", 1},
+                                                  {"10.1.0.0/16", 2}}));
+}
+
+TEST_F(fib_aggregator_test, siblings_are_merged) {
+  ASSERT_EQ(add("192.168.0.0/25", 3), 0);
+  EXPECT_EQ(fib, (std::map<std::string, uint32_t>{{"192.168.0.0/25", 3}}));
+
+  ASSERT_EQ(add("192.168.0.128/25", 3), 0);
+  EXPECT_EQ(fib, (std::map<std::string, uint32_t>{{"192.168.0.0/24", 3}}));
+  EXPECT_EQ(agg.fib_size(), 1u);
+
+  ASSERT_EQ(del("192.168.0.0/25"), 0);
+  EXPECT_EQ(fib, (std::map<std::string, uint32_t>{{"192.168.0.128/25", 3}}));
+}
+
+TEST_F(fib_aggregator_test, ecmp_and_l3_interface_differ) {
+  ASSERT_EQ(add("10.0.0.0/8", 1), 0);
+  ASSERT_EQ(agg.add_route(prefix("10.1.0.0/16").get(), 1, true), 0);
+
+  EXPECT_EQ(fib, (std::map<std::string, uint32_t>{
+                     {"10.0.0.0/8", 1}, {"10.1.0.0/16", 0x80000001}}));
+}
+
+TEST_F(fib_aggregator_test, local_prefixes_take_part_as_controller_routes) {
+  // l3 interface id 0 sends to the controller, as for connected prefixes
+  ASSERT_EQ(add("10.0.0.0/8", 1), 0);
+  ASSERT_EQ(add("10.1.0.0/24", 0), 0);
+  ASSERT_EQ(add("10.1.0.0/16", 1), 0);
+
+  EXPECT_EQ(fib, (std::map<std::string, uint32_t>{{"10.0.0.0/8", 1},
+                                                  {"10.1.0.0/24", 0}}));
+
+  ASSERT_EQ(add("10.1.0.0/24", 1), 0);
+  ASSERT_EQ(add("10.2.0.0/25", 0), 0);
+  ASSERT_EQ(add("10.2.0.128/25", 0), 0);
+  EXPECT_EQ(fib, (std::map<std::string, uint32_t>{{"10.0.0.0/8", 1},
+                                                  {"10.2.0.0/24", 0}}));
+
+  ASSERT_EQ(del("10.0.0.0/8"), 0);
+  EXPECT_EQ(fib, (std::map<std::string, uint32_t>{{"10.1.0.0/16", 1},
+                                                  {"10.2.0.0/24", 0}}));
+}
+
+TEST_F(fib_aggregator_test, families_are_separate) {
+  ASSERT_EQ(add("0.0.0.0/0", 1), 0);
+  ASSERT_EQ(add("::/0", 1), 0);
+  ASSERT_EQ(add("2001:db8::/32", 1), 0);
+
+  EXPECT_EQ(agg.rib_size(), 3u);
+  EXPECT_EQ(fib, (std::map<std::string, uint32_t>{{"0.0.0.0/0", 1},
+                                                  {"::/0", 1}}));
+}
+
+TEST_F(fib_aggregator_test, unknown_and_repeated_routes) {
+  EXPECT_EQ(del("10.0.0.0/8"), -ENODATA);
+
+  ASSERT_EQ(add("10.0.0.0/8", 1), 0);
+  unsigned n = adds;
+  ASSERT_EQ(add("10.0.0.0/8", 1), 0);
+  EXPECT_EQ(adds, n);
+  EXPECT_EQ(agg.rib_size(), 1u);
+
+  EXPECT_EQ(del("10.0.0.0/9"), -ENODATA);
+  EXPECT_EQ(del("10.0.0.0/8"), 0);
+  EXPECT_TRUE(fib.empty());
+  EXPECT_EQ(agg.rib_size(), 0u);
+}
+
+// longest prefix match of the routes in m, 0 if none
+static uint32_t lookup(const std::map<std::pair<uint32_t, unsigned>,
+                                      uint32_t> &m,
+                       uint32_t a) {
+  for (int len = 32; len >= 0; len--) {
+    uint32_t masked = len ? a & (UINT32_MAX << (32 - len)) : 0;
+    auto it = m.find(std::make_pair(masked, len));
+    if (it != m.end())
+      return it->second;
+  }
+  return 0;
+}
+
+TEST_F(fib_aggregator_test, random_routes_forward_like_the_rib) {
+  std::map<std::pair<uint32_t, unsigned>, uint32_t> rib;
+  std::mt19937 rng(7);
+
+  // routes within 10.0.0.0/16 to hit many overlaps
+  auto random_prefix = [&rng]() {
+    unsigned len = 8 + rng() % 17;
+    uint32_t a = 0x0a000000 | (rng() & 0xffff);
+    return std::make_pair(a & (UINT32_MAX << (32 - len)), len);
+  };
+
+  for (int i = 0; i < 2000; i++) {
+    auto p = random_prefix();
+    char s[32];
+    snprintf(s, sizeof(s), "%u.%u.%u.%u/%u", p.first >> 24,
+             p.first >> 16 & 0xff, p.first >> 8 & 0xff, p.first & 0xff,
+             p.second);
+
+    if (rng() % 3) {
+      uint32_t nh = 1 + rng() % 3;
+      ASSERT_EQ(add(s, nh), 0);
+      rib[p] = nh;
+    } else {
+      EXPECT_EQ(del(s), rib.erase(p) ? 0 : -ENODATA);
+    }
+  }
+
+  EXPECT_EQ(agg.rib_size(), rib.size());
+  EXPECT_EQ(agg.fib_size(), fib.size());
+  EXPECT_LE(fib.size(), rib.size());
+
+  std::map<std::pair<uint32_t, unsigned>, uint32_t> programmed;
+  for (const auto &e : fib) {
+    auto a = prefix(e.first.c_str());
+    programmed[std::make_pair(
+        ntohl(*static_cast<uint32_t *>(nl_addr_get_binary_addr(a.get()))),
+        nl_addr_get_prefixlen(a.get()))] = e.second;
+  }
+
+  for (uint32_t a = 0x0a000000; a <= 0x0a00ffff; a++)
+    ASSERT_EQ(lookup(programmed, a), lookup(rib, a)) << std::hex << a;
+}
+
+} // namespace basebox
@@ -0,0 +1,127 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <map>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "netlink/nl_flat_map.h"
+
+namespace basebox {
+
+// few home slots, so probe sequences are long and wrap around the end
+struct colliding_hash {
+  size_t operator()(uint32_t k) const noexcept {
+    return (k % 3) * (SIZE_MAX / 3) | 0xf;
+  }
+};
+
+template <typename M>
+static void expect_same(const M &m, const std::map<uint32_t, uint32_t> &ref) {
+  ASSERT_EQ(m.size(), ref.size());
+
+  for (const auto &e : ref) {
+    const uint32_t *v = m.find(e.first);
+    ASSERT_NE(v, nullptr) << "key " << e.first;
+    EXPECT_EQ(*v, e.second) << "key " << e.first;
+  }
+
+  size_t n = 0;
+  m.for_each([&ref, &n](uint32_t k, uint32_t v) {
+    auto it = ref.find(k);
+    ASSERT_NE(it, ref.end()) << "key " << k;
+    EXPECT_EQ(v, it->second);
+    n++;
+  });
+  EXPECT_EQ(n, ref.size());
+}
+
+TEST(nl_flat_map, emplace_keeps_existing_value) {
+  nl_flat_map<uint32_t, uint32_t> m;
+
+  auto r = m.emplace(1, 10);
+  EXPECT_TRUE(r.second);
+  EXPECT_EQ(*r.first, 10u);
+
+  r = m.emplace(1, 20);
+  EXPECT_FALSE(r.second);
+  EXPECT_EQ(*r.first, 10u);
+  EXPECT_EQ(m.size(), 1u);
+}
+
+TEST(nl_flat_map, find_and_erase_on_empty_map) {
+  nl_flat_map<uint32_t, uint32_t> m;
+
+  EXPECT_EQ(m.find(1), nullptr);
+  EXPECT_FALSE(m.erase(1));
+  EXPECT_TRUE(m.empty());
+}
+
+TEST(nl_flat_map, rehash_keeps_entries) {
+  nl_flat_map<uint32_t, uint32_t> m;
+  std::map<uint32_t, uint32_t> ref;
+
+  // crosses several load factor limits
+  for (uint32_t i = 0; i < 1000; i++) {
+    m.emplace(i * 7919, i);
+    ref.emplace(i * 7919, i);
+  }
+
+  expect_same(m, ref);
+}
+
+TEST(nl_flat_map, erase_shifts_back_probe_chains) {
+  nl_flat_map<uint32_t, uint32_t, colliding_hash> m;
+  std::map<uint32_t, uint32_t> ref;
+
+  for (uint32_t i = 0; i < 12; i++) {
+    m.emplace(i, i);
+    ref.emplace(i, i);
+  }
+
+  // erase from the head, the middle and the end of the chains
+  for (uint32_t k : {0u, 4u, 11u, 1u}) {
+    EXPECT_TRUE(m.erase(k));
+    ref.erase(k);
+    expect_same(m, ref);
+  }
+
+  EXPECT_FALSE(m.erase(0));
+}
+
+TEST(nl_flat_map, random_operations_match_std_map) {
+  nl_flat_map<uint32_t, uint32_t, colliding_hash> colliding;
+  nl_flat_map<uint32_t, uint32_t> spread;
+  std::map<uint32_t, uint32_t> ref;
+  std::mt19937 rng(42);
+
+  for (int i = 0; i < 20000; i++) {
+    uint32_t k = rng() % 256;
+
+    if (rng() % 3) {
+      bool inserted = ref.emplace(k, i).second;
+      EXPECT_EQ(colliding.emplace(k, i).second, inserted);
+      EXPECT_EQ(spread.emplace(k, i).second, inserted);
+    } else {
+      bool erased = ref.erase(k);
+      EXPECT_EQ(colliding.erase(k), erased);
+      EXPECT_EQ(spread.erase(k), erased);
+    }
+
+    if (i % 1000 == 0) {
+      expect_same(colliding, ref);
+      expect_same(spread, ref);
+    }
+  }
+
+  expect_same(colliding, ref);
+  expect_same(spread, ref);
+
+  colliding.clear();
+  EXPECT_TRUE(colliding.empty());
+  EXPECT_EQ(colliding.find(ref.begin()->first), nullptr);
+}
+
+} // namespace basebox
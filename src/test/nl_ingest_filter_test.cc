@@ -0,0 +1,150 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cstring>
+#include <vector>
+
+#include <linux/neighbour.h>
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "netlink/nl_ingest_filter.h"
+
+DECLARE_string(nl_route_tables);
+DECLARE_string(nl_route_protocols);
+DECLARE_string(nl_families);
+DECLARE_bool(nl_switch_neighbours_only);
+
+namespace basebox {
+
+class ingest_filter_test : public ::testing::Test {
+protected:
+  int fds[2] = {-1, -1};
+
+  void SetUp() override {
+    FLAGS_nl_route_tables = "";
+    FLAGS_nl_route_protocols = "";
+    FLAGS_nl_families = "";
+    FLAGS_nl_switch_neighbours_only = false;
+
+    // socket filters apply to unix sockets as well, the messages are sent
+    // through a pair to see which ones the attached program drops
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds), 0);
+  }
+
+  void TearDown() override {
+    close(fds[0]);
+    close(fds[1]);
+  }
+
+  static std::vector<uint8_t> route_msg(uint16_t type, uint8_t family,
+                                        uint8_t table, uint8_t protocol) {
+    std::vector<uint8_t> buf(NLMSG_SPACE(sizeof(struct rtmsg)));
+    auto *nlh = reinterpret_cast<struct nlmsghdr *>(buf.data());
+    auto *rtm = static_cast<struct rtmsg *>(NLMSG_DATA(nlh));
+
+    nlh->nlmsg_len = buf.size();
+    nlh->nlmsg_type = type;
+    rtm->rtm_family = family;
+    rtm->rtm_table = table;
+    rtm->rtm_protocol = protocol;
+    return buf;
+  }
+
+  static std::vector<uint8_t> neigh_msg(uint16_t type, uint8_t family) {
+    std::vector<uint8_t> buf(NLMSG_SPACE(sizeof(struct ndmsg)));
+    auto *nlh = reinterpret_cast<struct nlmsghdr *>(buf.data());
+    auto *ndm = static_cast<struct ndmsg *>(NLMSG_DATA(nlh));
+
+    nlh->nlmsg_len = buf.size();
+    nlh->nlmsg_type = type;
+    ndm->ndm_family = family;
+    return buf;
+  }
+
+  // true if the message passes the attached socket filter
+  bool passes(const std::vector<uint8_t> &msg) {
+    uint8_t buf[256];
+
+    EXPECT_EQ(send(fds[0], msg.data(), msg.size(), 0), (ssize_t)msg.size());
+    return recv(fds[1], buf, sizeof(buf), MSG_DONTWAIT) > 0;
+  }
+};
+
+TEST_F(ingest_filter_test, empty_selection_accepts_everything) {
+  nl_ingest_filter f;
+
+  EXPECT_FALSE(f.enabled());
+  EXPECT_TRUE(f.accept_route(AF_INET6, 1000, RTPROT_KERNEL));
+  EXPECT_TRUE(f.accept_neigh(AF_INET));
+  EXPECT_TRUE(f.accept_neigh(AF_BRIDGE));
+
+  ASSERT_EQ(f.attach(fds[1]), 0);
+  EXPECT_TRUE(passes(route_msg(RTM_NEWROUTE, AF_INET, 1, 2)));
+}
+
+TEST_F(ingest_filter_test, routes_are_selected_in_user_space) {
+  FLAGS_nl_route_tables = "254,1000";
+  FLAGS_nl_route_protocols = "186";
+  FLAGS_nl_families = "inet6";
+  nl_ingest_filter f;
+
+  EXPECT_TRUE(f.enabled());
+  EXPECT_TRUE(f.accept_route(AF_INET6, RT_TABLE_MAIN, 186));
+  EXPECT_TRUE(f.accept_route(AF_INET6, 1000, 186));
+  EXPECT_FALSE(f.accept_route(AF_INET, RT_TABLE_MAIN, 186));
+  EXPECT_FALSE(f.accept_route(AF_INET6, RT_TABLE_LOCAL, 186));
+  EXPECT_FALSE(f.accept_route(AF_INET6, RT_TABLE_MAIN, RTPROT_KERNEL));
+
+  EXPECT_TRUE(f.accept_neigh(AF_INET6));
+  EXPECT_FALSE(f.accept_neigh(AF_INET));
+  EXPECT_TRUE(f.accept_neigh(AF_BRIDGE));
+}
+
+TEST_F(ingest_filter_test, socket_filter_drops_unselected_routes) {
+  FLAGS_nl_route_tables = "254,1000";
+  FLAGS_nl_route_protocols = "186,4";
+  FLAGS_nl_families = "inet";
+  nl_ingest_filter f;
+
+  ASSERT_EQ(f.attach(fds[1]), 0);
+
+  EXPECT_TRUE(passes(route_msg(RTM_NEWROUTE, AF_INET, RT_TABLE_MAIN, 186)));
+  EXPECT_TRUE(passes(route_msg(RTM_DELROUTE, AF_INET, RT_TABLE_MAIN, 4)));
+  // table ids above 255 are reported as RT_TABLE_COMPAT
+  EXPECT_TRUE(passes(route_msg(RTM_NEWROUTE, AF_INET, RT_TABLE_COMPAT, 4)));
+
+  EXPECT_FALSE(passes(route_msg(RTM_NEWROUTE, AF_INET6, RT_TABLE_MAIN, 4)));
+  EXPECT_FALSE(passes(route_msg(RTM_NEWROUTE, AF_INET, RT_TABLE_LOCAL, 4)));
+  EXPECT_FALSE(passes(route_msg(RTM_DELROUTE, AF_INET, RT_TABLE_MAIN, 2)));
+}
+
+TEST_F(ingest_filter_test, socket_filter_drops_unselected_neighbours) {
+  FLAGS_nl_families = "inet6";
+  nl_ingest_filter f;
+
+  ASSERT_EQ(f.attach(fds[1]), 0);
+
+  EXPECT_TRUE(passes(neigh_msg(RTM_NEWNEIGH, AF_INET6)));
+  EXPECT_TRUE(passes(neigh_msg(RTM_DELNEIGH, AF_BRIDGE)));
+  EXPECT_FALSE(passes(neigh_msg(RTM_NEWNEIGH, AF_INET)));
+  EXPECT_FALSE(passes(neigh_msg(RTM_DELNEIGH, AF_INET)));
+}
+
+TEST_F(ingest_filter_test, socket_filter_passes_other_messages) {
+  FLAGS_nl_families = "inet";
+  nl_ingest_filter f;
+
+  ASSERT_EQ(f.attach(fds[1]), 0);
+
+  // links and addresses are not filtered, whatever their family byte is
+  EXPECT_TRUE(passes(route_msg(RTM_NEWLINK, AF_INET6, 0, 0)));
+  EXPECT_TRUE(passes(route_msg(RTM_NEWADDR, AF_INET6, 0, 0)));
+}
+
+} // namespace basebox
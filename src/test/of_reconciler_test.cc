@@ -0,0 +1,286 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <initializer_list>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "of-dpa/of_reconciler.h"
+
+namespace basebox {
+
+typedef std::vector<uint8_t> bytes;
+
+static void put16(bytes *b, uint16_t v) {
+  b->push_back(v >> 8);
+  b->push_back(v);
+}
+
+static void put32(bytes *b, uint32_t v) {
+  put16(b, v >> 16);
+  put16(b, v);
+}
+
+static bytes cat(std::initializer_list<bytes> parts) {
+  bytes b;
+  for (const auto &p : parts)
+    b.insert(b.end(), p.begin(), p.end());
+  return b;
+}
+
+// OXM TLV of the OpenFlow basic class
+static bytes oxm(uint8_t field, const bytes &value) {
+  bytes b{0x80, 0x00, (uint8_t)(field << 1), (uint8_t)value.size()};
+  b.insert(b.end(), value.begin(), value.end());
+  return b;
+}
+
+static const bytes in_port_1 = oxm(0, {0, 0, 0, 1});
+static const bytes vlan_10 = oxm(6, {0x10, 0x0a});
+static const bytes eth_type_ip = oxm(5, {0x08, 0x00});
+
+// struct ofp_match of type OXM, padded to 8 bytes
+static bytes match(std::initializer_list<bytes> fields) {
+  bytes oxms = cat(fields);
+  bytes b;
+
+  put16(&b, 1);
+  put16(&b, 4 + oxms.size());
+  b.insert(b.end(), oxms.begin(), oxms.end());
+  b.resize((b.size() + 7) / 8 * 8);
+  return b;
+}
+
+static bytes output(uint32_t port) {
+  bytes b;
+  put16(&b, 0);
+  put16(&b, 16);
+  put32(&b, port);
+  put16(&b, 0xffff);
+  b.resize(16);
+  return b;
+}
+
+static bytes set_group(uint32_t group_id) {
+  bytes b;
+  put16(&b, 22);
+  put16(&b, 8);
+  put32(&b, group_id);
+  return b;
+}
+
+static bytes apply_actions(std::initializer_list<bytes> actions) {
+  bytes a = cat(actions);
+  bytes b;
+
+  put16(&b, 4);
+  put16(&b, 8 + a.size());
+  put32(&b, 0);
+  b.insert(b.end(), a.begin(), a.end());
+  return b;
+}
+
+static bytes goto_table(uint8_t table_id) {
+  bytes b;
+  put16(&b, 1);
+  put16(&b, 8);
+  b.push_back(table_id);
+  b.resize(8);
+  return b;
+}
+
+static bytes bucket(std::initializer_list<bytes> actions) {
+  bytes a = cat(actions);
+  bytes b;
+
+  put16(&b, 16 + a.size());
+  put16(&b, 0);
+  put32(&b, 0xffffffff);
+  put32(&b, 0xffffffff);
+  put32(&b, 0);
+  b.insert(b.end(), a.begin(), a.end());
+  return b;
+}
+
+static const uint64_t owned_cookie = UINT64_C(0x12) << 32;
+
+static of_reconciler::flow flow(uint8_t table_id, const bytes &m,
+                                const bytes &instructions,
+                                uint64_t cookie = owned_cookie) {
+  return of_reconciler::flow{table_id, 100, cookie, 0, 0, 0, m, instructions};
+}
+
+// OF-DPA group ids, the type is in the upper 4 bits
+static const uint32_t l2_interface = 0x000a0001;
+static const uint32_t l3_unicast = 0x20000001;
+static const uint32_t l3_ecmp = 0x70000001;
+
+TEST(of_reconciler, equal_state_needs_no_changes) {
+  of_reconciler r;
+  of_reconciler::plan p;
+
+  r.flow_add(flow(10, match({in_port_1, vlan_10}),
+                  cat({apply_actions({output(1)}), goto_table(20)})));
+  r.group_add({l3_ecmp, 1,
+               cat({bucket({set_group(l3_unicast)}),
+                    bucket({set_group(l3_unicast + 1)})})});
+
+  // the switch reports fields, instructions and buckets in another order
+  r.diff({flow(10, match({vlan_10, in_port_1}),
+               cat({goto_table(20), apply_actions({output(1)})}))},
+         {{l3_ecmp, 1,
+           cat({bucket({set_group(l3_unicast + 1)}),
+                bucket({set_group(l3_unicast)})})}},
+         &p);
+
+  EXPECT_EQ(p.size(), 0u);
+}
+
+TEST(of_reconciler, missing_and_changed_flows_are_added) {
+  of_reconciler r;
+  of_reconciler::plan p;
+
+  r.flow_add(flow(10, match({in_port_1}), apply_actions({output(1)})));
+  r.flow_add(flow(10, match({vlan_10}), apply_actions({output(2)})));
+
+  r.diff({flow(10, match({in_port_1}), apply_actions({output(3)}))}, {}, &p);
+
+  ASSERT_EQ(p.add_flows.size(), 2u);
+  EXPECT_EQ(p.add_flows[0].instructions, apply_actions({output(1)}));
+  EXPECT_EQ(p.add_flows[1].match, match({vlan_10}));
+  EXPECT_TRUE(p.remove_flows.empty());
+}
+
+TEST(of_reconciler, only_owned_unknown_flows_are_removed) {
+  of_reconciler r;
+  of_reconciler::plan p;
+
+  r.flow_add(flow(10, match({in_port_1}), goto_table(20)));
+  r.flow_remove_strict(10, 100, match({in_port_1}));
+  EXPECT_EQ(r.flow_count(), 0u);
+
+  r.diff(
+      {
+          flow(10, match({vlan_10}), goto_table(20)),
+          // another table, an unused cookie class and no cookie class
+          flow(20, match({vlan_10}), goto_table(30)),
+          flow(10, match({eth_type_ip}), goto_table(20), UINT64_C(7) << 32),
+          flow(10, match({in_port_1}), goto_table(20), 0x12),
+      },
+      {}, &p);
+
+  ASSERT_EQ(p.remove_flows.size(), 1u);
+  EXPECT_EQ(p.remove_flows[0].table_id, 10);
+  EXPECT_EQ(p.remove_flows[0].match, match({vlan_10}));
+  EXPECT_TRUE(p.add_flows.empty());
+}
+
+TEST(of_reconciler, owned_cookies_survive_a_restart) {
+  of_reconciler old;
+  old.flow_add(flow(10, match({in_port_1}), goto_table(20)));
+
+  of_reconciler r;
+  of_reconciler::plan p;
+  r.add_owned_cookies(old.get_owned_cookies());
+
+  r.diff({flow(10, match({in_port_1}), goto_table(20))}, {}, &p);
+
+  EXPECT_EQ(p.remove_flows.size(), 1u);
+}
+
+TEST(of_reconciler, flow_remove_applies_the_filter) {
+  of_reconciler r;
+  of_reconciler::plan p;
+
+  r.flow_add(flow(10, match({in_port_1, vlan_10}), apply_actions({output(1)})));
+  r.flow_add(flow(10, match({vlan_10}), apply_actions({output(2)})));
+  r.flow_add(flow(10, match({in_port_1}), apply_actions({output(1)})));
+  r.flow_add(flow(20, match({vlan_10}), apply_actions({output(1)})));
+
+  // table 10, output to port 1, matching the vlan
+  r.flow_remove({10, 0, 0, 1, 0xffffffff, match({vlan_10})});
+
+  EXPECT_EQ(r.flow_count(), 3u);
+  r.diff({}, {}, &p);
+  for (const auto &f : p.add_flows)
+    EXPECT_NE(f.match, match({in_port_1, vlan_10}));
+
+  // all tables and ports
+  r.flow_remove({0xff, 0, 0, 0xffffffff, 0xffffffff, match({})});
+  EXPECT_EQ(r.flow_count(), 0u);
+}
+
+TEST(of_reconciler, groups_are_ordered_by_references) {
+  of_reconciler r;
+  of_reconciler::plan p;
+
+  r.group_add({l3_ecmp, 1, bucket({set_group(l3_unicast)})});
+  r.group_add({l3_unicast, 0, bucket({set_group(l2_interface)})});
+  r.group_add({l2_interface, 0, bucket({output(1)})});
+
+  r.diff({}, {}, &p);
+
+  ASSERT_EQ(p.add_groups.size(), 3u);
+  EXPECT_EQ(p.add_groups[0].group_id, l2_interface);
+  EXPECT_EQ(p.add_groups[1].group_id, l3_unicast);
+  EXPECT_EQ(p.add_groups[2].group_id, l3_ecmp);
+
+  of_reconciler::plan q;
+  r.group_remove(0xfffffffc); // OFPG_ALL
+  EXPECT_EQ(r.group_count(), 0u);
+
+  r.diff({}, p.add_groups, &q);
+
+  ASSERT_EQ(q.remove_groups.size(), 3u);
+  EXPECT_EQ(q.remove_groups[0], l3_ecmp);
+  EXPECT_EQ(q.remove_groups[1], l3_unicast);
+  EXPECT_EQ(q.remove_groups[2], l2_interface);
+}
+
+TEST(of_reconciler, only_owned_unknown_groups_are_removed) {
+  of_reconciler r;
+  of_reconciler::plan p;
+
+  r.group_add({l2_interface, 0, bucket({output(1)})});
+  r.group_remove(l2_interface);
+
+  r.diff({},
+         {{l2_interface, 0, bucket({output(1)})},
+          {l3_unicast, 0, bucket({set_group(l2_interface)})}},
+         &p);
+
+  ASSERT_EQ(p.remove_groups.size(), 1u);
+  EXPECT_EQ(p.remove_groups[0], l2_interface);
+
+  // taken over by a restarted instance
+  of_reconciler restarted;
+  of_reconciler::plan q;
+  restarted.add_owned_groups(r.get_owned_groups());
+  EXPECT_FALSE(restarted.empty());
+
+  restarted.diff({}, {{l2_interface, 0, bucket({output(1)})}}, &q);
+  EXPECT_EQ(q.remove_groups.size(), 1u);
+}
+
+TEST(of_reconciler, changed_groups_are_modified) {
+  of_reconciler r;
+  of_reconciler::plan p;
+
+  r.group_add({l2_interface, 0, bucket({output(1)})});
+  r.group_add({l3_unicast, 0, bucket({set_group(l2_interface)})});
+
+  r.diff({},
+         {{l2_interface, 0, bucket({output(2)})},
+          {l3_unicast, 1, bucket({set_group(l2_interface)})}},
+         &p);
+
+  ASSERT_EQ(p.modify_groups.size(), 2u);
+  EXPECT_TRUE(p.add_groups.empty());
+  EXPECT_TRUE(p.remove_groups.empty());
+  EXPECT_EQ(r.get_group_ids(),
+            (std::vector<uint32_t>{l2_interface, l3_unicast}));
+}
+
+} // namespace basebox
@@ -0,0 +1,136 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+#include <cassert>
+
+#include "latency_histogram.h"
+
+namespace basebox {
+
+latency_histogram::latency_histogram() noexcept : count(0), sum(0), max(0) {
+  for (auto &b : buckets)
+    b.store(0, std::memory_order_relaxed);
+}
+
+size_t latency_histogram::bucket_of(uint64_t us) noexcept {
+  if (us > max_value)
+    us = max_value;
+
+  if (us < (2 << sub_bits))
+    return us;
+
+  unsigned exponent = 63 - __builtin_clzll(us);
+  unsigned shift = exponent - sub_bits;
+  size_t sub = (us >> shift) & ((1 << sub_bits) - 1);
+
+  return (2 << sub_bits) + (shift - 1) * (1 << sub_bits) + sub;
+}
+
+uint64_t latency_histogram::bucket_upper_bound(size_t bucket) noexcept {
+  if (bucket < (2 << sub_bits))
+    return bucket;
+
+  size_t shift = (bucket - (2 << sub_bits)) / (1 << sub_bits) + 1;
+  uint64_t sub = (bucket - (2 << sub_bits)) % (1 << sub_bits);
+
+  return (((1 << sub_bits) + sub + 1) << shift) - 1;
+}
+
+void latency_histogram::record(uint64_t us) noexcept {
+  buckets[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(us, std::memory_order_relaxed);
+
+  uint64_t m = max.load(std::memory_order_relaxed);
+  while (us > m &&
+         !max.compare_exchange_weak(m, us, std::memory_order_relaxed))
+    ;
+}
+
+latency_histogram::snapshot latency_histogram::get_snapshot() const {
+  snapshot s{0, sum.load(std::memory_order_relaxed),
+             max.load(std::memory_order_relaxed),
+             std::vector<uint64_t>(n_buckets)};
+
+  // count the buckets, so the total matches them while records go on
+  for (size_t i = 0; i < n_buckets; i++) {
+    s.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+    s.count += s.buckets[i];
+  }
+
+  return s;
+}
+
+uint64_t latency_histogram::snapshot::percentile(double p) const noexcept {
+  if (count == 0)
+    return 0;
+
+  uint64_t rank = p / 100 * count + 0.5;
+  if (rank == 0)
+    rank = 1;
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); i++) {
+    seen += buckets[i];
+    if (seen >= rank)
+      return std::min(bucket_upper_bound(i), max);
+  }
+
+  return max;
+}
+
+const char *latency_event_name(enum latency_event_t event) noexcept {
+  static const char *names[LATENCY_MAX_EVENT] = {"link", "neigh", "route",
+                                                 "addr"};
+  assert(event < LATENCY_MAX_EVENT);
+  return names[event];
+}
+
+const char *latency_checkpoint_name(enum latency_checkpoint_t cp) noexcept {
+  static const char *names[LATENCY_MAX_CHECKPOINT] = {"dequeued", "sent",
+                                                      "applied"};
+  assert(cp < LATENCY_MAX_CHECKPOINT);
+  return names[cp];
+}
+
+latency_histogram &event_latency(enum latency_event_t event,
+                                 enum latency_checkpoint_t cp) noexcept {
+  static latency_histogram histograms[LATENCY_MAX_EVENT]
+                                     [LATENCY_MAX_CHECKPOINT];
+  assert(event < LATENCY_MAX_EVENT);
+  assert(cp < LATENCY_MAX_CHECKPOINT);
+  return histograms[event][cp];
+}
+
+thread_local latency_trace *latency_trace::current = nullptr;
+
+latency_trace::latency_trace(
+    enum latency_event_t event,
+    std::chrono::steady_clock::time_point received) noexcept
+    : event(event), received(received), sent(false), outer(current) {
+  event_latency(event, LATENCY_DEQUEUED)
+      .record(std::chrono::steady_clock::now() - received);
+  current = this;
+}
+
+latency_trace::~latency_trace() noexcept {
+  event_latency(event, LATENCY_APPLIED)
+      .record(std::chrono::steady_clock::now() - received);
+  current = outer;
+}
+
+void latency_trace::message_sent() noexcept {
+  latency_trace *t = current;
+
+  // messages not caused by an event, or not the first one
+  if (t == nullptr || t->sent)
+    return;
+
+  t->sent = true;
+  event_latency(t->event, LATENCY_SENT)
+      .record(std::chrono::steady_clock::now() - t->received);
+}
+
+} // namespace basebox
@@ -0,0 +1,112 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace basebox {
+
+/**
+ * Histogram of latencies in microseconds with a bounded relative error.
+ *
+ * Values below 64us are counted exactly, above that every power of two is
+ * split into 32 buckets, so the error is below 3.2%. Recording is wait-free
+ * and may happen concurrently with reading snapshots.
+ */
+class latency_histogram final {
+public:
+  static const unsigned sub_bits = 5;
+  static const unsigned max_exponent = 40; // ~12 days
+  static const uint64_t max_value = (UINT64_C(2) << max_exponent) - 1;
+  static const size_t n_buckets =
+      (2 << sub_bits) + (max_exponent - sub_bits) * (1 << sub_bits);
+
+  struct snapshot {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    std::vector<uint64_t> buckets;
+
+    // upper bound of the bucket holding the p-th percentile, p in [0, 100]
+    uint64_t percentile(double p) const noexcept;
+  };
+
+  latency_histogram() noexcept;
+
+  void record(uint64_t us) noexcept;
+  void record(std::chrono::steady_clock::duration d) noexcept {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(d);
+    record(us.count() > 0 ? us.count() : 0);
+  }
+
+  snapshot get_snapshot() const;
+
+  static size_t bucket_of(uint64_t us) noexcept;
+  static uint64_t bucket_upper_bound(size_t bucket) noexcept;
+
+private:
+  std::array<std::atomic<uint64_t>, n_buckets> buckets;
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> max;
+};
+
+// netlink events traced from reception to the switch
+enum latency_event_t {
+  LATENCY_LINK,
+  LATENCY_NEIGH,
+  LATENCY_ROUTE,
+  LATENCY_ADDR,
+  LATENCY_MAX_EVENT,
+};
+
+// checkpoints, all measured from the reception of the event
+enum latency_checkpoint_t {
+  LATENCY_DEQUEUED, // picked up by the netlink thread
+  LATENCY_SENT,     // first message sent to the switch
+  LATENCY_APPLIED,  // subsystem done with the event
+  LATENCY_MAX_CHECKPOINT,
+};
+
+const char *latency_event_name(enum latency_event_t event) noexcept;
+const char *latency_checkpoint_name(enum latency_checkpoint_t cp) noexcept;
+
+// process wide histogram of an event type at a checkpoint
+latency_histogram &event_latency(enum latency_event_t event,
+                                 enum latency_checkpoint_t cp) noexcept;
+
+/**
+ * Scope of applying an event on the current thread.
+ *
+ * Records the dequeue checkpoint when created and the apply checkpoint when
+ * destroyed. Switch messages sent by the same thread in between are
+ * attributed to the event.
+ */
+class latency_trace final {
+public:
+  latency_trace(enum latency_event_t event,
+                std::chrono::steady_clock::time_point received) noexcept;
+  ~latency_trace() noexcept;
+
+  // to be called for every message sent to the switch
+  static void message_sent() noexcept;
+
+private:
+  latency_trace(const latency_trace &) = delete;
+  latency_trace &operator=(const latency_trace &) = delete;
+
+  enum latency_event_t event;
+  std::chrono::steady_clock::time_point received;
+  bool sent;
+  latency_trace *outer;
+
+  static thread_local latency_trace *current;
+};
+
+} // namespace basebox
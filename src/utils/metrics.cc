@@ -0,0 +1,148 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <sstream>
+
+#include <glog/logging.h>
+
+#include "metrics.h"
+
+namespace basebox {
+
+metric_counter::metric_counter() noexcept {
+  for (auto &s : shards)
+    s.value.store(0, std::memory_order_relaxed);
+}
+
+uint64_t metric_counter::value() const noexcept {
+  uint64_t v = 0;
+
+  for (const auto &s : shards)
+    v += s.value.load(std::memory_order_relaxed);
+
+  return v;
+}
+
+unsigned metric_counter::shard_of_thread() noexcept {
+  static std::atomic<unsigned> next_shard(0);
+  thread_local unsigned shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed) % n_shards;
+
+  return shard;
+}
+
+metrics_registry &metrics_registry::get() noexcept {
+  static metrics_registry registry;
+  return registry;
+}
+
+static void escape(std::ostream &os, const std::string &value) {
+  for (char c : value) {
+    switch (c) {
+    case '\\':
+      os << "\\\\";
+      break;
+    case '"':
+      os << "\\\"";
+      break;
+    case '\n':
+      os << "\\n";
+      break;
+    default:
+      os << c;
+      break;
+    }
+  }
+}
+
+static std::string format_labels(const metric_labels &labels) {
+  std::ostringstream os;
+
+  if (labels.empty())
+    return "";
+
+  os << "{";
+  for (size_t i = 0; i < labels.size(); i++) {
+    if (i)
+      os << ",";
+    os << labels[i].first << "=\"";
+    escape(os, labels[i].second);
+    os << "\"";
+  }
+  os << "}";
+
+  return os.str();
+}
+
+metrics_registry::series &
+metrics_registry::get_series(const std::string &name, const std::string &help,
+                             bool is_counter, const metric_labels &labels) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto it = families.find(name);
+  if (it == families.end())
+    it = families.emplace(name, family{help, is_counter, {}}).first;
+  else if (it->second.is_counter != is_counter)
+    LOG(FATAL) << __FUNCTION__ << ": metric " << name
+               << " registered with different types";
+
+  auto &s = it->second.members[format_labels(labels)];
+  if (!s.counter && !s.gauge) {
+    s.labels = labels;
+    if (is_counter)
+      s.counter.reset(new metric_counter());
+    else
+      s.gauge.reset(new metric_gauge());
+  }
+
+  return s;
+}
+
+metric_counter &metrics_registry::counter(const std::string &name,
+                                          const std::string &help,
+                                          const metric_labels &labels) {
+  return *get_series(name, help, true, labels).counter;
+}
+
+metric_gauge &metrics_registry::gauge(const std::string &name,
+                                      const std::string &help,
+                                      const metric_labels &labels) {
+  return *get_series(name, help, false, labels).gauge;
+}
+
+std::string metrics_registry::expose() const {
+  std::ostringstream os;
+  std::lock_guard<std::mutex> lock(mutex);
+
+  for (const auto &f : families) {
+    os << "# HELP " << f.first << " " << f.second.help << "\n";
+    os << "# TYPE " << f.first << " "
+       << (f.second.is_counter ? "counter" : "gauge") << "\n";
+
+    for (const auto &s : f.second.members) {
+      os << f.first << s.first << " ";
+      if (s.second.counter)
+        os << s.second.counter->value() << "\n";
+      else
+        os << s.second.gauge->value() << "\n";
+    }
+  }
+
+  return os.str();
+}
+
+std::vector<metric_sample> metrics_registry::collect() const {
+  std::vector<metric_sample> samples;
+  std::lock_guard<std::mutex> lock(mutex);
+
+  for (const auto &f : families) {
+    for (const auto &s : f.second.members)
+      samples.push_back(metric_sample{f.first, s.second.labels,
+                                      f.second.is_counter, s.second.value()});
+  }
+
+  return samples;
+}
+
+} // namespace basebox
@@ -0,0 +1,119 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace basebox {
+
+typedef std::vector<std::pair<std::string, std::string>> metric_labels;
+
+/**
+ * Monotonic counter.
+ *
+ * Threads increment their own cache line aligned shard, the shards are only
+ * summed up when the counter is read.
+ */
+class metric_counter final {
+public:
+  metric_counter() noexcept;
+
+  void add(uint64_t n = 1) noexcept {
+    shards[shard_of_thread()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  uint64_t value() const noexcept;
+
+private:
+  static const unsigned n_shards = 16;
+
+  struct alignas(64) shard {
+    std::atomic<uint64_t> value;
+  };
+
+  shard shards[n_shards];
+
+  static unsigned shard_of_thread() noexcept;
+};
+
+// value that can go up and down, e.g. the depth of a queue
+class metric_gauge final {
+public:
+  metric_gauge() noexcept : v(0) {}
+
+  void set(int64_t value) noexcept {
+    v.store(value, std::memory_order_relaxed);
+  }
+  void add(int64_t n) noexcept { v.fetch_add(n, std::memory_order_relaxed); }
+  int64_t value() const noexcept { return v.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<int64_t> v;
+};
+
+struct metric_sample {
+  std::string name;
+  metric_labels labels;
+  bool is_counter;
+  double value;
+};
+
+/**
+ * Process wide registry of metrics.
+ *
+ * Metrics are created once, usually when the owning object is constructed,
+ * and the returned references stay valid for the lifetime of the process.
+ * Updating a metric does not touch the registry.
+ */
+class metrics_registry final {
+public:
+  static metrics_registry &get() noexcept;
+
+  metric_counter &counter(const std::string &name, const std::string &help,
+                          const metric_labels &labels = metric_labels());
+  metric_gauge &gauge(const std::string &name, const std::string &help,
+                      const metric_labels &labels = metric_labels());
+
+  // prometheus text exposition format 0.0.4
+  std::string expose() const;
+
+  std::vector<metric_sample> collect() const;
+
+private:
+  metrics_registry() = default;
+  metrics_registry(const metrics_registry &) = delete;
+  metrics_registry &operator=(const metrics_registry &) = delete;
+
+  struct series {
+    metric_labels labels;
+    std::unique_ptr<metric_counter> counter;
+    std::unique_ptr<metric_gauge> gauge;
+
+    double value() const noexcept {
+      return counter ? counter->value() : gauge->value();
+    }
+  };
+
+  struct family {
+    std::string help;
+    bool is_counter;
+    std::map<std::string, series> members; // by formatted labels
+  };
+
+  mutable std::mutex mutex;
+  std::map<std::string, family> families;
+
+  series &get_series(const std::string &name, const std::string &help,
+                     bool is_counter, const metric_labels &labels);
+};
+
+} // namespace basebox
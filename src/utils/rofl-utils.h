@@ -23,7 +23,8 @@ inline caddress_in6 build_mask_in6(unsigned prefix_len) {
   sa.sin6_family = AF_INET6;
   memset(sa.sin6_addr.s6_addr, 0, sizeof(sa.sin6_addr.s6_addr));
   memset(sa.sin6_addr.s6_addr, 0xff, div);
-  sa.sin6_addr.s6_addr[div] = (0xff << (8 - prefix_len % 8)) & 0xff;
+  if (div < 16)
+    sa.sin6_addr.s6_addr[div] = (0xff << (8 - prefix_len % 8)) & 0xff;
 
   return rofl::caddress_in6(&sa, sizeof(sa));
 }
@@ -0,0 +1,75 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cerrno>
+#include <cstdio>
+#include <exception>
+
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "snapshot_file.h"
+
+namespace basebox {
+
+int snapshot_write(const std::string &path,
+                   const std::vector<uint8_t> &buf) noexcept {
+  std::string tmp = path + ".tmp";
+  int rv = 0;
+
+  FILE *f = fopen(tmp.c_str(), "w");
+  if (f == nullptr) {
+    rv = -errno;
+    LOG(ERROR) << __FUNCTION__ << ": cannot open " << tmp << ": "
+               << strerror(-rv);
+    return rv;
+  }
+
+  if (fwrite(buf.data(), 1, buf.size(), f) != buf.size() || fflush(f) != 0 ||
+      fsync(fileno(f)) != 0)
+    rv = -errno;
+
+  if (fclose(f) != 0 && rv == 0)
+    rv = -errno;
+
+  if (rv == 0 && rename(tmp.c_str(), path.c_str()) != 0)
+    rv = -errno;
+
+  if (rv < 0) {
+    LOG(ERROR) << __FUNCTION__ << ": failed to write " << path << ": "
+               << strerror(-rv);
+    unlink(tmp.c_str());
+    return rv;
+  }
+
+  VLOG(2) << __FUNCTION__ << ": wrote " << buf.size() << " bytes to " << path;
+  return 0;
+}
+
+int snapshot_read(const std::string &path,
+                  std::vector<uint8_t> *buf) noexcept {
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == nullptr)
+    return -errno;
+
+  try {
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+      buf->insert(buf->end(), chunk, chunk + n);
+  } catch (std::exception &e) {
+    fclose(f);
+    return -ENOMEM;
+  }
+
+  bool failed = ferror(f);
+  fclose(f);
+  if (failed)
+    return -EIO;
+
+  return 0;
+}
+
+} // namespace basebox
@@ -0,0 +1,50 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace basebox {
+
+/**
+ * Files of fixed size records in host byte order, used for the state kept
+ * across restarts.
+ *
+ * A file is written to a temporary file first and renamed, hence a reader
+ * either sees the previous or the new content.
+ */
+template <typename T>
+void snapshot_append(std::vector<uint8_t> *buf, const T &v) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(&v);
+  buf->insert(buf->end(), p, p + sizeof(v));
+}
+
+// false if buf holds less than a record at off
+template <typename T>
+bool snapshot_consume(const std::vector<uint8_t> &buf, size_t *off, T *v) {
+  if (buf.size() - *off < sizeof(*v))
+    return false;
+  memcpy(v, buf.data() + *off, sizeof(*v));
+  *off += sizeof(*v);
+  return true;
+}
+
+/**
+ * @returns 0 on success, negative errno otherwise
+ */
+int snapshot_write(const std::string &path,
+                   const std::vector<uint8_t> &buf) noexcept;
+
+/**
+ * @returns 0 on success, -ENOENT if there is no file, other negative errno
+ * otherwise
+ */
+int snapshot_read(const std::string &path, std::vector<uint8_t> *buf) noexcept;
+
+} // namespace basebox